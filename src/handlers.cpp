@@ -0,0 +1,129 @@
+#include "handlers.hpp"
+#include "wininput/tracepoint.hpp"
+
+// The mouse message of the Windows headers, which are not included so that
+// the handlers can be built on any platform.
+#define HANDLERS_WM_MOUSEMOVE 0x0200
+
+namespace state {
+
+	ModeHandlers::ModeHandlers(const std::atomic<InputState>& mode, const Options& opts,
+		change_mode_fn changeMode, tick_fn getTicks)
+		: mode(mode), opts(opts), changeMode(changeMode), getTicks(getTicks),
+		lastActive(getTicks()), mashReset(true), throttleReset(true) {}
+
+	void ModeHandlers::modeChanged(InputState state) {
+		lastActive.store(getTicks());
+		mashReset.store(true);
+		if (state == InputState::THROTTLED) throttleReset.store(true);
+	}
+
+	void ModeHandlers::resetMashing() {
+		mashReset.store(true);
+	}
+
+	void ModeHandlers::setThrottleRates(int keys, int clicks) {
+		throttle.setRates(keys, clicks);
+	}
+
+	// lock if there was no input for the autolock period; the period counts
+	// from the last input, or from the last change of mode
+	void ModeHandlers::checkAutoLock() {
+		unsigned long long now = getTicks();
+		unsigned long long last = lastActive.exchange(now);
+		if (now > last && now - last > opts.autoLock * 60000ULL)
+			changeMode(InputState::LOCKED, true, 0);
+	}
+
+	bool ModeHandlers::key(input::KeyData& data) {
+		if (opts.mashLock) {
+			if (mashReset.exchange(false)) {
+				mashDetector.setLimits(opts.mashLimits);
+				mashDetector.reset();
+			}
+
+			// keys are let through in Unlocked/Limited/Throttled -> set to Locked
+			if (mashDetector.update(data) && mode.load() != InputState::LOCKED) {
+				INPUT_TRACEPOINT(MASHING_DETECTED, mashDetector.keyCount(),
+					mashDetector.pressedCount(), mashDetector.spread());
+				changeMode(InputState::LOCKED, true, 0);
+				return true;
+			}
+		}
+
+		InputState state = mode.load();
+		if (state == InputState::UNLOCKED && opts.autoLock > 0) {
+			checkAutoLock();
+			return false;
+		}
+
+		// the limits of Throttled mode are applied by throttleKey
+		return isKeyBlocked(state, data, opts.limitKeys);
+	}
+
+	// if Throttled -> limit keystrokes, including repeats of held keys
+	bool ModeHandlers::throttleKey(input::KeyData& data) {
+		if (mode.load() != InputState::THROTTLED) return false;
+		if (throttleReset.exchange(false)) throttle.reset();
+		return throttle.isKeyBlocked(data);
+	}
+
+	// if Limited/Locked -> block all mouse input
+	bool ModeHandlers::mouse(input::MouseData& data) {
+		InputState state = mode.load();
+		if (state == InputState::THROTTLED) {
+			if (throttleReset.exchange(false)) throttle.reset();
+			return throttle.isMouseBlocked(data);
+		} else if (state == InputState::UNLOCKED) {
+			if (opts.autoLock > 0 && data.code != HANDLERS_WM_MOUSEMOVE) checkAutoLock();
+			return false;
+		}
+		return isMouseBlocked(state);
+	}
+
+	bool ModeHandlers::sequence(int type, int stripKeys) {
+		InputState state = mode.load();
+		InputState target = getSequenceTarget(type, state);
+		if (target == state) return false;
+		changeMode(target, target == InputState::LIMITED || target == InputState::LOCKED, stripKeys);
+		return true;
+	}
+
+	ModeSwitch::ModeSwitch(std::atomic<InputState>& mode, const Options& opts, ModeHandlers& handlers,
+		const SessionTracker& session, input::StateJournal& journal, ModePlatform& platform)
+		: mode(mode), opts(opts), handlers(handlers), session(session), journal(journal),
+		platform(platform) {}
+
+	void ModeSwitch::change(InputState state, bool trackMods, int stripKeys) {
+		handlers.modeChanged(state);
+		InputState prev = mode.exchange(state);
+		if (state != prev) journal.record((unsigned char)state);
+		platform.trackModifierState(trackMods);
+		platform.invalidateKeyVerdicts();
+
+		// keys blocked in Limited mode are replayed when unlocking, and discarded
+		// when switching to Locked mode
+		if (prev == InputState::LIMITED && state != InputState::LIMITED) {
+			platform.setKeyBuffering(false);
+			platform.releaseKeyBuffer(state == InputState::UNLOCKED, stripKeys);
+		} else if (state == InputState::LIMITED) {
+			platform.setKeyBuffering(opts.bufferKeys);
+		}
+
+		// the hooks are only suspended in Unlocked mode, so they are kept
+		// when leaving it while the user is away, even if about to be removed
+		switch (session.getAction(state, platform.isSuspended())) {
+		case HookAction::RESUME:
+			INPUT_TRACEPOINT(INPUT_RESUMED);
+			platform.resume();
+			break;
+		case HookAction::SUSPEND:
+			platform.suspend();
+			break;
+		case HookAction::NONE:
+			break;
+		}
+
+		platform.postStatusUpdate();
+	}
+}
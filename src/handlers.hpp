@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include "policy.hpp"
+#include "session.hpp"
+#include "state.hpp"
+#include "wininput/journal.hpp"
+
+namespace state {
+
+	// Changes the mode, as changeInputState in state.cpp does; trackMods is
+	// true if ctrl, shift, and alt are tracked in the new mode, and stripKeys
+	// is the number of key downs at the end of the key buffer that are not
+	// replayed on unlock.
+	typedef void(*change_mode_fn)(InputState state, bool trackMods, int stripKeys);
+
+	// Returns the time, in milliseconds, that the autolock period is measured by.
+	typedef unsigned long long(*tick_fn)();
+
+	// The key and mouse handlers of the modes, and the changes of mode called
+	// for by the sequences, kept apart from the hooks, the UI, and the
+	// settings, so that state.cpp and the audit of the hook path
+	// (tools/audit.cpp) run the same handlers.
+	// The mode is read from the given atomic, and is only changed through
+	// changeMode. Apart from the atomics, the state of the handlers is only
+	// accessed by the thread they are called on.
+	class ModeHandlers {
+	public:
+		ModeHandlers(const std::atomic<InputState>& mode, const Options& opts,
+			change_mode_fn changeMode, tick_fn getTicks);
+
+		ModeHandlers(const ModeHandlers&) = delete;
+		ModeHandlers& operator=(const ModeHandlers&) = delete;
+
+		// Restart the autolock period, and reset mashing detection, and the
+		// limits of Throttled mode if entering it. To be called by changeMode
+		// on every change of mode, from any thread.
+		void modeChanged(InputState state);
+
+		// Reset mashing detection, such as when it is turned on, so that it
+		// follows the current limits.
+		void resetMashing();
+
+		// Set the keystrokes and clicks allowed per second in Throttled mode.
+		void setThrottleRates(int keys, int clicks);
+
+		// The key_handler_fn of the current mode, which also switches to
+		// Locked mode when the keyboard is mashed, or after the autolock
+		// period. The limits of Throttled mode are applied by throttleKey.
+		bool key(input::KeyData& data);
+
+		// The key_handler_fn that applies the limits of Throttled mode to
+		// keystrokes, including repeats of held keys.
+		bool throttleKey(input::KeyData& data);
+
+		// The mouse_handler_fn of the current mode, including the limits of
+		// Throttled mode.
+		bool mouse(input::MouseData& data);
+
+		// Switch to the mode called for by the sequence of the given type,
+		// one of STATE_KEYSEQ_[X], in the current mode.
+		// Returns true if the mode was changed, and false if otherwise.
+		bool sequence(int type, int stripKeys = 0);
+
+	private:
+		const std::atomic<InputState>& mode;
+		const Options& opts;
+		change_mode_fn changeMode;
+		tick_fn getTicks;
+
+		std::atomic<unsigned long long> lastActive;
+		input::MashDetector mashDetector;
+		std::atomic<bool> mashReset;
+		Throttle throttle;
+		std::atomic<bool> throttleReset;
+
+		void checkAutoLock();
+	};
+
+	// The calls made to the hooks and the UI on a change of mode, which are
+	// platform specific. state.cpp makes them to WinInput and the UI, and the
+	// audit of the hook path fakes them, so that both run ModeSwitch.
+	class ModePlatform {
+	public:
+		virtual ~ModePlatform() {}
+
+		// Track ctrl, shift, and alt, see input::trackModifierState.
+		virtual void trackModifierState(bool track) = 0;
+
+		// Drop the cached verdicts on keys, see input::invalidateKeyVerdicts.
+		virtual void invalidateKeyVerdicts() = 0;
+
+		// Buffer the keys blocked from now on, see input::setKeyBuffering.
+		virtual void setKeyBuffering(bool buffer) = 0;
+
+		// Replay or discard the buffered keys, see input::releaseKeyBuffer.
+		virtual void releaseKeyBuffer(bool replay, int stripKeys) = 0;
+
+		// Returns true if the hooks are suspended, see input::isSuspended.
+		virtual bool isSuspended() = 0;
+
+		// Reinstall the hooks, see input::resume.
+		virtual void resume() = 0;
+
+		// Suspend the hooks from the hook thread, between input events, if
+		// the session still calls for it then.
+		virtual void suspend() = 0;
+
+		// Redraw the status of the UI without waiting for it, see
+		// ui::postStatusUpdate.
+		virtual void postStatusUpdate() = 0;
+	};
+
+	// Changes the mode, and applies the change to the handlers, the journal,
+	// the hooks, and the UI. This is the change_mode_fn of state.cpp, kept
+	// apart from the platform so that the audit of the hook path runs it.
+	// Called on the hook thread, or on the UI thread before the hooks are
+	// installed, since the journal is only recorded by one thread at a time.
+	class ModeSwitch {
+	public:
+		ModeSwitch(std::atomic<InputState>& mode, const Options& opts, ModeHandlers& handlers,
+			const SessionTracker& session, input::StateJournal& journal, ModePlatform& platform);
+
+		ModeSwitch(const ModeSwitch&) = delete;
+		ModeSwitch& operator=(const ModeSwitch&) = delete;
+
+		// Switch to the given mode; trackMods and stripKeys are as for
+		// change_mode_fn.
+		void change(InputState state, bool trackMods, int stripKeys);
+
+	private:
+		std::atomic<InputState>& mode;
+		const Options& opts;
+		ModeHandlers& handlers;
+		const SessionTracker& session;
+		input::StateJournal& journal;
+		ModePlatform& platform;
+	};
+}
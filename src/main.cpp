@@ -1,14 +1,40 @@
 #include "stdafx.h"
 
+#include "settings.hpp"
 #include "state.hpp"
 #include "ui.hpp"
+#include "wininput/instance.hpp"
+
+// The name under which the hooks of a session are owned, see HookOwner.
+#define APP_INSTANCE_NAME "Padlock.Hooks"
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, 
 	PWSTR pCmdLine, int nCmdShow) {
 
-	_D(AllocConsole(); freopen("CONOUT$", "w", stdout); freopen("CONOUT$", "w", stderr););
+#ifdef _WININPUT_TRACE
+	bool trace = wcsstr(pCmdLine, L"/trace") != NULL;
+	input::enableTracepoints(trace);
+#endif
+
+	// only one instance installs hooks in each session; any other launch
+	// passes its intent to it and exits, while the first carries it out
+	int intent = ui::parseIntent(pCmdLine);
+	input::HookOwner owner;
+	if (!owner.acquire(APP_INSTANCE_NAME)) {
+		return ui::sendIntent(intent) ? 0 : 1;
+	}
 
 	state::setup();
-	return ui::mainLoop(hInstance, nCmdShow);
+	int res = ui::mainLoop(hInstance, nCmdShow, intent);
+	state::shutdown();
+
+#ifdef _WININPUT_TRACE
+	// formatted with tools/tracefmt.cpp
+	if (trace) {
+		input::enableTracepoints(false);
+		input::dumpTracepoints(settings::getTraceFile());
+	}
+#endif
+	return res;
 
 }
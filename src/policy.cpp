@@ -0,0 +1,299 @@
+#include "policy.hpp"
+#include "state.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+// The virtual key codes and mouse messages of the Windows headers, which are
+// not included so that the policy can be built on any platform.
+#define POLICY_VK_LSHIFT 0xA0
+#define POLICY_VK_RMENU 0xA5
+#define POLICY_WM_LBUTTONDOWN 0x0201
+#define POLICY_WM_LBUTTONUP 0x0202
+#define POLICY_WM_RBUTTONDOWN 0x0204
+#define POLICY_WM_RBUTTONUP 0x0205
+#define POLICY_WM_MBUTTONDOWN 0x0207
+#define POLICY_WM_MBUTTONUP 0x0208
+#define POLICY_WM_XBUTTONDOWN 0x020B
+#define POLICY_WM_XBUTTONUP 0x020C
+#define POLICY_XBUTTON1 0x0001
+// The number of seeds of the hash tried when building the table of an
+// InjectionPolicy, before giving up.
+#define POLICY_INJECT_SEEDS 64
+
+
+namespace {
+
+	inline bool isModifier(unsigned long code) {
+		return code >= POLICY_VK_LSHIFT && code <= POLICY_VK_RMENU;
+	}
+
+	// returns the bit of the mouse button of the given message, and sets down
+	// to true if the button was pressed, or returns 0 if not a button message
+	unsigned getMouseButton(unsigned msg, unsigned long param, bool& down) {
+		down = msg == POLICY_WM_LBUTTONDOWN || msg == POLICY_WM_RBUTTONDOWN
+			|| msg == POLICY_WM_MBUTTONDOWN || msg == POLICY_WM_XBUTTONDOWN;
+		switch (msg) {
+		case POLICY_WM_LBUTTONDOWN: case POLICY_WM_LBUTTONUP: return 1;
+		case POLICY_WM_RBUTTONDOWN: case POLICY_WM_RBUTTONUP: return 2;
+		case POLICY_WM_MBUTTONDOWN: case POLICY_WM_MBUTTONUP: return 4;
+		case POLICY_WM_XBUTTONDOWN: case POLICY_WM_XBUTTONUP:
+			return ((param >> 16) & 0xFFFF) == POLICY_XBUTTON1 ? 8 : 16;
+		}
+		return 0;
+	}
+
+	// the letters of the modes of an InjectionPolicy, in the order of InputState
+	const char modeLetters[] = "urlt";
+
+	// returns the modes of the given letters, or -1 if they are not valid
+	int parseModes(const std::string& text) {
+		if (text == "-") return 0;
+		if (text.empty()) return -1;
+		int modes = 0;
+		for (char c : text) {
+			const char *letter = std::strchr(modeLetters, c);
+			if (c == 0 || letter == nullptr) return -1;
+			modes |= 1 << (letter - modeLetters);
+		}
+		return modes;
+	}
+
+	std::string modesToString(unsigned modes) {
+		std::string str;
+		for (int i = 0; i < 4; i++) {
+			if (modes & (1U << i)) str += modeLetters[i];
+		}
+		return str.empty() ? "-" : str;
+	}
+}
+
+namespace state {
+
+	void KeySet::clear() {
+		for (int i = 0; i < 8; i++) bits[i] = 0;
+	}
+
+	bool KeySet::parse(const std::string& text) {
+		KeySet set;
+		std::stringstream in(text);
+		std::string item;
+		while (std::getline(in, item, ',')) {
+			if (item.empty()) continue;
+			unsigned first = 0, last = 0;
+			char dash = 0, extra = 0;
+			int fields = sscanf(item.c_str(), "%u%c%u%c", &first, &dash, &last, &extra);
+			if (fields == 1) {
+				last = first;
+			} else if (fields != 3 || dash != '-') {
+				return false;
+			}
+			if (first > last || last > 255) return false;
+			for (unsigned code = first; code <= last; code++) set.add(code);
+		}
+		*this = set;
+		return true;
+	}
+
+	std::string KeySet::toString() const {
+		std::string str;
+		for (unsigned code = 0; code < 256; code++) {
+			if (!contains(code)) continue;
+			unsigned last = code;
+			while (last < 255 && contains(last + 1)) ++last;
+
+			if (!str.empty()) str += ",";
+			str += std::to_string(code);
+			if (last != code) str += "-" + std::to_string(last);
+			code = last;
+		}
+		return str;
+	}
+
+	bool KeySet::operator==(const KeySet& other) const {
+		for (int i = 0; i < 8; i++) {
+			if (bits[i] != other.bits[i]) return false;
+		}
+		return true;
+	}
+
+	void InjectionPolicy::clear() {
+		tags.clear();
+		defaultModes = POLICY_DEFAULT_INJECT_MODES;
+		build();
+	}
+
+	bool InjectionPolicy::allow(unsigned long long tag, unsigned modes) {
+		for (auto& entry : tags) {
+			if (entry.tag == tag) {
+				entry.modes = modes & 0xF;
+				return build();
+			}
+		}
+		if (tags.size() >= POLICY_INJECT_TAGS) return false;
+		Slot entry;
+		entry.tag = tag;
+		entry.modes = modes & 0xF;
+		entry.used = true;
+		tags.push_back(entry);
+		if (build()) return true;
+		tags.pop_back();
+		build();
+		return false;
+	}
+
+	// place every tag within POLICY_INJECT_PROBES slots of its hash, trying
+	// other seeds if some do not fit
+	bool InjectionPolicy::build() {
+		for (unsigned long long n = 0; n < POLICY_INJECT_SEEDS; n++) {
+			Slot table[POLICY_INJECT_SLOTS];
+			unsigned long long candidate = n * 0xBF58476D1CE4E5B9ULL;
+			bool placed = true;
+			for (const auto& entry : tags) {
+				unsigned slot = getSlot(entry.tag, candidate);
+				int i = 0;
+				while (i < POLICY_INJECT_PROBES && table[(slot + i) & (POLICY_INJECT_SLOTS - 1)].used) ++i;
+				if (i == POLICY_INJECT_PROBES) {
+					placed = false;
+					break;
+				}
+				table[(slot + i) & (POLICY_INJECT_SLOTS - 1)] = entry;
+			}
+			if (!placed) continue;
+			std::copy(table, table + POLICY_INJECT_SLOTS, slots);
+			seed = candidate;
+			return true;
+		}
+		return false;
+	}
+
+	bool InjectionPolicy::parse(const std::string& text) {
+		InjectionPolicy policy;
+		std::stringstream in(text);
+		std::string item;
+		while (std::getline(in, item, ',')) {
+			if (item.empty()) continue;
+			size_t colon = item.find(':');
+			if (colon == std::string::npos) return false;
+			int modes = parseModes(item.substr(colon + 1));
+			if (modes < 0) return false;
+
+			std::string tag = item.substr(0, colon);
+			if (tag == "*") {
+				policy.setDefault(modes);
+				continue;
+			}
+			char *end = nullptr;
+			unsigned long long value = std::strtoull(tag.c_str(), &end, 0);
+			if (tag.empty() || *end != 0 || tag[0] == '-') return false;
+			if (!policy.allow(value, modes)) return false;
+		}
+		*this = policy;
+		return true;
+	}
+
+	std::string InjectionPolicy::toString() const {
+		std::string str = "*:" + modesToString(defaultModes);
+		for (const auto& entry : tags) {
+			char tag[24];
+			std::snprintf(tag, sizeof(tag), "0x%llX", entry.tag);
+			str += std::string(",") + tag + ":" + modesToString(entry.modes);
+		}
+		return str;
+	}
+
+	bool isKeyBlocked(InputState state, const input::KeyData& data, const KeySet& limitKeys) {
+		switch (state) {
+
+		case InputState::UNLOCKED:
+		case InputState::THROTTLED:
+			return false;
+
+		case InputState::LIMITED:
+			if (!data.ctrl && !data.alt && limitKeys.contains(data.code)) return false;
+			// other keys are handled as in Locked mode
+			// fall through
+
+		case InputState::LOCKED:
+			// allow ctrl, shift, alt keyup
+			if (data.type == INPUT_TYPE_KEYUP && isModifier(data.code)) return false;
+		}
+		return true;
+	}
+
+	bool isMouseBlocked(InputState state) {
+		return state == InputState::LIMITED || state == InputState::LOCKED;
+	}
+
+	InputState getSequenceTarget(int type, InputState state) {
+		switch (type) {
+		case STATE_KEYSEQ_UNLOCKED:
+			return InputState::UNLOCKED;
+		case STATE_KEYSEQ_LIMITED:
+			return state == InputState::UNLOCKED ? InputState::LIMITED : state;
+		case STATE_KEYSEQ_LOCKED:
+			return InputState::LOCKED;
+		case STATE_KEYSEQ_THROTTLED:
+			return state == InputState::UNLOCKED ? InputState::THROTTLED : state;
+		}
+		return state;
+	}
+
+	void Throttle::setRates(unsigned keys, unsigned clicks) {
+		keyBucket.setRate(keys);
+		clickBucket.setRate(clicks);
+	}
+
+	void Throttle::reset() {
+		keyBucket.reset();
+		clickBucket.reset();
+		for (int i = 0; i < 8; i++) keys[i] = 0;
+		buttons = 0;
+	}
+
+	// pass key downs while there are tokens left, and block the key ups of
+	// blocked key downs
+	bool Throttle::isKeyBlocked(const input::KeyData& data) {
+		if (isModifier(data.code)) return false;
+
+		unsigned& bits = keys[(data.code >> 5) & 7];
+		unsigned bit = 1U << (data.code & 31);
+		if (data.type == INPUT_TYPE_KEYUP) {
+			bool blocked = (bits & bit) != 0;
+			bits &= ~bit;
+			return blocked;
+		}
+
+		if (keyBucket.take(data.time)) {
+			bits &= ~bit;
+			return false;
+		}
+		// a blocked repeat of a key that went down still needs its key up
+		if (data.type == INPUT_TYPE_KEYDOWN) bits |= bit;
+		return true;
+	}
+
+	// pass clicks while there are tokens left, and block the button ups of
+	// blocked clicks; movement and wheel input are always passed
+	bool Throttle::isMouseBlocked(const input::MouseData& data) {
+		bool down;
+		unsigned button = getMouseButton(data.code, data.param, down);
+		if (button == 0) return false;
+
+		if (!down) {
+			bool blocked = (buttons & button) != 0;
+			buttons &= ~button;
+			return blocked;
+		}
+
+		if (clickBucket.take(data.time)) {
+			buttons &= ~button;
+			return false;
+		}
+		buttons |= button;
+		return true;
+	}
+}
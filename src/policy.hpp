@@ -0,0 +1,166 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "wininput/wininput.hpp"
+#include "wininput/throttle.hpp"
+
+// The keys allowed in Restricted mode by default: shift, space, the
+// navigation keys, 0-9, and A-Z.
+#define POLICY_DEFAULT_LIMIT_KEYS "32-40,48-90,160-161"
+// The modes in which input injected by other processes is allowed if its tag
+// is not listed, as a bit per InputState: the modes that allow physical input,
+// Unlocked and Throttled mode.
+#define POLICY_DEFAULT_INJECT_MODES 0x9
+// The number of tags an InjectionPolicy can list.
+#define POLICY_INJECT_TAGS 32
+// The table of the tags of an InjectionPolicy has 2^POLICY_INJECT_BITS slots,
+// and each tag is in one of the POLICY_INJECT_PROBES slots from its hash.
+#define POLICY_INJECT_BITS 7
+#define POLICY_INJECT_SLOTS (1 << POLICY_INJECT_BITS)
+#define POLICY_INJECT_PROBES 4
+
+// The decisions of each mode on which input is blocked, kept apart from the
+// hooks, timers, and settings, so that they can also be replayed offline
+// against recorded input (see tools/simulate.cpp).
+namespace state {
+
+	enum class InputState { UNLOCKED, LIMITED, LOCKED, THROTTLED };
+
+	// A set of virtual key codes, such as the keys allowed in Restricted mode.
+	class KeySet {
+	public:
+		KeySet() {}
+
+		inline bool contains(unsigned long code) const {
+			return code < 256 && (bits[code >> 5] & (1U << (code & 31))) != 0;
+		}
+
+		inline void add(unsigned long code) {
+			if (code < 256) bits[code >> 5] |= 1U << (code & 31);
+		}
+
+		void clear();
+
+		// Set to the codes of a comma separated list of codes and ranges of
+		// codes, in decimal, such as "32-40,48-90".
+		// Returns true if successful, and false if otherwise, in which case
+		// the set is left unchanged.
+		bool parse(const std::string& text);
+
+		// Returns the list of codes and ranges of codes read by parse.
+		std::string toString() const;
+
+		bool operator==(const KeySet& other) const;
+		bool operator!=(const KeySet& other) const { return !(*this == other); }
+
+	private:
+		unsigned bits[8] = { 0 };
+	};
+
+	// The modes in which input injected by other processes, such as with
+	// SendInput, is allowed, by its tag: the dwExtraInfo it was sent with. An
+	// on-screen keyboard or an accessibility tool that tags its input can then
+	// be allowed in Restricted or Locked mode, while a script cannot bypass
+	// them. The tags are resolved into a table in which each is found within
+	// POLICY_INJECT_PROBES slots, so that isBlocked takes the same time however
+	// many tags are listed.
+	class InjectionPolicy {
+	public:
+		InjectionPolicy() { clear(); }
+
+		// Remove all tags, and allow untagged input in the default modes.
+		void clear();
+
+		// Allow input with the given tag in the given modes, as a bit per
+		// InputState, and block it in the others.
+		// Returns true if successful, and false if otherwise, such as if
+		// POLICY_INJECT_TAGS are already listed.
+		bool allow(unsigned long long tag, unsigned modes);
+
+		// Set the modes in which input with a tag that is not listed is allowed.
+		void setDefault(unsigned modes) { defaultModes = modes & 0xF; }
+
+		// Returns true if input injected with the given tag is blocked in the
+		// given mode.
+		inline bool isBlocked(InputState state, unsigned long long tag) const {
+			unsigned modes = defaultModes;
+			unsigned slot = getSlot(tag, seed);
+			for (int i = 0; i < POLICY_INJECT_PROBES; i++) {
+				const Slot& entry = slots[(slot + i) & (POLICY_INJECT_SLOTS - 1)];
+				// without a branch, which would mispredict as tags come and go
+				bool match = entry.used & (entry.tag == tag);
+				modes = match ? entry.modes : modes;
+			}
+			return (modes & (1U << (int)state)) == 0;
+		}
+
+		// Set to a comma separated list of tags, in decimal or in hexadecimal
+		// with 0x, each followed by ':' and the modes it is allowed in, as the
+		// letters u, r, l, and t, or - for none, such as "*:ut,0x4F534B31:urlt",
+		// where * gives the modes of the tags that are not listed.
+		// Returns true if successful, and false if otherwise, in which case
+		// the policy is left unchanged.
+		bool parse(const std::string& text);
+
+		// Returns the list of tags and modes read by parse.
+		std::string toString() const;
+
+	private:
+		struct Slot {
+			unsigned long long tag = 0;
+			unsigned modes = 0;
+			bool used = false;
+		};
+
+		static inline unsigned getSlot(unsigned long long tag, unsigned long long seed) {
+			return (unsigned)(((tag ^ seed) * 0x9E3779B97F4A7C15ULL) >> (64 - POLICY_INJECT_BITS));
+		}
+
+		std::vector<Slot> tags; // as listed, from which the table is built
+		Slot slots[POLICY_INJECT_SLOTS];
+		unsigned long long seed = 0;
+		unsigned defaultModes = POLICY_DEFAULT_INJECT_MODES;
+
+		bool build();
+	};
+
+	// Returns true if the key event is blocked in the given mode, apart from
+	// the limits of Throttled mode (see Throttle). limitKeys are the keys
+	// allowed in Restricted mode while neither ctrl nor alt is held.
+	bool isKeyBlocked(InputState state, const input::KeyData& data, const KeySet& limitKeys);
+
+	// Returns true if the mouse event is blocked in the given mode, apart from
+	// the limits of Throttled mode.
+	bool isMouseBlocked(InputState state);
+
+	// Returns the mode switched to when the sequence of the given type, one of
+	// STATE_KEYSEQ_[X], is typed in the given mode, or that mode if the
+	// sequence does not apply in it.
+	InputState getSequenceTarget(int type, InputState state);
+
+	// The limits of Throttled mode. Key downs and clicks are allowed up to a
+	// number per second, and the key and button ups of those blocked are also
+	// blocked. Ctrl, shift, alt, movement, and wheel input are always allowed.
+	// Should only be used from a single thread, apart from setRates.
+	class Throttle {
+	public:
+		// Set the key downs and clicks allowed per second, where 0 = no limit.
+		void setRates(unsigned keys, unsigned clicks);
+
+		// Forget all previous events, such as when entering Throttled mode.
+		void reset();
+
+		// Returns true if the key event, which may be a repeat, is blocked.
+		bool isKeyBlocked(const input::KeyData& data);
+
+		// Returns true if the mouse event is blocked.
+		bool isMouseBlocked(const input::MouseData& data);
+
+	private:
+		input::TokenBucket keyBucket;
+		input::TokenBucket clickBucket;
+		unsigned keys[8] = { 0 };
+		unsigned buttons = 0;
+	};
+}
@@ -0,0 +1,355 @@
+#include "schedule.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+
+// The minutes in a day.
+#define SCHEDULE_DAY 1440
+// Every day of the week, the days from Monday to Friday, and the weekend.
+#define SCHEDULE_DAILY 0x7F
+#define SCHEDULE_WEEKDAYS 0x3E
+#define SCHEDULE_WEEKENDS 0x41
+
+namespace {
+	using state::InputState;
+	using state::ScheduleRule;
+
+	const char *dayNames[] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+	std::tm toLocal(long long time) {
+		std::time_t t = (std::time_t)time;
+		std::tm local;
+#ifdef _WIN32
+		localtime_s(&local, &t);
+#else
+		localtime_r(&t, &local);
+#endif
+		return local;
+	}
+
+	// the time, in seconds since the epoch, of the given minutes into the
+	// given local date, which may be past the end of its month
+	long long fromLocal(int year, int month, int day, int minutes) {
+		std::tm local;
+		std::memset(&local, 0, sizeof(local));
+		local.tm_year = year - 1900;
+		local.tm_mon = month - 1;
+		local.tm_mday = day;
+		local.tm_hour = minutes / 60;
+		local.tm_min = minutes % 60;
+		local.tm_isdst = -1;
+		return (long long)std::mktime(&local);
+	}
+
+	inline int toDate(const std::tm& local) {
+		return (local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 + local.tm_mday;
+	}
+
+	inline bool isOnDay(const ScheduleRule& rule, int date, int weekday) {
+		return rule.date != 0 ? rule.date == date : (rule.days & (1 << weekday)) != 0;
+	}
+
+	// a day of the week, returning -1 if there is none
+	int parseDay(const std::string& text) {
+		for (int i = 0; i < 7; i++) {
+			if (text == dayNames[i]) return i;
+		}
+		return -1;
+	}
+
+	bool parseDays(const std::string& text, ScheduleRule& rule) {
+		if (text == "daily") {
+			rule.days = SCHEDULE_DAILY;
+			return true;
+		} else if (text == "weekdays") {
+			rule.days = SCHEDULE_WEEKDAYS;
+			return true;
+		} else if (text == "weekends") {
+			rule.days = SCHEDULE_WEEKENDS;
+			return true;
+		}
+
+		int year, month, day;
+		char end;
+		if (std::sscanf(text.c_str(), "%4d-%2d-%2d%c", &year, &month, &day, &end) == 3) {
+			if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+			rule.date = year * 10000 + month * 100 + day;
+			return true;
+		}
+
+		// days and ranges of days, which may wrap around the end of the week
+		std::stringstream in(text);
+		std::string item;
+		while (std::getline(in, item, ',')) {
+			size_t dash = item.find('-');
+			int first = parseDay(item.substr(0, dash));
+			int last = dash == std::string::npos ? first : parseDay(item.substr(dash + 1));
+			if (first < 0 || last < 0) return false;
+			for (int i = first; ; i = (i + 1) % 7) {
+				rule.days |= 1 << i;
+				if (i == last) break;
+			}
+		}
+		return rule.days != 0;
+	}
+
+	bool parseTimes(const std::string& text, ScheduleRule& rule) {
+		int startHour, startMinute, endHour, endMinute;
+		char end;
+		if (std::sscanf(text.c_str(), "%2d:%2d-%2d:%2d%c", &startHour, &startMinute,
+			&endHour, &endMinute, &end) != 4) return false;
+		if (startHour < 0 || startHour > 23 || endHour < 0 || endHour > 24
+			|| startMinute < 0 || startMinute > 59 || endMinute < 0 || endMinute > 59
+			|| (endHour == 24 && endMinute != 0)) return false;
+		rule.start = startHour * 60 + startMinute;
+		rule.end = endHour * 60 + endMinute;
+		return true;
+	}
+}
+
+namespace state {
+
+	int getSchedulePriority(InputState mode) {
+		switch (mode) {
+		case InputState::LOCKED: return 3;
+		case InputState::LIMITED: return 2;
+		case InputState::THROTTLED: return 1;
+		default: return 0;
+		}
+	}
+
+	bool parseSchedule(const std::string& text, std::vector<ScheduleRule>& rules) {
+		std::vector<ScheduleRule> parsed;
+		std::stringstream in(text);
+		std::string item;
+		while (std::getline(in, item, ';')) {
+			std::stringstream fields(item);
+			std::string mode, days, times, extra;
+			if (!(fields >> mode)) continue; // empty
+			if (!(fields >> days >> times) || (fields >> extra)) return false;
+
+			ScheduleRule rule;
+			if (mode == "restrict")
+				rule.mode = InputState::LIMITED;
+			else if (mode == "lock")
+				rule.mode = InputState::LOCKED;
+			else if (mode == "throttle")
+				rule.mode = InputState::THROTTLED;
+			else
+				return false;
+			if (!parseDays(days, rule) || !parseTimes(times, rule)) return false;
+			parsed.push_back(rule);
+		}
+		rules = parsed;
+		return true;
+	}
+
+	InputState getScheduledMode(const std::vector<ScheduleRule>& rules, long long time) {
+		std::tm today = toLocal(time);
+		std::tm yesterday = toLocal(fromLocal(today.tm_year + 1900, today.tm_mon + 1,
+			today.tm_mday - 1, 12 * 60));
+		int minute = today.tm_hour * 60 + today.tm_min;
+
+		InputState mode = InputState::UNLOCKED;
+		for (auto& rule : rules) {
+			bool overnight = rule.end <= rule.start;
+			bool active = isOnDay(rule, toDate(today), today.tm_wday)
+				&& minute >= rule.start && (overnight || minute < rule.end);
+			if (overnight && isOnDay(rule, toDate(yesterday), yesterday.tm_wday) && minute < rule.end)
+				active = true;
+			if (active && getSchedulePriority(rule.mode) > getSchedulePriority(mode)) mode = rule.mode;
+		}
+		return mode;
+	}
+
+	void TimerWheel::reset(long long now) {
+		current = now;
+		count = 0;
+		for (auto& level : slots) {
+			for (auto& slot : level) slot.clear();
+		}
+		overdue.clear();
+	}
+
+	void TimerWheel::add(long long time, int id) {
+		++count;
+		place({ time, id });
+	}
+
+	long long TimerWheel::next() const {
+		if (!overdue.empty()) return current;
+
+		// the first slot in use of each level, in the order the wheel reaches
+		// them, holds the earliest timers of that level
+		long long best = -1;
+		for (int level = 0; level < SCHEDULE_WHEEL_LEVELS; level++) {
+			int shift = SCHEDULE_WHEEL_BITS * level;
+			long long base = current >> shift;
+			for (int i = 1; i <= SCHEDULE_WHEEL_SLOTS; i++) {
+				auto& slot = slots[level][(base + i) & (SCHEDULE_WHEEL_SLOTS - 1)];
+				if (slot.empty()) continue;
+				for (auto& timer : slot) {
+					if (best < 0 || timer.time < best) best = timer.time;
+				}
+				break;
+			}
+		}
+		return best;
+	}
+
+	long long TimerWheel::nextTick() const {
+		// the start of the next span of each slot in use, at which its timers
+		// are due, or move down a level
+		long long best = -1;
+		for (int level = 0; level < SCHEDULE_WHEEL_LEVELS; level++) {
+			int shift = SCHEDULE_WHEEL_BITS * level;
+			long long base = current >> shift;
+			for (int i = 1; i <= SCHEDULE_WHEEL_SLOTS; i++) {
+				if (slots[level][(base + i) & (SCHEDULE_WHEEL_SLOTS - 1)].empty()) continue;
+				long long tick = (base + i) << shift;
+				if (best < 0 || tick < best) best = tick;
+				break;
+			}
+		}
+		return best;
+	}
+
+	void TimerWheel::step(long long tick, std::vector<Timer>& due) {
+		// the current minute has been stepped to already, and only has timers
+		// added since that are overdue
+		due.swap(overdue);
+		if (tick != current) {
+			current = tick;
+			for (int level = SCHEDULE_WHEEL_LEVELS - 1; level > 0; level--) {
+				int shift = SCHEDULE_WHEEL_BITS * level;
+				if ((tick & ((1LL << shift) - 1)) != 0) continue;
+				std::vector<Timer> moved;
+				moved.swap(slots[level][(tick >> shift) & (SCHEDULE_WHEEL_SLOTS - 1)]);
+				for (auto& timer : moved) place(timer);
+			}
+
+			auto& slot = slots[0][tick & (SCHEDULE_WHEEL_SLOTS - 1)];
+			due.insert(due.end(), overdue.begin(), overdue.end());
+			due.insert(due.end(), slot.begin(), slot.end());
+			overdue.clear();
+			slot.clear();
+		}
+		std::stable_sort(due.begin(), due.end(),
+			[](const Timer& a, const Timer& b) { return a.time < b.time; });
+		count -= (int)due.size();
+	}
+
+	void TimerWheel::place(const Timer& timer) {
+		if (timer.time <= current) {
+			overdue.push_back(timer);
+			return;
+		}
+		// the lowest level that spans the time until the timer is due, where
+		// those further out than the top level wait in it and are placed again
+		long long delta = timer.time - current;
+		int level = 0;
+		while (level < SCHEDULE_WHEEL_LEVELS - 1 && delta >= (1LL << (SCHEDULE_WHEEL_BITS * (level + 1))))
+			++level;
+		slots[level][(timer.time >> (SCHEDULE_WHEEL_BITS * level)) & (SCHEDULE_WHEEL_SLOTS - 1)].push_back(timer);
+	}
+
+	long long ScheduleClock::now() {
+		return (long long)std::time(nullptr);
+	}
+
+	bool Scheduler::load(const std::string& text) {
+		std::vector<ScheduleRule> parsed;
+		bool res = parseSchedule(text, parsed);
+		rules = parsed;
+		compile(clock.now() / 60);
+		return res;
+	}
+
+	InputState Scheduler::update() {
+		long long now = clock.now() / 60;
+		// the clock was set back, or has passed what was compiled
+		if (now < wheel.getCurrent() || now >= compiled) {
+			compile(now);
+			return mode;
+		}
+
+		bool recompile = false;
+		wheel.advance(now, [&](int id) {
+			if (id < 0)
+				recompile = true;
+			else
+				mode = deadlines[id].mode;
+		});
+		if (recompile) compile(now);
+		return mode;
+	}
+
+	long long Scheduler::wait() {
+		if (rules.empty()) return -1;
+		long long next = wheel.next();
+		if (next < 0) return -1;
+		long long ms = (next * 60 - clock.now()) * 1000;
+		return ms < 0 ? 0 : ms;
+	}
+
+	void Scheduler::compile(long long now) {
+		struct Window {
+			long long start;
+			long long end;
+			InputState mode;
+		};
+
+		deadlines.clear();
+		wheel.reset(now);
+		compiled = now + SCHEDULE_HORIZON_DAYS * SCHEDULE_DAY;
+
+		// the windows of each day, from the one before, whose windows may run
+		// overnight, to the end of the horizon
+		std::vector<Window> windows;
+		std::tm today = toLocal(now * 60);
+		for (int i = -1; i <= SCHEDULE_HORIZON_DAYS && !rules.empty(); i++) {
+			int year = today.tm_year + 1900, month = today.tm_mon + 1, day = today.tm_mday + i;
+			std::tm local = toLocal(fromLocal(year, month, day, 12 * 60));
+			for (auto& rule : rules) {
+				if (!isOnDay(rule, toDate(local), local.tm_wday)) continue;
+				Window window;
+				window.start = fromLocal(year, month, day, rule.start) / 60;
+				window.end = fromLocal(year, month, rule.end <= rule.start ? day + 1 : day, rule.end) / 60;
+				window.mode = rule.mode;
+				if (window.end > now && window.start < compiled) windows.push_back(window);
+			}
+		}
+
+		// the times the mode of highest priority changes, in order
+		std::vector<long long> edges;
+		for (auto& window : windows) {
+			if (window.start > now && window.start < compiled) edges.push_back(window.start);
+			if (window.end > now && window.end < compiled) edges.push_back(window.end);
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		auto modeAt = [&](long long time) {
+			InputState res = InputState::UNLOCKED;
+			for (auto& window : windows) {
+				if (time >= window.start && time < window.end && getSchedulePriority(window.mode) > getSchedulePriority(res))
+					res = window.mode;
+			}
+			return res;
+		};
+		mode = modeAt(now);
+		InputState last = mode;
+		for (long long edge : edges) {
+			InputState next = modeAt(edge);
+			if (next == last) continue;
+			deadlines.push_back({ edge, next });
+			last = next;
+		}
+
+		for (int i = 0; i < (int)deadlines.size(); i++) wheel.add(deadlines[i].time, i);
+		// the next horizon is compiled once this one is over
+		wheel.add(compiled, -1);
+	}
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "policy.hpp"
+
+// The number of slots of each level of a TimerWheel, as a power of two.
+#define SCHEDULE_WHEEL_BITS 6
+#define SCHEDULE_WHEEL_SLOTS (1 << SCHEDULE_WHEEL_BITS)
+// The number of levels of a TimerWheel, which together span 64^4 minutes.
+#define SCHEDULE_WHEEL_LEVELS 4
+// The number of days of deadlines compiled at once by a Scheduler.
+#define SCHEDULE_HORIZON_DAYS 7
+
+// Schedules of modes by the time of day, such as "restrict mon-fri
+// 22:00-06:00; lock 2026-11-03 09:00-12:00", kept apart from the timers of
+// the UI so that they can be run on a simulated clock (see tools/schedule.cpp).
+namespace state {
+
+	// A window of time in which a mode is scheduled, on each of the days of
+	// the week in days, or on a single date.
+	struct ScheduleRule {
+		InputState mode = InputState::LOCKED;
+		unsigned char days = 0; // bit per day of the week, from Sunday = 1
+		int date = 0;           // as yyyymmdd, where 0 = weekly
+		int start = 0;          // minutes into the day, local time
+		int end = 0;            // ends the next day if not after start
+	};
+
+	// Returns the order in which modes take effect when their windows
+	// overlap: Locked mode comes first, then Restricted, then Throttled mode,
+	// and Unlocked mode last.
+	int getSchedulePriority(InputState mode);
+
+	// Read a schedule of rules separated by ';', each of the form
+	// "MODE DAYS HH:MM-HH:MM", where MODE is restrict, lock, or throttle, and
+	// DAYS is daily, weekdays, weekends, a list of days and ranges of days
+	// such as "mon-fri,sun", or a date such as 2026-11-03.
+	// Returns true if successful, and false if otherwise, in which case rules
+	// is left unchanged.
+	bool parseSchedule(const std::string& text, std::vector<ScheduleRule>& rules);
+
+	// Returns the mode of highest priority of the given rules at the given
+	// time, in seconds since the epoch, or UNLOCKED if none is scheduled.
+	InputState getScheduledMode(const std::vector<ScheduleRule>& rules, long long time);
+
+	// A hierarchical timer wheel of IDs due at given minutes. Each level has
+	// SCHEDULE_WHEEL_SLOTS slots, each of which spans all of the slots of the
+	// level below, and timers move down a level when the wheel reaches their
+	// slot. Advancing skips from one slot in use to the next, so it takes time
+	// by the timers due, and not by the minutes passed.
+	class TimerWheel {
+	public:
+		// Remove all timers, and start at the given minute.
+		void reset(long long now);
+
+		// Add a timer with the given ID, due at the given minute. Timers due
+		// before the current minute are due at the next advance.
+		void add(long long time, int id);
+
+		// Returns the minute the next timer is due, or -1 if there are none.
+		long long next() const;
+
+		// Returns the minute the wheel has advanced to.
+		long long getCurrent() const { return current; }
+
+		// Advance to the given minute, calling fire with the ID of each timer
+		// due by then, in the order they are due.
+		template <typename Fn>
+		void advance(long long now, Fn fire) {
+			while (true) {
+				long long tick = overdue.empty() ? nextTick() : current;
+				if (tick < 0 || tick > now) break;
+				std::vector<Timer> due;
+				step(tick, due);
+				for (auto& timer : due) fire(timer.id);
+			}
+			if (now > current) current = now;
+		}
+
+		// Returns the number of timers.
+		int size() const { return count; }
+
+	private:
+		struct Timer {
+			long long time;
+			int id;
+		};
+
+		long long current = 0;
+		int count = 0;
+		std::vector<Timer> slots[SCHEDULE_WHEEL_LEVELS][SCHEDULE_WHEEL_SLOTS];
+		std::vector<Timer> overdue;
+
+		long long nextTick() const;
+		void step(long long tick, std::vector<Timer>& due);
+		void place(const Timer& timer);
+	};
+
+	// The clock of a Scheduler, which can be replaced by a simulated one.
+	class ScheduleClock {
+	public:
+		virtual ~ScheduleClock() {}
+
+		// Returns the time in seconds since the epoch.
+		virtual long long now();
+	};
+
+	// Follows a schedule on a clock. The rules are compiled into a sorted
+	// list of the times the scheduled mode changes, SCHEDULE_HORIZON_DAYS at
+	// a time, which are kept in a TimerWheel, so that the scheduled mode only
+	// needs updating when the next of them is due, as given by wait.
+	class Scheduler {
+	public:
+		explicit Scheduler(ScheduleClock& clock) : clock(clock) {}
+
+		// Replace the rules with those of the given schedule, see
+		// parseSchedule. An empty schedule has no rules.
+		// Returns true if successful, and false if otherwise, in which case
+		// there are no rules.
+		bool load(const std::string& text);
+
+		// Catch up with the clock, such as when the timer set by wait fires,
+		// or the clock has changed.
+		// Returns the mode scheduled now, or UNLOCKED if none is.
+		InputState update();
+
+		// Returns the mode scheduled as of the last update.
+		InputState getMode() const { return mode; }
+
+		// Returns the milliseconds from now until the scheduled mode may
+		// change, or -1 if it never does.
+		long long wait();
+
+		// Returns the number of rules.
+		int getRuleCount() const { return (int)rules.size(); }
+
+	private:
+		struct Deadline {
+			long long time; // minutes since the epoch
+			InputState mode;
+		};
+
+		ScheduleClock& clock;
+		std::vector<ScheduleRule> rules;
+		std::vector<Deadline> deadlines;
+		TimerWheel wheel;
+		long long compiled = 0; // the minute compiled up to
+		InputState mode = InputState::UNLOCKED;
+
+		void compile(long long now);
+	};
+}
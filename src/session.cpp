@@ -0,0 +1,63 @@
+#include "session.hpp"
+
+namespace {
+	using state::SessionEvent;
+
+	const char *eventNames[] = { "lock", "unlock", "display-off", "display-on" };
+}
+
+namespace state {
+
+	void SessionTracker::update(SessionEvent evt) {
+		switch (evt) {
+		case SessionEvent::LOCKED:
+			sessionInactive.store(true);
+			break;
+		case SessionEvent::UNLOCKED:
+			sessionInactive.store(false);
+			break;
+		case SessionEvent::DISPLAY_OFF:
+			displayOff.store(true);
+			break;
+		case SessionEvent::DISPLAY_ON:
+			displayOff.store(false);
+			break;
+		}
+	}
+
+	HookAction SessionTracker::getAction(InputState state, bool suspended) const {
+		bool suspend = isAway() && state == InputState::UNLOCKED;
+		if (suspend == suspended) return HookAction::NONE;
+		return suspend ? HookAction::SUSPEND : HookAction::RESUME;
+	}
+
+	bool parseSessionEvent(const std::string& text, SessionEvent& evt) {
+		for (int i = 0; i < 4; i++) {
+			if (text == eventNames[i]) {
+				evt = (SessionEvent)i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const char *getSessionEventName(SessionEvent evt) {
+		return eventNames[(int)evt];
+	}
+
+	int feedSessionEvents(std::istream& in, session_event_fn fn) {
+		int count = 0;
+		std::string line;
+		while (std::getline(in, line)) {
+			// tolerate the line endings of files written on Windows
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (line.empty() || line[0] == '#') continue;
+
+			SessionEvent evt;
+			if (!parseSessionEvent(line, evt)) return -1;
+			fn(evt);
+			++count;
+		}
+		return count;
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <istream>
+#include <string>
+#include "policy.hpp"
+
+// Whether the user is at the session, and whether the hooks can be removed
+// meanwhile, kept apart from the notifications of the platform so that the
+// decisions can be driven by a simulated feed of session events (see
+// tools/session.cpp).
+namespace state {
+
+	enum class SessionEvent { LOCKED, UNLOCKED, DISPLAY_OFF, DISPLAY_ON };
+
+	// What should be done with the hooks, see SessionTracker::getAction.
+	enum class HookAction { NONE, SUSPEND, RESUME };
+
+	// Defines the type of function that session events are passed to, such as
+	// state::notifySessionEvent.
+	typedef void(*session_event_fn)(SessionEvent evt);
+
+	// Follows whether the session is locked or disconnected, and whether the
+	// display is off. Updated by the thread that receives the notifications,
+	// and read by any other.
+	class SessionTracker {
+	public:
+		// Record a change in the session or display state.
+		void update(SessionEvent evt);
+
+		// Returns true if the session is locked or disconnected, or the display is off.
+		bool isAway() const {
+			return sessionInactive.load() || displayOff.load();
+		}
+
+		// Returns whether the hooks should be suspended or reinstalled in the
+		// given mode, given whether they are currently suspended. They are only
+		// suspended in Unlocked mode while the user is away, since in the other
+		// modes the keys that wake the display or unlock the session would
+		// otherwise reach applications unfiltered. They are reinstalled as soon
+		// as either no longer holds.
+		HookAction getAction(InputState state, bool suspended) const;
+
+	private:
+		std::atomic<bool> sessionInactive{ false };
+		std::atomic<bool> displayOff{ false };
+	};
+
+	// Read a session event by its name: lock, unlock, display-off, or display-on.
+	// Returns true if successful, and false if otherwise.
+	bool parseSessionEvent(const std::string& text, SessionEvent& evt);
+
+	// Returns the name of the given session event, as read by parseSessionEvent.
+	const char *getSessionEventName(SessionEvent evt);
+
+	// Pass the session events read from the given stream, one per line, to fn,
+	// such as to simulate the notifications of the platform on Linux. Empty
+	// lines and lines starting with # are skipped.
+	// Returns the number of events passed, or -1 if a line is not an event,
+	// in which case the events before it have been passed.
+	int feedSessionEvents(std::istream& in, session_event_fn fn);
+}
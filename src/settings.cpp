@@ -1,17 +1,25 @@
 #include "stdafx.h"
 
 #include <ShlObj.h>
+#include <aclapi.h>
+#include <wincrypt.h>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <mutex>
+#include <vector>
 #include "settings.hpp"
 
 #define APP_FOLDER_NAME "\\Padlock"
 #define APP_CONFIG_FILE "\\conf.ini"
+#define APP_PLUGIN_FOLDER "\\plugins"
+#define APP_TRACE_FILE "\\padlock.trace"
+#define APP_JOURNAL_FILE "\\state.journal"
 
 namespace {
 	std::map<std::string, std::string> iniData;
+	std::mutex iniDataMutex;
 
 	// intentionally naive conversion, returns 0 if no conversion can be made
 	int nstoi(const char *p) {
@@ -23,10 +31,10 @@ namespace {
 		return x;
 	}
 
-	void loadSeq(const char *name, input::KeyData *seq) {
+	// the keys of plaintext sequences are not traced if secret is true
+	void loadSeq(const char *name, input::KeyData *seq, bool secret = false) {
 		if (iniData.find(name) == iniData.end()) return;
 
-		_Dc("Loading seq: " << name << std::endl);
 		std::stringstream in(iniData[name]);
 		for (int i = 0; i < state::Options::MAX_SEQ_LEN; i++) {
 			if (!in.good()) {
@@ -38,24 +46,252 @@ namespace {
 			seq[i].alt = in.get() == '1';
 			in >> seq[i].code;
 			in.ignore(1);
-			_Dc((int)seq[i].ctrl << (int)seq[i].shift << (int)seq[i].alt << 
-				seq[i].code << std::endl);
+			if (!secret)
+				INPUT_TRACEPOINT(SEQUENCE_KEY_LOADED, i, seq[i].ctrl, seq[i].shift, seq[i].alt, seq[i].code);
 		}
 	}
 
 	void saveSeq(const char *name, const input::KeyData *seq) {
 		std::stringstream out;
 
-		_Dc("Saving seq: " << name << std::endl);
 		for (int i = 0; i < state::Options::MAX_SEQ_LEN; i++) {
 			out << (int)seq[i].ctrl << (int)seq[i].shift << (int)seq[i].alt;
 			out << seq[i].code << ",";
-			_Dc((int)seq[i].ctrl << (int)seq[i].shift << (int)seq[i].alt << 
-				seq[i].code << std::endl);
+			INPUT_TRACEPOINT(SEQUENCE_KEY_SAVED, i, seq[i].ctrl, seq[i].shift, seq[i].alt, seq[i].code);
 		}
 		iniData[name] = out.str();
 	}
 
+	std::string toHex(const unsigned char *data, size_t size) {
+		static const char digits[] = "0123456789abcdef";
+		std::string hex;
+		for (size_t i = 0; i < size; i++) {
+			hex += digits[data[i] >> 4];
+			hex += digits[data[i] & 15];
+		}
+		return hex;
+	}
+
+	// returns the number of bytes read, up to size, stopping at the first non-hex digit
+	size_t fromHex(const std::string& hex, unsigned char *data, size_t size) {
+		size_t count = 0;
+		for (; count < size && count * 2 + 1 < hex.size(); count++) {
+			int digits[2];
+			for (int j = 0; j < 2; j++) {
+				char c = hex[count * 2 + j];
+				digits[j] = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+			}
+			if (digits[0] < 0 || digits[1] < 0) break;
+			data[count] = (unsigned char)(digits[0] << 4 | digits[1]);
+		}
+		return count;
+	}
+
+	// the key is protected with DPAPI for the current user, so that a copy of
+	// conf.ini alone is not enough to test guesses of the unlock sequence
+	bool loadSecretKey(input::SecretKey& key) {
+		unsigned char blob[512];
+		DATA_BLOB in = { (DWORD)fromHex(iniData["ukey"], blob, sizeof(blob)), blob };
+		DATA_BLOB out = { 0, NULL };
+		if (in.cbData == 0 || !CryptUnprotectData(&in, NULL, NULL, NULL, NULL,
+			CRYPTPROTECT_UI_FORBIDDEN, &out)) return false;
+
+		bool res = out.cbData == sizeof(key.k0) + sizeof(key.k1);
+		if (res) {
+			std::memcpy(&key.k0, out.pbData, sizeof(key.k0));
+			std::memcpy(&key.k1, out.pbData + sizeof(key.k0), sizeof(key.k1));
+		}
+		SecureZeroMemory(out.pbData, out.cbData);
+		LocalFree(out.pbData);
+		return res;
+	}
+
+	void saveSecretKey(const input::SecretKey& key) {
+		unsigned char raw[sizeof(key.k0) + sizeof(key.k1)];
+		std::memcpy(raw, &key.k0, sizeof(key.k0));
+		std::memcpy(raw + sizeof(key.k0), &key.k1, sizeof(key.k1));
+		DATA_BLOB in = { sizeof(raw), raw };
+		DATA_BLOB out = { 0, NULL };
+		if (CryptProtectData(&in, APP_NAME, NULL, NULL, NULL, CRYPTPROTECT_UI_FORBIDDEN, &out)) {
+			iniData["ukey"] = toHex(out.pbData, out.cbData);
+			LocalFree(out.pbData);
+		}
+		SecureZeroMemory(raw, sizeof(raw));
+	}
+
+	// the text is protected with DPAPI for the current user, the same as the
+	// key of the unlock sequence, for settings that would reveal a way to unlock
+	std::string loadProtected(const char *name) {
+		std::string hex = iniData[name];
+		std::vector<unsigned char> blob(hex.size() / 2);
+		DATA_BLOB in = { (DWORD)fromHex(hex, blob.data(), blob.size()), blob.data() };
+		DATA_BLOB out = { 0, NULL };
+		if (in.cbData == 0 || !CryptUnprotectData(&in, NULL, NULL, NULL, NULL,
+			CRYPTPROTECT_UI_FORBIDDEN, &out)) return std::string();
+
+		std::string text((const char*)out.pbData, out.cbData);
+		SecureZeroMemory(out.pbData, out.cbData);
+		LocalFree(out.pbData);
+		return text;
+	}
+
+	void saveProtected(const char *name, const std::string& text) {
+		if (text.empty()) {
+			iniData.erase(name);
+			return;
+		}
+		DATA_BLOB in = { (DWORD)text.size(), (BYTE*)text.data() };
+		DATA_BLOB out = { 0, NULL };
+		if (CryptProtectData(&in, APP_NAME, NULL, NULL, NULL, CRYPTPROTECT_UI_FORBIDDEN, &out)) {
+			iniData[name] = toHex(out.pbData, out.cbData);
+			LocalFree(out.pbData);
+		}
+	}
+
+	// the secret is stored as length,salt,hash,rolling hash, all but the
+	// length in hex
+	bool loadSecret(const char *name, input::SecretSequence& secret) {
+		if (iniData.find(name) == iniData.end()) return false;
+
+		input::SecretSequence loaded;
+		std::stringstream in(iniData[name]);
+		std::string salt, hash, rolling;
+		in >> loaded.length;
+		in.ignore(1);
+		std::getline(in, salt, ',');
+		std::getline(in, hash, ',');
+		std::getline(in, rolling, ',');
+		if (in.fail() || loaded.length <= 0 || loaded.length > INPUT_SECRET_MAX_KEYS
+			|| fromHex(salt, loaded.salt, INPUT_SECRET_SALT) != INPUT_SECRET_SALT) return false;
+		loaded.hash = std::strtoull(hash.c_str(), nullptr, 16);
+		loaded.rolling = std::strtoull(rolling.c_str(), nullptr, 16);
+		secret = loaded;
+		return true;
+	}
+
+	void saveSecret(const char *name, const input::SecretSequence& secret) {
+		char hash[17], rolling[17];
+		snprintf(hash, sizeof(hash), "%016llx", secret.hash);
+		snprintf(rolling, sizeof(rolling), "%016llx", secret.rolling);
+		iniData[name] = std::to_string(secret.length) + "," + toHex(secret.salt, INPUT_SECRET_SALT)
+			+ "," + hash + "," + rolling;
+	}
+
+	// hash a plaintext unlock sequence of an older version, which is then
+	// removed from the file
+	bool migrateUnlockSeq(state::Options& opts) {
+		if (iniData.find("useq") == iniData.end()) return false;
+
+		input::KeyData seq[state::Options::MAX_SEQ_LEN];
+		loadSeq("useq", seq, true);
+		seq[state::Options::MAX_SEQ_LEN - 1].code = 0;
+		input::makeSecret(opts.secretKey, seq, opts.unlockSecret);
+		SecureZeroMemory(seq, sizeof(seq));
+		SecureZeroMemory(&iniData["useq"][0], iniData["useq"].size());
+		iniData.erase("useq");
+		return true;
+	}
+
+	// points are stored as x,y pairs in ten-thousandths, with a line per gesture
+	bool readGesture(const std::string& line, input::Stroke& stroke) {
+		std::stringstream in(line);
+		for (int j = 0; j < GESTURE_POINTS; j++) {
+			int x = 0, y = 0;
+			in >> x;
+			in.ignore(1);
+			in >> y;
+			in.ignore(1);
+			stroke.x[j] = x / 10000.0f;
+			stroke.y[j] = y / 10000.0f;
+		}
+		return !in.fail();
+	}
+
+	// the gestures unlock, so they are kept protected as a whole under ugest;
+	// gestures saved by older versions in plaintext, as ugest0, ugest1, and
+	// so on, are read once and then removed when the options are saved
+	void loadGestures(std::vector<input::Stroke>& gestures) {
+		gestures.clear();
+		input::Stroke stroke;
+		std::string text = loadProtected("ugest");
+		if (!text.empty()) {
+			std::stringstream in(text);
+			std::string line;
+			while (std::getline(in, line) && readGesture(line, stroke))
+				gestures.push_back(stroke);
+			SecureZeroMemory(&text[0], text.size());
+			return;
+		}
+
+		for (int i = 0; iniData.find("ugest" + std::to_string(i)) != iniData.end(); i++) {
+			if (!readGesture(iniData["ugest" + std::to_string(i)], stroke)) break;
+			gestures.push_back(stroke);
+		}
+	}
+
+	void saveGestures(const std::vector<input::Stroke>& gestures) {
+		std::stringstream out;
+		for (const input::Stroke& stroke : gestures) {
+			for (int j = 0; j < GESTURE_POINTS; j++) {
+				out << (int)(stroke.x[j] * 10000.0f) << ",";
+				out << (int)(stroke.y[j] * 10000.0f) << ",";
+			}
+			out << "\n";
+		}
+		std::string text = out.str();
+		saveProtected("ugest", text);
+		SecureZeroMemory(&text[0], text.size());
+
+		for (int i = 0; ; i++) {
+			auto it = iniData.find("ugest" + std::to_string(i));
+			if (it == iniData.end()) break;
+			iniData.erase(it);
+		}
+	}
+
+	void loadRhythm(input::RhythmProfile& profile) {
+		profile.features = 0;
+		int features = nstoi(iniData["urhy"].c_str());
+		if (features <= 0 || features > RHYTHM_MAX_FEATURES) return;
+
+		// each feature is stored as a mean,deviation pair in microseconds
+		std::stringstream in(iniData["urhyd"]);
+		for (int i = 0; i < features; i++) {
+			int mean = 0, dev = 0;
+			in >> mean;
+			in.ignore(1);
+			in >> dev;
+			in.ignore(1);
+			profile.mean[i] = mean / 1000.0f;
+			profile.deviation[i] = dev / 1000.0f;
+		}
+		if (!in.fail()) profile.features = features;
+	}
+
+	void saveRhythm(const input::RhythmProfile& profile) {
+		std::stringstream out;
+		for (int i = 0; i < profile.features; i++) {
+			out << (int)(profile.mean[i] * 1000.0f) << ",";
+			out << (int)(profile.deviation[i] * 1000.0f) << ",";
+		}
+		iniData["urhy"] = std::to_string(profile.features);
+		iniData["urhyd"] = out.str();
+	}
+
+	// missing keys keep the default limits; the spread is stored in tenths of key widths
+	void loadMashLimits(input::MashLimits& limits) {
+		if (iniData.find("mwin") != iniData.end())
+			limits.window = nstoi(iniData["mwin"].c_str());
+		if (iniData.find("mkeys") != iniData.end())
+			limits.keys = nstoi(iniData["mkeys"].c_str());
+		if (iniData.find("mpress") != iniData.end())
+			limits.pressed = nstoi(iniData["mpress"].c_str());
+		if (iniData.find("mskeys") != iniData.end())
+			limits.spreadKeys = nstoi(iniData["mskeys"].c_str());
+		if (iniData.find("mspread") != iniData.end())
+			limits.spread = nstoi(iniData["mspread"].c_str()) / 10.0f;
+	}
+
 	// load config data from our config file into iniData
 	bool loadData() {
 		if (iniData.size() > 0) return true;
@@ -104,26 +340,129 @@ namespace {
 
 namespace settings {
 
+	std::string getPluginFolder() {
+		CHAR path[MAX_PATH];
+		DWORD length = GetModuleFileNameA(NULL, path, MAX_PATH);
+		char *name = strrchr(path, '\\');
+		if (length == 0 || length > 200 || name == NULL) return std::string();
+		strcpy(name, APP_PLUGIN_FOLDER);
+
+		// plug-ins run in the process that holds the hooks, so they are only
+		// loaded from a folder that only administrators could have created
+		PSID owner = NULL;
+		PSECURITY_DESCRIPTOR descriptor = NULL;
+		if (GetNamedSecurityInfoA(path, SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION,
+			&owner, NULL, NULL, NULL, &descriptor) != ERROR_SUCCESS) return std::string();
+		bool trusted = IsWellKnownSid(owner, WinBuiltinAdministratorsSid)
+			|| IsWellKnownSid(owner, WinLocalSystemSid);
+		LocalFree(descriptor);
+		return trusted ? std::string(path) : std::string();
+	}
+
+	std::string getTraceFile() {
+		CHAR path[MAX_PATH];
+		SHGetFolderPathA(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, path);
+		if (std::strlen(path) > 200) return std::string();
+		strcat(path, APP_FOLDER_NAME);
+		strcat(path, APP_TRACE_FILE);
+		return std::string(path);
+	}
+
+	std::string getJournalFile() {
+		CHAR path[MAX_PATH];
+		SHGetFolderPathA(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, path);
+		if (std::strlen(path) > 200) return std::string();
+		strcat(path, APP_FOLDER_NAME);
+		CreateDirectoryA(path, NULL);
+		strcat(path, APP_JOURNAL_FILE);
+		return std::string(path);
+	}
+
 	bool loadOptions(state::Options& opts) {
+		std::lock_guard<std::mutex> lock(iniDataMutex);
 		if (!loadData()) return false;
 
-		loadSeq("useq", opts.unlockSeq);
+		// the hashed unlock sequence is dropped if its key cannot be recovered
+		bool migrated = false;
+		if (!loadSecretKey(opts.secretKey) || !loadSecret("useqh", opts.unlockSecret)) {
+			iniData.erase("useqh");
+			migrated = migrateUnlockSeq(opts);
+		}
 		loadSeq("rseq", opts.limitSeq);
 		loadSeq("lseq", opts.lockSeq);
+		loadSeq("tseq", opts.throttleSeq);
 		opts.autoLock = nstoi(iniData["alock"].c_str());
 		opts.statusMode = nstoi(iniData["smode"].c_str());
 		if (opts.statusMode > STATE_STATUS_MAXVALUE)
 			opts.statusMode = STATE_STATUS_MAXVALUE;
+		opts.bufferKeys = nstoi(iniData["bufkeys"].c_str()) != 0;
+		loadGestures(opts.unlockGestures);
+		if (iniData.find("gtol") != iniData.end())
+			opts.gestureTolerance = nstoi(iniData["gtol"].c_str());
+		loadRhythm(opts.unlockRhythm);
+		if (iniData.find("rtol") != iniData.end())
+			opts.rhythmTolerance = nstoi(iniData["rtol"].c_str());
+		opts.mashLock = nstoi(iniData["mash"].c_str()) != 0;
+		loadMashLimits(opts.mashLimits);
+		if (iniData.find("tkeys") != iniData.end())
+			opts.throttleKeys = nstoi(iniData["tkeys"].c_str());
+		if (iniData.find("tclicks") != iniData.end())
+			opts.throttleClicks = nstoi(iniData["tclicks"].c_str());
+		// an invalid list keeps the default keys
+		if (iniData.find("rallow") != iniData.end())
+			opts.limitKeys.parse(iniData["rallow"]);
+		if (iniData.find("inject") != iniData.end())
+			opts.injectPolicy.parse(iniData["inject"]);
+		if (iniData.find("sched") != iniData.end())
+			opts.schedule = iniData["sched"];
+		opts.unlockComposite = loadProtected("ucomp");
+		opts.limitComposite = iniData["rcomp"];
+		opts.lockComposite = iniData["lcomp"];
+		opts.throttleComposite = iniData["tcomp"];
+		opts.limitPattern = iniData["rpat"];
+		opts.lockPattern = iniData["lpat"];
+		opts.throttlePattern = iniData["tpat"];
 
+		if (migrated) {
+			saveSecretKey(opts.secretKey);
+			saveSecret("useqh", opts.unlockSecret);
+			saveData();
+		}
 		return true;
 	}
 
 	bool saveOptions(const state::Options& opts) {
-		saveSeq("useq", opts.unlockSeq);
+		std::lock_guard<std::mutex> lock(iniDataMutex);
+		saveSecretKey(opts.secretKey);
+		saveSecret("useqh", opts.unlockSecret);
 		saveSeq("rseq", opts.limitSeq);
 		saveSeq("lseq", opts.lockSeq);
+		saveSeq("tseq", opts.throttleSeq);
 		iniData["alock"] = std::to_string(opts.autoLock);
 		iniData["smode"] = std::to_string(opts.statusMode);
+		iniData["bufkeys"] = std::to_string((int)opts.bufferKeys);
+		saveGestures(opts.unlockGestures);
+		iniData["gtol"] = std::to_string(opts.gestureTolerance);
+		saveRhythm(opts.unlockRhythm);
+		iniData["rtol"] = std::to_string(opts.rhythmTolerance);
+		iniData["mash"] = std::to_string((int)opts.mashLock);
+		iniData["mwin"] = std::to_string(opts.mashLimits.window);
+		iniData["mkeys"] = std::to_string(opts.mashLimits.keys);
+		iniData["mpress"] = std::to_string(opts.mashLimits.pressed);
+		iniData["mskeys"] = std::to_string(opts.mashLimits.spreadKeys);
+		iniData["mspread"] = std::to_string((int)(opts.mashLimits.spread * 10.0f));
+		iniData["tkeys"] = std::to_string(opts.throttleKeys);
+		iniData["tclicks"] = std::to_string(opts.throttleClicks);
+		iniData["rallow"] = opts.limitKeys.toString();
+		iniData["inject"] = opts.injectPolicy.toString();
+		iniData["sched"] = opts.schedule;
+		saveProtected("ucomp", opts.unlockComposite);
+		iniData["rcomp"] = opts.limitComposite;
+		iniData["lcomp"] = opts.lockComposite;
+		iniData["tcomp"] = opts.throttleComposite;
+		iniData["rpat"] = opts.limitPattern;
+		iniData["lpat"] = opts.lockPattern;
+		iniData["tpat"] = opts.throttlePattern;
 		return saveData();
 	}
 }
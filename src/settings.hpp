@@ -7,4 +7,15 @@ namespace settings {
 	bool loadOptions(state::Options& opts);
 
 	bool saveOptions(const state::Options& opts);
+
+	// Returns the folder that plug-ins are loaded from, the plugins folder next
+	// to the executable, or an empty string if it is missing or not owned by
+	// administrators.
+	std::string getPluginFolder();
+
+	// Returns the path of the file that recorded tracepoints are written to.
+	std::string getTraceFile();
+
+	// Returns the path of the journal of the mode, creating its folder if needed.
+	std::string getJournalFile();
 }
\ No newline at end of file
@@ -1,17 +1,28 @@
 #include "stdafx.h"
 
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "state.hpp"
+#include "handlers.hpp"
 #include "ui.hpp"
+#include "schedule.hpp"
 #include "settings.hpp"
 #include "wininput\keymap.hpp"
+#include "wininput/composite.hpp"
+#include "wininput/journal.hpp"
+#include "wininput/pipeline.hpp"
+#include "wininput/plugins.hpp"
+
+// The number of times the unlock sequence is typed to learn its rhythm.
+#define STATE_RHYTHM_SAMPLES 5
 
 #ifdef _WINXP
 #define GETTICKCOUNT GetTickCount
-#define GTCVAR DWORD
 #else
 #define GETTICKCOUNT GetTickCount64
-#define GTCVAR ULONGLONG
 #endif
 
 namespace {
@@ -20,11 +31,71 @@ namespace {
 	std::atomic<InputState> inputState(InputState::UNLOCKED);
 	std::atomic<EditState> editState(EditState::NONE);
 	Options opts;
-	GTCVAR lastActive;
 
 	std::atomic<int> updating(0);
 	int updateIndex = 0;
 
+	// the unlock sequence, as typed in the options until it is hashed, and
+	// the ID of its secret sequence
+	input::KeyData unlockEdit[Options::MAX_SEQ_LEN];
+	int unlockSeqId = 0;
+
+	// the number of key downs of the composite sequence that unlocks, which
+	// are not replayed
+	int unlockCompositeKeys = 0;
+
+	// guards the options that are updated from the wininput and stroke threads
+	std::mutex optsMutex;
+
+	// loads the options and registers the handlers, see setup and start
+	std::thread loader;
+
+	// the mode is journaled on each change, so that it survives a crash or
+	// restart, see setup
+	input::StateJournal journal;
+	// the mode read from the journal by the loader, applied by start
+	bool restoredJournal = false;
+	InputState restoredMode = InputState::UNLOCKED;
+
+	// the schedule of modes, only followed by the UI thread once loaded, and
+	// the mode it last called for, see applySchedule
+	ScheduleClock scheduleClock;
+	Scheduler scheduler(scheduleClock);
+	InputState scheduledMode = InputState::UNLOCKED;
+
+	// the cold-start timeline, in milliseconds since the process was created
+	std::atomic<unsigned long> startupTimes[STATE_STARTUP_STAGES];
+	std::atomic<bool> recordingGesture(false);
+
+	// rhythm samples are only accessed by the wininput thread, and by the UI
+	// thread once collected, see learnRhythm; training is started and
+	// stopped on the wininput thread, see startRhythmTraining
+	std::atomic<bool> trainingRhythm(false);
+	float rhythmSamples[STATE_RHYTHM_SAMPLES][RHYTHM_MAX_FEATURES];
+	int rhythmSampleCount = 0;
+	int rhythmFeatures = 0;
+
+	// the learned rhythm, only read by the wininput thread, or none if there
+	// is none; changes to opts.unlockRhythm publish a copy, under
+	// rhythmMutex, which then replaces it, and the copies replaced are freed
+	// on the wininput thread once it is between events, see retireRhythms
+	std::atomic<input::RhythmProfile*> rhythmProfile(nullptr);
+	std::vector<input::RhythmProfile*> retiredRhythms;
+	std::mutex rhythmMutex;
+
+	void changeInputState(InputState state, bool trackMods, int stripKeys);
+
+	unsigned long long getTicks() {
+		return GETTICKCOUNT();
+	}
+
+	// the handlers of the modes, called on the wininput thread
+	ModeHandlers handlers(inputState, opts, changeInputState, getTicks);
+
+	// the session and display state, updated by the UI thread, and followed
+	// by the wininput thread, see updateSuspension
+	SessionTracker session;
+
 	// intentionally naive conversion, returns 0 if no conversion can be made
 	int nstoi(const char *p) {
 		int x = 0;
@@ -35,88 +106,317 @@ namespace {
 		return x;
 	}
 
-	inline void changeInputState(InputState state, bool trackMods) {
-		lastActive = GETTICKCOUNT();
-		inputState.store(state);
-		input::trackModifierState(trackMods);
-		ui::updateStatusWindow();
+	// return the number of KeyData in the given sequence
+	int getSequenceLength(const input::KeyData *seq) {
+		int len = 0;
+		while (len < Options::MAX_SEQ_LEN && seq[len].code != 0) ++len;
+		return len;
 	}
 
-	bool keyHandler(input::KeyData& data) {
-		switch (inputState.load()) {
-
-		case InputState::UNLOCKED:
-			if (opts.autoLock > 0) {
-				// autolock check
-				GTCVAR now = GETTICKCOUNT();
-				if (now - lastActive > opts.autoLock * 60000ULL) {
-					changeInputState(InputState::LOCKED, true);
-				}
-				lastActive = now;
-			}
-			return false;
+	void updateSuspension(unsigned);
+	void callOnHookThread(input::hook_call_fn fn, unsigned arg);
 
-		case InputState::LIMITED:
-			if (!data.ctrl && !data.alt) {
-				// allow shift, 0-9, A-Z, various navigation keys
-				if (data.code == VK_LSHIFT || data.code == VK_RSHIFT) return false;
-				if (data.code >= 0x30 && data.code <= 0x5A) return false;
-				if (data.code >= VK_SPACE && data.code <= VK_DOWN) return false;
-			}
+	// the hooks of WinInput and the UI, as changes of mode apply to them
+	class HookPlatform : public ModePlatform {
+	public:
+		void trackModifierState(bool track) override {
+			input::trackModifierState(track);
+		}
+
+		void invalidateKeyVerdicts() override {
+			input::invalidateKeyVerdicts();
+		}
+
+		void setKeyBuffering(bool buffer) override {
+			input::setKeyBuffering(buffer);
+		}
+
+		void releaseKeyBuffer(bool replay, int stripKeys) override {
+			input::releaseKeyBuffer(replay, stripKeys);
+		}
+
+		bool isSuspended() override {
+			return input::isSuspended();
+		}
+
+		void resume() override {
+			input::resume();
+		}
+
+		void suspend() override {
+			callOnHookThread(updateSuspension, 0);
+		}
 
-		case InputState::LOCKED:
-			// allow ctrl, shift, alt keyup
-			if (data.type == INPUT_TYPE_KEYUP 
-				&& data.code >= VK_LSHIFT && data.code <= VK_RMENU) return false;
+		void postStatusUpdate() override {
+			ui::postStatusUpdate();
 		}
-		return true;
+	};
+
+	HookPlatform platform;
+	ModeSwitch modeSwitch(inputState, opts, handlers, session, journal, platform);
+
+	void changeInputState(InputState state, bool trackMods, int stripKeys = 0) {
+		modeSwitch.change(state, trackMods, stripKeys);
 	}
 
-	// if Limited/Locked -> block all mouse input
-	bool mouseHandler(input::MouseData& data) {
-		if (inputState.load() == InputState::UNLOCKED) {
-			if (opts.autoLock > 0 && data.code != WM_MOUSEMOVE) {
-				// autolock check
-				GTCVAR now = GETTICKCOUNT();
-				if (now - lastActive > opts.autoLock * 60000ULL) {
-					changeInputState(InputState::LOCKED, true);
-				}
-				lastActive = now;
+	// run the given function on the wininput thread, between input events,
+	// since the handlers change the mode and the state kept with it without
+	// locks; it is run at once if the wininput thread has yet to be created
+	void callOnHookThread(input::hook_call_fn fn, unsigned arg) {
+		if (!input::postHookCall(fn, arg)) fn(arg);
+	}
+
+	// reapply the current mode, which restarts the autolock period
+	void refreshInputState(unsigned) {
+		InputState state = inputState.load();
+		changeInputState(state, state != InputState::UNLOCKED);
+	}
+
+	// suspend or reinstall the hooks as the session state and the mode call
+	// for, on the wininput thread, where the mode cannot change meanwhile
+	void updateSuspension(unsigned) {
+		switch (session.getAction(inputState.load(), input::isSuspended())) {
+		case HookAction::SUSPEND:
+			INPUT_TRACEPOINT(INPUT_SUSPENDED);
+			input::suspend();
+			break;
+		case HookAction::RESUME:
+			INPUT_TRACEPOINT(INPUT_RESUMED);
+			// the user is present again, so restart the autolock period; the
+			// hooks are reinstalled once this returns, in the reapplied mode
+			input::resume();
+			refreshInputState(0);
+
+#ifdef _WININPUT_TRACE
+			if (input::tracepointsEnabled()) {
+				input::HookStats stats = input::getHookStats();
+				INPUT_TRACEPOINT(HOOK_STATS, stats.hookTime, stats.events, stats.suspendedTime,
+					stats.wakeupsSaved, stats.repeatsCached, stats.repeats);
 			}
-			return false;
-		} else {
-			return true;
+#endif
+			break;
+		case HookAction::NONE:
+			break;
+		}
+	}
+
+	bool keyHandler(input::KeyData& data) {
+		return handlers.key(data);
+	}
+
+	bool throttleKeyHandler(input::KeyData& data) {
+		return handlers.throttleKey(data);
+	}
+
+	// input injected by other processes is passed or blocked by its tag alone
+	bool injectedHandler(unsigned long long tag, bool mouse) {
+		return opts.injectPolicy.isBlocked(inputState.load(), tag);
+	}
+
+	bool mouseHandler(input::MouseData& data) {
+		return handlers.mouse(data);
+	}
+
+	// free the rhythm profiles that have been replaced; called on the
+	// wininput thread, which only reads the current one
+	void retireRhythms(unsigned) {
+		std::lock_guard<std::mutex> lock(rhythmMutex);
+		for (input::RhythmProfile *profile : retiredRhythms)
+			delete profile;
+		retiredRhythms.clear();
+	}
+
+	// replace the rhythm profile with a copy of the given one, or with none
+	// if it has no features
+	void publishRhythm(const input::RhythmProfile& profile) {
+		input::RhythmProfile *next = profile.features == 0 ? nullptr : new input::RhythmProfile(profile);
+		input::RhythmProfile *prev = rhythmProfile.exchange(next);
+		if (prev == nullptr) return;
+		{
+			std::lock_guard<std::mutex> lock(rhythmMutex);
+			retiredRhythms.push_back(prev);
+		}
+		callOnHookThread(retireRhythms, 0);
+	}
+
+	// start collecting samples of the unlock rhythm; called on the wininput
+	// thread, which collects them
+	void startRhythmTraining(unsigned) {
+		rhythmSampleCount = 0;
+		trainingRhythm.store(true);
+	}
+
+	// stop collecting samples of the unlock rhythm, dropping those collected;
+	// called on the wininput thread
+	void stopRhythmTraining(unsigned) {
+		trainingRhythm.store(false);
+		rhythmSampleCount = 0;
+	}
+
+	// returns the rhythm features of the sequence of the given length that was just typed
+	int getRhythm(int length, float *features) {
+		input::KeyTiming timings[INPUT_KEYTIMINGS];
+		int count = input::getKeyTimings(timings, length);
+		if (count != length) return 0;
+		return input::extractRhythm(timings, count, features);
+	}
+
+	// learn the rhythm from the samples collected by trainRhythmSample
+	void learnRhythm() {
+		std::lock_guard<std::mutex> lock(optsMutex);
+		if (input::buildRhythmProfile(rhythmSamples, STATE_RHYTHM_SAMPLES, rhythmFeatures, opts.unlockRhythm)) {
+			publishRhythm(opts.unlockRhythm);
+			settings::saveOptions(opts);
 		}
 	}
 
+	// collect a sample of the unlock rhythm, and learn the rhythm once there are enough
+	void trainRhythmSample() {
+		int length = opts.unlockSecret.length;
+		int features = getRhythm(length, rhythmSamples[rhythmSampleCount]);
+		if (features == 0) return;
+		INPUT_TRACEPOINT(RHYTHM_SAMPLE, rhythmSampleCount + 1);
+
+		if (++rhythmSampleCount < STATE_RHYTHM_SAMPLES) return;
+		trainingRhythm.store(false);
+		rhythmSampleCount = 0;
+
+		// learned by the UI, since the options are saved to disk
+		rhythmFeatures = features;
+		ui::postCall(learnRhythm);
+	}
+
+	// returns true if the unlock sequence that was just typed matches the learned rhythm
+	bool checkRhythm() {
+		const input::RhythmProfile *profile = rhythmProfile.load(std::memory_order_acquire);
+		if (profile == nullptr) return true;
+
+		float features[RHYTHM_MAX_FEATURES];
+		int count = getRhythm(opts.unlockSecret.length, features);
+		float score = input::scoreRhythm(*profile, features, count);
+		INPUT_TRACEPOINT(RHYTHM_SCORE, score);
+		return score * 100.0f <= opts.rhythmTolerance;
+	}
+
 	// if Limited/Locked -> set to Unlocked
 	bool unlockSeqHandler() {
-		_Dc("state: Unlock sequence" << std::endl);
-		if (inputState.load() != InputState::UNLOCKED) {
-			changeInputState(InputState::UNLOCKED, false);
-			return true;
+		INPUT_TRACEPOINT(UNLOCK_SEQUENCE);
+		InputState state = inputState.load();
+		if (getSequenceTarget(STATE_KEYSEQ_UNLOCKED, state) == state) {
+			if (trainingRhythm.load() && updating.load() == 0)
+				trainRhythmSample();
+			return false;
 		}
-		return false;
+		return checkRhythm() && handlers.sequence(STATE_KEYSEQ_UNLOCKED, opts.unlockSecret.length);
+	}
+
+	// if Limited/Locked -> set to Unlocked; the key downs of the sequence are
+	// not replayed, and the rhythm only applies to the unlock sequence
+	bool unlockCompositeHandler() {
+		INPUT_TRACEPOINT(UNLOCK_COMPOSITE);
+		return handlers.sequence(STATE_KEYSEQ_UNLOCKED, unlockCompositeKeys);
+	}
+
+	// if Limited/Locked -> set to Unlocked, on the wininput thread once a
+	// stroke has matched an unlock gesture
+	void gestureUnlock(unsigned) {
+		if (inputState.load() == InputState::UNLOCKED) return;
+		INPUT_TRACEPOINT(UNLOCK_GESTURE);
+		changeInputState(InputState::UNLOCKED, false);
+	}
+
+	// record the stroke as an unlock gesture if requested, otherwise
+	// if Limited/Locked and the stroke matches an unlock gesture -> set to Unlocked
+	void strokeHandler(const input::Stroke& stroke) {
+		std::lock_guard<std::mutex> lock(optsMutex);
+		if (recordingGesture.exchange(false)) {
+			INPUT_TRACEPOINT(GESTURE_RECORDED);
+			opts.unlockGestures.push_back(stroke);
+			settings::saveOptions(opts);
+			return;
+		}
+
+		if (inputState.load() == InputState::UNLOCKED) return;
+		float distance;
+		int index = input::matchStroke(stroke, opts.unlockGestures, &distance);
+		INPUT_TRACEPOINT(GESTURE_MATCHED, index, distance);
+		if (index >= 0 && distance * 1000.0f <= opts.gestureTolerance)
+			callOnHookThread(gestureUnlock, 0);
 	}
 
 	// if Unlocked -> set to Limited
 	bool limitSeqHandler() {
-		_Dc("state: Limit sequence" << std::endl);
-		if (inputState.load() == InputState::UNLOCKED && updating.load() == 0) {
-			changeInputState(InputState::LIMITED, true);
-			return true;
-		}
-		return false;
+		INPUT_TRACEPOINT(LIMIT_SEQUENCE);
+		return updating.load() == 0 && handlers.sequence(STATE_KEYSEQ_LIMITED);
 	}
 
-	// if Unlocked/Limited -> set to Locked
+	// if Unlocked -> set to Throttled
+	bool throttleSeqHandler() {
+		INPUT_TRACEPOINT(THROTTLE_SEQUENCE);
+		return updating.load() == 0 && handlers.sequence(STATE_KEYSEQ_THROTTLED);
+	}
+
+	// if Unlocked/Limited/Throttled -> set to Locked
 	bool lockSeqHandler() {
-		_Dc("state: Lock sequence" << std::endl);
-		if (inputState.load() != InputState::LOCKED && updating.load() == 0) {
-			changeInputState(InputState::LOCKED, true);
-			return true;
+		INPUT_TRACEPOINT(LOCK_SEQUENCE);
+		return updating.load() == 0 && handlers.sequence(STATE_KEYSEQ_LOCKED);
+	}
+
+	// run the handler of the sequence of the given type, as if it was typed,
+	// on the wininput thread, see requestMode
+	void runSeqHandler(unsigned type) {
+		switch (type) {
+		case STATE_KEYSEQ_LIMITED:
+			limitSeqHandler();
+			break;
+		case STATE_KEYSEQ_LOCKED:
+			lockSeqHandler();
+			break;
+		case STATE_KEYSEQ_THROTTLED:
+			throttleSeqHandler();
+			break;
+		}
+	}
+
+	// switch from the mode the schedule called for to the one it now calls
+	// for, both packed into arg by applySchedule, on the wininput thread,
+	// where the mode cannot change meanwhile; a window never relaxes a mode
+	// the user chose, and only returns to Unlocked mode if its own mode is
+	// still in effect
+	void changeScheduledMode(unsigned arg) {
+		InputState prev = (InputState)(arg >> 8);
+		InputState target = (InputState)(arg & 0xFF);
+		InputState state = inputState.load();
+		INPUT_TRACEPOINT(SCHEDULE_CHANGED, (int)prev, (int)target, (int)state);
+		if (state != target && (state == prev || getSchedulePriority(target) > getSchedulePriority(state)))
+			changeInputState(target, target == InputState::LIMITED || target == InputState::LOCKED);
+	}
+
+	// switch to the mode the schedule calls for when it changes, and set the
+	// timer for its next change
+	void applySchedule() {
+		InputState target = scheduler.update();
+		InputState prev = scheduledMode;
+		scheduledMode = target;
+		if (target != prev)
+			callOnHookThread(changeScheduledMode, ((unsigned)prev << 8) | (unsigned)target);
+		// the schedule is paused while the user is away, see notifySessionEvent
+		ui::setScheduleTimer(session.isAway() ? -1 : scheduler.wait());
+	}
+
+	// register the composite sequence of the given text, if there is one,
+	// returning the number of its key steps
+	int addComposite(const std::string& text, input::event_handler_fn fn) {
+		if (text.empty()) return 0;
+		std::vector<input::SequenceStep> steps;
+		if (!input::parseCompositeSequence(text, steps) || !input::addCompositeSequence(steps.data(), fn, nullptr)) {
+			INPUT_TRACEPOINT(COMPOSITE_INVALID, text.size());
+			return 0;
 		}
-		return false;
+		int keys = 0;
+		for (const input::SequenceStep& step : steps)
+			if (step.type == INPUT_STEP_KEY) ++keys;
+		return keys;
 	}
 
 	// return the string representation of the given sequence
@@ -129,6 +429,19 @@ namespace {
 		return str;
 	}
 
+	// replace the unlock sequence with the one typed in the options, if any,
+	// keeping only its hash
+	void commitUnlockEdit() {
+		if (unlockEdit[0].code == 0) return;
+
+		std::lock_guard<std::mutex> lock(optsMutex);
+		if (input::makeSecret(opts.secretKey, unlockEdit, opts.unlockSecret)) {
+			input::removeSecretSequence(unlockSeqId);
+			input::addSecretSequence(opts.secretKey, opts.unlockSecret, unlockSeqHandler, &unlockSeqId);
+		}
+		SecureZeroMemory(unlockEdit, sizeof(unlockEdit));
+	}
+
 	void updateKeyData(input::KeyData *seq, unsigned vkCode) {
 		if (updateIndex >= Options::MAX_SEQ_LEN - 1) return;
 
@@ -151,25 +464,129 @@ namespace {
 namespace state {
 
 	void setup() {
-		lastActive = GETTICKCOUNT();
-
 		// defaults
-		opts.unlockSeq[0] = { 0x41, false, false, false, 3 }; // asdf
-		opts.unlockSeq[1] = { 0x53, false, false, false, 3 };
-		opts.unlockSeq[2] = { 0x44, false, false, false, 3 };
-		opts.unlockSeq[3] = { 0x46, false, false, false, 3 };
 		opts.limitSeq[0] = { 0x52, false, false, true, 3 }; // Alt+R
 		opts.lockSeq[0] = { 0x4C, false, false, true, 3 }; // Alt+L
+		opts.throttleSeq[0] = { 0x54, false, false, true, 3 }; // Alt+T
+
+		// the options are loaded while the UI creates its windows, and the
+		// handlers are registered once they are, since the sequences are read
+		// in place; no input is seen until start installs the hooks
+		loader = std::thread([]() {
+			input::setupCodemap();
+			input::makeSecretKey(opts.secretKey);
+			settings::loadOptions(opts);
+			publishRhythm(opts.unlockRhythm);
+			if (opts.unlockSecret.length == 0) {
+				input::KeyData unlockSeq[] = {
+					{ 0x41, false, false, false, 3 }, // asdf
+					{ 0x53, false, false, false, 3 },
+					{ 0x44, false, false, false, 3 },
+					{ 0x46, false, false, false, 3 },
+					{ 0, false, false, false, 3 }
+				};
+				input::makeSecret(opts.secretKey, unlockSeq, opts.unlockSecret);
+			}
+			handlers.setThrottleRates(opts.throttleKeys, opts.throttleClicks);
+			if (!scheduler.load(opts.schedule))
+				INPUT_TRACEPOINT(SCHEDULE_INVALID);
+
+			// read the mode from before a crash or restart, which start
+			// applies on the UI thread, so that the hooks go live in it
+			auto restoreStart = std::chrono::steady_clock::now();
+			unsigned char restored;
+			if (journal.open(settings::getJournalFile(), restored)
+				&& restored <= (unsigned char)InputState::THROTTLED) {
+				restoredJournal = true;
+				restoredMode = (InputState)restored;
+				INPUT_TRACEPOINT(JOURNAL_RESTORED, restored,
+					std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::steady_clock::now() - restoreStart).count());
+			}
+
+			// add input handlers
+			// plug-ins see input before the handlers of the current mode
+			int plugins = input::loadPlugins(settings::getPluginFolder());
+			INPUT_TRACEPOINT(PLUGINS_LOADED, plugins);
+			input::setKeyPipeline<input::KeyStage<input::runKeyPlugins>,
+				input::KeyStage<keyHandler>, input::RepeatKeyStage<throttleKeyHandler>>();
+			input::setMousePipeline<input::runMousePlugins, mouseHandler>();
+			input::setInjectedHandler(injectedHandler);
+			input::addSecretSequence(opts.secretKey, opts.unlockSecret, unlockSeqHandler, &unlockSeqId);
+			input::addKeySequence(opts.limitSeq, true, limitSeqHandler, nullptr);
+			input::addKeySequence(opts.lockSeq, true, lockSeqHandler, nullptr);
+			input::addKeySequence(opts.throttleSeq, true, throttleSeqHandler, nullptr);
+			unlockCompositeKeys = addComposite(opts.unlockComposite, unlockCompositeHandler);
+			addComposite(opts.limitComposite, limitSeqHandler);
+			addComposite(opts.lockComposite, lockSeqHandler);
+			addComposite(opts.throttleComposite, throttleSeqHandler);
+			if (!opts.limitPattern.empty())
+				input::addKeyPattern(opts.limitPattern.c_str(), limitSeqHandler, nullptr);
+			if (!opts.lockPattern.empty())
+				input::addKeyPattern(opts.lockPattern.c_str(), lockSeqHandler, nullptr);
+			if (!opts.throttlePattern.empty())
+				input::addKeyPattern(opts.throttlePattern.c_str(), throttleSeqHandler, nullptr);
+
+			// strokes are only tracked if they can be used to unlock
+			if (!opts.unlockGestures.empty())
+				input::setStrokeHandler(strokeHandler);
+			markStartup(STATE_STARTUP_CONFIG);
+		});
+	}
 
-		// add input handlers
-		input::addKeyHandler(keyHandler);
-		input::addMouseHandler(mouseHandler);
-		input::addKeySequence(opts.unlockSeq, true, unlockSeqHandler, nullptr);
-		input::addKeySequence(opts.limitSeq, true, limitSeqHandler, nullptr);
-		input::addKeySequence(opts.lockSeq, true, lockSeqHandler, nullptr);
+	bool start() {
+		if (loader.joinable()) loader.join();
+		// the hooks go live in the restored mode, or the scheduled one if
+		// stricter; only changes from then on are journaled
+		if (restoredJournal)
+			changeInputState(restoredMode, restoredMode == InputState::LIMITED || restoredMode == InputState::LOCKED);
+		journal.start();
+		applySchedule();
+		bool res = input::start();
+		markStartup(STATE_STARTUP_HOOKS);
+		return res;
+	}
+
+	void shutdown() {
+		if (loader.joinable()) loader.join();
+		// plug-ins can only be unloaded once the hooks are removed
+		input::shutdown();
+		input::unloadPlugins();
+		journal.stop();
+#ifdef _WININPUT_TRACE
+		if (input::tracepointsEnabled()) {
+			input::JournalStats stats = journal.getStats();
+			INPUT_TRACEPOINT(JOURNAL_STATS, stats.written, stats.recorded, stats.syncs, stats.bytes,
+				stats.compactions, stats.written ? stats.durableTime / stats.written : 0);
+		}
+#endif
+	}
+
+	void requestMode(int type) {
+		callOnHookThread(runSeqHandler, (unsigned)type);
+	}
+
+	void notifyScheduleTimer() {
+		applySchedule();
+	}
 
-		input::setupCodemap();
-		settings::loadOptions(opts);
+	void markStartup(int stage) {
+		FILETIME creation, exit, kernel, user, now;
+		if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return;
+		GetSystemTimeAsFileTime(&now);
+		ULARGE_INTEGER from, to;
+		from.LowPart = creation.dwLowDateTime;
+		from.HighPart = creation.dwHighDateTime;
+		to.LowPart = now.dwLowDateTime;
+		to.HighPart = now.dwHighDateTime;
+		startupTimes[stage].store((unsigned long)((to.QuadPart - from.QuadPart) / 10000));
+
+		if (stage != STATE_STARTUP_UI) return;
+		unsigned long total = startupTimes[STATE_STARTUP_UI].load();
+		INPUT_TRACEPOINT(STARTUP_TIMELINE, startupTimes[STATE_STARTUP_CONFIG].load(),
+			startupTimes[STATE_STARTUP_HOOKS].load(), total);
+		if (total > STATE_STARTUP_BUDGET)
+			INPUT_TRACEPOINT(STARTUP_OVER_BUDGET, total, STATE_STARTUP_BUDGET);
 	}
 
 	std::string getAutoLock() {
@@ -180,6 +597,10 @@ namespace state {
 		return opts.statusMode;
 	}
 
+	bool getBufferKeys() {
+		return opts.bufferKeys;
+	}
+
 	std::string setAutoLock(std::string val) {
 		opts.autoLock = nstoi(val.c_str());
 		return std::to_string(opts.autoLock);
@@ -194,6 +615,41 @@ namespace state {
 		return opts.statusMode;
 	}
 
+	bool setBufferKeys(bool buffer) {
+		opts.bufferKeys = buffer;
+		return opts.bufferKeys;
+	}
+
+	std::string getThrottleKeys() {
+		return std::to_string(opts.throttleKeys);
+	}
+
+	std::string getThrottleClicks() {
+		return std::to_string(opts.throttleClicks);
+	}
+
+	std::string setThrottleKeys(std::string val) {
+		opts.throttleKeys = nstoi(val.c_str());
+		handlers.setThrottleRates(opts.throttleKeys, opts.throttleClicks);
+		return std::to_string(opts.throttleKeys);
+	}
+
+	std::string setThrottleClicks(std::string val) {
+		opts.throttleClicks = nstoi(val.c_str());
+		handlers.setThrottleRates(opts.throttleKeys, opts.throttleClicks);
+		return std::to_string(opts.throttleClicks);
+	}
+
+	bool getMashLock() {
+		return opts.mashLock;
+	}
+
+	bool setMashLock(bool lock) {
+		if (lock && !opts.mashLock) handlers.resetMashing();
+		opts.mashLock = lock;
+		return opts.mashLock;
+	}
+
 	bool isUnlocked() {
 		return inputState.load() == InputState::UNLOCKED;
 	}
@@ -202,22 +658,77 @@ namespace state {
 		return inputState.load();
 	}
 
+	void recordGesture() {
+		recordingGesture.store(true);
+		input::setStrokeHandler(strokeHandler);
+	}
+
+	void clearGestures() {
+		input::setStrokeHandler(nullptr);
+		recordingGesture.store(false);
+
+		std::lock_guard<std::mutex> lock(optsMutex);
+		opts.unlockGestures.clear();
+		settings::saveOptions(opts);
+	}
+
+	int getGestureCount() {
+		std::lock_guard<std::mutex> lock(optsMutex);
+		return (int)opts.unlockGestures.size();
+	}
+
+	void trainRhythm() {
+		callOnHookThread(startRhythmTraining, 0);
+	}
+
+	void clearRhythm() {
+		callOnHookThread(stopRhythmTraining, 0);
+
+		std::lock_guard<std::mutex> lock(optsMutex);
+		opts.unlockRhythm.features = 0;
+		publishRhythm(opts.unlockRhythm);
+		settings::saveOptions(opts);
+	}
+
+	bool hasRhythm() {
+		return rhythmProfile.load() != nullptr;
+	}
+
+	void notifySessionEvent(SessionEvent evt) {
+		bool wasAway = session.isAway();
+		session.update(evt);
+		callOnHookThread(updateSuspension, 0);
+
+		// nothing is shown while the user is away, and the schedule catches
+		// up on their return
+		if (session.isAway() && !wasAway)
+			ui::setScheduleTimer(-1);
+		else if (!session.isAway() && wasAway)
+			applySchedule();
+	}
+
 	void notifyInputUpdate(int type) {
-		updating.store(type);
+		if (updating.exchange(type) == STATE_KEYSEQ_UNLOCKED)
+			commitUnlockEdit();
 		updateIndex = 0;
 
-		if (type == STATE_KEYSEQ_NONE)
+		if (type == STATE_KEYSEQ_NONE) {
+			std::lock_guard<std::mutex> lock(optsMutex);
 			settings::saveOptions(opts);
+		}
 	}
 
 	std::string getSequence(int type) {
 		switch (type) {
 		case STATE_KEYSEQ_UNLOCKED:
-			return getSequenceText(opts.unlockSeq);
+			return std::string(updating.load() == STATE_KEYSEQ_UNLOCKED && unlockEdit[0].code != 0 ?
+				getSequenceLength(unlockEdit) : opts.unlockSecret.length, '*');
 		case STATE_KEYSEQ_LIMITED:
 			return getSequenceText(opts.limitSeq);
 		case STATE_KEYSEQ_LOCKED:
 			return getSequenceText(opts.lockSeq);
+		case STATE_KEYSEQ_THROTTLED:
+			return getSequenceText(opts.throttleSeq);
 		}
 		return std::string();
 	}
@@ -227,7 +738,14 @@ namespace state {
 			&& vkCode != VK_SHIFT && vkCode != VK_MENU) {
 			switch (type) {
 			case STATE_KEYSEQ_UNLOCKED:
-				updateKeyData(opts.unlockSeq, vkCode);
+				updateKeyData(unlockEdit, vkCode);
+				// the learned rhythm does not apply to a different sequence
+				callOnHookThread(stopRhythmTraining, 0);
+				{
+					std::lock_guard<std::mutex> lock(optsMutex);
+					opts.unlockRhythm.features = 0;
+					publishRhythm(opts.unlockRhythm);
+				}
 				break;
 			case STATE_KEYSEQ_LIMITED:
 				updateKeyData(opts.limitSeq, vkCode);
@@ -235,6 +753,9 @@ namespace state {
 			case STATE_KEYSEQ_LOCKED:
 				updateKeyData(opts.lockSeq, vkCode);
 				break;
+			case STATE_KEYSEQ_THROTTLED:
+				updateKeyData(opts.throttleSeq, vkCode);
+				break;
 			}
 		}
 		return getSequence(type);
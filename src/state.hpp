@@ -1,39 +1,111 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include "policy.hpp"
+#include "session.hpp"
 #include "wininput/wininput.hpp"
+#include "wininput/gesture.hpp"
+#include "wininput/mashing.hpp"
+#include "wininput/rhythm.hpp"
+#include "wininput/secret.hpp"
 
 #define STATE_KEYSEQ_NONE 0
 #define STATE_KEYSEQ_UNLOCKED 1
 #define STATE_KEYSEQ_LIMITED 2
 #define STATE_KEYSEQ_LOCKED 3
+#define STATE_KEYSEQ_THROTTLED 4
 #define STATE_STATUS_SHOWALWAYS 0
 #define STATE_STATUS_HIDEWHENUNLOCKED 1
 #define STATE_STATUS_HIDEALWAYS 2
 #define STATE_STATUS_MAXVALUE 2
+// The stages of the cold-start timeline, see markStartup.
+#define STATE_STARTUP_CONFIG 0
+#define STATE_STARTUP_HOOKS 1
+#define STATE_STARTUP_UI 2
+#define STATE_STARTUP_STAGES 3
+// The target time from process creation until the UI is shown, in milliseconds.
+#define STATE_STARTUP_BUDGET 500
 
 namespace state {
 
-	enum class InputState { UNLOCKED, LIMITED, LOCKED };
-	enum class EditState { NONE, UNLOCKSEQ, LIMITSEQ, LOCKSEQ };
+	enum class EditState { NONE, UNLOCKSEQ, LIMITSEQ, LOCKSEQ, THROTTLESEQ };
 
 	class Options {
 	public:
 		static const int MAX_SEQ_LEN = 11;
-		input::KeyData unlockSeq[MAX_SEQ_LEN];
+		input::SecretKey secretKey; // Key that the unlock sequence is hashed under.
+		input::SecretSequence unlockSecret; // The unlock sequence, only kept hashed.
 		input::KeyData limitSeq[MAX_SEQ_LEN];
 		input::KeyData lockSeq[MAX_SEQ_LEN];
+		input::KeyData throttleSeq[MAX_SEQ_LEN];
 		int autoLock = 0; // In minutes, where 0 = disabled.
 		int statusMode = STATE_STATUS_SHOWALWAYS;
+		bool bufferKeys = false; // Replay keys blocked in Restricted mode on unlock.
+		std::vector<input::Stroke> unlockGestures;
+		int gestureTolerance = 20; // Max distance to an unlock gesture, in thousandths.
+		input::RhythmProfile unlockRhythm; // Typing rhythm of the unlock sequence.
+		int rhythmTolerance = 250; // Max score of the unlock rhythm, in hundredths.
+		bool mashLock = false; // Switch to Locked mode when the keyboard is mashed.
+		input::MashLimits mashLimits;
+		int throttleKeys = 5; // Keystrokes allowed per second in Throttled mode.
+		int throttleClicks = 2; // Mouse clicks allowed per second in Throttled mode.
+		KeySet limitKeys; // Keys allowed in Restricted mode, without ctrl or alt.
+		InjectionPolicy injectPolicy; // Modes allowing input injected by other processes, by tag.
+		std::string schedule; // Modes scheduled by the time of day, see schedule.hpp.
+		// Composite sequences of keys and clicks switching to each mode, see
+		// composite.hpp; the one that unlocks is kept protected in conf.ini.
+		std::string unlockComposite;
+		std::string limitComposite;
+		std::string lockComposite;
+		std::string throttleComposite;
+		// Key patterns switching to each mode, see KeyPattern in keypattern.hpp.
+		std::string limitPattern;
+		std::string lockPattern;
+		std::string throttlePattern;
+
+		Options() {
+			limitKeys.parse(POLICY_DEFAULT_LIMIT_KEYS);
+		}
 
-		Options() {}
 		Options(const Options&) = delete;
 		Options& operator=(const Options&) = delete;
 	};
 
-	// Used by main.cpp; sets up input handling, and loads user settings.
+	// Used by main.cpp; starts loading user settings and registering the
+	// input handlers in the background, so that the UI can be created
+	// meanwhile. Input is not handled until start is called.
 	void setup();
 
+	// Used by ui.cpp; waits for setup to finish, applies the mode restored
+	// from the journal, then installs the hooks, so that they go live with
+	// the user's sequences in place. Should be called on the thread of the
+	// UI once the status window is created, and before the user settings
+	// are read by the UI.
+	// Returns true if successful, and false if otherwise.
+	bool start();
+
+	// Used by ui.cpp; switches modes as if the sequence of the given type,
+	// one of STATE_KEYSEQ_[X] other than STATE_KEYSEQ_UNLOCKED, was typed,
+	// such as when asked by another launch of Padlock. The mode is changed
+	// on the thread of the hooks, without waiting for it.
+	void requestMode(int type);
+
+	// Used by ui.cpp; follows the schedule of modes when the timer set with
+	// ui::setScheduleTimer fires, or when the clock may have changed, such as
+	// on resuming from sleep.
+	void notifyScheduleTimer();
+
+	// Used by main.cpp; removes the hooks, unloads the plug-ins, writes the
+	// changes of mode that are not yet durable, and stops the journal of the
+	// mode. Should be called once the UI exits.
+	void shutdown();
+
+	// Record the time a stage of startup, one of STATE_STARTUP_[X], was
+	// reached. Once the UI is shown, the timeline is traced, along with a
+	// warning if it took longer than STATE_STARTUP_BUDGET.
+	void markStartup(int stage);
+
 	// Get the time, in minutes, of inactivity before automatically switching
 	// to Locked mode. If this value is 0, autolock is disabled.
 	std::string getAutoLock();
@@ -41,25 +113,75 @@ namespace state {
 	// Get the current setting regarding when the status box should be shown.
 	int getStatusMode();
 
+	// Returns true if keys blocked in Restricted mode are replayed on unlock.
+	bool getBufferKeys();
+
+	// Returns true if Locked mode is entered when the keyboard is mashed.
+	bool getMashLock();
+
+	// Get the number of keystrokes allowed per second in Throttled mode.
+	std::string getThrottleKeys();
+
+	// Get the number of mouse clicks allowed per second in Throttled mode.
+	std::string getThrottleClicks();
+
 	// Sets the autolock value and returns the updated value.
 	std::string setAutoLock(std::string val);
 
 	// Sets the status box setting and returns the updated value.
 	int setStatusMode(int mode);
 
+	// Sets whether keys blocked in Restricted mode are replayed on unlock.
+	bool setBufferKeys(bool buffer);
+
+	// Sets whether Locked mode is entered when the keyboard is mashed.
+	bool setMashLock(bool lock);
+
+	// Sets the keystrokes allowed per second in Throttled mode and returns the updated value.
+	std::string setThrottleKeys(std::string val);
+
+	// Sets the mouse clicks allowed per second in Throttled mode and returns the updated value.
+	std::string setThrottleClicks(std::string val);
+
 	// Returns true if in Unlocked mode (all inputs allowed).
 	bool isUnlocked();
 
 	// Get the current mode as an InputState enum.
 	InputState getInputState();
 
+	// Record the next stroke drawn with the left mouse button as an unlock gesture.
+	void recordGesture();
+
+	// Remove all recorded unlock gestures.
+	void clearGestures();
+
+	// Returns the number of recorded unlock gestures.
+	int getGestureCount();
+
+	// Learn the typing rhythm of the unlock sequence from the next few times it is
+	// typed. Once learned, the unlock sequence only unlocks if typed with that rhythm.
+	void trainRhythm();
+
+	// Remove the learned typing rhythm of the unlock sequence.
+	void clearRhythm();
+
+	// Returns true if a typing rhythm of the unlock sequence has been learned.
+	bool hasRhythm();
+
+	// Notify of a change in the session or display state. In Unlocked mode,
+	// input handling is suspended while the session is locked or disconnected,
+	// or the display is off, and is restored once both are active again or the
+	// mode changes. The schedule of modes is paused meanwhile in every mode.
+	void notifySessionEvent(SessionEvent evt);
+
 	// Specify the sequence to be updated in following calls to updateSequence
 	// and resets the internal index that tracks which KeyData in the sequence
 	// to update next.
 	// Type should be one of STATE_KEYSEQ_[X].
 	void notifyInputUpdate(int type);
 
-	// Return a string representation of the sequence specified by type.
+	// Return a string representation of the sequence specified by type. The
+	// unlock sequence is only known while it is being typed, and is masked.
 	// Type should be one of STATE_KEYSEQ_[X].
 	std::string getSequence(int type);
 
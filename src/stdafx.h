@@ -12,17 +12,9 @@
 #include <windows.h>
 
 
-#include <iostream>
-
 #define APP_NAME L"Padlock"
 #define APP_VERSION L"1.12"
 
-//#define _PADLOCK_DEBUG
-
-#ifdef _PADLOCK_DEBUG
-#define _D(x) x
-#define _Dc(x) std::cout << x
-#else
-#define _D(x)
-#define _Dc(x)
-#endif
+// tracepoints are compiled in when _WININPUT_TRACE is defined, as in the
+// Debug configurations, and recorded when started with /trace
+#include "wininput/tracepoint.hpp"
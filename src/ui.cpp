@@ -2,26 +2,41 @@
 #include "Resource.h"
 #include <Commctrl.h>
 #include <shellapi.h>
+#include <WtsApi32.h>
+#include <algorithm>
 
 #include "ui.hpp"
 #include "state.hpp"
+#include "wininput\keymap.hpp"
 
 #define UI_TRAYICON_UID 0x400
 #define UI_TRAYICON_MSGID 0x410
+#define UI_STATUSUPDATE_MSGID 0x411
+#define UI_CALL_MSGID 0x412
+#define UI_SCHEDULE_TIMER_ID 0x420
+// The COPYDATASTRUCT.dwData of an intent sent by another launch, and the time
+// it waits for the window of the running instance, in milliseconds.
+#define UI_INTENT_COPYDATA 0x504C4931
+#define UI_INTENT_TIMEOUT 3000
+#define UI_INTENT_RETRY 50
 #define UI_POPUPMENUITEM_SHOW_ID 0x05
 #define UI_POPUPMENUITEM_EXIT_ID 0x06
+#define UI_POPUPMENUITEM_RECORDGESTURE_ID 0x07
+#define UI_POPUPMENUITEM_CLEARGESTURES_ID 0x08
+#define UI_POPUPMENUITEM_TRAINRHYTHM_ID 0x09
+#define UI_POPUPMENUITEM_CLEARRHYTHM_ID 0x0A
 
 using state::InputState;
 
 namespace {
 	RECT workArea;
 	RECT statusWndSize = { 0, 0, 76, 18 };
-	RECT optionsWndSize = { 0, 0, 430, 239 };
+	RECT optionsWndSize = { 0, 0, 430, 367 };
 
 	WCHAR appTitle[51] = L"";
 	const WCHAR statusWndClass[] = L"pl_status";
 	const WCHAR optionsWndClass[] = L"pl_options";
-	const WCHAR *statusTexts[] = { L"Default", L"Restricted", L"Locked" };
+	const WCHAR *statusTexts[] = { L"Default", L"Restricted", L"Locked", L"Throttled" };
 	const WCHAR *statusModeOptions[] = { L"Always show", L"Hide when unlocked", L"Always hide" };
 
 	HINSTANCE hInst;
@@ -30,8 +45,13 @@ namespace {
 	HWND tbUnlock;
 	HWND tbLimit;
 	HWND tbLock;
+	HWND tbThrottle;
 	HWND tbAutoLock;
 	HWND cbStatusMode;
+	HWND chkBufferKeys;
+	HWND chkMashLock;
+	HWND tbThrottleKeys;
+	HWND tbThrottleClicks;
 	HWND hTooltipWnd;
 
 	HFONT hFont;
@@ -40,6 +60,29 @@ namespace {
 	void createTrayIcon(bool update = false);
 	void showStatusWindow();
 
+	// carry out an intent, given on the command line of this launch or
+	// passed by another one, see ui::sendIntent
+	void applyIntent(int intent) {
+		switch (intent) {
+		case UI_INTENT_SHOW:
+			// the options window is created once the hooks are live
+			if (state::isUnlocked() && hOptionsWnd != NULL) {
+				ShowWindow(hOptionsWnd, SW_SHOW);
+				SetForegroundWindow(hOptionsWnd);
+			}
+			break;
+		case UI_INTENT_RESTRICT:
+			state::requestMode(STATE_KEYSEQ_LIMITED);
+			break;
+		case UI_INTENT_LOCK:
+			state::requestMode(STATE_KEYSEQ_LOCKED);
+			break;
+		case UI_INTENT_THROTTLE:
+			state::requestMode(STATE_KEYSEQ_THROTTLED);
+			break;
+		}
+	}
+
 	inline void repaintStatusWnd(const HWND& hWnd) {
 		PAINTSTRUCT ps;
 		HDC hdc = BeginPaint(hWnd, &ps);
@@ -64,8 +107,14 @@ namespace {
 		TextOut(hdc, 22, 26, L"Unlock sequence:", 16);
 		TextOut(hdc, 22, 59, L"Restrict sequence:", 18);
 		TextOut(hdc, 22, 91, L"Lock sequence:", 14);
-		TextOut(hdc, 22, 123, L"Autolock (minutes):", 19);
-		TextOut(hdc, 22, 155, L"Status box:", 11);
+		TextOut(hdc, 22, 123, L"Throttle sequence:", 18);
+		TextOut(hdc, 22, 155, L"Autolock (minutes):", 19);
+		TextOut(hdc, 22, 187, L"Status box:", 11);
+		TextOut(hdc, 22, 219, L"Restricted mode:", 16);
+		TextOut(hdc, 22, 251, L"Mashing:", 8);
+		TextOut(hdc, 22, 283, L"Throttled mode:", 15);
+		TextOut(hdc, 186, 283, L"keys/s", 6);
+		TextOut(hdc, 316, 283, L"clicks/s", 8);
 
 		SelectObject(hdc, hOldFont);
 		EndPaint(hWnd, &ps);
@@ -75,6 +124,9 @@ namespace {
 	LRESULT CALLBACK statusWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
 		static UINT taskbarCreatedMsgId;
 		static HMENU hMenu;
+#ifndef _WINXP
+		static HPOWERNOTIFY hPowerNotify;
+#endif
 
 		switch (message) {
 		case UI_TRAYICON_MSGID:
@@ -99,6 +151,14 @@ namespace {
 			}
 			break;
 
+		case UI_STATUSUPDATE_MSGID:
+			ui::updateStatusWindow();
+			break;
+		case UI_CALL_MSGID:
+			// calls posted by postCall, from threads that should not block
+			((void(*)())wParam)();
+			break;
+
 		case WM_EXITMENULOOP:
 			// hide status window when popup menu is closed, if necessary
 			if (state::isUnlocked() && state::getStatusMode() != STATE_STATUS_SHOWALWAYS)
@@ -115,6 +175,22 @@ namespace {
 				if (state::isUnlocked())
 					DestroyWindow(hWnd);
 				break;
+			case UI_POPUPMENUITEM_RECORDGESTURE_ID:
+				if (state::isUnlocked())
+					state::recordGesture();
+				break;
+			case UI_POPUPMENUITEM_CLEARGESTURES_ID:
+				if (state::isUnlocked())
+					state::clearGestures();
+				break;
+			case UI_POPUPMENUITEM_TRAINRHYTHM_ID:
+				if (state::isUnlocked())
+					state::trainRhythm();
+				break;
+			case UI_POPUPMENUITEM_CLEARRHYTHM_ID:
+				if (state::isUnlocked())
+					state::clearRhythm();
+				break;
 			}
 			return 0;
 		case WM_SETTINGCHANGE:
@@ -123,22 +199,90 @@ namespace {
 			SetWindowPos(hStatusWnd, NULL, workArea.right - statusWndSize.right, 
 				workArea.bottom - statusWndSize.bottom, 0, 0, SWP_NOSIZE);
 			return 0;
+		case WM_WTSSESSION_CHANGE:
+			// input handling may be suspended while the session is locked or
+			// disconnected, see state::notifySessionEvent
+			switch (wParam) {
+			case WTS_SESSION_LOCK:
+			case WTS_CONSOLE_DISCONNECT:
+			case WTS_REMOTE_DISCONNECT:
+				state::notifySessionEvent(state::SessionEvent::LOCKED);
+				break;
+			case WTS_SESSION_UNLOCK:
+			case WTS_CONSOLE_CONNECT:
+			case WTS_REMOTE_CONNECT:
+				state::notifySessionEvent(state::SessionEvent::UNLOCKED);
+				break;
+			}
+			return 0;
+		case WM_POWERBROADCAST:
+			// timers do not fire during sleep, so the schedule catches up on resuming
+			if (wParam == PBT_APMRESUMEAUTOMATIC)
+				state::notifyScheduleTimer();
+#ifndef _WINXP
+			// or while the display is off
+			if (wParam == PBT_POWERSETTINGCHANGE) {
+				POWERBROADCAST_SETTING *setting = (POWERBROADCAST_SETTING*)lParam;
+				if (setting->DataLength == sizeof(DWORD)) {
+					DWORD displayState = *(DWORD*)setting->Data;
+					state::notifySessionEvent(displayState == 0 ?
+						state::SessionEvent::DISPLAY_OFF : state::SessionEvent::DISPLAY_ON);
+				}
+			}
+#endif
+			return TRUE;
+		case WM_COPYDATA:
+			// an intent passed by another launch, see sendIntent
+			{
+				COPYDATASTRUCT *data = (COPYDATASTRUCT*)lParam;
+				if (data->dwData != UI_INTENT_COPYDATA || data->cbData != sizeof(int)) return FALSE;
+				int intent = *(int*)data->lpData;
+				INPUT_TRACEPOINT(UI_INTENT, intent);
+				applyIntent(intent);
+			}
+			return TRUE;
+		case WM_TIMER:
+			if (wParam == UI_SCHEDULE_TIMER_ID)
+				state::notifyScheduleTimer();
+			return 0;
+		case WM_TIMECHANGE:
+			// the next change of the schedule moves with the clock
+			state::notifyScheduleTimer();
+			return 0;
 		case WM_CREATE:
 			// create popup menu for tray icon
 			hMenu = CreatePopupMenu();
 			AppendMenu(hMenu, MF_STRING, UI_POPUPMENUITEM_SHOW_ID, TEXT("Settings"));
+			AppendMenu(hMenu, MF_STRING, UI_POPUPMENUITEM_RECORDGESTURE_ID, TEXT("Record unlock gesture"));
+			AppendMenu(hMenu, MF_STRING, UI_POPUPMENUITEM_CLEARGESTURES_ID, TEXT("Clear unlock gestures"));
+			AppendMenu(hMenu, MF_STRING, UI_POPUPMENUITEM_TRAINRHYTHM_ID, TEXT("Learn unlock rhythm"));
+			AppendMenu(hMenu, MF_STRING, UI_POPUPMENUITEM_CLEARRHYTHM_ID, TEXT("Clear unlock rhythm"));
 			AppendMenu(hMenu, MF_STRING, UI_POPUPMENUITEM_EXIT_ID, TEXT("Exit"));
 
 			// receive notification when taskbar is recreated
 			taskbarCreatedMsgId = RegisterWindowMessageA("TaskbarCreated");
 
+			// receive notification when the session is locked or the display turns off
+			WTSRegisterSessionNotification(hWnd, NOTIFY_FOR_THIS_SESSION);
+#ifndef _WINXP
+			hPowerNotify = RegisterPowerSettingNotification(hWnd,
+				&GUID_CONSOLE_DISPLAY_STATE, DEVICE_NOTIFY_WINDOW_HANDLE);
+
+			// intents can come from a launch that is not elevated, and can
+			// only make the mode stricter, see sendIntent
+			ChangeWindowMessageFilterEx(hWnd, WM_COPYDATA, MSGFLT_ALLOW, NULL);
+#endif
 			break;
 		case WM_PAINT:
-			_Dc("uis: Repainting" << std::endl);
+			INPUT_TRACEPOINT(STATUS_REPAINT);
 			repaintStatusWnd(hWnd);
 			return 0;
 		case WM_DESTROY:
-			_Dc("uis: Quitting" << std::endl);
+			INPUT_TRACEPOINT(UI_QUIT);
+			WTSUnRegisterSessionNotification(hWnd);
+#ifndef _WINXP
+			UnregisterPowerSettingNotification(hPowerNotify);
+#endif
 			PostQuitMessage(0);
 			return 0;
 		}
@@ -194,6 +338,11 @@ namespace {
 		return seqTextboxProc(STATE_KEYSEQ_LOCKED, hWnd, message, wParam, lParam);
 	}
 
+	LRESULT CALLBACK tbThrottleProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam,
+		UINT_PTR uIdSubclass, DWORD_PTR dwRefData) {
+		return seqTextboxProc(STATE_KEYSEQ_THROTTLED, hWnd, message, wParam, lParam);
+	}
+
 	LRESULT CALLBACK optionsWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
 		switch (message) {
 		case WM_MOUSEMOVE:
@@ -207,14 +356,29 @@ namespace {
 		case WM_PAINT:
 			repaintOptionsWnd(hWnd);
 			break;
+		case WM_INPUTLANGCHANGE:
+			// name the keys of the sequences by the new layout
+			input::notifyLayoutChange((unsigned long long)(ULONG_PTR)lParam);
+			SetWindowTextA(tbLimit, state::getSequence(STATE_KEYSEQ_LIMITED).c_str());
+			SetWindowTextA(tbLock, state::getSequence(STATE_KEYSEQ_LOCKED).c_str());
+			SetWindowTextA(tbThrottle, state::getSequence(STATE_KEYSEQ_THROTTLED).c_str());
+			return DefWindowProc(hWnd, message, wParam, lParam);
 		case WM_CLOSE:
 		{
 			// update state, save settings, and hide window
 			CHAR arr[10];
 			GetWindowTextA(tbAutoLock, arr, 10);
 			SetWindowTextA(tbAutoLock, state::setAutoLock(arr).c_str());
+			GetWindowTextA(tbThrottleKeys, arr, 10);
+			SetWindowTextA(tbThrottleKeys, state::setThrottleKeys(arr).c_str());
+			GetWindowTextA(tbThrottleClicks, arr, 10);
+			SetWindowTextA(tbThrottleClicks, state::setThrottleClicks(arr).c_str());
 			int index = (int)SendMessage(cbStatusMode, CB_GETCURSEL, NULL, NULL);
 			SendMessage(cbStatusMode, CB_SETCURSEL, (WPARAM)state::setStatusMode(index), (LPARAM)0);
+			bool buffer = SendMessage(chkBufferKeys, BM_GETCHECK, NULL, NULL) == BST_CHECKED;
+			SendMessage(chkBufferKeys, BM_SETCHECK, (WPARAM)state::setBufferKeys(buffer), (LPARAM)0);
+			bool mashLock = SendMessage(chkMashLock, BM_GETCHECK, NULL, NULL) == BST_CHECKED;
+			SendMessage(chkMashLock, BM_SETCHECK, (WPARAM)state::setMashLock(mashLock), (LPARAM)0);
 			showStatusWindow();
 			state::notifyInputUpdate(STATE_KEYSEQ_NONE);
 			ShowWindow(hWnd, SW_HIDE);
@@ -227,7 +391,8 @@ namespace {
 	}
 
 
-	// create the status window at the bottom right corner of the working area
+	// create the status window at the bottom right corner of the working area,
+	// hidden until showStatusWindow is called
 	bool createStatusWindow(HINSTANCE hInstance) {
 		WNDCLASSEXW wcex;
 
@@ -253,11 +418,7 @@ namespace {
 			statusWndSize.right, statusWndSize.bottom,
 			nullptr, nullptr, hInstance, nullptr);
 
-		if (!hStatusWnd) return false;
-
-		showStatusWindow();
-
-		return true;
+		return hStatusWnd != NULL;
 	}
 
 	// create the options window in the center of the working area
@@ -296,28 +457,51 @@ namespace {
 		tbLock = CreateWindowExA(WS_EX_CLIENTEDGE, "Edit",
 			state::getSequence(STATE_KEYSEQ_LOCKED).c_str(),
 			WS_CHILD | WS_VISIBLE, 120, 88, 270, 22, hOptionsWnd, NULL, NULL, NULL);
+		tbThrottle = CreateWindowExA(WS_EX_CLIENTEDGE, "Edit",
+			state::getSequence(STATE_KEYSEQ_THROTTLED).c_str(),
+			WS_CHILD | WS_VISIBLE, 120, 120, 270, 22, hOptionsWnd, NULL, NULL, NULL);
 		tbAutoLock = CreateWindowExA(WS_EX_CLIENTEDGE, "Edit",
 			state::getAutoLock().c_str(), WS_CHILD | WS_VISIBLE,
-			120, 120, 270, 22, hOptionsWnd, NULL, NULL, NULL);
+			120, 152, 270, 22, hOptionsWnd, NULL, NULL, NULL);
 		cbStatusMode = CreateWindowA("ComboBox", "",
 			CBS_DROPDOWNLIST | CBS_HASSTRINGS | WS_CHILD | WS_OVERLAPPED | WS_VISIBLE,
-			120, 152, 270, 22, hOptionsWnd, NULL, NULL, NULL);
+			120, 184, 270, 22, hOptionsWnd, NULL, NULL, NULL);
 		SendMessage(cbStatusMode, CB_ADDSTRING, NULL, (LPARAM)statusModeOptions[0]);
 		SendMessage(cbStatusMode, CB_ADDSTRING, NULL, (LPARAM)statusModeOptions[1]);
 		SendMessage(cbStatusMode, CB_ADDSTRING, NULL, (LPARAM)statusModeOptions[2]);
 		SendMessage(cbStatusMode, CB_SETCURSEL, (WPARAM)state::getStatusMode(), (LPARAM)0);
+		chkBufferKeys = CreateWindowA("Button", "Replay blocked keys on unlock",
+			BS_AUTOCHECKBOX | WS_CHILD | WS_VISIBLE,
+			120, 216, 270, 22, hOptionsWnd, NULL, NULL, NULL);
+		SendMessage(chkBufferKeys, BM_SETCHECK, (WPARAM)state::getBufferKeys(), (LPARAM)0);
+		chkMashLock = CreateWindowA("Button", "Lock when the keyboard is mashed",
+			BS_AUTOCHECKBOX | WS_CHILD | WS_VISIBLE,
+			120, 248, 270, 22, hOptionsWnd, NULL, NULL, NULL);
+		SendMessage(chkMashLock, BM_SETCHECK, (WPARAM)state::getMashLock(), (LPARAM)0);
+		tbThrottleKeys = CreateWindowExA(WS_EX_CLIENTEDGE, "Edit",
+			state::getThrottleKeys().c_str(), WS_CHILD | WS_VISIBLE,
+			120, 280, 60, 22, hOptionsWnd, NULL, NULL, NULL);
+		tbThrottleClicks = CreateWindowExA(WS_EX_CLIENTEDGE, "Edit",
+			state::getThrottleClicks().c_str(), WS_CHILD | WS_VISIBLE,
+			250, 280, 60, 22, hOptionsWnd, NULL, NULL, NULL);
 
 		// use default system font for controls
 		SendMessage(tbUnlock, WM_SETFONT, (WPARAM)hFont, TRUE);
 		SendMessage(tbLimit, WM_SETFONT, (WPARAM)hFont, TRUE);
 		SendMessage(tbLock, WM_SETFONT, (WPARAM)hFont, TRUE);
+		SendMessage(tbThrottle, WM_SETFONT, (WPARAM)hFont, TRUE);
 		SendMessage(tbAutoLock, WM_SETFONT, (WPARAM)hFont, TRUE);
 		SendMessage(cbStatusMode, WM_SETFONT, (WPARAM)hFont, TRUE);
+		SendMessage(chkBufferKeys, WM_SETFONT, (WPARAM)hFont, TRUE);
+		SendMessage(chkMashLock, WM_SETFONT, (WPARAM)hFont, TRUE);
+		SendMessage(tbThrottleKeys, WM_SETFONT, (WPARAM)hFont, TRUE);
+		SendMessage(tbThrottleClicks, WM_SETFONT, (WPARAM)hFont, TRUE);
 
 		// attach callback function to sequence textboxes
 		SetWindowSubclass(tbUnlock, tbUnlockProc, 0, 0);
 		SetWindowSubclass(tbLimit, tbLimitProc, 0, 0);
 		SetWindowSubclass(tbLock, tbLockProc, 0, 0);
+		SetWindowSubclass(tbThrottle, tbThrottleProc, 0, 0);
 
 		// create tooltip window
 		hTooltipWnd = CreateWindowEx(NULL, TOOLTIPS_CLASS, NULL,
@@ -340,6 +524,8 @@ namespace {
 		SendMessage(hTooltipWnd, TTM_ADDTOOL, 0, (LPARAM)&toolInfo);
 		toolInfo.uId = (UINT_PTR)tbLock;
 		SendMessage(hTooltipWnd, TTM_ADDTOOL, 0, (LPARAM)&toolInfo);
+		toolInfo.uId = (UINT_PTR)tbThrottle;
+		SendMessage(hTooltipWnd, TTM_ADDTOOL, 0, (LPARAM)&toolInfo);
 
 		toolInfo.lpszText = L"Time (in minutes) of inactivity before automatically "
 			"locking. Set to 0 to disable this feature.";
@@ -350,6 +536,23 @@ namespace {
 		toolInfo.uId = (UINT_PTR)cbStatusMode;
 		SendMessage(hTooltipWnd, TTM_ADDTOOL, 0, (LPARAM)&toolInfo);
 
+		toolInfo.lpszText = L"Keep keys blocked in Restricted mode, and send the text typed "
+			"in the last few seconds to the active window after the unlock sequence is typed.";
+		toolInfo.uId = (UINT_PTR)chkBufferKeys;
+		SendMessage(hTooltipWnd, TTM_ADDTOOL, 0, (LPARAM)&toolInfo);
+
+		toolInfo.lpszText = L"Switch to Locked mode when many keys are pressed at "
+			"once or in quick succession, such as by a pet walking over the keyboard.";
+		toolInfo.uId = (UINT_PTR)chkMashLock;
+		SendMessage(hTooltipWnd, TTM_ADDTOOL, 0, (LPARAM)&toolInfo);
+
+		toolInfo.lpszText = L"Keystrokes and mouse clicks allowed per second in "
+			"Throttled mode. Set to 0 to allow any number.";
+		toolInfo.uId = (UINT_PTR)tbThrottleKeys;
+		SendMessage(hTooltipWnd, TTM_ADDTOOL, 0, (LPARAM)&toolInfo);
+		toolInfo.uId = (UINT_PTR)tbThrottleClicks;
+		SendMessage(hTooltipWnd, TTM_ADDTOOL, 0, (LPARAM)&toolInfo);
+
 		return hOptionsWnd;
 	}
 
@@ -384,6 +587,7 @@ namespace {
 				nid.hIcon = LoadIcon(hInst, MAKEINTRESOURCE(IDI_DEFAULT));
 				break;
 			case state::InputState::LIMITED:
+			case state::InputState::THROTTLED:
 				nid.hIcon = LoadIcon(hInst, MAKEINTRESOURCE(IDI_RESTRICTED));
 				break;
 			case state::InputState::LOCKED:
@@ -398,6 +602,7 @@ namespace {
 			LoadIconMetric(hInst, MAKEINTRESOURCE(IDI_DEFAULT), LIM_SMALL, &(nid.hIcon));
 			break;
 		case state::InputState::LIMITED:
+		case state::InputState::THROTTLED:
 			LoadIconMetric(hInst, MAKEINTRESOURCE(IDI_RESTRICTED), LIM_SMALL, &(nid.hIcon));
 			break;
 		case state::InputState::LOCKED:
@@ -426,7 +631,7 @@ namespace {
 
 namespace ui {
 
-	int mainLoop(HINSTANCE hInstance, int nCmdShow) {
+	int mainLoop(HINSTANCE hInstance, int nCmdShow, int intent) {
 		std::wcscat(appTitle, APP_NAME);
 		std::wcscat(appTitle, L" v");
 		std::wcscat(appTitle, APP_VERSION);
@@ -440,9 +645,18 @@ namespace ui {
 
 		SystemParametersInfo(SPI_GETWORKAREA, 0, &workArea, 0);
 
-		if (!createStatusWindow(hInstance)) return FALSE;
+		// the status window does not depend on the user settings, so it is
+		// created while they are loaded, and the rest once the hooks are live
+		bool created = createStatusWindow(hInstance);
+		state::start();
+		// a mode given on the command line applies once the hooks are live,
+		// while the settings are only shown when asked for by a later launch
+		if (intent != UI_INTENT_SHOW) applyIntent(intent);
+		if (!created) return FALSE;
+		showStatusWindow();
 		if (!createOptionsWindow(hInstance)) return FALSE;
 		createTrayIcon();
+		state::markStartup(STATE_STARTUP_UI);
 
 		MSG msg;
 		while (GetMessage(&msg, nullptr, 0, 0)) {
@@ -455,6 +669,51 @@ namespace ui {
 		return msg.wParam;
 	}
 
+	int parseIntent(const wchar_t *cmdLine) {
+		if (wcsstr(cmdLine, L"/restrict") != NULL) return UI_INTENT_RESTRICT;
+		if (wcsstr(cmdLine, L"/lock") != NULL) return UI_INTENT_LOCK;
+		if (wcsstr(cmdLine, L"/throttle") != NULL) return UI_INTENT_THROTTLE;
+		return UI_INTENT_SHOW;
+	}
+
+	bool sendIntent(int intent) {
+		// the running instance may not have created its window yet
+		HWND hWnd = NULL;
+		for (int waited = 0; waited < UI_INTENT_TIMEOUT; waited += UI_INTENT_RETRY) {
+			hWnd = FindWindowW(statusWndClass, NULL);
+			if (hWnd != NULL) break;
+			Sleep(UI_INTENT_RETRY);
+		}
+		if (hWnd == NULL) return false;
+
+		// so that it can bring the options window to the front
+		AllowSetForegroundWindow(ASFW_ANY);
+		COPYDATASTRUCT data = { UI_INTENT_COPYDATA, sizeof(intent), &intent };
+		DWORD_PTR res = FALSE;
+		return SendMessageTimeoutW(hWnd, WM_COPYDATA, NULL, (LPARAM)&data,
+			SMTO_ABORTIFHUNG, UI_INTENT_TIMEOUT, &res) != 0 && res == TRUE;
+	}
+
+	void postStatusUpdate() {
+		if (hStatusWnd != NULL)
+			PostMessage(hStatusWnd, UI_STATUSUPDATE_MSGID, 0, 0);
+	}
+
+	void postCall(void(*fn)()) {
+		if (hStatusWnd != NULL)
+			PostMessage(hStatusWnd, UI_CALL_MSGID, (WPARAM)fn, 0);
+	}
+
+	void setScheduleTimer(long long ms) {
+		if (hStatusWnd == NULL) return;
+		if (ms < 0) {
+			KillTimer(hStatusWnd, UI_SCHEDULE_TIMER_ID);
+			return;
+		}
+		// longer waits fire early, and the schedule sets the timer again
+		SetTimer(hStatusWnd, UI_SCHEDULE_TIMER_ID, (UINT)std::min<long long>(ms, USER_TIMER_MAXIMUM), NULL);
+	}
+
 	void updateStatusWindow() {
 		createTrayIcon(true);
 		InvalidateRect(hStatusWnd, NULL, TRUE);
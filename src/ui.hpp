@@ -2,10 +2,40 @@
 
 #include <windows.h>
 
+// The intents that a launch of Padlock passes to the one already running, see
+// sendIntent: show the settings, or switch to Restricted, Locked, or Throttled
+// mode, as given by /restrict, /lock, or /throttle on the command line.
+#define UI_INTENT_SHOW 0
+#define UI_INTENT_RESTRICT 1
+#define UI_INTENT_LOCK 2
+#define UI_INTENT_THROTTLE 3
+
 namespace ui {
 
-	int mainLoop(HINSTANCE hInstance, int nCmdShow);
+	// Run the UI until exit, starting in the mode asked for by the intent,
+	// one of UI_INTENT_[X], given on the command line of this launch.
+	int mainLoop(HINSTANCE hInstance, int nCmdShow, int intent);
+
+	// Returns the intent given on the command line, one of UI_INTENT_[X].
+	int parseIntent(const wchar_t *cmdLine);
+
+	// Pass the intent to the instance of Padlock running in this session,
+	// waiting for its window if it is still starting.
+	// Returns true if successful, and false if otherwise.
+	bool sendIntent(int intent);
 
-	// request the status window to be redrawn
+	// redraw the status window, only from the thread of the UI
 	void updateStatusWindow();
+
+	// request the status window to be redrawn by the thread of the UI, without
+	// waiting for it, so that it can be called from the input hooks
+	void postStatusUpdate();
+
+	// request the thread of the UI to call the given function, without
+	// waiting for it, such as for work that may block on the input hooks
+	void postCall(void(*fn)());
+
+	// set the one timer that follows the schedule of modes to fire in the
+	// given milliseconds, or stop it if negative, only from the thread of the UI
+	void setScheduleTimer(long long ms);
 }
\ No newline at end of file
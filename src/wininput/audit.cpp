@@ -0,0 +1,274 @@
+#include "audit.hpp"
+
+#ifdef _WININPUT_AUDIT
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// The number of frames of the stack traces of reports.
+#define AUDIT_STACK_FRAMES 32
+
+namespace {
+
+	const char *kindNames[] = { "", "allocation", "lock", "system call" };
+
+	// the depth of the AuditScopes of the thread, and whether it is reporting,
+	// so that the allocations of the report itself are not reported
+	thread_local int depth = 0;
+	thread_local bool reporting = false;
+
+	std::atomic<bool> abortOnReport(true);
+	std::atomic<unsigned long long> counts[4];
+
+	void printStack() {
+		void *frames[AUDIT_STACK_FRAMES];
+#ifdef _WIN32
+		USHORT count = CaptureStackBackTrace(2, AUDIT_STACK_FRAMES, frames, NULL);
+		for (USHORT i = 0; i < count; i++) {
+			HMODULE module = NULL;
+			GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS
+				| GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, (LPCSTR)frames[i], &module);
+			char name[MAX_PATH] = "?";
+			if (module) GetModuleFileNameA(module, name, MAX_PATH);
+			fprintf(stderr, "  #%u %s+0x%llx\n", (unsigned)i, name,
+				(unsigned long long)((char*)frames[i] - (char*)module));
+		}
+#else
+		// backtrace_symbols_fd does not allocate, unlike backtrace_symbols
+		int count = backtrace(frames, AUDIT_STACK_FRAMES);
+		if (count > 2) backtrace_symbols_fd(frames + 2, count - 2, STDERR_FILENO);
+#endif
+	}
+
+	inline bool onHookPath() {
+		return depth > 0 && !reporting;
+	}
+
+#ifndef _WIN32
+	// the entry points of the C library that are intercepted; calls made
+	// before they are found, such as by dlsym itself, are not audited
+	template <typename Fn>
+	Fn next(const char *name) {
+		return (Fn)dlsym(RTLD_NEXT, name);
+	}
+
+	// reads and writes of a non-blocking descriptor, such as an eventfd that
+	// wakes another thread, return at once, so only others are reported
+	void auditTransfer(int fd, const char *name) {
+		if (onHookPath() && (fcntl(fd, F_GETFL) & O_NONBLOCK) == 0)
+			input::auditEntry(INPUT_AUDIT_SYSCALL, name);
+	}
+#endif
+}
+
+namespace input {
+
+	AuditScope::AuditScope() {
+		++depth;
+	}
+
+	AuditScope::~AuditScope() {
+		--depth;
+	}
+
+	void auditEntry(int kind, const char *name) {
+		if (!onHookPath()) return;
+		reporting = true;
+		counts[kind & 3].fetch_add(1);
+		fprintf(stderr, "audit: %s %s on the hook path\n", kindNames[kind & 3], name);
+		printStack();
+		if (abortOnReport.load()) abort();
+		reporting = false;
+	}
+
+	void setAuditAbort(bool abort) {
+		abortOnReport.store(abort);
+	}
+
+	unsigned long long getAuditCount(int kind) {
+		return counts[kind & 3].load();
+	}
+}
+
+// the allocator, replaced on all platforms
+void *operator new(size_t size) {
+#ifdef _WIN32
+	input::auditEntry(INPUT_AUDIT_ALLOC, "operator new");
+#endif
+	void *p = malloc(size ? size : 1);
+	if (p == nullptr) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept {
+#ifdef _WIN32
+	input::auditEntry(INPUT_AUDIT_ALLOC, "operator new");
+#endif
+	return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+	return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept {
+#ifdef _WIN32
+	if (p) input::auditEntry(INPUT_AUDIT_ALLOC, "operator delete");
+#endif
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	operator delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	operator delete(p);
+}
+
+#ifndef _WIN32
+
+// on Linux, the C library is intercepted instead, which also covers the
+// allocations of the C++ library; the originals are those of glibc
+extern "C" {
+	void *__libc_malloc(size_t size);
+	void *__libc_calloc(size_t count, size_t size);
+	void *__libc_realloc(void *p, size_t size);
+	void __libc_free(void *p);
+
+	void *malloc(size_t size) {
+		input::auditEntry(INPUT_AUDIT_ALLOC, "malloc");
+		return __libc_malloc(size);
+	}
+
+	void *calloc(size_t count, size_t size) {
+		input::auditEntry(INPUT_AUDIT_ALLOC, "calloc");
+		return __libc_calloc(count, size);
+	}
+
+	void *realloc(void *p, size_t size) {
+		input::auditEntry(INPUT_AUDIT_ALLOC, "realloc");
+		return __libc_realloc(p, size);
+	}
+
+	void free(void *p) {
+		if (p) input::auditEntry(INPUT_AUDIT_ALLOC, "free");
+		__libc_free(p);
+	}
+
+	int pthread_mutex_lock(pthread_mutex_t *mutex) {
+		static auto fn = next<int(*)(pthread_mutex_t*)>("pthread_mutex_lock");
+		input::auditEntry(INPUT_AUDIT_LOCK, "pthread_mutex_lock");
+		return fn(mutex);
+	}
+
+	int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+		static auto fn = next<int(*)(pthread_mutex_t*)>("pthread_mutex_trylock");
+		input::auditEntry(INPUT_AUDIT_LOCK, "pthread_mutex_trylock");
+		return fn(mutex);
+	}
+
+	int pthread_rwlock_rdlock(pthread_rwlock_t *lock) {
+		static auto fn = next<int(*)(pthread_rwlock_t*)>("pthread_rwlock_rdlock");
+		input::auditEntry(INPUT_AUDIT_LOCK, "pthread_rwlock_rdlock");
+		return fn(lock);
+	}
+
+	int pthread_rwlock_wrlock(pthread_rwlock_t *lock) {
+		static auto fn = next<int(*)(pthread_rwlock_t*)>("pthread_rwlock_wrlock");
+		input::auditEntry(INPUT_AUDIT_LOCK, "pthread_rwlock_wrlock");
+		return fn(lock);
+	}
+
+	int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+		static auto fn = next<int(*)(pthread_cond_t*, pthread_mutex_t*)>("pthread_cond_wait");
+		input::auditEntry(INPUT_AUDIT_LOCK, "pthread_cond_wait");
+		return fn(cond, mutex);
+	}
+
+	int sem_wait(sem_t *sem) {
+		static auto fn = next<int(*)(sem_t*)>("sem_wait");
+		input::auditEntry(INPUT_AUDIT_LOCK, "sem_wait");
+		return fn(sem);
+	}
+
+	ssize_t read(int fd, void *buf, size_t count) {
+		static auto fn = next<ssize_t(*)(int, void*, size_t)>("read");
+		auditTransfer(fd, "read");
+		return fn(fd, buf, count);
+	}
+
+	ssize_t write(int fd, const void *buf, size_t count) {
+		static auto fn = next<ssize_t(*)(int, const void*, size_t)>("write");
+		auditTransfer(fd, "write");
+		return fn(fd, buf, count);
+	}
+
+	int ioctl(int fd, unsigned long request, ...) {
+		static auto fn = next<int(*)(int, unsigned long, void*)>("ioctl");
+		va_list args;
+		va_start(args, request);
+		void *arg = va_arg(args, void*);
+		va_end(args);
+		input::auditEntry(INPUT_AUDIT_SYSCALL, "ioctl");
+		return fn(fd, request, arg);
+	}
+
+	int poll(struct pollfd *fds, nfds_t count, int timeout) {
+		static auto fn = next<int(*)(struct pollfd*, nfds_t, int)>("poll");
+		input::auditEntry(INPUT_AUDIT_SYSCALL, "poll");
+		return fn(fds, count, timeout);
+	}
+
+	int epoll_wait(int epfd, struct epoll_event *events, int count, int timeout) {
+		static auto fn = next<int(*)(int, struct epoll_event*, int, int)>("epoll_wait");
+		input::auditEntry(INPUT_AUDIT_SYSCALL, "epoll_wait");
+		return fn(epfd, events, count, timeout);
+	}
+
+	int nanosleep(const struct timespec *req, struct timespec *rem) {
+		static auto fn = next<int(*)(const struct timespec*, struct timespec*)>("nanosleep");
+		input::auditEntry(INPUT_AUDIT_SYSCALL, "nanosleep");
+		return fn(req, rem);
+	}
+
+	int usleep(useconds_t usec) {
+		static auto fn = next<int(*)(useconds_t)>("usleep");
+		input::auditEntry(INPUT_AUDIT_SYSCALL, "usleep");
+		return fn(usec);
+	}
+
+	int fsync(int fd) {
+		static auto fn = next<int(*)(int)>("fsync");
+		input::auditEntry(INPUT_AUDIT_SYSCALL, "fsync");
+		return fn(fd);
+	}
+}
+
+#endif
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+// The kinds of entry points reported by the audit, see auditEntry.
+#define INPUT_AUDIT_ALLOC 1
+#define INPUT_AUDIT_LOCK 2
+#define INPUT_AUDIT_SYSCALL 3
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// Marks the calling thread as running the hook path while in scope, such
+	// as the hook procedures and the handlers they call. In builds with
+	// _WININPUT_AUDIT defined, the allocations, locks, and blocking system
+	// calls made by the thread in scope are reported (see auditEntry). In
+	// other builds, it compiles to nothing.
+	class AuditScope {
+	public:
+#ifdef _WININPUT_AUDIT
+		AuditScope();
+		~AuditScope();
+#else
+		AuditScope() {}
+#endif
+		AuditScope(const AuditScope&) = delete;
+		AuditScope& operator=(const AuditScope&) = delete;
+	};
+
+#ifdef _WININPUT_AUDIT
+	// Report a call to the named entry point, of one of the INPUT_AUDIT_
+	// kinds, if the calling thread is on the hook path. The report is printed
+	// to stderr with a stack trace, and the process is aborted unless
+	// setAuditAbort(false) was called.
+	// The allocator is intercepted on all platforms, and locks and blocking
+	// system calls also on Linux, so this is only called directly for other
+	// entry points. The hook path on Windows takes no locks of its own, since
+	// the handlers and sequences it reads are published copy-on-write.
+	void auditEntry(int kind, const char *name);
+
+	// Set whether the process is aborted on the first report, which is the
+	// default, or reports are only counted.
+	void setAuditAbort(bool abort);
+
+	// Returns the number of reports of the given INPUT_AUDIT_ kind so far.
+	unsigned long long getAuditCount(int kind);
+#endif
+}
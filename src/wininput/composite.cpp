@@ -0,0 +1,290 @@
+#include "composite.hpp"
+#include "keypattern.hpp"
+#include "tracepoint.hpp"
+
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+// The mouse messages of the Windows headers, used as SequenceStep.code.
+#ifndef WM_LBUTTONDOWN
+#define WM_LBUTTONDOWN 0x0201
+#define WM_RBUTTONDOWN 0x0204
+#define WM_MBUTTONDOWN 0x0207
+#define WM_MOUSEWHEEL 0x020A
+#define WM_XBUTTONDOWN 0x020B
+#define WM_MOUSEHWHEEL 0x020E
+#endif
+
+namespace {
+
+	struct NamedInput {
+		const char *name;
+		short type;
+		unsigned long code;
+	};
+
+	// the inputs of a step, and the keys held down, named other than as in KeyPattern
+	const NamedInput namedInputs[] = {
+		{ "LClick", INPUT_STEP_MOUSE, WM_LBUTTONDOWN }, { "RClick", INPUT_STEP_MOUSE, WM_RBUTTONDOWN },
+		{ "MClick", INPUT_STEP_MOUSE, WM_MBUTTONDOWN }, { "XClick", INPUT_STEP_MOUSE, WM_XBUTTONDOWN },
+		{ "Wheel", INPUT_STEP_MOUSE, WM_MOUSEWHEEL }, { "HWheel", INPUT_STEP_MOUSE, WM_MOUSEHWHEEL },
+	};
+	const NamedInput namedHeld[] = {
+		{ "Ctrl", INPUT_STEP_KEY, 0x11 }, { "Shift", INPUT_STEP_KEY, 0x10 }, { "Alt", INPUT_STEP_KEY, 0x12 },
+		{ "LButton", INPUT_STEP_KEY, 0x01 }, { "RButton", INPUT_STEP_KEY, 0x02 }, { "MButton", INPUT_STEP_KEY, 0x04 },
+	};
+
+	// returns the names of the inputs of a step, or of the keys held down
+	inline const NamedInput *getNames(bool held, size_t& count) {
+		count = held ? sizeof(namedHeld) / sizeof(NamedInput) : sizeof(namedInputs) / sizeof(NamedInput);
+		return held ? namedHeld : namedInputs;
+	}
+
+	inline bool testBit(const unsigned *bits, unsigned long code) {
+		return (bits[(code >> 5) & 7] >> (code & 31)) & 1;
+	}
+
+	bool sameName(const std::string& text, const char *name) {
+		if (text.size() != std::strlen(name)) return false;
+		for (size_t i = 0; i < text.size(); i++)
+			if (std::tolower((unsigned char)text[i]) != std::tolower((unsigned char)name[i])) return false;
+		return true;
+	}
+
+	// read a key, or if held is false, a mouse input as well
+	bool parseInput(const std::string& name, bool held, short& type, unsigned long& code) {
+		type = INPUT_STEP_KEY;
+		if (name.size() == 1 && std::isalnum((unsigned char)name[0])) {
+			code = (unsigned long)std::toupper((unsigned char)name[0]);
+			return true;
+		}
+		size_t count;
+		const NamedInput *names = getNames(held, count);
+		for (size_t i = 0; i < count; i++) {
+			if (sameName(name, names[i].name)) {
+				type = names[i].type;
+				code = names[i].code;
+				return true;
+			}
+		}
+		code = input::parseKeyName(name);
+		return code != 0;
+	}
+
+	std::string inputToString(short type, unsigned long code, bool held) {
+		if (type == INPUT_STEP_KEY && ((code >= '0' && code <= '9') || (code >= 'A' && code <= 'Z')))
+			return std::string(1, (char)code);
+		size_t count;
+		const NamedInput *names = getNames(held, count);
+		for (size_t i = 0; i < count; i++)
+			if (names[i].type == type && names[i].code == code) return names[i].name;
+		if (type == INPUT_STEP_KEY && code >= 0x70 && code < 0x70 + 24)
+			return "F" + std::to_string(code - 0x70 + 1);
+		const char *name = type == INPUT_STEP_KEY ? input::getKeyName((unsigned)code) : nullptr;
+		if (name) return name;
+
+		char hex[8];
+		snprintf(hex, sizeof(hex), "0x%02lX", code & 0xFF);
+		return hex;
+	}
+
+	// read a step, such as Ctrl+LClick@0,0,9,9/500
+	bool parseStep(const std::string& text, input::SequenceStep& step) {
+		std::string keys = text;
+		size_t delay = keys.find('/');
+		if (delay != std::string::npos) {
+			char *end;
+			step.maxDelay = std::strtoul(keys.c_str() + delay + 1, &end, 10);
+			if (*end != '\0' || delay + 1 == keys.size() || step.maxDelay == 0) return false;
+			keys.erase(delay);
+		}
+
+		size_t region = keys.find('@');
+		if (region != std::string::npos) {
+			long values[4];
+			const char *p = keys.c_str() + region + 1;
+			for (int i = 0; i < 4; i++) {
+				char *end;
+				values[i] = std::strtol(p, &end, 10);
+				if (end == p || *end != (i < 3 ? ',' : '\0')) return false;
+				p = end + 1;
+			}
+			step.left = values[0];
+			step.top = values[1];
+			step.right = values[2];
+			step.bottom = values[3];
+			keys.erase(region);
+		}
+
+		// the keys held down, then the input
+		int held = 0;
+		size_t start = 0;
+		while (true) {
+			size_t plus = keys.find('+', start);
+			std::string name = keys.substr(start, plus == std::string::npos ? std::string::npos : plus - start);
+			short type;
+			unsigned long code;
+			if (plus == std::string::npos) {
+				if (!parseInput(name, false, step.type, step.code)) return false;
+				break;
+			}
+			if (held == INPUT_STEP_MAXHELD || !parseInput(name, true, type, code)) return false;
+			step.held[held++] = code;
+			start = plus + 1;
+		}
+		// a region only applies to mouse inputs
+		return region == std::string::npos || step.type == INPUT_STEP_MOUSE;
+	}
+}
+
+namespace input {
+
+	CompositeMatcher::CompositeMatcher(const CompositeMatcher& other) {
+		seqs.reserve(other.seqs.size());
+		for (const Sequence& seq : other.seqs) {
+			seqs.emplace_back();
+			seqs.back().id = seq.id;
+			seqs.back().steps = seq.steps;
+			seqs.back().handler = seq.handler;
+			index(seq.steps[0]);
+		}
+	}
+
+	bool CompositeMatcher::add(int id, const SequenceStep *steps, event_handler_fn fn) {
+		Sequence seq;
+		seq.id = id;
+		seq.handler = fn;
+		for (const SequenceStep *step = steps; step->type != INPUT_STEP_NONE; ++step) {
+			if (seq.steps.size() == INPUT_COMPOSITE_MAX_STEPS) return false;
+			Step compiled = { step->type, step->code, { 0 }, step->left, step->top,
+				step->right, step->bottom, step->maxDelay };
+			for (int i = 0; i < INPUT_STEP_MAXHELD && step->held[i] != 0; i++) {
+				unsigned long vk = step->held[i] & 0xFF;
+				compiled.held[vk >> 5] |= 1U << (vk & 31);
+			}
+			seq.steps.push_back(compiled);
+		}
+		if (seq.steps.empty()) return false;
+
+		index(seq.steps[0]);
+		seqs.push_back(std::move(seq));
+		return true;
+	}
+
+	bool CompositeMatcher::remove(int id) {
+		for (auto it = seqs.begin(); it != seqs.end(); ++it) {
+			if (it->id != id) continue;
+			seqs.erase(it);
+
+			// the progress is kept, but the counts of partially matched
+			// sequences and the index of first steps are rebuilt
+			std::memset(firstKeys, 0, sizeof(firstKeys));
+			std::memset(firstButtons, 0, sizeof(firstButtons));
+			for (unsigned device = 0; device < INPUT_MAX_DEVICES; device++) {
+				int count = 0;
+				for (const Sequence& seq : seqs)
+					if (seq.progress[device].pos != 0) ++count;
+				active[device] = count;
+			}
+			for (const Sequence& seq : seqs)
+				index(seq.steps[0]);
+			return true;
+		}
+		return false;
+	}
+
+	void CompositeMatcher::index(const Step& first) {
+		unsigned *bits = first.type == INPUT_STEP_KEY ? firstKeys : firstButtons;
+		unsigned long code = first.type == INPUT_STEP_KEY ? first.code : first.code - 0x200;
+		if (code < 256) bits[code >> 5] |= 1U << (code & 31);
+	}
+
+	bool CompositeMatcher::startsSequence(const CompositeEvent& evt) const {
+		if (evt.type == INPUT_STEP_KEY) return evt.code < 256 && testBit(firstKeys, evt.code);
+		return evt.code >= 0x200 && evt.code < 0x300 && testBit(firstButtons, evt.code - 0x200);
+	}
+
+	bool CompositeMatcher::step(const CompositeEvent& evt, const unsigned *pressed) {
+		int& partial = active[evt.device];
+		if (partial == 0 && !startsSequence(evt)) return false;
+
+		auto matches = [&](const Step& step) {
+			if (step.type != evt.type || step.code != evt.code) return false;
+			for (int i = 0; i < 8; i++) {
+				if ((pressed[i] & step.held[i]) != step.held[i]) return false;
+			}
+			return evt.type != INPUT_STEP_MOUSE || (evt.x >= step.left && evt.x <= step.right
+				&& evt.y >= step.top && evt.y <= step.bottom);
+		};
+
+		bool stop = false;
+		for (Sequence& seq : seqs) {
+			Progress& progress = seq.progress[evt.device];
+			bool matched = false;
+
+			const Step& next = seq.steps[progress.pos];
+			if (matches(next) && (progress.pos == 0 || next.maxDelay == 0
+				|| evt.time - progress.lastTime <= next.maxDelay)) {
+				matched = true;
+
+			} else if (progress.pos != 0) {
+				progress.pos = 0;
+				--partial;
+				matched = matches(seq.steps[0]);
+			}
+			if (!matched) continue;
+
+			// increment pos on successful match
+			INPUT_TRACEPOINT(COMPOSITE_MATCHED, seq.id, evt.code);
+			progress.lastTime = evt.time;
+			if (progress.pos++ == 0) ++partial;
+
+			if (progress.pos == seq.steps.size()) {
+				// complete sequence matched
+				progress.pos = 0;
+				--partial;
+				stop = seq.handler();
+				if (stop) break;
+			}
+		}
+		return stop;
+	}
+
+	bool parseCompositeSequence(const std::string& text, std::vector<SequenceStep>& steps) {
+		std::vector<SequenceStep> parsed;
+		std::istringstream in(text);
+		std::string word;
+		while (in >> word) {
+			if (parsed.size() == INPUT_COMPOSITE_MAX_STEPS) return false;
+			parsed.emplace_back();
+			if (!parseStep(word, parsed.back())) return false;
+		}
+		if (parsed.empty()) return false;
+
+		parsed.emplace_back();
+		steps = parsed;
+		return true;
+	}
+
+	std::string compositeSequenceToString(const SequenceStep *steps) {
+		std::string text;
+		for (const SequenceStep *step = steps; step->type != INPUT_STEP_NONE; ++step) {
+			if (!text.empty()) text += ' ';
+			for (int i = 0; i < INPUT_STEP_MAXHELD && step->held[i] != 0; i++)
+				text += inputToString(INPUT_STEP_KEY, step->held[i], true) + "+";
+			text += inputToString(step->type, step->code, false);
+			if (step->type == INPUT_STEP_MOUSE && (step->left != LONG_MIN || step->top != LONG_MIN
+				|| step->right != LONG_MAX || step->bottom != LONG_MAX)) {
+				text += "@" + std::to_string(step->left) + "," + std::to_string(step->top) + ","
+					+ std::to_string(step->right) + "," + std::to_string(step->bottom);
+			}
+			if (step->maxDelay != 0)
+				text += "/" + std::to_string(step->maxDelay);
+		}
+		return text;
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "devicetable.hpp"
+#include "wininput.hpp"
+
+// The maximum number of steps of a composite sequence.
+#define INPUT_COMPOSITE_MAX_STEPS 32
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// An event of the merged key and mouse stream seen by composite sequences:
+	// a key down, or a mouse button down or wheel event.
+	struct CompositeEvent {
+		short type;         // INPUT_STEP_KEY or INPUT_STEP_MOUSE
+		unsigned long code; // the virtual key code, or the mouse message
+		long x;
+		long y;
+		unsigned long time; // in milliseconds
+		unsigned device;    // see KeyData.device
+	};
+
+	// Matches composite sequences (see addCompositeSequence) against the
+	// events of each device, keeping the progress of every sequence on every
+	// device in a DeviceTable. An event that starts no sequence, on a device
+	// where none is partially matched, is passed over after a single lookup.
+	// Once built, the sequences are only read, and the progress is only
+	// updated by step, which should be called from a single thread, so that
+	// the matcher can be published to that thread as a whole and replaced
+	// with a copy, instead of being locked for each event.
+	class CompositeMatcher {
+	public:
+		CompositeMatcher() {}
+
+		// Copy the sequences of another matcher, starting over on every
+		// device. Only the sequences are read, so this can be done while
+		// the other matcher is being stepped.
+		CompositeMatcher(const CompositeMatcher& other);
+		CompositeMatcher& operator=(const CompositeMatcher&) = delete;
+
+		// Add a sequence, terminated by a step of type INPUT_STEP_NONE, with
+		// the handler called when it is matched.
+		// Returns true if successful, and false if otherwise, such as when
+		// there are no steps or more than INPUT_COMPOSITE_MAX_STEPS.
+		bool add(int id, const SequenceStep *steps, event_handler_fn fn);
+
+		// Remove the sequence with the given ID.
+		// Returns true if successful, and false if otherwise.
+		bool remove(int id);
+
+		// Returns the number of sequences.
+		size_t size() const {
+			return seqs.size();
+		}
+
+		// Advance every sequence by the given event, on its device, where
+		// pressed is the bitmap of the 256 keys and mouse buttons held down,
+		// with VK_CONTROL, VK_SHIFT, and VK_MENU set if either side is held.
+		// The handlers of the completed sequences are called in the order
+		// the sequences were added, until one returns true.
+		// Returns true if further processing of the event should be halted.
+		bool step(const CompositeEvent& evt, const unsigned *pressed);
+
+	private:
+		// a SequenceStep with its chord compiled into a key bitmap
+		struct Step {
+			short type;
+			unsigned long code;
+			unsigned held[8];
+			long left;
+			long top;
+			long right;
+			long bottom;
+			unsigned long maxDelay;
+		};
+
+		struct Progress {
+			unsigned short pos = 0; // the number of steps matched so far
+			unsigned long lastTime = 0;
+		};
+
+		struct Sequence {
+			int id;
+			std::vector<Step> steps;
+			event_handler_fn handler;
+			DeviceTable<Progress> progress;
+		};
+
+		std::vector<Sequence> seqs;
+		// the number of sequences partially matched on each device
+		DeviceTable<int> active{ 0 };
+		// the key codes, and the mouse messages less 0x200, of the first steps
+		unsigned firstKeys[8] = { 0 };
+		unsigned firstButtons[8] = { 0 };
+
+		void index(const Step& first);
+		bool startsSequence(const CompositeEvent& evt) const;
+	};
+
+	// Read a composite sequence from its text, replacing the given steps,
+	// which are then terminated by a step of type INPUT_STEP_NONE.
+	//
+	// Syntax: steps separated by spaces, each written as the keys held down
+	// and the input, joined by +, optionally followed by @left,top,right,bottom
+	// for the region of a mouse input, and /ms for the maximum time since the
+	// previous step, such as
+	//   Ctrl+Shift+LClick@0,0,9,9 Ctrl+Shift+LClick@0,0,9,9/500
+	// Inputs are a letter or digit, a key named as in KeyPattern without the
+	// brackets (such as Enter, F5, or 0xBA), or one of LClick, RClick, MClick,
+	// XClick, Wheel, and HWheel. The keys held down are named the same, or
+	// are one of Ctrl, Shift, Alt, LButton, RButton, and MButton.
+	// Returns true if successful, and false if otherwise, in which case the
+	// steps are left unchanged.
+	bool parseCompositeSequence(const std::string& text, std::vector<SequenceStep>& steps);
+
+	// Returns the text of a composite sequence, as read by parseCompositeSequence.
+	std::string compositeSequenceToString(const SequenceStep *steps);
+}
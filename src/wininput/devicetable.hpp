@@ -0,0 +1,38 @@
+#pragma once
+
+#include "wininput.hpp"
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// A flat table with an entry for each input device, indexed by the device
+	// of a KeyData or MouseData, so that handlers can keep state per device
+	// and find it with a single array access. Devices outside the table share
+	// the entry of device 0.
+	template <typename T>
+	class DeviceTable {
+	public:
+		DeviceTable() {}
+
+		explicit DeviceTable(const T& value) {
+			fill(value);
+		}
+
+		inline T& operator[](unsigned device) {
+			return entries[device < INPUT_MAX_DEVICES ? device : 0];
+		}
+
+		inline const T& operator[](unsigned device) const {
+			return entries[device < INPUT_MAX_DEVICES ? device : 0];
+		}
+
+		// Set the entries of all devices to the given value.
+		void fill(const T& value) {
+			for (int i = 0; i < INPUT_MAX_DEVICES; i++)
+				entries[i] = value;
+		}
+
+	private:
+		T entries[INPUT_MAX_DEVICES];
+	};
+}
@@ -0,0 +1,812 @@
+#include "evdev.hpp"
+#include "audit.hpp"
+#include "devicetable.hpp"
+#include "trace.hpp"
+#include "tracepoint.hpp"
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+// The name of the uinput device, which is skipped when discovering devices.
+#define EVDEV_OUTPUT_NAME "Padlock virtual input"
+// Maximum number of input_events taken from a device with each read.
+#define EVDEV_READ_BATCH 64
+// Maximum number of input_events collected before they are written to the output.
+#define EVDEV_WRITE_BATCH 256
+// Maximum number of ready devices returned by each epoll_wait.
+#define EVDEV_MAX_READY 16
+
+// The mouse messages of the Windows headers, used as MouseData.code.
+#ifndef WM_MOUSEMOVE
+#define WM_MOUSEMOVE 0x0200
+#define WM_LBUTTONDOWN 0x0201
+#define WM_LBUTTONUP 0x0202
+#define WM_RBUTTONDOWN 0x0204
+#define WM_RBUTTONUP 0x0205
+#define WM_MBUTTONDOWN 0x0207
+#define WM_MBUTTONUP 0x0208
+#define WM_MOUSEWHEEL 0x020A
+#define WM_XBUTTONDOWN 0x020B
+#define WM_XBUTTONUP 0x020C
+#define WM_MOUSEHWHEEL 0x020E
+#define XBUTTON1 0x0001
+#define XBUTTON2 0x0002
+#define WHEEL_DELTA 120
+#endif
+
+// bits of Device.mods
+#define MOD_LCTRL 0x01
+#define MOD_RCTRL 0x02
+#define MOD_LSHIFT 0x04
+#define MOD_RSHIFT 0x08
+#define MOD_LALT 0x10
+#define MOD_RALT 0x20
+
+namespace {
+
+	using input::evdev::DeviceInfo;
+
+	struct Device {
+		int fd = -1;
+		DeviceInfo info;
+		bool fake = false;
+		unsigned char mods = 0;          // MOD_ bits of the ctrl, shift, alt keys held down
+		unsigned long long emitted[KEY_CNT / 64] = { 0ULL }; // keys whose down was emitted
+		long dx = 0;                     // motion in the current frame
+		long dy = 0;
+		bool dropping = false;           // discarding events until the next SYN_REPORT
+		bool frameOutput = false;        // events of the current frame were emitted
+		size_t partial = 0;              // bytes of an incomplete input_event in buffer
+		input_event buffer[EVDEV_READ_BATCH];
+	};
+
+	// virtual key codes of the Linux key codes below 256
+	struct KeyTable {
+		unsigned char vk[256];
+
+		KeyTable() {
+			memset(vk, 0xFF, sizeof(vk));
+
+			static const unsigned char row0[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', 0xBD, 0xBB, 0x08, 0x09 };
+			static const unsigned char row1[] = { 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', 0xDB, 0xDD, 0x0D, 0xA2 };
+			static const unsigned char row2[] = { 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', 0xBA, 0xDE, 0xC0, 0xA0, 0xDC };
+			static const unsigned char row3[] = { 'Z', 'X', 'C', 'V', 'B', 'N', 'M', 0xBC, 0xBE, 0xBF, 0xA1, 0x6A, 0xA4, 0x20, 0x14 };
+			static const unsigned char keypad[] = { 0x67, 0x68, 0x69, 0x6D, 0x64, 0x65, 0x66, 0x6B, 0x61, 0x62, 0x63, 0x60, 0x6E };
+			place(row0, sizeof(row0), KEY_1);
+			place(row1, sizeof(row1), KEY_Q);
+			place(row2, sizeof(row2), KEY_A);
+			place(row3, sizeof(row3), KEY_Z);
+			place(keypad, sizeof(keypad), KEY_KP7);
+			vk[KEY_ESC] = 0x1B;
+			for (int i = 0; i < 10; i++) vk[KEY_F1 + i] = 0x70 + i;
+			for (int i = 0; i < 12; i++) vk[KEY_F13 + i] = 0x7C + i;
+			vk[KEY_F11] = 0x7A;
+			vk[KEY_F12] = 0x7B;
+			vk[KEY_NUMLOCK] = 0x90;
+			vk[KEY_SCROLLLOCK] = 0x91;
+			vk[KEY_102ND] = 0xE2;
+			vk[KEY_KPENTER] = 0x0D;
+			vk[KEY_RIGHTCTRL] = 0xA3;
+			vk[KEY_KPSLASH] = 0x6F;
+			vk[KEY_SYSRQ] = 0x2C;
+			vk[KEY_RIGHTALT] = 0xA5;
+			vk[KEY_HOME] = 0x24;
+			vk[KEY_UP] = 0x26;
+			vk[KEY_PAGEUP] = 0x21;
+			vk[KEY_LEFT] = 0x25;
+			vk[KEY_RIGHT] = 0x27;
+			vk[KEY_END] = 0x23;
+			vk[KEY_DOWN] = 0x28;
+			vk[KEY_PAGEDOWN] = 0x22;
+			vk[KEY_INSERT] = 0x2D;
+			vk[KEY_DELETE] = 0x2E;
+			vk[KEY_MUTE] = 0xAD;
+			vk[KEY_VOLUMEDOWN] = 0xAE;
+			vk[KEY_VOLUMEUP] = 0xAF;
+			vk[KEY_PAUSE] = 0x13;
+			vk[KEY_LEFTMETA] = 0x5B;
+			vk[KEY_RIGHTMETA] = 0x5C;
+			vk[KEY_COMPOSE] = 0x5D;
+			vk[KEY_NEXTSONG] = 0xB0;
+			vk[KEY_PREVIOUSSONG] = 0xB1;
+			vk[KEY_STOPCD] = 0xB2;
+			vk[KEY_PLAYPAUSE] = 0xB3;
+		}
+
+		void place(const unsigned char *row, int length, int first) {
+			for (int i = 0; i < length; i++)
+				vk[first + i] = row[i];
+		}
+	} keyTable;
+
+	// handlers that replace the default ones for a device
+	struct DevicePolicy {
+		std::atomic<bool> custom;
+		std::atomic<input::key_handler_fn> key;
+		std::atomic<input::mouse_handler_fn> mouse;
+	};
+
+	std::list<Device> devices;
+	std::mutex devicesMutex;
+	bool usedIds[INPUT_MAX_DEVICES] = { true }; // device 0 is never assigned
+	input::DeviceTable<DevicePolicy> policies;
+
+	int epollFd = -1;
+	int stopFd = -1;
+	int outputFd = -1;
+	bool outputUinput = false;
+	std::atomic<int> traceFd(-1);
+	std::thread thread;
+
+	std::atomic<input::key_handler_fn> keyHandler(nullptr);
+	std::atomic<bool> keyRepeats(false);
+	std::atomic<input::mouse_handler_fn> mouseHandler(nullptr);
+	std::atomic<long> boundsWidth(0);
+	std::atomic<long> boundsHeight(0);
+
+	// the following are only accessed by the evdev thread
+	long cursorX = 0;
+	long cursorY = 0;
+	input_event outBuffer[EVDEV_WRITE_BATCH];
+	int outCount = 0;
+	input::TraceRecord traceBuffer[EVDEV_WRITE_BATCH];
+	int traceCount = 0;
+
+	// statistics, only written by the evdev thread
+	std::atomic<unsigned long long> eventCount(0);
+	std::atomic<unsigned long long> readCount(0);
+	std::atomic<unsigned long long> writeCount(0);
+	std::atomic<unsigned long long> blockedCount(0);
+	std::atomic<unsigned long long> repeatCount(0);
+	std::atomic<unsigned long long> droppedCount(0);
+	std::atomic<unsigned long long> latencyCounts[INPUT_LATENCY_BUCKETS];
+
+	// add to a counter that only has a single writer, without a locked instruction
+	inline void count(std::atomic<unsigned long long>& counter, unsigned long long n = 1) {
+		counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	inline bool testBit(const unsigned char *bits, unsigned bit) {
+		return (bits[bit / 8] >> (bit % 8)) & 1;
+	}
+
+	inline long long toMicroseconds(const input_event& evt) {
+#ifdef input_event_sec
+		return evt.input_event_sec * 1000000LL + evt.input_event_usec;
+#else
+		return evt.time.tv_sec * 1000000LL + evt.time.tv_usec;
+#endif
+	}
+
+	inline unsigned long toMilliseconds(const input_event& evt) {
+		return (unsigned long)(toMicroseconds(evt) / 1000);
+	}
+
+	// count a report read at the given time in the latency histogram
+	inline void countLatency(const input_event& evt, long long now) {
+		long long time = toMicroseconds(evt);
+		if (time == 0) return;
+
+		unsigned long long latency = now > time ? (unsigned long long)(now - time) : 0ULL;
+		int bucket = latency == 0 ? 0 : 64 - __builtin_clzll(latency);
+		if (bucket >= INPUT_LATENCY_BUCKETS) bucket = INPUT_LATENCY_BUCKETS - 1;
+		count(latencyCounts[bucket]);
+	}
+
+	// the INPUT_DEVICE_ kinds of an opened device
+	unsigned deviceKinds(int fd) {
+		unsigned char keys[KEY_CNT / 8] = { 0 };
+		unsigned char rels[REL_CNT / 8 + 1] = { 0 };
+		ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+		ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rels)), rels);
+
+		unsigned kinds = 0;
+		if (testBit(keys, KEY_A) && testBit(keys, KEY_SPACE))
+			kinds |= INPUT_DEVICE_KEYBOARD;
+		if (testBit(rels, REL_X) && testBit(rels, REL_Y) && testBit(keys, BTN_LEFT))
+			kinds |= INPUT_DEVICE_MOUSE;
+		return kinds;
+	}
+
+	bool setupEpoll() {
+		if (epollFd >= 0) return true;
+
+		epollFd = epoll_create1(EPOLL_CLOEXEC);
+		stopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (epollFd < 0 || stopFd < 0) return false;
+
+		// the stop event is the only one without a device
+		epoll_event evt = {};
+		evt.events = EPOLLIN;
+		evt.data.ptr = nullptr;
+		return epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &evt) == 0;
+	}
+
+	bool registerDevice(int fd, const DeviceInfo& info, bool fake) {
+		if (!setupEpoll()) return false;
+
+		std::lock_guard<std::mutex> lock(devicesMutex);
+		unsigned id = 1;
+		while (id < INPUT_MAX_DEVICES && usedIds[id]) ++id;
+		if (id == INPUT_MAX_DEVICES) return false;
+
+		devices.emplace_back();
+		Device& dev = devices.back();
+		dev.fd = fd;
+		dev.info = info;
+		dev.info.id = id;
+		dev.fake = fake;
+
+		epoll_event evt = {};
+		evt.events = EPOLLIN;
+		evt.data.ptr = &dev;
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &evt) != 0) {
+			devices.pop_back();
+			return false;
+		}
+		usedIds[id] = true;
+
+		INPUT_TRACEPOINT(EVDEV_DEVICE_ADDED, id, info.kinds, info.grabbed);
+		return true;
+	}
+
+	void flushTrace() {
+		if (traceCount == 0) return;
+		int fd = traceFd.load(std::memory_order_relaxed);
+		if (fd >= 0) {
+			ssize_t res = write(fd, traceBuffer, traceCount * sizeof(input::TraceRecord));
+			(void)res;
+		}
+		traceCount = 0;
+	}
+
+	// record an event for the trace, if one is being written
+	template <typename Data>
+	inline void trace(const Data& data) {
+		if (traceFd.load(std::memory_order_relaxed) < 0) return;
+		if (traceCount == EVDEV_WRITE_BATCH) flushTrace();
+		traceBuffer[traceCount++] = input::toTraceRecord(data);
+	}
+
+	void flushOutput() {
+		flushTrace();
+		if (outCount == 0) return;
+		if (outputFd >= 0) {
+			ssize_t res = write(outputFd, outBuffer, outCount * sizeof(input_event));
+			(void)res;
+			count(writeCount);
+		}
+		outCount = 0;
+	}
+
+	inline void emit(Device& dev, unsigned short type, unsigned short code, int value) {
+		if (outCount == EVDEV_WRITE_BATCH) flushOutput();
+		input_event& evt = outBuffer[outCount++];
+		memset(&evt, 0, sizeof(evt));
+		evt.type = type;
+		evt.code = code;
+		evt.value = value;
+		dev.frameOutput = true;
+	}
+
+	inline void endFrame(Device& dev) {
+		if (!dev.frameOutput) return;
+		emit(dev, EV_SYN, SYN_REPORT, 0);
+		dev.frameOutput = false;
+	}
+
+	inline void updateMods(Device& dev, unsigned short code, bool down) {
+		unsigned char bit = 0;
+		switch (code) {
+		case KEY_LEFTCTRL: bit = MOD_LCTRL; break;
+		case KEY_RIGHTCTRL: bit = MOD_RCTRL; break;
+		case KEY_LEFTSHIFT: bit = MOD_LSHIFT; break;
+		case KEY_RIGHTSHIFT: bit = MOD_RSHIFT; break;
+		case KEY_LEFTALT: bit = MOD_LALT; break;
+		case KEY_RIGHTALT: bit = MOD_RALT; break;
+		default: return;
+		}
+		if (down)
+			dev.mods |= bit;
+		else
+			dev.mods &= ~bit;
+	}
+
+	// the mouse message of a mouse button, with the X button in param,
+	// or 0 if the button has no message
+	inline unsigned buttonMessage(unsigned short code, bool down, unsigned long& param) {
+		switch (code) {
+		case BTN_LEFT: return down ? WM_LBUTTONDOWN : WM_LBUTTONUP;
+		case BTN_RIGHT: return down ? WM_RBUTTONDOWN : WM_RBUTTONUP;
+		case BTN_MIDDLE: return down ? WM_MBUTTONDOWN : WM_MBUTTONUP;
+		case BTN_SIDE:
+		case BTN_BACK:
+			param = (unsigned long)XBUTTON1 << 16;
+			return down ? WM_XBUTTONDOWN : WM_XBUTTONUP;
+		case BTN_EXTRA:
+		case BTN_FORWARD:
+			param = (unsigned long)XBUTTON2 << 16;
+			return down ? WM_XBUTTONDOWN : WM_XBUTTONUP;
+		}
+		return 0;
+	}
+
+	inline bool callKeyHandler(input::KeyData& data) {
+		trace(data);
+		input::AuditScope audit;
+		DevicePolicy& policy = policies[data.device];
+		input::key_handler_fn fn = policy.custom.load(std::memory_order_relaxed) ?
+			policy.key.load(std::memory_order_relaxed) : keyHandler.load(std::memory_order_relaxed);
+		return fn != nullptr && fn(data);
+	}
+
+	inline bool callMouseHandler(input::MouseData& data) {
+		trace(data);
+		input::AuditScope audit;
+		DevicePolicy& policy = policies[data.device];
+		input::mouse_handler_fn fn = policy.custom.load(std::memory_order_relaxed) ?
+			policy.mouse.load(std::memory_order_relaxed) : mouseHandler.load(std::memory_order_relaxed);
+		return fn != nullptr && fn(data);
+	}
+
+	inline input::KeyData keyData(const Device& dev, const input_event& evt, short type) {
+		return { evt.code < 256 ? keyTable.vk[evt.code] : input::evdev::toVirtualKey(evt.code),
+			(dev.mods & (MOD_LCTRL | MOD_RCTRL)) != 0,
+			(dev.mods & (MOD_LSHIFT | MOD_RSHIFT)) != 0,
+			(dev.mods & (MOD_LALT | MOD_RALT)) != 0,
+			type, toMilliseconds(evt), dev.info.id };
+	}
+
+	void handleKey(Device& dev, const input_event& evt) {
+		unsigned short code = evt.code;
+		if (code >= KEY_CNT) return;
+
+		unsigned long long bit = 1ULL << (code % 64);
+		unsigned long long& word = dev.emitted[code / 64];
+		bool wasEmitted = (word & bit) != 0;
+		short type = evt.value == 0 ? INPUT_TYPE_KEYUP :
+			evt.value == 2 ? INPUT_TYPE_KEYREPEAT : INPUT_TYPE_KEYDOWN;
+		bool stop;
+
+		// repeats reuse the verdict of the key down, unless the handler sees them
+		if (type == INPUT_TYPE_KEYREPEAT) {
+			count(repeatCount);
+			if (!keyRepeats.load(std::memory_order_relaxed)) {
+				// the trace has the repeats the handler would have seen
+				trace(keyData(dev, evt, type));
+				if (wasEmitted)
+					emit(dev, EV_KEY, code, evt.value);
+				else
+					count(blockedCount);
+				return;
+			}
+		}
+
+		unsigned long param = 0;
+		unsigned message = type == INPUT_TYPE_KEYREPEAT ? 0 :
+			buttonMessage(code, type == INPUT_TYPE_KEYDOWN, param);
+		if (message != 0) {
+			input::MouseData data = { message, cursorX, cursorY, param, toMilliseconds(evt), dev.info.id };
+			stop = callMouseHandler(data);
+		} else {
+			input::KeyData data = keyData(dev, evt, type);
+			INPUT_TRACEPOINT(KEY_EVENT, data.code, data.ctrl, data.shift, data.alt, data.type);
+			updateMods(dev, code, type != INPUT_TYPE_KEYUP);
+			stop = callKeyHandler(data);
+		}
+
+		// the key up of an emitted key down is always emitted
+		if (type == INPUT_TYPE_KEYUP ? !wasEmitted : stop) {
+			count(blockedCount);
+			return;
+		}
+
+		emit(dev, EV_KEY, code, evt.value);
+		if (type == INPUT_TYPE_KEYUP)
+			word &= ~bit;
+		else
+			word |= bit;
+	}
+
+	// pass the motion of the current frame to the mouse handler
+	void handleMotion(Device& dev, const input_event& evt) {
+		long x = cursorX + dev.dx;
+		long y = cursorY + dev.dy;
+		long width = boundsWidth.load(std::memory_order_relaxed);
+		long height = boundsHeight.load(std::memory_order_relaxed);
+		if (width > 0) x = x < 0 ? 0 : x >= width ? width - 1 : x;
+		if (height > 0) y = y < 0 ? 0 : y >= height ? height - 1 : y;
+
+		input::MouseData data = { WM_MOUSEMOVE, x, y, 0, toMilliseconds(evt), dev.info.id };
+		if (callMouseHandler(data)) {
+			count(blockedCount);
+		} else {
+			if (dev.dx) emit(dev, EV_REL, REL_X, dev.dx);
+			if (dev.dy) emit(dev, EV_REL, REL_Y, dev.dy);
+			cursorX = x;
+			cursorY = y;
+		}
+		dev.dx = 0;
+		dev.dy = 0;
+	}
+
+	void handleWheel(Device& dev, const input_event& evt) {
+		short delta = (short)(evt.value * WHEEL_DELTA);
+		input::MouseData data = { (unsigned)(evt.code == REL_WHEEL ? WM_MOUSEWHEEL : WM_MOUSEHWHEEL),
+			cursorX, cursorY, (unsigned long)(unsigned short)delta << 16, toMilliseconds(evt), dev.info.id };
+		if (callMouseHandler(data))
+			count(blockedCount);
+		else
+			emit(dev, EV_REL, evt.code, evt.value);
+	}
+
+	// the kernel dropped events of the device, so release the emitted keys that
+	// are no longer held down, and recover the state of ctrl, shift, alt
+	void resyncDevice(Device& dev) {
+		if (dev.fake) return;
+
+		unsigned char keys[KEY_CNT / 8] = { 0 };
+		if (ioctl(dev.fd, EVIOCGKEY(sizeof(keys)), keys) < 0) return;
+
+		dev.mods = 0;
+		for (unsigned code = 0; code < KEY_CNT; code++) {
+			bool down = testBit(keys, code);
+			updateMods(dev, code, down);
+
+			unsigned long long bit = 1ULL << (code % 64);
+			if (!down && (dev.emitted[code / 64] & bit)) {
+				emit(dev, EV_KEY, code, 0);
+				dev.emitted[code / 64] &= ~bit;
+			}
+		}
+	}
+
+	inline void processEvent(Device& dev, const input_event& evt) {
+		if (dev.dropping) {
+			if (evt.type == EV_SYN && evt.code == SYN_REPORT) {
+				dev.dropping = false;
+				resyncDevice(dev);
+				endFrame(dev);
+			}
+			return;
+		}
+
+		switch (evt.type) {
+		case EV_SYN:
+			if (evt.code == SYN_DROPPED) {
+				count(droppedCount);
+				dev.dropping = true;
+				dev.dx = 0;
+				dev.dy = 0;
+			} else if (evt.code == SYN_REPORT) {
+				if (dev.dx || dev.dy) handleMotion(dev, evt);
+				endFrame(dev);
+			}
+			break;
+		case EV_KEY:
+			handleKey(dev, evt);
+			break;
+		case EV_REL:
+			if (evt.code == REL_X)
+				dev.dx += evt.value;
+			else if (evt.code == REL_Y)
+				dev.dy += evt.value;
+			else if (evt.code == REL_WHEEL || evt.code == REL_HWHEEL)
+				handleWheel(dev, evt);
+			break;
+		}
+		// other events, such as scan codes and high resolution wheel events,
+		// are not needed by the output device
+	}
+
+	// release the keys the device left held down on the output, and close it
+	void removeDevice(Device& dev) {
+		for (unsigned code = 0; code < KEY_CNT; code++) {
+			if (dev.emitted[code / 64] & (1ULL << (code % 64)))
+				emit(dev, EV_KEY, code, 0);
+		}
+		endFrame(dev);
+
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, dev.fd, nullptr);
+		if (dev.info.grabbed) ioctl(dev.fd, EVIOCGRAB, 0);
+		close(dev.fd);
+		INPUT_TRACEPOINT(EVDEV_DEVICE_REMOVED, dev.info.id);
+
+		// a device given the same ID later should not inherit the handlers
+		input::evdev::clearDeviceHandlers(dev.info.id);
+		std::lock_guard<std::mutex> lock(devicesMutex);
+		usedIds[dev.info.id] = false;
+		for (auto it = devices.begin(); it != devices.end(); ++it) {
+			if (&*it == &dev) {
+				devices.erase(it);
+				break;
+			}
+		}
+	}
+
+	// take the available events of the device with a single read, leaving the
+	// rest to the next epoll_wait
+	void readDevice(Device& dev) {
+		char *bytes = (char*)dev.buffer;
+		ssize_t n = read(dev.fd, bytes + dev.partial, sizeof(dev.buffer) - dev.partial);
+		count(readCount);
+		if (n <= 0) {
+			if (n == 0 || (errno != EAGAIN && errno != EINTR)) removeDevice(dev);
+			return;
+		}
+
+		// the clock is read once for all the events
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		long long now = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+
+		// a fake device may return part of an input_event, which is kept for the next read
+		size_t total = dev.partial + (size_t)n;
+		size_t events = total / sizeof(input_event);
+		for (size_t i = 0; i < events; i++) {
+			const input_event& evt = dev.buffer[i];
+			if (evt.type == EV_SYN && evt.code == SYN_REPORT) countLatency(evt, now);
+			processEvent(dev, evt);
+		}
+		count(eventCount, events);
+
+		dev.partial = total % sizeof(input_event);
+		if (dev.partial) memmove(bytes, bytes + events * sizeof(input_event), dev.partial);
+	}
+
+	// the main function of the internal evdev thread
+	void _main() {
+		INPUT_TRACEPOINT(EVDEV_THREAD_STARTED);
+		epoll_event ready[EVDEV_MAX_READY];
+
+		while (true) {
+			int n = epoll_wait(epollFd, ready, EVDEV_MAX_READY, -1);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				break;
+			}
+
+			bool stop = false;
+			for (int i = 0; i < n; i++) {
+				if (ready[i].data.ptr == nullptr)
+					stop = true;
+				else
+					readDevice(*(Device*)ready[i].data.ptr);
+			}
+			// the events allowed in this round are emitted with a single write
+			flushOutput();
+			if (stop) break;
+		}
+
+		INPUT_TRACEPOINT(EVDEV_THREAD_STOPPED);
+	}
+}
+
+namespace input {
+namespace evdev {
+
+	unsigned long toVirtualKey(unsigned short code) {
+		if (code < 256) return keyTable.vk[code];
+
+		switch (code) {
+		case BTN_LEFT: return 0x01;
+		case BTN_RIGHT: return 0x02;
+		case BTN_MIDDLE: return 0x04;
+		case BTN_SIDE: return 0x05;
+		case BTN_EXTRA: return 0x06;
+		}
+		return 0xFF;
+	}
+
+	bool addDevice(const std::string& path) {
+		int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0) return false;
+
+		char name[256] = "";
+		ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+
+		DeviceInfo info;
+		info.path = path;
+		info.name = name;
+		info.kinds = deviceKinds(fd);
+		info.grabbed = true;
+
+		if (info.kinds == 0 || info.name == EVDEV_OUTPUT_NAME
+			|| ioctl(fd, EVIOCGRAB, 1) != 0) {
+			close(fd);
+			return false;
+		}
+		// timestamps are compared against the monotonic clock for Stats.latency
+		int clock = CLOCK_MONOTONIC;
+		ioctl(fd, EVIOCSCLOCKID, &clock);
+
+		if (!registerDevice(fd, info, false)) {
+			ioctl(fd, EVIOCGRAB, 0);
+			close(fd);
+			return false;
+		}
+		return true;
+	}
+
+	int addDevices(const std::string& folder) {
+		DIR *dir = opendir(folder.c_str());
+		if (dir == nullptr) return 0;
+
+		int added = 0;
+		while (dirent *entry = readdir(dir)) {
+			if (strncmp(entry->d_name, "event", 5) != 0) continue;
+
+			std::string path = folder + "/" + entry->d_name;
+			bool known = false;
+			{
+				std::lock_guard<std::mutex> lock(devicesMutex);
+				for (auto& dev : devices)
+					if (dev.info.path == path) known = true;
+			}
+			if (!known && addDevice(path)) ++added;
+		}
+		closedir(dir);
+		return added;
+	}
+
+	bool addFakeDevice(int fd, unsigned kinds) {
+		DeviceInfo info;
+		info.path = "fd:" + std::to_string(fd);
+		info.name = "Fake device";
+		info.kinds = kinds;
+
+		int flags = fcntl(fd, F_GETFL);
+		if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) return false;
+		return registerDevice(fd, info, true);
+	}
+
+	bool openOutput() {
+		int fd = open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+		if (fd < 0) return false;
+
+		ioctl(fd, UI_SET_EVBIT, EV_SYN);
+		ioctl(fd, UI_SET_EVBIT, EV_KEY);
+		ioctl(fd, UI_SET_EVBIT, EV_REL);
+		// keys and mouse buttons, but not joystick or touch buttons, which
+		// would make the device look like one of those
+		for (int code = 1; code < KEY_CNT; code++) {
+			if (code < BTN_MISC || (code >= BTN_MOUSE && code < BTN_JOYSTICK) || code >= KEY_OK)
+				ioctl(fd, UI_SET_KEYBIT, code);
+		}
+		ioctl(fd, UI_SET_RELBIT, REL_X);
+		ioctl(fd, UI_SET_RELBIT, REL_Y);
+		ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
+		ioctl(fd, UI_SET_RELBIT, REL_HWHEEL);
+
+		uinput_user_dev dev;
+		memset(&dev, 0, sizeof(dev));
+		strncpy(dev.name, EVDEV_OUTPUT_NAME, UINPUT_MAX_NAME_SIZE - 1);
+		dev.id.bustype = BUS_VIRTUAL;
+		dev.id.vendor = 0x1;
+		dev.id.product = 0x1;
+		dev.id.version = 1;
+
+		if (write(fd, &dev, sizeof(dev)) != (ssize_t)sizeof(dev) || ioctl(fd, UI_DEV_CREATE) != 0) {
+			close(fd);
+			return false;
+		}
+
+		setOutput(fd);
+		outputUinput = true;
+		return true;
+	}
+
+	void setOutput(int fd) {
+		if (outputFd >= 0) {
+			if (outputUinput) ioctl(outputFd, UI_DEV_DESTROY);
+			close(outputFd);
+		}
+		outputFd = fd;
+		outputUinput = false;
+	}
+
+	void setTraceOutput(int fd) {
+		int prev = traceFd.exchange(fd);
+		if (prev >= 0) close(prev);
+	}
+
+	void setKeyHandler(key_handler_fn fn, bool repeats) {
+		keyRepeats.store(repeats);
+		keyHandler.store(fn);
+	}
+
+	void setMouseHandler(mouse_handler_fn fn) {
+		mouseHandler.store(fn);
+	}
+
+	void setDeviceHandlers(unsigned device, key_handler_fn key, mouse_handler_fn mouse) {
+		if (device == 0 || device >= INPUT_MAX_DEVICES) return;
+		DevicePolicy& policy = policies[device];
+		policy.key.store(key);
+		policy.mouse.store(mouse);
+		policy.custom.store(true);
+	}
+
+	void clearDeviceHandlers(unsigned device) {
+		if (device == 0 || device >= INPUT_MAX_DEVICES) return;
+		policies[device].custom.store(false);
+	}
+
+	void setCursorBounds(long width, long height) {
+		boundsWidth.store(width);
+		boundsHeight.store(height);
+	}
+
+	bool start() {
+		if (thread.joinable()) return true;
+		if (!setupEpoll()) return false;
+
+		thread = std::thread(_main);
+		return true;
+	}
+
+	void shutdown() {
+		if (thread.joinable()) {
+			uint64_t one = 1;
+			ssize_t res = write(stopFd, &one, sizeof(one));
+			(void)res;
+			thread.join();
+		}
+
+		std::lock_guard<std::mutex> lock(devicesMutex);
+		for (auto& dev : devices) {
+			if (dev.info.grabbed) ioctl(dev.fd, EVIOCGRAB, 0);
+			close(dev.fd);
+			clearDeviceHandlers(dev.info.id);
+			usedIds[dev.info.id] = false;
+		}
+		devices.clear();
+
+		setOutput(-1);
+		setTraceOutput(-1);
+		if (epollFd >= 0) close(epollFd);
+		if (stopFd >= 0) close(stopFd);
+		epollFd = -1;
+		stopFd = -1;
+		outCount = 0;
+	}
+
+	std::vector<DeviceInfo> getDevices() {
+		std::vector<DeviceInfo> infos;
+		std::lock_guard<std::mutex> lock(devicesMutex);
+		for (auto& dev : devices)
+			infos.push_back(dev.info);
+		return infos;
+	}
+
+	Stats getStats() {
+		Stats stats;
+		stats.events = eventCount.load();
+		stats.reads = readCount.load();
+		stats.writes = writeCount.load();
+		stats.blocked = blockedCount.load();
+		stats.repeats = repeatCount.load();
+		stats.dropped = droppedCount.load();
+		for (int i = 0; i < INPUT_LATENCY_BUCKETS; i++)
+			stats.latency[i] = latencyCounts[i].load();
+		return stats;
+	}
+}
+}
+
+#endif
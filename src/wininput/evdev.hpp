@@ -0,0 +1,134 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "wininput.hpp"
+
+// The value of DeviceInfo.kinds for a device with keys.
+#define INPUT_DEVICE_KEYBOARD 0x1
+// The value of DeviceInfo.kinds for a device with relative X and Y axes.
+#define INPUT_DEVICE_MOUSE 0x2
+
+// The number of buckets of Stats.latency.
+#define INPUT_LATENCY_BUCKETS 24
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// The Linux backend, which reads the keyboards and mice under /dev/input
+	// instead of hooking them. The devices are grabbed, so that no one else
+	// sees their events, and the events are translated into KeyData and
+	// MouseData for the handlers set below. Those that are not blocked are
+	// emitted again through a virtual uinput device.
+	// Key codes are translated to Windows virtual key codes, and mouse events
+	// to WM_ mouse messages, so that the same handlers can be used on both
+	// platforms. The cursor position is tracked from the relative motion of
+	// the mice, starting at (0, 0).
+	// Each device is given an ID from 1 up to INPUT_MAX_DEVICES - 1, which is
+	// set as the device of its events, and can be given its own handlers.
+	// Sequences, patterns, and other handlers registered with WinInput are not
+	// seen by this backend, so the handlers are usually compiled pipelines
+	// (see pipeline.hpp).
+	namespace evdev {
+
+		// Describes an input device read by the backend.
+		struct DeviceInfo {
+			unsigned id = 0; // the value of KeyData.device and MouseData.device
+			std::string path;
+			std::string name;
+			unsigned kinds = 0; // combination of INPUT_DEVICE_ values
+			bool grabbed = false;
+		};
+
+		// Counters describing the work done by the backend.
+		struct Stats {
+			unsigned long long events = 0;  // number of input_events read
+			unsigned long long reads = 0;   // number of read calls
+			unsigned long long writes = 0;  // number of write calls to the output
+			unsigned long long blocked = 0; // number of key and mouse events blocked
+			unsigned long long repeats = 0; // number of auto-repeated key downs
+			unsigned long long dropped = 0; // number of times the kernel dropped events
+			// reports (frames of events ending in SYN_REPORT) by the time from
+			// their timestamp to when they were read, where bucket 0 counts
+			// latencies under 1us, and bucket i > 0 those from 2^(i-1) up to
+			// 2^i us; the last bucket also counts all longer latencies
+			unsigned long long latency[INPUT_LATENCY_BUCKETS] = { 0 };
+		};
+
+		// Translate a Linux key code (KEY_ or BTN_) to a virtual key code.
+		// Returns 0xFF for keys without one.
+		unsigned long toVirtualKey(unsigned short code);
+
+		// Open and grab the device at the given path, if it is a keyboard or a mouse.
+		// Returns true if successful, and false if otherwise, such as when
+		// there are no device IDs left.
+		bool addDevice(const std::string& path);
+
+		// Open and grab all keyboards and mice among the event devices in the
+		// given folder. Devices that are already open are skipped, so this can
+		// be called again to pick up newly connected devices.
+		// Returns the number of devices added.
+		int addDevices(const std::string& folder = "/dev/input");
+
+		// Read input_events from the given file descriptor, such as a pipe, as
+		// if it was a device of the given INPUT_DEVICE_ kinds. It is not grabbed,
+		// and is closed along with the other devices. Timestamps should be taken
+		// from CLOCK_MONOTONIC, the same as for grabbed devices, and events with
+		// a zero timestamp are left out of Stats.latency.
+		// Returns true if successful, and false if otherwise.
+		bool addFakeDevice(int fd, unsigned kinds);
+
+		// Create the uinput device that allowed events are emitted through.
+		// Returns true if successful, and false if otherwise.
+		bool openOutput();
+
+		// Emit the allowed events to the given file descriptor, such as a pipe,
+		// instead of a uinput device. It is closed by shutdown.
+		void setOutput(int fd);
+
+		// Record every key and mouse event passed to the handlers, along with
+		// the repeats they would have seen, as TraceRecords (see trace.hpp)
+		// written to the given file descriptor, or stop recording if fd is -1.
+		// The records are written along with the output. Should be called
+		// before start. The file descriptor is closed by shutdown.
+		void setTraceOutput(int fd);
+
+		// Set the key_handler_fn that decides whether key events are blocked.
+		// Auto-repeated key downs are only passed to the function, as
+		// INPUT_TYPE_KEYREPEAT, if repeats is true. Otherwise, they are blocked
+		// if the key down was. Key ups are always emitted if the key down was,
+		// so that no key is left held down on the output.
+		void setKeyHandler(key_handler_fn fn, bool repeats = false);
+
+		// Set the mouse_handler_fn that decides whether mouse events are blocked.
+		void setMouseHandler(mouse_handler_fn fn);
+
+		// Set the handlers used for the events of the given device, instead of
+		// those set by setKeyHandler and setMouseHandler. A null handler lets
+		// all events of its kind through, such as for an admin keyboard or a
+		// barcode scanner that should stay live while other devices are locked.
+		// The handlers are cleared when the device is removed.
+		void setDeviceHandlers(unsigned device, key_handler_fn key, mouse_handler_fn mouse);
+
+		// Use the handlers set by setKeyHandler and setMouseHandler for the
+		// events of the given device again.
+		void clearDeviceHandlers(unsigned device);
+
+		// Keep the tracked cursor position within the given size, in pixels,
+		// where 0 = no limit.
+		void setCursorBounds(long width, long height);
+
+		// Start reading the devices on an internal thread.
+		// Returns true if successful, and false if otherwise.
+		bool start();
+
+		// Stop the internal thread, then release and close all devices and the output.
+		void shutdown();
+
+		// Get a description of each device being read.
+		std::vector<DeviceInfo> getDevices();
+
+		// Get the counters describing the work done by the backend so far.
+		Stats getStats();
+	}
+}
@@ -0,0 +1,138 @@
+#include "gesture.hpp"
+
+#include <cmath>
+#include <cfloat>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define GESTURE_SSE
+#endif
+
+// The minimum length of the path, in pixels, for a stroke to be recognized.
+#define GESTURE_MIN_LENGTH 60.0f
+
+namespace input {
+
+	void StrokeSampler::begin(long x, long y) {
+		count = 0;
+		spacing = 2.0f;
+		carried = 0.0f;
+		length = 0.0f;
+		lastX = (float)x;
+		lastY = (float)y;
+		emit(lastX, lastY);
+	}
+
+	void StrokeSampler::emit(float x, float y) {
+		if (count == MAX_POINTS) {
+			// keep every other point, which keeps the points equidistant
+			for (int i = 1; i < MAX_POINTS / 2; i++) {
+				px[i] = px[i * 2];
+				py[i] = py[i * 2];
+			}
+			count = MAX_POINTS / 2;
+			spacing *= 2.0f;
+		}
+		px[count] = x;
+		py[count] = y;
+		++count;
+	}
+
+	void StrokeSampler::add(long x, long y) {
+		if (count == 0) return;
+
+		float fx = (float)x;
+		float fy = (float)y;
+		float dx = fx - lastX;
+		float dy = fy - lastY;
+		float dist = std::sqrt(dx * dx + dy * dy);
+		if (dist <= 0.0f) return;
+		length += dist;
+
+		// emit points along the segment every spacing pixels of path length
+		float t = spacing - carried;
+		while (t <= dist) {
+			emit(lastX + dx * (t / dist), lastY + dy * (t / dist));
+			t += spacing;
+		}
+		carried = dist - (t - spacing);
+		lastX = fx;
+		lastY = fy;
+	}
+
+	bool StrokeSampler::finish(Stroke& out) {
+		if (count < 2 || length < GESTURE_MIN_LENGTH) return false;
+		emit(lastX, lastY);
+
+		// the emitted points are equidistant, so resampling by index is enough
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+		float sumX = 0.0f, sumY = 0.0f;
+		for (int i = 0; i < GESTURE_POINTS; i++) {
+			float pos = (float)i * (count - 1) / (GESTURE_POINTS - 1);
+			int j = (int)pos;
+			float f = pos - j;
+			if (j >= count - 1) {
+				j = count - 2;
+				f = 1.0f;
+			}
+			float x = px[j] + (px[j + 1] - px[j]) * f;
+			float y = py[j] + (py[j + 1] - py[j]) * f;
+			out.x[i] = x;
+			out.y[i] = y;
+			sumX += x;
+			sumY += y;
+			if (x < minX) minX = x;
+			if (x > maxX) maxX = x;
+			if (y < minY) minY = y;
+			if (y > maxY) maxY = y;
+		}
+
+		// translate the centroid to the origin, and scale uniformly to a unit box
+		float cx = sumX / GESTURE_POINTS;
+		float cy = sumY / GESTURE_POINTS;
+		float size = maxX - minX > maxY - minY ? maxX - minX : maxY - minY;
+		float scale = size > 0.0f ? 1.0f / size : 1.0f;
+		for (int i = 0; i < GESTURE_POINTS; i++) {
+			out.x[i] = (out.x[i] - cx) * scale;
+			out.y[i] = (out.y[i] - cy) * scale;
+		}
+		count = 0;
+		return true;
+	}
+
+	float strokeDistance(const Stroke& a, const Stroke& b) {
+#ifdef GESTURE_SSE
+		__m128 sum = _mm_setzero_ps();
+		for (int i = 0; i < GESTURE_POINTS; i += 4) {
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(&a.x[i]), _mm_loadu_ps(&b.x[i]));
+			__m128 dy = _mm_sub_ps(_mm_loadu_ps(&a.y[i]), _mm_loadu_ps(&b.y[i]));
+			sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+		}
+		float parts[4];
+		_mm_storeu_ps(parts, sum);
+		return (parts[0] + parts[1] + parts[2] + parts[3]) / GESTURE_POINTS;
+#else
+		float sum = 0.0f;
+		for (int i = 0; i < GESTURE_POINTS; i++) {
+			float dx = a.x[i] - b.x[i];
+			float dy = a.y[i] - b.y[i];
+			sum += dx * dx + dy * dy;
+		}
+		return sum / GESTURE_POINTS;
+#endif
+	}
+
+	int matchStroke(const Stroke& stroke, const std::vector<Stroke>& templates, float *distance) {
+		int best = -1;
+		float bestDist = FLT_MAX;
+		for (size_t i = 0; i < templates.size(); i++) {
+			float dist = strokeDistance(stroke, templates[i]);
+			if (dist < bestDist) {
+				bestDist = dist;
+				best = (int)i;
+			}
+		}
+		if (distance) *distance = bestDist;
+		return best;
+	}
+}
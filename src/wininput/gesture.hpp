@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+// The number of points a stroke is resampled to before it is scored.
+#define GESTURE_POINTS 64
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// A stroke resampled to GESTURE_POINTS equidistant points, translated so
+	// that its centroid is at the origin, and scaled to fit a unit box.
+	// The coordinates are kept in separate arrays so that they can be scored
+	// 4 points at a time.
+	struct Stroke {
+		float x[GESTURE_POINTS];
+		float y[GESTURE_POINTS];
+	};
+
+	// Incrementally resamples the path of a stroke while it is being drawn.
+	// Points are emitted at a fixed spacing along the path as movements arrive,
+	// and the spacing is doubled whenever the fixed buffer fills up, so memory
+	// use is bounded and adding a movement never allocates.
+	class StrokeSampler {
+	public:
+		// Start a new stroke at the given position.
+		void begin(long x, long y);
+
+		// Extend the stroke to the given position.
+		void add(long x, long y);
+
+		// Resample the stroke to GESTURE_POINTS points and normalize it.
+		// Returns false if the stroke is too short to be recognized.
+		bool finish(Stroke& out);
+
+	private:
+		static const int MAX_POINTS = 1024;
+		float px[MAX_POINTS];
+		float py[MAX_POINTS];
+		int count = 0;
+		float spacing = 2.0f;
+		float lastX = 0.0f;
+		float lastY = 0.0f;
+		float carried = 0.0f; // path length since the last emitted point
+		float length = 0.0f;
+
+		void emit(float x, float y);
+	};
+
+	// Returns the mean squared distance between the corresponding points of the
+	// two strokes. Vectorized with SSE where available.
+	float strokeDistance(const Stroke& a, const Stroke& b);
+
+	// Returns the index of the template closest to the given stroke, or -1 if
+	// there are no templates. The distance to that template is written to distance.
+	int matchStroke(const Stroke& stroke, const std::vector<Stroke>& templates, float *distance);
+}
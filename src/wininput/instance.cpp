@@ -0,0 +1,70 @@
+#include "instance.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace input {
+
+	HookOwner::~HookOwner() {
+		release();
+	}
+
+#ifdef _WIN32
+	bool HookOwner::acquire(const std::string& name) {
+		if (owner) return true;
+		// the mutex can outlive an owner that has exited while another
+		// process still has it open, so ownership is taken by waiting on it,
+		// and not by whether it already exists
+		HANDLE handle = CreateMutexA(NULL, FALSE, ("Local\\" + name).c_str());
+		if (handle == NULL) return false;
+		DWORD res = WaitForSingleObject(handle, 0);
+		if (res != WAIT_OBJECT_0 && res != WAIT_ABANDONED) {
+			CloseHandle(handle);
+			return false;
+		}
+		mutex = handle;
+		owner = true;
+		return true;
+	}
+
+	void HookOwner::release() {
+		if (mutex == nullptr) return;
+		ReleaseMutex((HANDLE)mutex);
+		CloseHandle((HANDLE)mutex);
+		mutex = nullptr;
+		owner = false;
+	}
+#else
+	bool HookOwner::acquire(const std::string& name) {
+		if (owner) return true;
+		// the runtime folder belongs to the user, and the fallback is told
+		// apart by the ID of the user
+		const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+		std::string path = runtime && *runtime ? std::string(runtime) + "/" + name + ".lock"
+			: "/tmp/" + name + "." + std::to_string(getuid()) + ".lock";
+		int file = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (file < 0) return false;
+		if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+			close(file);
+			return false;
+		}
+		fd = file;
+		owner = true;
+		return true;
+	}
+
+	void HookOwner::release() {
+		if (fd < 0) return;
+		flock(fd, LOCK_UN);
+		close(fd);
+		fd = -1;
+		owner = false;
+	}
+#endif
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// Ownership of the hooks of a session, so that a second process started
+	// in it, such as by a startup script and then by hand, does not install
+	// its own hooks alongside those of the first. On Windows, the owner holds
+	// a named mutex in the Local namespace, which is separate for each session
+	// of a terminal server. On Linux, it holds a lock on a file in the runtime
+	// folder of the user. Either way, ownership ends with the process, even if
+	// it crashes.
+	class HookOwner {
+	public:
+		HookOwner() {}
+		~HookOwner();
+
+		HookOwner(const HookOwner&) = delete;
+		HookOwner& operator=(const HookOwner&) = delete;
+
+		// Become the owner of the hooks of the session under the given name,
+		// without waiting for another owner.
+		// Returns true if successful, and false if another process is the owner.
+		bool acquire(const std::string& name);
+
+		// Give up ownership, so that another process can acquire it.
+		void release();
+
+		// Returns true if this process is the owner.
+		bool isOwner() const { return owner; }
+
+	private:
+		bool owner = false;
+#ifdef _WIN32
+		void *mutex = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+}
@@ -0,0 +1,329 @@
+#include "journal.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+// The first bytes of a journal, followed by the size of its records. The
+// header is padded to the size of a record, so that no record crosses a
+// sector of the disk.
+#define JOURNAL_MAGIC "PLJN"
+#define JOURNAL_HEADER 16
+// The types of JournalRecord: the state when the journal was compacted, and
+// a state recorded since.
+#define JOURNAL_CHECKPOINT 1
+#define JOURNAL_TRANSITION 2
+// The bits of the index of a state in the queue that are packed with it.
+#define JOURNAL_INDEX_MASK 0xFFFFFFULL
+
+namespace {
+	using input::JournalRecord;
+
+	unsigned long long nowMicros() {
+		return (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// a state waiting in the queue: the state in the low byte, then the low
+	// bits of its index, then the microseconds when it was recorded
+	unsigned long long pack(unsigned char state, unsigned long long index, unsigned long long time) {
+		return state | (index & JOURNAL_INDEX_MASK) << 8 | (time & 0xFFFFFFFFULL) << 32;
+	}
+
+	// CRC-32 of the fields of a record before its check
+	unsigned int checkRecord(const JournalRecord& record) {
+		const unsigned char *p = (const unsigned char*)&record;
+		unsigned int crc = 0xFFFFFFFF;
+		for (size_t i = 0; i < offsetof(JournalRecord, check); i++) {
+			crc ^= p[i];
+			for (int bit = 0; bit < 8; bit++)
+				crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+		return ~crc;
+	}
+
+	// flush the file through to the disk
+	bool syncFile(FILE *file) {
+		if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+		return _commit(_fileno(file)) == 0;
+#else
+		return fsync(fileno(file)) == 0;
+#endif
+	}
+
+	// replace the file at to with that at from, durably
+	bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+		return MoveFileExA(from.c_str(), to.c_str(),
+			MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		if (std::rename(from.c_str(), to.c_str()) != 0) return false;
+		// the rename is only durable once the folder is
+		size_t slash = to.find_last_of('/');
+		std::string folder = slash == std::string::npos ? "." : to.substr(0, slash + 1);
+		int fd = ::open(folder.c_str(), O_RDONLY);
+		if (fd >= 0) {
+			fsync(fd);
+			close(fd);
+		}
+		return true;
+#endif
+	}
+}
+
+namespace input {
+
+	StateJournal::~StateJournal() {
+		stop();
+	}
+
+	bool StateJournal::open(const std::string& path, unsigned char& state) {
+		this->path = path;
+		// left by a crash while compacting, before it replaced the journal
+		std::remove((path + ".tmp").c_str());
+
+		bool recovered = false;
+		file = std::fopen(path.c_str(), "r+b");
+		if (file) {
+			char magic[4];
+			unsigned int size = 0;
+			if (std::fread(magic, 1, 4, file) == 4 && std::fread(&size, sizeof(size), 1, file) == 1
+				&& std::memcmp(magic, JOURNAL_MAGIC, 4) == 0 && size == sizeof(JournalRecord)
+				&& std::fseek(file, 0, SEEK_END) == 0) {
+				long end = std::ftell(file);
+				count = (int)std::min<long>(std::max<long>(end - JOURNAL_HEADER, 0)
+					/ (long)sizeof(JournalRecord), INPUT_JOURNAL_RECORDS);
+
+				// a crash can only tear the records of the last batch, so only
+				// those are read, from the last, until one is whole
+				for (int i = 0; i < INPUT_JOURNAL_QUEUE && count > 0 && !recovered; i++) {
+					JournalRecord record;
+					std::fseek(file, JOURNAL_HEADER + (long)(count - 1) * sizeof(JournalRecord), SEEK_SET);
+					if (std::fread(&record, sizeof(record), 1, file) == 1 && record.check == checkRecord(record)) {
+						state = record.state;
+						last = record.state;
+						sequence = record.sequence + 1;
+						recovered = true;
+					} else {
+						--count;
+					}
+				}
+			}
+			if (!recovered) {
+				std::fclose(file);
+				file = nullptr;
+			}
+		}
+
+		// start over if there is no journal, or nothing could be recovered from it
+		if (!recovered) {
+			count = 0;
+			if (create(path, nullptr, 0)) file = std::fopen(path.c_str(), "r+b");
+		}
+		return recovered;
+	}
+
+	void StateJournal::start() {
+		if (running.load() || !file) return;
+#ifdef _WIN32
+		wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (wakeEvent == NULL) return;
+#else
+		wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (wakeFd < 0) return;
+#endif
+		tail = head.load();
+		running.store(true);
+		writer = std::thread(&StateJournal::run, this);
+	}
+
+	void StateJournal::record(unsigned char state) {
+		if (!running.load(std::memory_order_relaxed)) return;
+		// once full, the oldest state waiting is replaced, which the writer
+		// tells by its index
+		unsigned long long index = head.load(std::memory_order_relaxed);
+		queue[index % INPUT_JOURNAL_QUEUE].store(pack(state, index, nowMicros()), std::memory_order_release);
+		head.store(index + 1, std::memory_order_release);
+		signal();
+	}
+
+	void StateJournal::stop() {
+		if (running.exchange(false)) signal();
+		if (writer.joinable()) writer.join();
+#ifdef _WIN32
+		if (wakeEvent) CloseHandle(wakeEvent);
+		wakeEvent = nullptr;
+#else
+		if (wakeFd >= 0) close(wakeFd);
+		wakeFd = -1;
+#endif
+		if (file) {
+			std::fclose(file);
+			file = nullptr;
+		}
+	}
+
+	JournalStats StateJournal::getStats() {
+		std::lock_guard<std::mutex> lock(statsMutex);
+		JournalStats copy = stats;
+		// only updated by the writer, so those recorded since are counted here
+		copy.recorded = head.load();
+		return copy;
+	}
+
+	// wake the writer, without blocking
+	void StateJournal::signal() {
+#ifdef _WIN32
+		SetEvent(wakeEvent);
+#else
+		unsigned long long one = 1;
+		ssize_t res = write(wakeFd, &one, sizeof(one));
+		(void)res; // only fails if the counter is about to overflow, when the writer is awake anyway
+#endif
+	}
+
+	// wait for signal, or return at once if it was called since the last wait
+	void StateJournal::wait() {
+#ifdef _WIN32
+		WaitForSingleObject(wakeEvent, INFINITE);
+#else
+		pollfd fd = { wakeFd, POLLIN, 0 };
+		poll(&fd, 1, -1);
+		unsigned long long count;
+		ssize_t res = read(wakeFd, &count, sizeof(count));
+		(void)res;
+#endif
+	}
+
+	// move the states waiting into batch, oldest first, and count those that
+	// were replaced before they could be taken
+	// Returns the number of states in batch.
+	int StateJournal::take(Pending *batch, unsigned long long& replaced) {
+		unsigned long long end = head.load(std::memory_order_acquire);
+		replaced = 0;
+		if (end - tail > INPUT_JOURNAL_QUEUE) {
+			replaced = end - tail - INPUT_JOURNAL_QUEUE;
+			tail = end - INPUT_JOURNAL_QUEUE;
+		}
+		int size = 0;
+		for (unsigned long long i = tail; i < end; i++) {
+			unsigned long long value = queue[i % INPUT_JOURNAL_QUEUE].load(std::memory_order_acquire);
+			if ((value >> 8 & JOURNAL_INDEX_MASK) != (i & JOURNAL_INDEX_MASK)) {
+				// replaced by a later state, which the next batch takes
+				++replaced;
+				continue;
+			}
+			batch[size++] = { (unsigned char)value, (unsigned int)(value >> 32) };
+		}
+		tail = end;
+		return size;
+	}
+
+	void StateJournal::run() {
+		Pending batch[INPUT_JOURNAL_QUEUE];
+		while (true) {
+			// states recorded before stop are still written
+			bool stopping = !running.load();
+			unsigned long long replaced;
+			int size = take(batch, replaced);
+			bool written = size > 0 && append(batch, size);
+			unsigned int now = (unsigned int)nowMicros();
+
+			{
+				std::lock_guard<std::mutex> lock(statsMutex);
+				stats.replaced += replaced;
+				stats.bytes = bytes;
+				stats.compactions = compactions;
+				if (written) {
+					stats.written += size;
+					++stats.syncs;
+					for (int i = 0; i < size; i++) {
+						unsigned long long time = (unsigned int)(now - batch[i].time);
+						stats.durableTime += time;
+						stats.maxDurableTime = std::max(stats.maxDurableTime, time);
+					}
+				}
+			}
+
+			// everything recorded while this batch was written goes in the next
+			if (size == 0 && replaced == 0) {
+				if (stopping) break;
+				wait();
+			}
+		}
+	}
+
+	bool StateJournal::append(const Pending *batch, int size) {
+		if (!file) return false;
+		if (count + size > INPUT_JOURNAL_RECORDS) return compact(batch, size);
+
+		JournalRecord records[INPUT_JOURNAL_QUEUE];
+		for (int i = 0; i < size; i++)
+			records[i] = makeRecord(JOURNAL_TRANSITION, batch[i].state);
+		if (std::fseek(file, JOURNAL_HEADER + (long)count * sizeof(JournalRecord), SEEK_SET) != 0
+			|| std::fwrite(records, sizeof(JournalRecord), size, file) != (size_t)size
+			|| !syncFile(file)) return false;
+
+		count += size;
+		last = batch[size - 1].state;
+		bytes += size * sizeof(JournalRecord);
+		return true;
+	}
+
+	bool StateJournal::compact(const Pending *batch, int size) {
+		// the new journal starts with the last state, followed by the batch,
+		// and replaces the old one only once it is durable
+		JournalRecord records[INPUT_JOURNAL_QUEUE + 1];
+		records[0] = makeRecord(JOURNAL_CHECKPOINT, last);
+		for (int i = 0; i < size; i++)
+			records[i + 1] = makeRecord(JOURNAL_TRANSITION, batch[i].state);
+
+		std::string temp = path + ".tmp";
+		if (!create(temp, records, size + 1)) return false;
+		std::fclose(file);
+		bool replaced = replaceFile(temp, path);
+		file = std::fopen(path.c_str(), "r+b");
+		if (!replaced || !file) return false;
+
+		count = size + 1;
+		last = batch[size - 1].state;
+		++compactions;
+		return true;
+	}
+
+	bool StateJournal::create(const std::string& target, const JournalRecord *records, int size) {
+		FILE *out = std::fopen(target.c_str(), "wb");
+		if (!out) return false;
+		unsigned int header[JOURNAL_HEADER / 4] = { 0, sizeof(JournalRecord) };
+		std::memcpy(header, JOURNAL_MAGIC, 4);
+		bool res = std::fwrite(header, sizeof(header), 1, out) == 1
+			&& (size == 0 || std::fwrite(records, sizeof(JournalRecord), size, out) == (size_t)size)
+			&& syncFile(out);
+		std::fclose(out);
+		if (res) bytes += JOURNAL_HEADER + size * sizeof(JournalRecord);
+		return res;
+	}
+
+	JournalRecord StateJournal::makeRecord(unsigned char type, unsigned char state) {
+		JournalRecord record;
+		record.sequence = sequence++;
+		record.type = type;
+		record.state = state;
+		record.time = (unsigned int)std::time(nullptr);
+		record.check = checkRecord(record);
+		return record;
+	}
+}
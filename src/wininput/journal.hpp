@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// The number of records a journal holds before it is compacted into a
+// checkpoint, which bounds both its size and the time taken to recover it.
+#define INPUT_JOURNAL_RECORDS 256
+// The number of recorded states waiting to be written. Once full, each state
+// recorded replaces the oldest one waiting.
+#define INPUT_JOURNAL_QUEUE 32
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// A record of a journal, which is the same size on every platform.
+	struct JournalRecord {
+		unsigned int sequence = 0; // increases by one with each record, across compactions
+		unsigned char type = 0;    // checkpoint or transition, see journal.cpp
+		unsigned char state = 0;
+		unsigned short reserved = 0;
+		unsigned int time = 0;     // seconds since the epoch when it was written
+		unsigned int check = 0;    // CRC-32 of the fields above
+	};
+
+	static_assert(sizeof(JournalRecord) == 16, "JournalRecord should be 16 bytes");
+
+	// Counters of a StateJournal, see getStats.
+	struct JournalStats {
+		unsigned long long recorded = 0;    // states given to record
+		unsigned long long replaced = 0;    // states replaced while waiting, as the queue was full
+		unsigned long long written = 0;     // records of states written
+		unsigned long long syncs = 0;       // durable writes, one per batch
+		unsigned long long compactions = 0;
+		unsigned long long bytes = 0;       // bytes written to the file, including compactions
+		unsigned long long durableTime = 0; // total microseconds from record until durable
+		unsigned long long maxDurableTime = 0;
+	};
+
+	// An append-only journal of a single small state, such as the mode of
+	// Padlock, that is kept across crashes and restarts. States are given to
+	// record without locks, such as from the thread of the hooks, and are
+	// written by a thread of the journal in batches, with one durable write
+	// for all of those waiting. Recovery only
+	// reads the last records, and the file is compacted into a checkpoint of
+	// the last state once it holds INPUT_JOURNAL_RECORDS, so both take constant
+	// time however many states have been recorded.
+	class StateJournal {
+	public:
+		StateJournal() {}
+		~StateJournal();
+
+		StateJournal(const StateJournal&) = delete;
+		StateJournal& operator=(const StateJournal&) = delete;
+
+		// Open the journal at the given path, creating it if needed, and read
+		// the last state recorded in it into state. A record torn by a crash
+		// is skipped, in favour of the one before it.
+		// Returns true if a state was recovered, and false if otherwise.
+		bool open(const std::string& path, unsigned char& state);
+
+		// Start writing recorded states. States recorded before are ignored,
+		// such as the one recovered by open.
+		void start();
+
+		// Record the given state, to be written shortly. Never takes a lock
+		// or waits for the writer, so it can be called on the hook path.
+		// Only one thread may record at a time.
+		void record(unsigned char state);
+
+		// Write the states waiting, then stop the writer and close the file.
+		void stop();
+
+		// Returns a copy of the counters of the journal.
+		JournalStats getStats();
+
+	private:
+		struct Pending {
+			unsigned char state;
+			unsigned int time; // microseconds of a steady clock, wrapping around
+		};
+
+		std::string path;
+		FILE *file = nullptr;
+		int count = 0;              // records in the file
+		unsigned int sequence = 0;  // of the next record
+		unsigned char last = 0;     // the last state written, for checkpoints
+		unsigned long long bytes = 0;       // written to the file, only by the writer
+		unsigned long long compactions = 0; // only by the writer
+
+		std::thread writer;
+		std::atomic<bool> running{ false };
+#ifdef _WIN32
+		void *wakeEvent = nullptr; // an auto-reset event
+#else
+		int wakeFd = -1;           // an eventfd
+#endif
+
+		// a ring of the states recorded, with the index of each packed with
+		// it, so that the writer can tell those replaced while it read them;
+		// head is only written by record, and tail only by the writer
+		std::atomic<unsigned long long> queue[INPUT_JOURNAL_QUEUE];
+		std::atomic<unsigned long long> head{ 0 };
+		unsigned long long tail = 0;
+
+		// guards stats, which are only written by the writer
+		std::mutex statsMutex;
+		JournalStats stats;
+
+		void run();
+		int take(Pending *batch, unsigned long long& replaced);
+		void signal();
+		void wait();
+		bool append(const Pending *batch, int size);
+		bool compact(const Pending *batch, int size);
+		bool create(const std::string& target, const JournalRecord *records, int size);
+		JournalRecord makeRecord(unsigned char type, unsigned char state);
+	};
+}
@@ -0,0 +1,48 @@
+#include "keybuffer.hpp"
+
+namespace input {
+
+	bool isTypingKey(unsigned long code) {
+		return code == 0x20                     // space
+			|| (code >= 0x30 && code <= 0x39)   // 0 to 9
+			|| (code >= 0x41 && code <= 0x5A)   // A to Z
+			|| (code >= 0x60 && code <= 0x6F)   // keypad digits and operators
+			|| (code >= 0xBA && code <= 0xC0)   // punctuation
+			|| (code >= 0xDB && code <= 0xDF)
+			|| code == 0xE2
+			|| code == 0x10 || code == 0xA0 || code == 0xA1; // shift
+	}
+
+	int KeyBuffer::release(unsigned long stripFrom, unsigned long now, BufferedKey *out, bool *held) {
+		for (int vk = 0; vk < 256; vk++)
+			held[vk] = false;
+
+		// the window ends where the stripped key downs start, if there are any
+		for (int n = 0; n < count; n++) {
+			const BufferedKey& key = keys[(start + n) % INPUT_KEYBUFFER_SIZE];
+			if (!key.up && key.index > stripFrom) {
+				now = key.time;
+				break;
+			}
+		}
+
+		int replayed = 0;
+		for (int n = 0; n < count; n++) {
+			const BufferedKey& key = keys[(start + n) % INPUT_KEYBUFFER_SIZE];
+			unsigned long vk = key.code & 0xFF;
+
+			if (key.up) {
+				if (!held[vk]) continue;
+				held[vk] = false;
+			} else {
+				if (key.index > stripFrom || key.chord || !isTypingKey(vk)
+					|| (long)(now - key.time) > INPUT_KEYBUFFER_WINDOW) continue;
+				held[vk] = true;
+			}
+			out[replayed++] = key;
+		}
+
+		clear();
+		return replayed;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// The maximum number of blocked key events that are buffered; older events are overwritten.
+#define INPUT_KEYBUFFER_SIZE 256
+// Only key events blocked within this many milliseconds before the unlock are replayed.
+#define INPUT_KEYBUFFER_WINDOW 3000
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// A blocked key event, as kept by a KeyBuffer.
+	struct BufferedKey {
+		unsigned long code;  // virtual key code
+		unsigned long scan;  // hardware scan code
+		bool up;
+		bool extended;
+		bool chord;          // whether ctrl, alt, or a Windows key was held down
+		unsigned long time;  // in milliseconds
+		unsigned long index; // the number of key downs seen by sequences, see KeyBuffer::release
+	};
+
+	// Returns true if the key with the given virtual key code types a
+	// character, or is a shift key.
+	bool isTypingKey(unsigned long code);
+
+	// A ring of blocked key events, which are either discarded or replayed
+	// once the user unlocks. Memory is fixed, and adding an event takes
+	// constant time.
+	// Only what was being typed just before the unlock is replayed: events
+	// older than INPUT_KEYBUFFER_WINDOW, keys that do not type a character,
+	// and keys pressed along with ctrl, alt, or a Windows key are left out,
+	// so that no shortcut, such as Alt+F4 or Ctrl+W, reaches the focused window.
+	// Should only be accessed by a single thread, such as the one of the hooks.
+	class KeyBuffer {
+	public:
+		// Add a key event, overwriting the oldest one if the buffer is full.
+		void add(const BufferedKey& key) {
+			int i = (start + count) % INPUT_KEYBUFFER_SIZE;
+			if (count < INPUT_KEYBUFFER_SIZE)
+				++count;
+			else
+				start = (start + 1) % INPUT_KEYBUFFER_SIZE;
+			keys[i] = key;
+		}
+
+		// Returns the number of key events in the buffer.
+		int size() const {
+			return count;
+		}
+
+		// Empty the buffer, taking the events to replay, in order, into out,
+		// which should hold INPUT_KEYBUFFER_SIZE events. Key downs with an
+		// index after stripFrom are left out, such as those of a sequence that
+		// was just matched, along with any event older than the window before
+		// the first of those key downs, or before now if there are none, and
+		// those described above. A key up is only replayed if its
+		// key down was, and held is set for the keys whose key down was
+		// replayed without a key up, out of 256.
+		// Returns the number of events taken into out.
+		int release(unsigned long stripFrom, unsigned long now, BufferedKey *out, bool *held);
+
+		// Empty the buffer without replaying any events.
+		void clear() {
+			start = 0;
+			count = 0;
+		}
+
+	private:
+		BufferedKey keys[INPUT_KEYBUFFER_SIZE];
+		int start = 0;
+		int count = 0;
+	};
+}
@@ -1,13 +1,174 @@
 
 #include "keymap.hpp"
 
+#include <mutex>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 namespace {
+	using input::KeyLayout;
+
 	std::map<unsigned, std::string> map;
-	std::map<unsigned, std::string> shifted;
+
+	// the keys that are named by the text they type on the layout in use
+	const unsigned typedKeys[] = {
+		0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+		0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF, 0xC0, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF, 0xE2
+	};
+
+	// the names of the typed keys on a layout, indexed by virtual-key code,
+	// where an empty name means the key types no text
+	struct LayoutNames {
+		unsigned long long id = 0;
+		bool valid = false;
+		std::string normal[256];
+		std::string shifted[256];
+	};
+
+#ifdef _WIN32
+	// the layouts of the system, where the layout IDs are HKLs
+	class SystemKeyLayout : public KeyLayout {
+	public:
+		unsigned long long current() override {
+			return (unsigned long long)(ULONG_PTR)GetKeyboardLayout(0);
+		}
+
+		bool translate(unsigned long long layout, unsigned code, bool shift,
+			std::string& text) override {
+			HKL hkl = (HKL)(ULONG_PTR)layout;
+			BYTE keyState[256] = { 0 };
+			if (shift) keyState[VK_SHIFT] = 0x80;
+			UINT scanCode = MapVirtualKeyEx(code, MAPVK_VK_TO_VSC, hkl);
+
+			// flag 0x4 keeps the state of dead keys as is, on Windows 10 1607
+			// and later; before that, the dead key is typed again to clear it
+			WCHAR buffer[8];
+			int length = ToUnicodeEx(code, scanCode, keyState, buffer, 8, 0x4, hkl);
+			if (length < 0) {
+				WCHAR discard[8];
+				ToUnicodeEx(code, scanCode, keyState, discard, 8, 0x4, hkl);
+				length = 1; // the dead key itself
+			}
+			if (length == 0 || buffer[0] < 0x20) return false;
+
+			// the text is shown in ANSI controls
+			char out[16];
+			BOOL usedDefault = FALSE;
+			int size = WideCharToMultiByte(CP_ACP, 0, buffer, length, out, sizeof(out),
+				NULL, &usedDefault);
+			if (size <= 0 || usedDefault) return false;
+			text.assign(out, size);
+			return true;
+		}
+	};
+
+	SystemKeyLayout defaultLayout;
+#else
+	input::FixedKeyLayout defaultLayout;
+#endif
+
+	// the names of the layouts used most recently, along with the layout in
+	// use, all guarded by namesMutex
+	LayoutNames names[INPUT_LAYOUT_CACHE];
+	int nextNames = 0; // the entry replaced next once all are in use
+	unsigned long long currentLayout = 0;
+	bool haveCurrent = false;
+	KeyLayout *keyLayout = &defaultLayout;
+	std::mutex namesMutex;
+
+	// brackets enclose keys with modifiers, so they are named instead
+	std::string escapeName(const std::string& text) {
+		if (text == "[") return "LB";
+		if (text == "]") return "RB";
+		return text;
+	}
+
+	// returns the names of the layout in use, built on first use
+	const LayoutNames& getNames() {
+		if (!haveCurrent) {
+			currentLayout = keyLayout->current();
+			haveCurrent = true;
+		}
+		for (auto& entry : names) {
+			if (entry.valid && entry.id == currentLayout) return entry;
+		}
+
+		LayoutNames& entry = names[nextNames];
+		nextNames = (nextNames + 1) % INPUT_LAYOUT_CACHE;
+		entry.id = currentLayout;
+		entry.valid = true;
+		for (unsigned code : typedKeys) {
+			std::string text;
+			entry.normal[code] = keyLayout->translate(currentLayout, code, false, text) ?
+				escapeName(text) : std::string();
+			text.clear();
+			entry.shifted[code] = keyLayout->translate(currentLayout, code, true, text) ?
+				escapeName(text) : std::string();
+		}
+		return entry;
+	}
 }
 
 namespace input {
 
+	FixedKeyLayout::FixedKeyLayout(unsigned long long id) : id(id) {
+		const char *digits = ")!@#$%^&*(";
+		for (unsigned i = 0; i < 10; i++) {
+			char normal[2] = { (char)('0' + i), 0 };
+			char shifted[2] = { digits[i], 0 };
+			set(0x30 + i, normal, shifted);
+		}
+		set(0xBA, ";", ":");
+		set(0xBB, "=", "+");
+		set(0xBC, ",", "<");
+		set(0xBD, "-", "_");
+		set(0xBE, ".", ">");
+		set(0xBF, "/", "?");
+		set(0xC0, "`", "~");
+		set(0xDB, "[", "{");
+		set(0xDC, "\\", "|");
+		set(0xDD, "]", "}");
+		set(0xDE, "'", "\"");
+	}
+
+	void FixedKeyLayout::set(unsigned code, const char *normal, const char *shifted) {
+		if (normal && *normal) this->normal[code] = normal;
+		else this->normal.erase(code);
+		if (shifted && *shifted) this->shifted[code] = shifted;
+		else this->shifted.erase(code);
+	}
+
+	unsigned long long FixedKeyLayout::current() {
+		return id;
+	}
+
+	bool FixedKeyLayout::translate(unsigned long long layout, unsigned code, bool shift,
+		std::string& text) {
+		if (layout != id) return false;
+		auto& table = shift ? shifted : normal;
+		auto it = table.find(code);
+		if (it == table.end()) return false;
+		text = it->second;
+		return true;
+	}
+
+	void setKeyLayout(KeyLayout *layout) {
+		std::lock_guard<std::mutex> lock(namesMutex);
+		keyLayout = layout ? layout : &defaultLayout;
+		for (auto& entry : names) entry.valid = false;
+		haveCurrent = false;
+	}
+
+	void notifyLayoutChange(unsigned long long layout) {
+		std::lock_guard<std::mutex> lock(namesMutex);
+		currentLayout = layout;
+		haveCurrent = true;
+		for (auto& entry : names) {
+			if (entry.id == layout) entry.valid = false;
+		}
+	}
+
 	void setupCodemap() {
 		map[0x10] = "Shift";
 		map[0x11] = "Ctrl";
@@ -88,6 +249,7 @@ namespace input {
 		map[0x87] = "F24";
 		map[0xDF] = "OEM8";
 
+		// names of the typed keys when the layout types no text for them
 		map[0xBA] = ";";
 		map[0xBB] = "=";
 		map[0xBC] = ",";
@@ -99,34 +261,15 @@ namespace input {
 		map[0xDC] = "\\";
 		map[0xDD] = "RB";
 		map[0xDE] = "'";
-
-		shifted[0xBA] = ":";
-		shifted[0xBB] = "+";
-		shifted[0xBC] = "<";
-		shifted[0xBD] = "_";
-		shifted[0xBE] = ">";
-		shifted[0xBF] = "?";
-		shifted[0xC0] = "~";
-		shifted[0xDB] = "{";
-		shifted[0xDC] = "|";
-		shifted[0xDD] = "}";
-		shifted[0xDE] = "\"";
-
-		// number keys
-		shifted[0x30] = ")";
-		shifted[0x31] = "!";
-		shifted[0x32] = "@";
-		shifted[0x33] = "#";
-		shifted[0x34] = "$";
-		shifted[0x35] = "%";
-		shifted[0x36] = "^";
-		shifted[0x37] = "&";
-		shifted[0x38] = "*";
-		shifted[0x39] = "(";
+		map[0xE2] = "OEM102";
 	}
 
 	std::string keyToString(const KeyData& key) {
 		bool shift = key.shift;
+		std::lock_guard<std::mutex> lock(namesMutex);
+		const LayoutNames& layoutNames = getNames();
+		unsigned index = key.code < 256 ? key.code : 0; // 0 is never typed
+		bool digit = key.code >= 0x30 && key.code <= 0x39;
 
 		std::string base;
 		// A - Z
@@ -140,13 +283,18 @@ namespace input {
 				shift = false; // hide shift if it's the only modifier
 			base = arr;
 
-		// keys with special handling when shifted
-		} else if (shift && !key.ctrl && !key.alt && shifted.find(key.code) != shifted.end()) {
+		// keys that type other text when shifted
+		} else if (shift && !key.ctrl && !key.alt && !layoutNames.shifted[index].empty()) {
 			shift = false;
-			base = shifted[key.code];
+			base = layoutNames.shifted[index];
+
+		// keys named by the text they type, apart from digits with ctrl or
+		// alt, which are commands named by their key
+		} else if (!layoutNames.normal[index].empty() && !(digit && (key.ctrl || key.alt))) {
+			base = layoutNames.normal[index];
 
 		// 0 - 9
-		} else if (key.code >= 0x30 && key.code <= 0x39) {
+		} else if (digit) {
 			char arr[2] = "0";
 			arr[0] = (char)(key.code - 0x30) + '0';
 			base = arr;
@@ -4,13 +4,65 @@
 #include <map>
 #include "wininput.hpp"
 
+// The number of keyboard layouts whose key names are kept at once.
+#define INPUT_LAYOUT_CACHE 4
+// The ID of the US layout, the default of FixedKeyLayout.
+#define INPUT_LAYOUT_US 0x04090409ULL
+
 // Definitions provided by WinInput are contained within the 'input' scope
 namespace input {
 
+	// Translates keys to the text they type on a keyboard layout, for naming
+	// them. The names of each layout are built once from it and kept, so it is
+	// not called for each key named.
+	class KeyLayout {
+	public:
+		virtual ~KeyLayout() {}
+
+		// Returns the ID of the layout currently in use.
+		virtual unsigned long long current() = 0;
+
+		// Writes the text typed by the given virtual-key code on the given
+		// layout, with or without shift, to text.
+		// Returns true if successful, and false if the key types no text.
+		virtual bool translate(unsigned long long layout, unsigned code, bool shift,
+			std::string& text) = 0;
+	};
+
+	// A KeyLayout of fixed tables, such as for running the tools on Linux,
+	// where it is the default. It starts out as the US layout.
+	class FixedKeyLayout : public KeyLayout {
+	public:
+		explicit FixedKeyLayout(unsigned long long id = INPUT_LAYOUT_US);
+
+		// Sets the text typed by the given virtual-key code, without and with
+		// shift, where an empty string or nullptr means no text.
+		void set(unsigned code, const char *normal, const char *shifted);
+
+		unsigned long long current() override;
+		bool translate(unsigned long long layout, unsigned code, bool shift,
+			std::string& text) override;
+
+	private:
+		unsigned long long id;
+		std::map<unsigned, std::string> normal;
+		std::map<unsigned, std::string> shifted;
+	};
+
 	// Sets up the internal map used for mapping keys to strings.
 	// This must be called before any calls to keyToString is made.
 	void setupCodemap();
 
-	// Returns a string representation of the given KeyData.
+	// Sets the layout that keys are named by, or the default one of the
+	// platform if nullptr, which on Windows are the layouts of the system.
+	// The layout must outlive its use, and the names kept are discarded.
+	void setKeyLayout(KeyLayout *layout);
+
+	// Notify that the layout in use has changed to the given one, such as on
+	// WM_INPUTLANGCHANGE, so that its names are built again when next used.
+	void notifyLayoutChange(unsigned long long layout);
+
+	// Returns a string representation of the given KeyData, with the text
+	// that the key types on the layout in use, see setKeyLayout.
 	std::string keyToString(const KeyData& key);
-}
\ No newline at end of file
+}
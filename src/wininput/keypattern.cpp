@@ -0,0 +1,498 @@
+#include "keypattern.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <utility>
+
+namespace {
+	typedef std::bitset<input::KeyPattern::SYMBOLS> SymbolSet;
+	typedef std::bitset<256> KeySet;
+
+	// the largest count allowed in a {n,m} repetition
+	const int MAX_REPEAT = 64;
+
+	// modifier requirements of an atom
+	const int MOD_OFF = 0;
+	const int MOD_ON = 1;
+	const int MOD_ANY = 2;
+
+	struct NamedKey {
+		const char *name;
+		unsigned code;
+	};
+
+	const NamedKey namedKeys[] = {
+		{ "Back", 0x08 }, { "Tab", 0x09 }, { "Enter", 0x0D }, { "Esc", 0x1B },
+		{ "Space", 0x20 }, { "PgUp", 0x21 }, { "PgDn", 0x22 }, { "End", 0x23 },
+		{ "Home", 0x24 }, { "Left", 0x25 }, { "Up", 0x26 }, { "Right", 0x27 },
+		{ "Down", 0x28 }, { "Ins", 0x2D }, { "Del", 0x2E },
+	};
+
+	// a node of the parsed pattern
+	struct Node {
+		enum Type { SET, CONCAT, ALT, REPEAT } type;
+		int set;                   // index of the symbol set, for SET
+		int min;                   // for REPEAT
+		int max;                   // for REPEAT, where -1 = unbounded
+		std::vector<int> children; // indices of the child nodes
+	};
+
+	// recursive descent parser producing a list of nodes and symbol sets
+	class Parser {
+	public:
+		std::vector<Node> nodes;
+		std::vector<SymbolSet> sets;
+		std::string error;
+
+		explicit Parser(const char *pattern) : p(pattern) {}
+
+		// returns the index of the root node, or -1 on error
+		int parse() {
+			int root = parseAlt();
+			if (root >= 0 && *p != '\0') return fail("unexpected character");
+			return root;
+		}
+
+	private:
+		const char *p;
+
+		int fail(const char *msg) {
+			if (error.empty()) error = msg;
+			return -1;
+		}
+
+		bool reject(const char *msg) {
+			fail(msg);
+			return false;
+		}
+
+		int addNode(Node::Type type, int set = 0, int min = 0, int max = 0) {
+			Node node = { type, set, min, max, std::vector<int>() };
+			nodes.push_back(node);
+			return (int)nodes.size() - 1;
+		}
+
+		int parseAlt() {
+			int first = parseConcat();
+			if (first < 0 || *p != '|') return first;
+
+			int alt = addNode(Node::ALT);
+			nodes[alt].children.push_back(first);
+			while (*p == '|') {
+				++p;
+				int next = parseConcat();
+				if (next < 0) return -1;
+				nodes[alt].children.push_back(next);
+			}
+			return alt;
+		}
+
+		int parseConcat() {
+			int concat = addNode(Node::CONCAT);
+			while (*p != '\0' && *p != '|' && *p != ')') {
+				int next = parseRepeat();
+				if (next < 0) return -1;
+				nodes[concat].children.push_back(next);
+			}
+			return concat;
+		}
+
+		int parseRepeat() {
+			int atom = parseAtom();
+			while (atom >= 0 && (*p == '*' || *p == '?' || *p == '{')) {
+				int min = 0;
+				int max = -1;
+				if (*p == '?') {
+					max = 1;
+					++p;
+				} else if (*p == '*') {
+					++p;
+				} else {
+					++p;
+					if (!std::isdigit((unsigned char)*p)) return fail("expected a count after '{'");
+					min = max = (int)std::strtol(p, const_cast<char**>(&p), 10);
+					if (*p == ',') {
+						++p;
+						max = -1;
+						if (std::isdigit((unsigned char)*p))
+							max = (int)std::strtol(p, const_cast<char**>(&p), 10);
+					}
+					if (*p != '}') return fail("expected '}'");
+					++p;
+					if (min > MAX_REPEAT || max > MAX_REPEAT || (max >= 0 && max < min))
+						return fail("invalid repetition count");
+				}
+
+				int repeat = addNode(Node::REPEAT, 0, min, max);
+				nodes[repeat].children.push_back(atom);
+				atom = repeat;
+			}
+			return atom;
+		}
+
+		// parse a single modifier prefix, setting its requirement
+		void parseModifier(int& mod) {
+			++p;
+			mod = MOD_ON;
+			if (*p == '?') {
+				mod = MOD_ANY;
+				++p;
+			}
+		}
+
+		int parseAtom() {
+			if (*p == '(') {
+				++p;
+				int inner = parseAlt();
+				if (inner < 0) return -1;
+				if (*p != ')') return fail("expected ')'");
+				++p;
+				return inner;
+			}
+
+			int ctrl = MOD_OFF;
+			int shift = MOD_OFF;
+			int alt = MOD_OFF;
+			while (*p == '^' || *p == '+' || *p == '!' || *p == '~') {
+				if (*p == '^') parseModifier(ctrl);
+				else if (*p == '+') parseModifier(shift);
+				else if (*p == '!') parseModifier(alt);
+				else {
+					ctrl = shift = alt = MOD_ANY;
+					++p;
+				}
+			}
+
+			KeySet keys;
+			if (*p == '.') {
+				keys.set();
+				keys.reset(0);
+				++p;
+			} else if (*p == '\\') {
+				++p;
+				if (*p == 'd') addRange(keys, '0', '9');
+				else if (*p == 'w') {
+					addRange(keys, '0', '9');
+					addRange(keys, 'A', 'Z');
+				} else return fail("unknown escape");
+				++p;
+			} else if (*p == '[') {
+				++p;
+				if (!parseClass(keys)) return -1;
+			} else {
+				unsigned code;
+				if (!parseKey(code)) return -1;
+				keys.set(code);
+			}
+
+			SymbolSet set;
+			for (unsigned mods = 0; mods < 8; mods++) {
+				if (!allows(ctrl, mods & 1) || !allows(shift, mods & 2) || !allows(alt, mods & 4))
+					continue;
+				for (unsigned code = 0; code < 256; code++) {
+					if (keys.test(code)) set.set(code | (mods << 8));
+				}
+			}
+			sets.push_back(set);
+			return addNode(Node::SET, (int)sets.size() - 1);
+		}
+
+		static bool allows(int mod, unsigned held) {
+			return mod == MOD_ANY || (mod == MOD_ON) == (held != 0);
+		}
+
+		static void addRange(KeySet& keys, unsigned from, unsigned to) {
+			for (unsigned code = from; code <= to; code++) keys.set(code);
+		}
+
+		// parse the contents of a [] class, after the '['
+		bool parseClass(KeySet& keys) {
+			while (*p != ']') {
+				if (*p == '\0') return reject("expected ']'");
+				unsigned from;
+				if (!parseKey(from)) return false;
+				if (*p == '-' && p[1] != ']') {
+					++p;
+					unsigned to;
+					if (!parseKey(to)) return false;
+					if (to < from) return reject("invalid range");
+					addRange(keys, from, to);
+				} else {
+					keys.set(from);
+				}
+			}
+			++p;
+			return true;
+		}
+
+		// parse a letter, digit, or <Name>, giving its virtual key code
+		bool parseKey(unsigned& code) {
+			if (std::isalpha((unsigned char)*p)) {
+				code = (unsigned)std::toupper((unsigned char)*p++);
+				return true;
+			}
+			if (std::isdigit((unsigned char)*p)) {
+				code = (unsigned)*p++;
+				return true;
+			}
+			if (*p != '<') return reject("expected a key");
+
+			const char *end = std::strchr(p, '>');
+			if (!end) return reject("expected '>'");
+			code = input::parseKeyName(std::string(p + 1, end));
+			p = end + 1;
+			return code != 0 || reject("unknown key name");
+		}
+	};
+
+	struct NfaState {
+		std::vector<std::pair<int, int>> edges; // (symbol set, target state)
+		std::vector<int> eps;                   // targets of epsilon transitions
+	};
+
+	struct Fragment {
+		int in;
+		int out;
+	};
+
+	// Thompson construction of an NFA from the parsed nodes
+	class NfaBuilder {
+	public:
+		std::vector<NfaState> states;
+
+		explicit NfaBuilder(const std::vector<Node>& nodes) : nodes(nodes) {}
+
+		int addState() {
+			states.push_back(NfaState());
+			return (int)states.size() - 1;
+		}
+
+		Fragment build(int index) {
+			const Node& node = nodes[index];
+			switch (node.type) {
+			case Node::SET:
+			{
+				int in = addState();
+				int out = addState();
+				states[in].edges.push_back(std::make_pair(node.set, out));
+				return { in, out };
+			}
+			case Node::CONCAT:
+			{
+				int in = addState();
+				int cur = in;
+				for (int child : node.children) {
+					Fragment f = build(child);
+					states[cur].eps.push_back(f.in);
+					cur = f.out;
+				}
+				return { in, cur };
+			}
+			case Node::ALT:
+			{
+				int in = addState();
+				int out = addState();
+				for (int child : node.children) {
+					Fragment f = build(child);
+					states[in].eps.push_back(f.in);
+					states[f.out].eps.push_back(out);
+				}
+				return { in, out };
+			}
+			case Node::REPEAT:
+			default:
+			{
+				int in = addState();
+				int cur = in;
+				for (int i = 0; i < node.min; i++) {
+					Fragment f = build(node.children[0]);
+					states[cur].eps.push_back(f.in);
+					cur = f.out;
+				}
+
+				int out = addState();
+				if (node.max < 0) {
+					// loop back to a state that may exit or repeat again
+					int loop = addState();
+					Fragment f = build(node.children[0]);
+					states[cur].eps.push_back(loop);
+					states[loop].eps.push_back(f.in);
+					states[loop].eps.push_back(out);
+					states[f.out].eps.push_back(loop);
+				} else {
+					for (int i = node.min; i < node.max; i++) {
+						Fragment f = build(node.children[0]);
+						states[cur].eps.push_back(out);
+						states[cur].eps.push_back(f.in);
+						cur = f.out;
+					}
+					states[cur].eps.push_back(out);
+				}
+				return { in, out };
+			}
+			}
+		}
+
+	private:
+		const std::vector<Node>& nodes;
+	};
+
+	// return the epsilon closure of the given states, as a sorted list
+	std::vector<int> closure(const std::vector<NfaState>& states, std::vector<int> stack) {
+		std::vector<bool> seen(states.size(), false);
+		std::vector<int> result;
+		while (!stack.empty()) {
+			int s = stack.back();
+			stack.pop_back();
+			if (seen[s]) continue;
+			seen[s] = true;
+			result.push_back(s);
+			for (int t : states[s].eps) stack.push_back(t);
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+}
+
+namespace input {
+
+	unsigned parseKeyName(const std::string& name) {
+		if (name.size() > 2 && name[0] == '0' && (name[1] == 'x' || name[1] == 'X')) {
+			unsigned long code = std::strtoul(name.c_str() + 2, nullptr, 16);
+			if (code > 0 && code < 256) return (unsigned)code;
+		} else if (name.size() > 1 && (name[0] == 'F' || name[0] == 'f')
+			&& std::isdigit((unsigned char)name[1])) {
+			int n = std::atoi(name.c_str() + 1);
+			if (n >= 1 && n <= 24) return 0x70 + n - 1;
+		} else {
+			for (const NamedKey& key : namedKeys) {
+				if (name.size() != std::strlen(key.name)) continue;
+				bool same = true;
+				for (size_t i = 0; i < name.size() && same; i++)
+					same = std::tolower((unsigned char)name[i]) == std::tolower((unsigned char)key.name[i]);
+				if (same) return key.code;
+			}
+		}
+		return 0;
+	}
+
+	const char *getKeyName(unsigned code) {
+		for (const NamedKey& key : namedKeys)
+			if (key.code == code) return key.name;
+		return nullptr;
+	}
+
+	bool KeyPattern::compile(const char *pattern, std::string *error) {
+		Parser parser(pattern);
+		int root = parser.parse();
+		if (root < 0) {
+			if (error) *error = parser.error;
+			return false;
+		}
+
+		// unanchored matching: the start state loops on every symbol
+		SymbolSet any;
+		any.set();
+		parser.sets.push_back(any);
+		int anySet = (int)parser.sets.size() - 1;
+
+		NfaBuilder nfa(parser.nodes);
+		int nfaStart = nfa.addState();
+		Fragment body = nfa.build(root);
+		nfa.states[nfaStart].edges.push_back(std::make_pair(anySet, nfaStart));
+		nfa.states[nfaStart].eps.push_back(body.in);
+
+		// split the symbols into classes that no symbol set distinguishes
+		std::vector<int> symClass(SYMBOLS, 0);
+		int classCount = 1;
+		for (const SymbolSet& set : parser.sets) {
+			std::map<std::pair<int, bool>, int> remap;
+			for (int sym = 0; sym < SYMBOLS; sym++) {
+				auto key = std::make_pair(symClass[sym], (bool)set.test(sym));
+				auto it = remap.find(key);
+				if (it == remap.end()) it = remap.insert(std::make_pair(key, (int)remap.size())).first;
+				symClass[sym] = it->second;
+			}
+			classCount = (int)remap.size();
+		}
+		std::vector<int> rep(classCount, -1);
+		for (int sym = 0; sym < SYMBOLS; sym++) {
+			if (rep[symClass[sym]] < 0) rep[symClass[sym]] = sym;
+		}
+
+		// subset construction
+		std::map<std::vector<int>, int> dfaIds;
+		std::vector<std::vector<int>> dfaSets;
+		std::vector<int> trans;
+		dfaSets.push_back(closure(nfa.states, std::vector<int>(1, nfaStart)));
+		dfaIds[dfaSets[0]] = 0;
+		for (size_t d = 0; d < dfaSets.size(); d++) {
+			for (int c = 0; c < classCount; c++) {
+				std::vector<int> moved;
+				for (int s : dfaSets[d]) {
+					for (auto& edge : nfa.states[s].edges) {
+						if (parser.sets[edge.first].test(rep[c])) moved.push_back(edge.second);
+					}
+				}
+				std::vector<int> target = closure(nfa.states, moved);
+				auto it = dfaIds.find(target);
+				if (it == dfaIds.end()) {
+					if ((int)dfaSets.size() >= MAX_STATES) {
+						if (error) *error = "pattern is too complex";
+						return false;
+					}
+					it = dfaIds.insert(std::make_pair(target, (int)dfaSets.size())).first;
+					dfaSets.push_back(target);
+				}
+				trans.push_back(it->second);
+			}
+		}
+
+		int dfaCount = (int)dfaSets.size();
+		std::vector<int> block(dfaCount);
+		for (int d = 0; d < dfaCount; d++) {
+			block[d] = std::binary_search(dfaSets[d].begin(), dfaSets[d].end(), body.out) ? 1 : 0;
+		}
+
+		// minimize by refining the partition until no block is split
+		int blockCount = 0;
+		while (true) {
+			std::map<std::vector<int>, int> sigIds;
+			std::vector<int> next(dfaCount);
+			for (int d = 0; d < dfaCount; d++) {
+				std::vector<int> sig(1, block[d]);
+				for (int c = 0; c < classCount; c++) sig.push_back(block[trans[d * classCount + c]]);
+				auto it = sigIds.find(sig);
+				if (it == sigIds.end()) it = sigIds.insert(std::make_pair(sig, (int)sigIds.size())).first;
+				next[d] = it->second;
+			}
+			block.swap(next);
+			if ((int)sigIds.size() == blockCount) break;
+			blockCount = (int)sigIds.size();
+		}
+
+		// build the dense transition table of the minimized DFA
+		classes = classCount;
+		classOf.assign(symClass.begin(), symClass.end());
+		table.assign((size_t)blockCount * classCount, 0);
+		accepting.assign(blockCount, 0);
+		for (int d = 0; d < dfaCount; d++) {
+			for (int c = 0; c < classCount; c++)
+				table[block[d] * classCount + c] = (unsigned short)block[trans[d * classCount + c]];
+			if (std::binary_search(dfaSets[d].begin(), dfaSets[d].end(), body.out))
+				accepting[block[d]] = 1;
+		}
+		start = block[0];
+		state = start;
+		if (accepting[start]) {
+			table.clear();
+			if (error) *error = "pattern matches an empty sequence";
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "wininput.hpp"
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// Returns the virtual key code of a key named as between < > in a pattern,
+	// such as Enter, F5, or 0xBA, ignoring case, or 0 if there is none.
+	unsigned parseKeyName(const std::string& name);
+
+	// Returns the name of a key read by parseKeyName, other than a function
+	// key or a code in hex, or null if there is none.
+	const char *getKeyName(unsigned code);
+
+	// A pattern over key-down events, compiled ahead of time into a minimized
+	// DFA with a dense transition table. Matching is unanchored, so the pattern
+	// may start at any point of the input, and stepping through the DFA takes
+	// one table lookup per key-down without any allocation.
+	//
+	// Pattern syntax:
+	//   a-z, 0-9     the key with that letter or digit
+	//   <Name>       a named key (Enter, Space, Tab, Esc, Back, Del, Ins, Home,
+	//                End, PgUp, PgDn, Left, Up, Right, Down, F1-F24), or a
+	//                virtual key code in hex such as <0xBA>
+	//   .            any key
+	//   \d  \w       any digit, any letter or digit
+	//   [a-z0-9]     any key in the class; names such as <Enter> may be used
+	//   ^ + !        prefixes requiring ctrl, shift, alt on the next key;
+	//                follow with ? to make the modifier optional, e.g. +?a
+	//   ~            prefix allowing any modifiers on the next key
+	//   * ? {n} {n,} {n,m}   repetition of the previous key or group
+	//   |  ( )       alternation and grouping
+	// Modifiers that are not mentioned must not be held down, and patterns that
+	// match an empty sequence are rejected.
+	// For example, "\d{4}<Enter>" matches any 4 digits followed by Enter, and
+	// "+?a+?s+?d+?f" matches asdf with or without shift.
+	class KeyPattern {
+	public:
+		// The number of distinct key-down symbols: 256 key codes by 8 combinations
+		// of ctrl, shift, alt.
+		static const int SYMBOLS = 2048;
+		// The maximum number of DFA states a pattern may compile into.
+		static const int MAX_STATES = 4096;
+
+		// Compile the given pattern, replacing any previously compiled one.
+		// Returns true if successful. Otherwise, returns false and writes a
+		// description of the problem to error, if it is not null.
+		bool compile(const char *pattern, std::string *error = nullptr);
+
+		// Advance the DFA by the given key-down event. Returns true if the
+		// pattern has been matched, in which case the DFA is reset.
+		inline bool step(const KeyData& data) {
+			return step(data, state);
+		}
+
+		// Advance the DFA from the given state, which is kept by the caller so
+		// that the same pattern can be matched against several inputs, such
+		// as one per device. The state should start as startState().
+		inline bool step(const KeyData& data, int& current) const {
+			if (table.empty()) return false;
+
+			unsigned sym = (data.code & 0xFF) | (data.ctrl << 8) | (data.shift << 9) | (data.alt << 10);
+			current = table[current * classes + classOf[sym]];
+			if (accepting[current]) {
+				current = start;
+				return true;
+			}
+			return false;
+		}
+
+		// Reset the DFA to its start state.
+		void reset() {
+			state = start;
+		}
+
+		// Returns the start state of the DFA, for use with step.
+		int startState() const {
+			return start;
+		}
+
+		// Returns the number of states of the minimized DFA.
+		int stateCount() const {
+			return (int)accepting.size();
+		}
+
+		// Returns the number of symbol classes (columns) of the transition table.
+		int classCount() const {
+			return classes;
+		}
+
+	private:
+		std::vector<unsigned short> classOf;
+		std::vector<unsigned short> table;
+		std::vector<unsigned char> accepting;
+		int classes = 0;
+		int start = 0;
+		int state = 0;
+	};
+}
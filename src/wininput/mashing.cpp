@@ -0,0 +1,132 @@
+#include "mashing.hpp"
+
+#include <cmath>
+
+namespace {
+
+	// positions of the keys of a US keyboard, in quarter key widths
+	struct KeyGrid {
+		short x[256];
+		short y[256];
+
+		KeyGrid() {
+			for (int i = 0; i < 256; i++) {
+				x[i] = -1;
+				y[i] = -1;
+			}
+
+			// each row is listed from the left, with the offset of its first key
+			static const unsigned char row0[] = { 0xC0, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', 0xBD, 0xBB, 0x08 };
+			static const unsigned char row1[] = { 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', 0xDB, 0xDD, 0xDC };
+			static const unsigned char row2[] = { 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', 0xBA, 0xDE, 0x0D };
+			static const unsigned char row3[] = { 'Z', 'X', 'C', 'V', 'B', 'N', 'M', 0xBC, 0xBE, 0xBF };
+			place(row0, sizeof(row0), 0, 0);
+			place(row1, sizeof(row1), 1, 6);
+			place(row2, sizeof(row2), 2, 7);
+			place(row3, sizeof(row3), 3, 9);
+			x[0x09] = 2; y[0x09] = 4;   // Tab
+			x[0x14] = 3; y[0x14] = 8;   // Caps Lock
+			x[0x20] = 26; y[0x20] = 16; // Space
+		}
+
+		void place(const unsigned char *row, int length, int index, short offset) {
+			for (int i = 0; i < length; i++) {
+				x[row[i]] = offset + i * 4;
+				y[row[i]] = index * 4;
+			}
+		}
+	} grid;
+
+	inline bool isModifier(unsigned long code) {
+		return (code >= 0x10 && code <= 0x12) || (code >= 0xA0 && code <= 0xA5)
+			|| code == 0x5B || code == 0x5C;
+	}
+}
+
+namespace input {
+
+	MashDetector::MashDetector() {
+		reset();
+	}
+
+	void MashDetector::setLimits(const MashLimits& limits) {
+		this->limits = limits;
+	}
+
+	void MashDetector::reset() {
+		start = 0;
+		count = 0;
+		placed = 0;
+		sumX = sumY = sumXX = sumYY = 0;
+		for (int i = 0; i < 8; i++)
+			down[i] = 0;
+		pressed = 0;
+	}
+
+	void MashDetector::add(unsigned long time, short x, short y) {
+		if (count == RING_SIZE) removeOldest();
+
+		ring[(start + count) % RING_SIZE] = { time, x, y };
+		++count;
+		if (x >= 0) {
+			++placed;
+			sumX += x;
+			sumY += y;
+			sumXX += x * x;
+			sumYY += y * y;
+		}
+	}
+
+	void MashDetector::removeOldest() {
+		const Entry& entry = ring[start];
+		if (entry.x >= 0) {
+			--placed;
+			sumX -= entry.x;
+			sumY -= entry.y;
+			sumXX -= entry.x * entry.x;
+			sumYY -= entry.y * entry.y;
+		}
+		start = (start + 1) % RING_SIZE;
+		--count;
+	}
+
+	bool MashDetector::update(const KeyData& data) {
+		unsigned long code = data.code & 0xFF;
+		if (isModifier(code)) return false;
+
+		unsigned long bit = 1UL << (code & 31);
+		bool held = (down[code >> 5] & bit) != 0;
+		if (data.type == INPUT_TYPE_KEYUP) {
+			if (held) {
+				down[code >> 5] &= ~bit;
+				--pressed;
+			}
+			return false;
+		}
+		if (data.type != INPUT_TYPE_KEYDOWN || held) return false;
+
+		down[code >> 5] |= bit;
+		++pressed;
+
+		// slide the window to end at this key down
+		while (count > 0 && data.time - ring[start].time >= limits.window)
+			removeOldest();
+		add(data.time, grid.x[code], grid.y[code]);
+
+		if (limits.keys > 0 && count >= limits.keys) return true;
+		if (limits.pressed > 0 && pressed >= limits.pressed) return true;
+		if (limits.spreadKeys > 0 && placed >= limits.spreadKeys
+			&& limits.spread > 0.0f && spread() >= limits.spread) return true;
+		return false;
+	}
+
+	float MashDetector::spread() const {
+		if (placed < 2) return 0.0f;
+
+		// variance of x and y, in squared quarter key widths
+		float n = (float)placed;
+		float varX = (sumXX - sumX * (float)sumX / n) / n;
+		float varY = (sumYY - sumY * (float)sumY / n) / n;
+		return std::sqrt(varX + varY) / 4.0f;
+	}
+}
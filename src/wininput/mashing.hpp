@@ -0,0 +1,78 @@
+#pragma once
+
+#include "wininput.hpp"
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// The limits beyond which key input is considered to be mashing, where 0
+	// disables a limit.
+	struct MashLimits {
+		unsigned long window = 100UL; // length of the sliding window, in milliseconds
+		int keys = 5;                 // key downs within the window
+		int pressed = 5;              // keys held down at the same time
+		int spreadKeys = 4;           // key downs within the window for spread to apply
+		float spread = 3.5f;          // spread of those keys, in key widths
+	};
+
+	// Detects keyboard mashing, such as by a cat walking over the keyboard, from
+	// a stream of key events. The key downs in a sliding window are kept in a
+	// fixed ring along with running sums of their positions on a US keyboard,
+	// so each event is processed in constant time without any allocation.
+	// Key downs of ctrl, shift, alt, and the Windows keys, and auto-repeated
+	// key downs, are ignored.
+	class MashDetector {
+	public:
+		MashDetector();
+
+		// Set the limits used by update.
+		void setLimits(const MashLimits& limits);
+
+		// Forget all previous events, such as after events may have been missed.
+		void reset();
+
+		// Process the given key event. Returns true if any limit is reached.
+		bool update(const KeyData& data);
+
+		// Returns the number of key downs within the window.
+		int keyCount() const {
+			return count;
+		}
+
+		// Returns the number of keys currently held down.
+		int pressedCount() const {
+			return pressed;
+		}
+
+		// Returns the standard deviation of the positions of the key downs within
+		// the window, in key widths. Keys without a known position are left out.
+		float spread() const;
+
+	private:
+		static const int RING_SIZE = 32;
+
+		struct Entry {
+			unsigned long time;
+			short x; // position in quarter key widths, or -1 if unknown
+			short y;
+		};
+
+		MashLimits limits;
+		Entry ring[RING_SIZE];
+		int start = 0;
+		int count = 0;
+
+		// running sums over the entries with a known position
+		int placed = 0;
+		long sumX = 0;
+		long sumY = 0;
+		long sumXX = 0;
+		long sumYY = 0;
+
+		unsigned long down[8];
+		int pressed = 0;
+
+		void add(unsigned long time, short x, short y);
+		void removeOldest();
+	};
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "wininput.hpp"
+
+// Returned by a key_pipeline_fn when no handler halted processing.
+#define INPUT_PIPELINE_PASS -1
+// Returned by a key_pipeline_fn when a handler that sees repeats halted processing.
+#define INPUT_PIPELINE_STOP -2
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// Defines the type of a compiled key pipeline, see setKeyPipeline.
+	// The function receives the key event, and a copy of it presented as a key
+	// down to handlers without repeats. If cached is true, the event is a
+	// repeat, and handlers without repeats are skipped except for the one at
+	// cachedStop, which halts processing as it did on the key down.
+	// The function returns the index of the handler without repeats that
+	// halted processing, or one of INPUT_PIPELINE_PASS and INPUT_PIPELINE_STOP.
+	typedef int(*key_pipeline_fn)(KeyData& data, KeyData& down, bool cached, int cachedStop);
+
+	// Defines the type of a compiled mouse pipeline, see setMousePipeline.
+	typedef bool(*mouse_pipeline_fn)(MouseData& data);
+
+	// A stage of a key pipeline that calls the given key_handler_fn, which does
+	// not see repeats, the same as addKeyHandler(fn, false).
+	template <key_handler_fn fn>
+	struct KeyStage {
+		static const bool repeats = false;
+		static inline bool call(KeyData& data) { return fn(data); }
+	};
+
+	// A stage of a key pipeline that calls the given key_handler_fn, which also
+	// sees repeats, the same as addKeyHandler(fn, true).
+	template <key_handler_fn fn>
+	struct RepeatKeyStage {
+		static const bool repeats = true;
+		static inline bool call(KeyData& data) { return fn(data); }
+	};
+
+	// The stages of a key pipeline from the given index onwards, expanded at
+	// compile time so that every call is direct and can be inlined.
+	template <int index, typename... Stages>
+	struct KeyPipeline;
+
+	template <int index>
+	struct KeyPipeline<index> {
+		static inline int run(KeyData&, KeyData&, bool, int) {
+			return INPUT_PIPELINE_PASS;
+		}
+	};
+
+	template <int index, typename Stage, typename... Rest>
+	struct KeyPipeline<index, Stage, Rest...> {
+		static inline int run(KeyData& data, KeyData& down, bool cached, int cachedStop) {
+			if (Stage::repeats) {
+				if (Stage::call(data)) return INPUT_PIPELINE_STOP;
+			} else if (!cached) {
+				if (Stage::call(down)) return index;
+			} else if (cachedStop == index) {
+				return index;
+			}
+			return KeyPipeline<index + 1, Rest...>::run(data, down, cached, cachedStop);
+		}
+	};
+
+	// The handlers of a mouse pipeline, expanded at compile time.
+	template <mouse_handler_fn... fns>
+	struct MousePipeline;
+
+	template <>
+	struct MousePipeline<> {
+		static inline bool run(MouseData&) {
+			return false;
+		}
+	};
+
+	template <mouse_handler_fn fn, mouse_handler_fn... rest>
+	struct MousePipeline<fn, rest...> {
+		static inline bool run(MouseData& data) {
+			return fn(data) || MousePipeline<rest...>::run(data);
+		}
+	};
+
+	// Set the compiled key pipeline, which is run before any handlers registered
+	// with addKeyHandler. Use the template version below instead.
+	// Returns true if successful, and false if otherwise.
+	bool setKeyPipeline(key_pipeline_fn fn, int stages);
+
+	// Set the compiled mouse pipeline, which is run before any handlers registered
+	// with addMouseHandler. Use the template version below instead.
+	// Returns true if successful, and false if otherwise.
+	bool setMousePipeline(mouse_pipeline_fn fn);
+
+	// Compose the given KeyStage and RepeatKeyStage handlers into a single
+	// function, replacing the previous key pipeline. The handlers are run in
+	// order, before any handlers registered with addKeyHandler, and processing
+	// halts at the first one that returns true. This avoids the indirect call
+	// and lock of each registered handler for handlers that are known ahead of
+	// time, with addKeyHandler left for handlers added later on.
+	// For example, setKeyPipeline<KeyStage<a>, RepeatKeyStage<b>>().
+	// Returns true if successful, and false if otherwise.
+	template <typename... Stages>
+	bool setKeyPipeline() {
+		return setKeyPipeline(&KeyPipeline<0, Stages...>::run, (int)sizeof...(Stages));
+	}
+
+	// Compose the given mouse_handler_fn handlers into a single function,
+	// replacing the previous mouse pipeline. The handlers are run in order,
+	// before any handlers registered with addMouseHandler, and processing
+	// halts at the first one that returns true.
+	// Returns true if successful, and false if otherwise.
+	template <mouse_handler_fn... fns>
+	bool setMousePipeline() {
+		return setMousePipeline(&MousePipeline<fns...>::run);
+	}
+}
@@ -0,0 +1,82 @@
+/*
+ * Padlock plug-in interface.
+ *
+ * A plug-in is a shared library (a .dll on Windows, or a .so elsewhere) placed
+ * in the plug-ins folder, the plugins folder next to Padlock.exe on Windows,
+ * which is only used if it is owned by administrators. It exports
+ * padlock_plugin_init, which returns a description of the plug-in, including
+ * its key and mouse handlers. The handlers mirror key_handler_fn and
+ * mouse_handler_fn of WinInput, and are called before Padlock's own handlers.
+ *
+ * This header is plain C, so that plug-ins can be built with any compiler.
+ * Only fields may be appended to the structures below, and doing so requires
+ * incrementing PADLOCK_PLUGIN_ABI.
+ */
+#ifndef PADLOCK_PLUGIN_H
+#define PADLOCK_PLUGIN_H
+
+/* The version of this interface. */
+#define PADLOCK_PLUGIN_ABI 1
+
+/* Values of padlock_key_event.type. */
+#define PADLOCK_KEYUP 2
+#define PADLOCK_KEYDOWN 3
+
+/* Values of padlock_plugin.flags. */
+/* Call the handlers on a worker thread instead of the hook thread. Their
+ * return value is then ignored, as the event has already been processed. */
+#define PADLOCK_PLUGIN_ASYNC 0x1
+
+#ifdef __cplusplus
+#define PADLOCK_EXTERN_C extern "C"
+#else
+#define PADLOCK_EXTERN_C
+#endif
+
+#ifdef _WIN32
+#define PADLOCK_PLUGIN_EXPORT PADLOCK_EXTERN_C __declspec(dllexport)
+#else
+#define PADLOCK_PLUGIN_EXPORT PADLOCK_EXTERN_C __attribute__((visibility("default")))
+#endif
+
+typedef struct padlock_key_event {
+	unsigned long code;  /* virtual key code */
+	int ctrl;
+	int shift;
+	int alt;
+	int type;            /* PADLOCK_KEYUP or PADLOCK_KEYDOWN */
+	unsigned long time;  /* timestamp of the event, in milliseconds */
+} padlock_key_event;
+
+typedef struct padlock_mouse_event {
+	unsigned code;       /* mouse message, such as WM_LBUTTONDOWN */
+	long x;
+	long y;
+	unsigned long param; /* wheel delta or X button, as in MSLLHOOKSTRUCT */
+	unsigned long time;  /* timestamp of the event, in milliseconds */
+} padlock_mouse_event;
+
+/* Handlers return nonzero if the event should be blocked, and 0 if otherwise. */
+typedef int (*padlock_key_fn)(const padlock_key_event *event);
+typedef int (*padlock_mouse_fn)(const padlock_mouse_event *event);
+
+typedef struct padlock_plugin {
+	unsigned abi;              /* set to PADLOCK_PLUGIN_ABI */
+	const char *name;
+	unsigned flags;            /* combination of PADLOCK_PLUGIN_ values */
+	/* The time a handler may take per call, in microseconds, where 0 = the
+	 * default of 200. A plug-in that repeatedly takes longer is moved to the
+	 * worker thread, and is disabled if it keeps overrunning there. */
+	unsigned budget;
+	padlock_key_fn on_key;     /* may be null */
+	padlock_mouse_fn on_mouse; /* may be null */
+	void (*shutdown)(void);    /* called before the library is unloaded, may be null */
+} padlock_plugin;
+
+/* The function exported by a plug-in. It receives the PADLOCK_PLUGIN_ABI of
+ * Padlock, and returns a description that stays valid until shutdown, or null
+ * if the plug-in cannot be used. */
+typedef const padlock_plugin *(*padlock_plugin_init_fn)(unsigned abi);
+#define PADLOCK_PLUGIN_INIT "padlock_plugin_init"
+
+#endif
@@ -0,0 +1,349 @@
+#include "plugins.hpp"
+#include "plugin.h"
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#define PLUGIN_EXTENSION ".dll"
+#else
+#include <dirent.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#define PLUGIN_EXTENSION ".so"
+#endif
+
+// The budget of a plug-in that does not specify one, in microseconds.
+#define PLUGIN_DEFAULT_BUDGET 200
+// The number of overruns within PLUGIN_STRIKE_WINDOW calls that demotes a plug-in.
+#define PLUGIN_MAX_STRIKES 3
+#define PLUGIN_STRIKE_WINDOW 1000
+// On the worker thread, a call overruns if it takes this many times the budget.
+#define PLUGIN_ASYNC_BUDGET_FACTOR 100
+// The number of events that can be waiting for the worker thread.
+#define PLUGIN_QUEUE_SIZE 256
+
+namespace {
+
+	struct Plugin {
+		void *library;
+		const padlock_plugin *desc;
+		std::string path;
+		unsigned budget;
+		std::atomic<int> mode;
+		// the overruns and calls counted towards demoting the plug-in from its
+		// mode, which both threads update while events queued before a
+		// demotion are still being called
+		std::atomic<int> strikes{ 0 };
+		std::atomic<int> windowCalls{ 0 };
+		std::atomic<unsigned long long> calls{ 0 };
+		std::atomic<unsigned long long> overruns{ 0 };
+		std::atomic<unsigned long long> dropped{ 0 };
+	};
+
+	struct QueuedEvent {
+		Plugin *plugin;
+		bool key;
+		padlock_key_event keyEvent;
+		padlock_mouse_event mouseEvent;
+	};
+
+	std::list<Plugin> plugins;
+	std::mutex pluginsMutex;
+
+	// the plug-ins seen by the hooks, which read it without taking
+	// pluginsMutex; it is replaced as a whole when a plug-in is loaded, and
+	// the replaced ones are kept until unloadPlugins, as the hook thread may
+	// still be reading them
+	typedef std::vector<Plugin*> Snapshot;
+	std::atomic<Snapshot*> snapshot(nullptr);
+	std::vector<std::unique_ptr<Snapshot>> snapshots;
+
+	// the events for the worker thread, in a ring written only by the hook
+	// thread, at queueHead, and read only by the worker, at queueTail
+	QueuedEvent queue[PLUGIN_QUEUE_SIZE];
+	std::atomic<unsigned> queueHead(0);
+	std::atomic<unsigned> queueTail(0);
+	std::atomic<bool> workerStop(false);
+	// set by the worker before it waits, so that the hook thread only wakes
+	// it when it may be waiting
+	std::atomic<bool> workerIdle(false);
+#ifdef _WIN32
+	HANDLE workerEvent = NULL; // an auto-reset event
+#else
+	int workerFd = -1;         // an eventfd
+#endif
+	std::thread worker;
+
+	void *openLibrary(const std::string& path) {
+#ifdef _WIN32
+		return (void*)LoadLibraryA(path.c_str());
+#else
+		return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+	}
+
+	void *findSymbol(void *library, const char *name) {
+#ifdef _WIN32
+		return (void*)GetProcAddress((HMODULE)library, name);
+#else
+		return dlsym(library, name);
+#endif
+	}
+
+	void closeLibrary(void *library) {
+#ifdef _WIN32
+		FreeLibrary((HMODULE)library);
+#else
+		dlclose(library);
+#endif
+	}
+
+	// call a handler of the plug-in in the given mode and time it, moving the
+	// plug-in to the next mode if it overruns its budget too often there;
+	// calls made in a mode it has since left, for events queued or in flight
+	// when it was demoted, do not count towards the next one
+	template <typename Fn, typename Event>
+	int callPlugin(Plugin& plugin, int mode, Fn fn, const Event& evt, unsigned budget) {
+		auto start = std::chrono::steady_clock::now();
+		int res = fn(&evt);
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+		plugin.calls.fetch_add(1, std::memory_order_relaxed);
+		if (elapsed > budget) plugin.overruns.fetch_add(1, std::memory_order_relaxed);
+		if (plugin.mode.load() != mode) return res;
+
+		if (plugin.windowCalls.fetch_add(1) + 1 >= PLUGIN_STRIKE_WINDOW) {
+			plugin.windowCalls.store(0);
+			plugin.strikes.store(0);
+		}
+		if (elapsed > budget && plugin.strikes.fetch_add(1) + 1 >= PLUGIN_MAX_STRIKES
+			&& plugin.mode.compare_exchange_strong(mode, mode + 1)) {
+			plugin.strikes.store(0);
+			plugin.windowCalls.store(0);
+		}
+		return res;
+	}
+
+	// wake the worker thread, without blocking
+	void wakeWorker() {
+#ifdef _WIN32
+		SetEvent(workerEvent);
+#else
+		unsigned long long one = 1;
+		ssize_t res = write(workerFd, &one, sizeof(one));
+		(void)res; // only fails if the worker has yet to take the last wakes
+#endif
+	}
+
+	// wait for wakeWorker, or return at once if it was called since the last wait
+	void waitForWork() {
+#ifdef _WIN32
+		WaitForSingleObject(workerEvent, INFINITE);
+#else
+		pollfd fd = { workerFd, POLLIN, 0 };
+		poll(&fd, 1, -1);
+		unsigned long long count;
+		ssize_t res = read(workerFd, &count, sizeof(count));
+		(void)res;
+#endif
+	}
+
+	void workerMain() {
+		while (!workerStop.load()) {
+			unsigned tail = queueTail.load(std::memory_order_relaxed);
+			if (tail == queueHead.load(std::memory_order_acquire)) {
+				// the hook thread wakes the worker if it sees it idle, and
+				// either it sees it, or the worker sees the event it queued
+				workerIdle.store(true);
+				if (tail == queueHead.load() && !workerStop.load()) waitForWork();
+				workerIdle.store(false);
+				continue;
+			}
+
+			QueuedEvent evt = queue[tail % PLUGIN_QUEUE_SIZE];
+			queueTail.store(tail + 1, std::memory_order_release);
+
+			Plugin& plugin = *evt.plugin;
+			if (plugin.mode.load() == INPUT_PLUGIN_ASYNC) {
+				unsigned budget = plugin.budget * PLUGIN_ASYNC_BUDGET_FACTOR;
+				if (evt.key)
+					callPlugin(plugin, INPUT_PLUGIN_ASYNC, plugin.desc->on_key, evt.keyEvent, budget);
+				else
+					callPlugin(plugin, INPUT_PLUGIN_ASYNC, plugin.desc->on_mouse, evt.mouseEvent, budget);
+			}
+		}
+	}
+
+	// pass the event to the worker thread, or drop it if the queue is full;
+	// only called by the hook thread, and takes no lock
+	void enqueue(Plugin& plugin, const padlock_key_event *keyEvent,
+		const padlock_mouse_event *mouseEvent) {
+		unsigned head = queueHead.load(std::memory_order_relaxed);
+		if (head - queueTail.load(std::memory_order_acquire) == PLUGIN_QUEUE_SIZE) {
+			plugin.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		QueuedEvent& evt = queue[head % PLUGIN_QUEUE_SIZE];
+		evt.plugin = &plugin;
+		evt.key = keyEvent != nullptr;
+		if (keyEvent) evt.keyEvent = *keyEvent;
+		if (mouseEvent) evt.mouseEvent = *mouseEvent;
+		queueHead.store(head + 1);
+		if (workerIdle.exchange(false)) wakeWorker();
+	}
+}
+
+namespace input {
+
+	bool loadPlugin(const std::string& path) {
+		void *library = openLibrary(path);
+		if (library == nullptr) return false;
+
+		padlock_plugin_init_fn init = (padlock_plugin_init_fn)findSymbol(library, PADLOCK_PLUGIN_INIT);
+		const padlock_plugin *desc = init ? init(PADLOCK_PLUGIN_ABI) : nullptr;
+		if (desc == nullptr || desc->abi != PADLOCK_PLUGIN_ABI) {
+			closeLibrary(library);
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(pluginsMutex);
+		plugins.emplace_back();
+		Plugin& plugin = plugins.back();
+		plugin.library = library;
+		plugin.desc = desc;
+		plugin.path = path;
+		plugin.budget = desc->budget > 0 ? desc->budget : PLUGIN_DEFAULT_BUDGET;
+		plugin.mode.store(desc->flags & PADLOCK_PLUGIN_ASYNC ? INPUT_PLUGIN_ASYNC : INPUT_PLUGIN_INLINE);
+
+		if (!worker.joinable()) {
+#ifdef _WIN32
+			if (workerEvent == NULL) workerEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+			if (workerFd < 0) workerFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#endif
+			workerStop.store(false);
+			queueTail.store(queueHead.load());
+			worker = std::thread(workerMain);
+		}
+
+		snapshots.emplace_back(new Snapshot());
+		for (auto& loaded : plugins)
+			snapshots.back()->push_back(&loaded);
+		snapshot.store(snapshots.back().get(), std::memory_order_release);
+		return true;
+	}
+
+	int loadPlugins(const std::string& folder) {
+		int count = 0;
+		if (folder.empty()) return 0;
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((folder + "\\*" PLUGIN_EXTENSION).c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE) return 0;
+		do {
+			if (loadPlugin(folder + "\\" + data.cFileName)) ++count;
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+#else
+		DIR *dir = opendir(folder.c_str());
+		if (dir == nullptr) return 0;
+		while (dirent *entry = readdir(dir)) {
+			std::string name = entry->d_name;
+			size_t ext = sizeof(PLUGIN_EXTENSION) - 1;
+			if (name.size() > ext && name.compare(name.size() - ext, ext, PLUGIN_EXTENSION) == 0
+				&& loadPlugin(folder + "/" + name)) ++count;
+		}
+		closedir(dir);
+#endif
+		return count;
+	}
+
+	void unloadPlugins() {
+		// the events still queued are dropped
+		if (worker.joinable()) {
+			workerStop.store(true);
+			wakeWorker();
+			worker.join();
+		}
+
+		std::lock_guard<std::mutex> lock(pluginsMutex);
+		snapshot.store(nullptr);
+		for (auto& plugin : plugins) {
+			if (plugin.desc->shutdown) plugin.desc->shutdown();
+			closeLibrary(plugin.library);
+		}
+		plugins.clear();
+		snapshots.clear();
+	}
+
+	std::vector<PluginInfo> getPlugins() {
+		std::vector<PluginInfo> infos;
+		std::lock_guard<std::mutex> lock(pluginsMutex);
+		for (auto& plugin : plugins) {
+			PluginInfo info;
+			info.name = plugin.desc->name ? plugin.desc->name : "";
+			info.path = plugin.path;
+			info.mode = plugin.mode.load();
+			info.budget = plugin.budget;
+			info.calls = plugin.calls.load();
+			info.overruns = plugin.overruns.load();
+			info.dropped = plugin.dropped.load();
+			infos.push_back(info);
+		}
+		return infos;
+	}
+
+	bool runKeyPlugins(KeyData& data) {
+		Snapshot *loaded = snapshot.load(std::memory_order_acquire);
+		if (loaded == nullptr) return false;
+
+		padlock_key_event evt = { data.code, data.ctrl, data.shift, data.alt,
+			data.type == INPUT_TYPE_KEYUP ? PADLOCK_KEYUP : PADLOCK_KEYDOWN, data.time };
+		for (Plugin *entry : *loaded) {
+			Plugin& plugin = *entry;
+			if (plugin.desc->on_key == nullptr) continue;
+
+			switch (plugin.mode.load(std::memory_order_relaxed)) {
+			case INPUT_PLUGIN_INLINE:
+				if (callPlugin(plugin, INPUT_PLUGIN_INLINE, plugin.desc->on_key, evt, plugin.budget) != 0) return true;
+				break;
+			case INPUT_PLUGIN_ASYNC:
+				enqueue(plugin, &evt, nullptr);
+				break;
+			}
+		}
+		return false;
+	}
+
+	bool runMousePlugins(MouseData& data) {
+		Snapshot *loaded = snapshot.load(std::memory_order_acquire);
+		if (loaded == nullptr) return false;
+
+		padlock_mouse_event evt = { data.code, data.x, data.y, data.param, data.time };
+		for (Plugin *entry : *loaded) {
+			Plugin& plugin = *entry;
+			if (plugin.desc->on_mouse == nullptr) continue;
+
+			switch (plugin.mode.load(std::memory_order_relaxed)) {
+			case INPUT_PLUGIN_INLINE:
+				if (callPlugin(plugin, INPUT_PLUGIN_INLINE, plugin.desc->on_mouse, evt, plugin.budget) != 0) return true;
+				break;
+			case INPUT_PLUGIN_ASYNC:
+				enqueue(plugin, nullptr, &evt);
+				break;
+			}
+		}
+		return false;
+	}
+}
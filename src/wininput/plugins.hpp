@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "wininput.hpp"
+
+// The value of PluginInfo.mode for a plug-in called on the hook thread.
+#define INPUT_PLUGIN_INLINE 0
+// The value of PluginInfo.mode for a plug-in called on the worker thread.
+#define INPUT_PLUGIN_ASYNC 1
+// The value of PluginInfo.mode for a plug-in that is no longer called.
+#define INPUT_PLUGIN_DISABLED 2
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// Describes a loaded plug-in, see plugin.h.
+	struct PluginInfo {
+		std::string name;
+		std::string path;
+		int mode = INPUT_PLUGIN_INLINE;
+		unsigned budget = 0;               // in microseconds
+		unsigned long long calls = 0;
+		unsigned long long overruns = 0;   // calls that took longer than the budget
+		unsigned long long dropped = 0;    // events not passed to the worker thread
+	};
+
+	// Load the plug-in in the given shared library.
+	// Returns true if successful, and false if otherwise.
+	bool loadPlugin(const std::string& path);
+
+	// Load the plug-ins in all shared libraries in the given folder, or none
+	// if folder is empty. Returns the number of plug-ins loaded.
+	int loadPlugins(const std::string& folder);
+
+	// Shut down and unload all plug-ins. The hooks should not be running.
+	void unloadPlugins();
+
+	// Get a description of each loaded plug-in.
+	std::vector<PluginInfo> getPlugins();
+
+	// A key_handler_fn that passes the event to the loaded plug-ins.
+	// Plug-ins called on the hook thread are timed against their budget.
+	// No lock is taken, so plug-ins can be loaded while the hooks run.
+	bool runKeyPlugins(KeyData& data);
+
+	// A mouse_handler_fn that passes the event to the loaded plug-ins.
+	bool runMousePlugins(MouseData& data);
+}
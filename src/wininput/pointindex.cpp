@@ -0,0 +1,30 @@
+#include "pointindex.hpp"
+
+// The smallest cell size used, so that sequences with a tolerance of 0 do
+// not spread over a very sparse grid.
+#define POINTINDEX_MIN_CELL 32
+
+namespace input {
+
+	void PointIndex::build(const std::vector<Target>& targets) {
+		cells.clear();
+
+		// a cell at least as large as every tolerance box means that each box
+		// overlaps at most 2 cells in each direction
+		cellSize = POINTINDEX_MIN_CELL;
+		for (const Target& t : targets) {
+			long size = 2L * (long)t.tolerance + 1;
+			if (size > cellSize) cellSize = size;
+		}
+
+		for (const Target& t : targets) {
+			long tol = (long)t.tolerance;
+			long x0 = cellOf(t.x - tol), x1 = cellOf(t.x + tol);
+			long y0 = cellOf(t.y - tol), y1 = cellOf(t.y + tol);
+			for (long cx = x0; cx <= x1; cx++) {
+				for (long cy = y0; cy <= y1; cy++)
+					cells[cellKey(cx, cy)].push_back(t.id);
+			}
+		}
+	}
+}
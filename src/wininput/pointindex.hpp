@@ -0,0 +1,46 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// A uniform grid over screen coordinates, used to find the targets whose
+	// tolerance box may contain a point without testing every target.
+	// The cell size is derived from the largest tolerance, so each target is
+	// stored in at most 4 cells, and a query only looks at a single cell.
+	class PointIndex {
+	public:
+		struct Target {
+			long x;
+			long y;
+			unsigned tolerance;
+			int id;
+		};
+
+		// Rebuild the index from the given targets.
+		void build(const std::vector<Target>& targets);
+
+		// Get the ids of the targets whose tolerance box may contain the given
+		// point, or null if there are none. The ids are in the order given to build.
+		inline const std::vector<int>* query(long x, long y) const {
+			if (cells.empty()) return nullptr;
+			auto it = cells.find(cellKey(cellOf(x), cellOf(y)));
+			return it == cells.end() ? nullptr : &it->second;
+		}
+
+	private:
+		std::unordered_map<unsigned long long, std::vector<int>> cells;
+		long cellSize = 1;
+
+		// index of the cell containing the coordinate, rounding towards negative infinity
+		inline long cellOf(long v) const {
+			return v >= 0 ? v / cellSize : -((-v - 1) / cellSize) - 1;
+		}
+
+		static inline unsigned long long cellKey(long cx, long cy) {
+			return ((unsigned long long)(unsigned)cx << 32) | (unsigned)cy;
+		}
+	};
+}
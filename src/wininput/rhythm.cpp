@@ -0,0 +1,60 @@
+#include "rhythm.hpp"
+
+#include <cmath>
+#include <limits>
+
+// The smallest deviation a feature may have, in milliseconds, so that a few
+// very consistent enrollment samples do not make the profile too strict.
+#define RHYTHM_MIN_DEVIATION 10.0f
+
+namespace input {
+
+	int extractRhythm(const KeyTiming *timings, int count, float *features) {
+		if (count < 2) return 0;
+		if (count > INPUT_KEYTIMINGS) count = INPUT_KEYTIMINGS;
+
+		int n = count - 1;
+		long long last = timings[count - 1].down;
+		for (int i = 0; i < n; i++) {
+			features[i] = (timings[i + 1].down - timings[i].down) / 1000.0f;
+
+			// a key still held down has been held for at least this long
+			long long up = timings[i].up != 0 ? timings[i].up : last;
+			features[n + i] = (up - timings[i].down) / 1000.0f;
+		}
+		return n * 2;
+	}
+
+	bool buildRhythmProfile(const float (*samples)[RHYTHM_MAX_FEATURES], int sampleCount,
+		int features, RhythmProfile& profile) {
+		if (sampleCount < 2 || features <= 0 || features > RHYTHM_MAX_FEATURES)
+			return false;
+
+		for (int f = 0; f < features; f++) {
+			float sum = 0.0f;
+			for (int s = 0; s < sampleCount; s++)
+				sum += samples[s][f];
+			float mean = sum / sampleCount;
+
+			float dev = 0.0f;
+			for (int s = 0; s < sampleCount; s++)
+				dev += std::fabs(samples[s][f] - mean);
+			dev /= sampleCount;
+
+			profile.mean[f] = mean;
+			profile.deviation[f] = dev > RHYTHM_MIN_DEVIATION ? dev : RHYTHM_MIN_DEVIATION;
+		}
+		profile.features = features;
+		return true;
+	}
+
+	float scoreRhythm(const RhythmProfile& profile, const float *features, int count) {
+		if (profile.features == 0 || count != profile.features)
+			return std::numeric_limits<float>::infinity();
+
+		float score = 0.0f;
+		for (int f = 0; f < count; f++)
+			score += std::fabs(features[f] - profile.mean[f]) / profile.deviation[f];
+		return score / count;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "wininput.hpp"
+
+// The maximum number of features extracted from a sequence of key timings.
+#define RHYTHM_MAX_FEATURES (2 * (INPUT_KEYTIMINGS - 1))
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// The typing rhythm of a key sequence, described by the mean and the mean
+	// absolute deviation of each feature over the enrollment samples.
+	struct RhythmProfile {
+		int features = 0; // 0 if no profile has been enrolled
+		float mean[RHYTHM_MAX_FEATURES];
+		float deviation[RHYTHM_MAX_FEATURES];
+	};
+
+	// Extract the rhythm features of the given key timings, in milliseconds,
+	// into features. For n keys, these are the n-1 times between consecutive
+	// key downs (flight), followed by the n-1 times that all but the last key
+	// were held down (dwell). The last key is left out of the dwell times, as
+	// a sequence is matched before that key is released.
+	// Returns the number of features extracted, or 0 if there are fewer than 2 keys.
+	int extractRhythm(const KeyTiming *timings, int count, float *features);
+
+	// Build a profile from the given enrollment samples, each of which holds
+	// the given number of features.
+	// Returns true if successful, and false if otherwise.
+	bool buildRhythmProfile(const float (*samples)[RHYTHM_MAX_FEATURES], int sampleCount,
+		int features, RhythmProfile& profile);
+
+	// Returns the scaled Manhattan distance between the features and the profile,
+	// which is the mean number of deviations by which each feature differs from
+	// the enrolled mean. A sample that does not fit the profile scores infinity.
+	float scoreRhythm(const RhythmProfile& profile, const float *features, int count);
+}
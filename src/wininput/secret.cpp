@@ -0,0 +1,161 @@
+#include "secret.hpp"
+
+#include <cstring>
+#include <random>
+
+namespace {
+	using input::KeyData;
+
+	inline unsigned long long rotl(unsigned long long x, int b) {
+		return (x << b) | (x >> (64 - b));
+	}
+
+	inline void sipRound(unsigned long long& v0, unsigned long long& v1,
+		unsigned long long& v2, unsigned long long& v3) {
+		v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+		v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+		v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+		v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+	}
+
+	inline unsigned long long readLittleEndian(const unsigned char *p, size_t size) {
+		unsigned long long x = 0;
+		for (size_t i = 0; i < size; i++)
+			x |= (unsigned long long)p[i] << (8 * i);
+		return x;
+	}
+
+	// the key down as a symbol, in the same layout as KeyPattern
+	inline unsigned short toToken(const KeyData& data) {
+		return (unsigned short)((data.code & 0xFF) | (data.ctrl << 8) | (data.shift << 9) | (data.alt << 10));
+	}
+
+	// the bytes hashed for a sequence: the salt, then each token, low byte first
+	size_t hashInput(const unsigned char *salt, const unsigned short *tokens, int length,
+		unsigned char *out) {
+		std::memcpy(out, salt, INPUT_SECRET_SALT);
+		size_t size = INPUT_SECRET_SALT;
+		for (int i = 0; i < length; i++) {
+			out[size++] = (unsigned char)(tokens[i] & 0xFF);
+			out[size++] = (unsigned char)(tokens[i] >> 8);
+		}
+		return size;
+	}
+
+	// the parameters of the rolling hash, derived from the key so that the
+	// rolling hash of a secret tells nothing without it
+	void rollingParams(const input::SecretKey& key, unsigned long long& base, unsigned long long& offset) {
+		static const char baseLabel[] = "padlock rolling base";
+		static const char offsetLabel[] = "padlock rolling offset";
+		base = input::sipHash(key, baseLabel, sizeof(baseLabel) - 1) | 1;
+		offset = input::sipHash(key, offsetLabel, sizeof(offsetLabel) - 1);
+	}
+}
+
+namespace input {
+
+	unsigned long long sipHash(const SecretKey& key, const void *data, size_t size) {
+		const unsigned char *p = (const unsigned char*)data;
+		unsigned long long v0 = 0x736f6d6570736575ULL ^ key.k0;
+		unsigned long long v1 = 0x646f72616e646f6dULL ^ key.k1;
+		unsigned long long v2 = 0x6c7967656e657261ULL ^ key.k0;
+		unsigned long long v3 = 0x7465646279746573ULL ^ key.k1;
+
+		size_t blocks = size / 8;
+		for (size_t i = 0; i < blocks; i++) {
+			unsigned long long m = readLittleEndian(p + i * 8, 8);
+			v3 ^= m;
+			sipRound(v0, v1, v2, v3);
+			sipRound(v0, v1, v2, v3);
+			v0 ^= m;
+		}
+
+		unsigned long long last = ((unsigned long long)size << 56)
+			| readLittleEndian(p + blocks * 8, size % 8);
+		v3 ^= last;
+		sipRound(v0, v1, v2, v3);
+		sipRound(v0, v1, v2, v3);
+		v0 ^= last;
+
+		v2 ^= 0xFF;
+		for (int i = 0; i < 4; i++) sipRound(v0, v1, v2, v3);
+		return v0 ^ v1 ^ v2 ^ v3;
+	}
+
+	void makeSecretKey(SecretKey& key) {
+		std::random_device random;
+		key.k0 = ((unsigned long long)random() << 32) | random();
+		key.k1 = ((unsigned long long)random() << 32) | random();
+	}
+
+	bool makeSecret(const SecretKey& key, const KeyData *seq, SecretSequence& secret) {
+		unsigned short tokens[INPUT_SECRET_MAX_KEYS];
+		int length = 0;
+		while (length < INPUT_SECRET_MAX_KEYS && seq[length].code != 0) {
+			tokens[length] = toToken(seq[length]);
+			++length;
+		}
+		if (length == 0) return false;
+
+		SecretSequence made;
+		made.length = length;
+		std::random_device random;
+		for (int i = 0; i < INPUT_SECRET_SALT; i++)
+			made.salt[i] = (unsigned char)random();
+
+		unsigned char input[INPUT_SECRET_SALT + INPUT_SECRET_MAX_KEYS * 2];
+		made.hash = sipHash(key, input, hashInput(made.salt, tokens, length, input));
+
+		unsigned long long base, offset;
+		rollingParams(key, base, offset);
+		for (int i = 0; i < length; i++)
+			made.rolling = made.rolling * base + tokens[i] + offset;
+
+		secret = made;
+		return true;
+	}
+
+	SecretMatcher::SecretMatcher(const SecretKey& key, const SecretSequence& secret)
+		: key(key), secret(secret) {
+		rollingParams(key, base, offset);
+		for (int i = 1; i < secret.length; i++) top *= base;
+	}
+
+	bool SecretMatcher::step(const KeyData& data) {
+		if (secret.length == 0) return false;
+
+		Window& window = windows[data.device];
+		unsigned long long value = toToken(data);
+		if (window.count < secret.length) {
+			window.tokens[(window.head + window.count++) % INPUT_SECRET_MAX_KEYS] = (unsigned short)value;
+		} else {
+			// slide the oldest key down out of the window
+			window.rolling -= (window.tokens[window.head] + offset) * top;
+			window.tokens[(window.head + secret.length) % INPUT_SECRET_MAX_KEYS] = (unsigned short)value;
+			window.head = (window.head + 1) % INPUT_SECRET_MAX_KEYS;
+		}
+		window.rolling = window.rolling * base + value + offset;
+
+		if (window.count < secret.length || window.rolling != secret.rolling) return false;
+		if (!confirm(window)) return false;
+
+		window.head = 0;
+		window.count = 0;
+		window.rolling = 0;
+		return true;
+	}
+
+	void SecretMatcher::reset() {
+		windows.fill(Window());
+	}
+
+	bool SecretMatcher::confirm(const Window& window) const {
+		unsigned short tokens[INPUT_SECRET_MAX_KEYS];
+		for (int i = 0; i < secret.length; i++)
+			tokens[i] = window.tokens[(window.head + i) % INPUT_SECRET_MAX_KEYS];
+
+		unsigned char input[INPUT_SECRET_SALT + INPUT_SECRET_MAX_KEYS * 2];
+		unsigned long long hash = sipHash(key, input, hashInput(secret.salt, tokens, secret.length, input));
+		return hash == secret.hash;
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include "devicetable.hpp"
+#include "wininput.hpp"
+
+// The maximum number of key downs of a secret sequence.
+#define INPUT_SECRET_MAX_KEYS 16
+// The number of bytes of the salt of a secret sequence.
+#define INPUT_SECRET_SALT 16
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// The 128-bit key that secret sequences are hashed under. It should be
+	// kept apart from the secrets, or protected, such as with DPAPI.
+	struct SecretKey {
+		unsigned long long k0 = 0;
+		unsigned long long k1 = 0;
+	};
+
+	// A key sequence kept only as salted, keyed hashes of its key downs, so
+	// that it can be matched without being stored. The keys are compared along
+	// with ctrl, shift, and alt, the same as a strict key sequence.
+	struct SecretSequence {
+		int length = 0; // number of key downs, where 0 = no sequence
+		unsigned char salt[INPUT_SECRET_SALT] = { 0 };
+		unsigned long long hash = 0;    // SipHash-2-4 of the salt and the key downs
+		unsigned long long rolling = 0; // keyed rolling hash of the key downs, see SecretMatcher
+	};
+
+	// Returns the SipHash-2-4 of the given bytes under the given key.
+	unsigned long long sipHash(const SecretKey& key, const void *data, size_t size);
+
+	// Fill the key with random bytes from the system.
+	void makeSecretKey(SecretKey& key);
+
+	// Hash the given key sequence, terminated by a KeyData with a code of 0,
+	// into secret with a new random salt. Only the first INPUT_SECRET_MAX_KEYS
+	// key downs are used.
+	// Returns true if successful, and false if otherwise, such as when the
+	// sequence is empty.
+	bool makeSecret(const SecretKey& key, const KeyData *seq, SecretSequence& secret);
+
+	// Matches a SecretSequence against key downs. The last key downs of each
+	// device are kept in a fixed ring along with a rolling hash of them, which
+	// is updated in constant time on each key down. Only when the rolling hash
+	// equals that of the secret is the keyed hash of the ring computed to
+	// confirm the match, which is bounded by INPUT_SECRET_MAX_KEYS, so each
+	// key down takes constant time without any allocation.
+	class SecretMatcher {
+	public:
+		SecretMatcher() {}
+		SecretMatcher(const SecretKey& key, const SecretSequence& secret);
+
+		// Advance the matcher by the given key down, on the device of the
+		// KeyData (see KeyData.device). Auto-repeated key downs and those of
+		// ctrl, shift, and alt should not be passed.
+		// Returns true if the key down completed the sequence, in which case
+		// the device starts over.
+		bool step(const KeyData& data);
+
+		// Forget the key downs seen so far on all devices.
+		void reset();
+
+	private:
+		struct Window {
+			unsigned short tokens[INPUT_SECRET_MAX_KEYS];
+			int head = 0;  // index of the oldest token once the ring is full
+			int count = 0;
+			unsigned long long rolling = 0;
+		};
+
+		SecretKey key;
+		SecretSequence secret;
+		unsigned long long base = 1;   // odd multiplier of the rolling hash
+		unsigned long long offset = 0; // added to each token of the rolling hash
+		unsigned long long top = 1;    // base to the power of length - 1
+		DeviceTable<Window> windows;
+
+		bool confirm(const Window& window) const;
+	};
+}
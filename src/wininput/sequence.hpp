@@ -0,0 +1,31 @@
+#pragma once
+
+#include "wininput.hpp"
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// Returns true if the key down matches the given KeyData of a sequence.
+	// If strict is false, ctrl, shift, and alt are not compared.
+	inline bool matchSequenceKey(const KeyData& data, const KeyData& key, bool strict) {
+		return data.code == key.code && (!strict ||
+			(data.ctrl == key.ctrl && data.shift == key.shift && data.alt == key.alt));
+	}
+
+	// Advance a key sequence, as given to addKeySequence, by a key down, where
+	// pos is the number of KeyData of the sequence matched so far. A key down
+	// that breaks the sequence may start it over. pos is reset to 0 once the
+	// sequence is complete.
+	// Returns true if the key down completed the sequence.
+	inline bool stepKeySequence(const KeyData *evts, bool strict, int& pos, const KeyData& data) {
+		if (!matchSequenceKey(data, evts[pos], strict)) {
+			if (pos == 0) return false;
+			pos = 0;
+			if (!matchSequenceKey(data, evts[0], strict)) return false;
+		}
+
+		if (evts[++pos].code != 0) return false;
+		pos = 0;
+		return true;
+	}
+}
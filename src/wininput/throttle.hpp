@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// A token bucket that allows up to a given number of events per second, with
+	// bursts of up to one second's worth of events. Tokens are refilled from the
+	// timestamps of the events themselves, so no timer is needed, and an event
+	// under the limit costs a few arithmetic operations.
+	// take and reset should only be called from a single thread, such as from
+	// within a handler, while the rate can be changed from any thread.
+	class TokenBucket {
+	public:
+		// Set the number of events allowed per second, where 0 = no limit.
+		void setRate(unsigned perSecond) {
+			rate.store(perSecond, std::memory_order_relaxed);
+		}
+
+		unsigned getRate() const {
+			return rate.load(std::memory_order_relaxed);
+		}
+
+		// Refill the bucket, so that a full burst is allowed again.
+		void reset() {
+			full = true;
+		}
+
+		// Take a token for an event at the given time, in milliseconds.
+		// Returns true if the event is allowed, and false if the bucket is empty.
+		bool take(unsigned long time) {
+			unsigned perSecond = rate.load(std::memory_order_relaxed);
+			if (perSecond == 0) return true;
+
+			// tokens are counted in thousandths, so that a millisecond refills
+			// perSecond of them
+			unsigned long long capacity = perSecond * 1000ULL;
+			if (full) {
+				tokens = capacity;
+				full = false;
+			} else if ((long)(time - last) > 0) {
+				tokens += (unsigned long long)(time - last) * perSecond;
+				if (tokens > capacity) tokens = capacity;
+			}
+			last = time;
+
+			if (tokens < 1000ULL) return false;
+			tokens -= 1000ULL;
+			return true;
+		}
+
+	private:
+		std::atomic<unsigned> rate{ 0 };
+		unsigned long long tokens = 0;
+		unsigned long last = 0;
+		bool full = true;
+	};
+}
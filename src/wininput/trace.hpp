@@ -0,0 +1,74 @@
+#pragma once
+
+#include "wininput.hpp"
+
+// The value of TraceRecord.kind for a KeyData.
+#define INPUT_TRACE_KEY 1
+// The value of TraceRecord.kind for a MouseData.
+#define INPUT_TRACE_MOUSE 2
+
+// Bits of TraceRecord.flags for the modifiers of a KeyData.
+#define INPUT_TRACE_CTRL 0x1
+#define INPUT_TRACE_SHIFT 0x2
+#define INPUT_TRACE_ALT 0x4
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+	// A recorded key or mouse event, as seen by the handlers. A trace is a
+	// file of these records in the order the events occurred, in the byte
+	// order of the machine that recorded it. The records have a fixed size, so
+	// that a trace can be mapped into memory and read without any parsing.
+	struct TraceRecord {
+		unsigned int time;      // KeyData.time or MouseData.time
+		unsigned int code;      // KeyData.code or MouseData.code
+		unsigned int param;     // MouseData.param
+		int x;                  // MouseData.x
+		int y;                  // MouseData.y
+		unsigned short device;  // KeyData.device or MouseData.device
+		unsigned char kind;     // one of INPUT_TRACE_KEY and INPUT_TRACE_MOUSE
+		unsigned char flags;    // KeyData.type in the high bits, INPUT_TRACE_ bits in the low ones
+	};
+
+	static_assert(sizeof(TraceRecord) == 24, "TraceRecord should not be padded");
+
+	inline TraceRecord toTraceRecord(const KeyData& data) {
+		TraceRecord rec = { (unsigned int)data.time, (unsigned int)data.code, 0, 0, 0,
+			(unsigned short)data.device, INPUT_TRACE_KEY, (unsigned char)(data.type << 3) };
+		if (data.ctrl) rec.flags |= INPUT_TRACE_CTRL;
+		if (data.shift) rec.flags |= INPUT_TRACE_SHIFT;
+		if (data.alt) rec.flags |= INPUT_TRACE_ALT;
+		return rec;
+	}
+
+	inline TraceRecord toTraceRecord(const MouseData& data) {
+		TraceRecord rec = { (unsigned int)data.time, data.code, (unsigned int)data.param,
+			(int)data.x, (int)data.y, (unsigned short)data.device, INPUT_TRACE_MOUSE, 0 };
+		return rec;
+	}
+
+	// Get the KeyData of a record of kind INPUT_TRACE_KEY.
+	inline KeyData toKeyData(const TraceRecord& rec) {
+		KeyData data;
+		data.code = rec.code;
+		data.ctrl = (rec.flags & INPUT_TRACE_CTRL) != 0;
+		data.shift = (rec.flags & INPUT_TRACE_SHIFT) != 0;
+		data.alt = (rec.flags & INPUT_TRACE_ALT) != 0;
+		data.type = rec.flags >> 3;
+		data.time = rec.time;
+		data.device = rec.device;
+		return data;
+	}
+
+	// Get the MouseData of a record of kind INPUT_TRACE_MOUSE.
+	inline MouseData toMouseData(const TraceRecord& rec) {
+		MouseData data;
+		data.code = rec.code;
+		data.x = rec.x;
+		data.y = rec.y;
+		data.param = rec.param;
+		data.time = rec.time;
+		data.device = rec.device;
+		return data;
+	}
+}
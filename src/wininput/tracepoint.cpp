@@ -0,0 +1,174 @@
+#include "tracepoint.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+
+// The first bytes of a file written by dumpTracepoints.
+#define TRACEPOINT_MAGIC "PLTP"
+
+namespace {
+	using input::TracepointRecord;
+
+	// the records of a thread, only written by that thread
+	struct Ring {
+		TracepointRecord records[INPUT_TRACEPOINT_RING];
+		std::atomic<unsigned long long> head{ 0 }; // number of records written
+		unsigned char index = 0;
+	};
+
+	const char *formats[] = {
+#define TRACEPOINT_FORMAT(name, format) format,
+		INPUT_TRACEPOINT_LIST(TRACEPOINT_FORMAT)
+#undef TRACEPOINT_FORMAT
+	};
+
+	std::atomic<bool> enabled(false);
+	std::atomic<long long> origin(0);
+
+	// rings are never freed, since their threads may still be writing
+	Ring *rings[INPUT_TRACEPOINT_THREADS] = { nullptr };
+	std::atomic<int> ringCount(0);
+	std::mutex ringsMutex;
+
+	thread_local Ring *threadRing = nullptr;
+	thread_local bool threadFull = false;
+
+	inline long long now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// give the calling thread a ring, or return nullptr if there are none left
+	Ring *addRing() {
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		int count = ringCount.load();
+		if (count == INPUT_TRACEPOINT_THREADS) {
+			threadFull = true;
+			return nullptr;
+		}
+		Ring *ring = new Ring();
+		ring->index = (unsigned char)count;
+		rings[count] = ring;
+		ringCount.store(count + 1);
+		threadRing = ring;
+		return ring;
+	}
+
+	void appendArg(std::string& text, const TracepointRecord& record, int index) {
+		unsigned long long raw = record.args[index];
+		switch ((record.kinds >> (index * 2)) & 3) {
+		case INPUT_TRACEPOINT_INT:
+			text += std::to_string((long long)raw);
+			break;
+		case INPUT_TRACEPOINT_FLOAT: {
+			double real;
+			std::memcpy(&real, &raw, sizeof(real));
+			text += std::to_string(real);
+			break;
+		}
+		default:
+			text += std::to_string(raw);
+		}
+	}
+}
+
+namespace input {
+
+	void enableTracepoints(bool enable) {
+#ifdef _WININPUT_TRACE
+		long long none = 0;
+		origin.compare_exchange_strong(none, now());
+		enabled.store(enable);
+#else
+		(void)enable;
+#endif
+	}
+
+	bool tracepointsEnabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	TracepointRecord *beginTracepoint(Tracepoint id) {
+		Ring *ring = threadRing;
+		if (ring == nullptr) {
+			if (threadFull) return nullptr;
+			ring = addRing();
+			if (ring == nullptr) return nullptr;
+		}
+
+		TracepointRecord *record = &ring->records[
+			ring->head.load(std::memory_order_relaxed) % INPUT_TRACEPOINT_RING];
+		record->time = (unsigned long long)(now() - origin.load(std::memory_order_relaxed));
+		record->id = (unsigned short)id;
+		record->thread = ring->index;
+		return record;
+	}
+
+	void endTracepoint() {
+		Ring *ring = threadRing;
+		ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	bool dumpTracepoints(const std::string& path) {
+		std::vector<TracepointRecord> records;
+		int count = ringCount.load();
+		for (int i = 0; i < count; i++) {
+			Ring *ring = rings[i];
+			unsigned long long head = ring->head.load(std::memory_order_acquire);
+			unsigned long long first = head > INPUT_TRACEPOINT_RING ? head - INPUT_TRACEPOINT_RING : 0;
+			for (unsigned long long j = first; j < head; j++)
+				records.push_back(ring->records[j % INPUT_TRACEPOINT_RING]);
+		}
+		std::stable_sort(records.begin(), records.end(),
+			[](const TracepointRecord& a, const TracepointRecord& b) { return a.time < b.time; });
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out.good()) return false;
+		unsigned int size = sizeof(TracepointRecord);
+		out.write(TRACEPOINT_MAGIC, 4);
+		out.write((const char*)&size, sizeof(size));
+		if (!records.empty())
+			out.write((const char*)records.data(), records.size() * sizeof(TracepointRecord));
+		return out.good();
+	}
+
+	bool readTracepoints(const std::string& path, std::vector<TracepointRecord>& records) {
+		std::ifstream in(path, std::ios::binary);
+		char magic[4];
+		unsigned int size = 0;
+		in.read(magic, 4);
+		in.read((char*)&size, sizeof(size));
+		if (!in.good() || std::memcmp(magic, TRACEPOINT_MAGIC, 4) != 0
+			|| size != sizeof(TracepointRecord)) return false;
+
+		TracepointRecord record;
+		while (in.read((char*)&record, sizeof(record)))
+			records.push_back(record);
+		return true;
+	}
+
+	std::string formatTracepoint(const TracepointRecord& record) {
+		if (record.id >= (unsigned short)Tracepoint::COUNT)
+			return "unknown tracepoint " + std::to_string(record.id);
+
+		// each {} is replaced by the next argument, and missing ones by ?
+		std::string text;
+		int index = 0;
+		for (const char *p = formats[record.id]; *p; p++) {
+			if (p[0] == '{' && p[1] == '}') {
+				if (index < record.count && index < INPUT_TRACEPOINT_ARGS)
+					appendArg(text, record, index);
+				else
+					text += '?';
+				++index;
+				++p;
+			} else {
+				text += *p;
+			}
+		}
+		return text;
+	}
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// The maximum number of arguments of a tracepoint.
+#define INPUT_TRACEPOINT_ARGS 6
+// The number of records kept for each thread; older ones are overwritten.
+#define INPUT_TRACEPOINT_RING 4096
+// The maximum number of threads that record tracepoints.
+#define INPUT_TRACEPOINT_THREADS 16
+
+// The kinds of the arguments of a TracepointRecord, see TracepointRecord.kinds.
+#define INPUT_TRACEPOINT_UINT 0
+#define INPUT_TRACEPOINT_INT 1
+#define INPUT_TRACEPOINT_FLOAT 2
+
+// The tracepoints, each with its format, where {} stands for an argument.
+// Formats are only applied when the records are read, so new tracepoints are
+// added at the end to keep the IDs of older ones.
+#define INPUT_TRACEPOINT_LIST(X) \
+	X(KEY_EVENT, "key {}, ctrl {}, shift {}, alt {}, type {}") \
+	X(KEY_SEQUENCE_MATCHED, "key sequence {} matched by key {}") \
+	X(KEY_PATTERN_MATCHED, "key pattern {} matched by key {}") \
+	X(MOUSE_SEQUENCE_MATCHED, "mouse sequence {} matched by message {} at {}, {}") \
+	X(COMPOSITE_MATCHED, "composite sequence {} matched by code {}") \
+	X(KEY_BUFFER_RELEASED, "key buffer released, {} buffered, {} replayed") \
+	X(INVALID_KEY_PATTERN, "invalid key pattern of {} characters") \
+	X(HOOK_THREAD_CREATED, "creating wininput thread") \
+	X(HOOK_THREAD_STARTED, "wininput thread started") \
+	X(HOOK_THREAD_STOPPED, "wininput thread stopped") \
+	X(HOOKS_SUSPENDED, "wininput hooks suspended") \
+	X(HOOKS_RESUMED, "wininput hooks resumed") \
+	X(HOOK_SHUTDOWN, "wininput shutdown complete") \
+	X(EVDEV_DEVICE_ADDED, "evdev device {} added, kinds {}, grabbed {}") \
+	X(EVDEV_DEVICE_REMOVED, "evdev device {} removed") \
+	X(EVDEV_THREAD_STARTED, "evdev thread started") \
+	X(EVDEV_THREAD_STOPPED, "evdev thread stopped") \
+	X(MASHING_DETECTED, "state: mashing detected, {} keys, {} pressed, spread {}") \
+	X(RHYTHM_SAMPLE, "state: unlock rhythm sample {}") \
+	X(RHYTHM_SCORE, "state: unlock rhythm score {}") \
+	X(UNLOCK_SEQUENCE, "state: unlock sequence") \
+	X(LIMIT_SEQUENCE, "state: limit sequence") \
+	X(LOCK_SEQUENCE, "state: lock sequence") \
+	X(THROTTLE_SEQUENCE, "state: throttle sequence") \
+	X(GESTURE_RECORDED, "state: recorded unlock gesture") \
+	X(GESTURE_MATCHED, "state: stroke matched gesture {}, distance {}") \
+	X(UNLOCK_GESTURE, "state: unlock gesture") \
+	X(PLUGINS_LOADED, "state: loaded {} plug-ins") \
+	X(INPUT_SUSPENDED, "state: suspending input handling") \
+	X(INPUT_RESUMED, "state: resuming input handling") \
+	X(HOOK_STATS, "state: hook time {}us over {} events, {}ms suspended, ~{} wakeups saved, {} of {} repeats cached") \
+	X(SEQUENCE_KEY_LOADED, "settings: loaded sequence key {}: ctrl {}, shift {}, alt {}, code {}") \
+	X(SEQUENCE_KEY_SAVED, "settings: saved sequence key {}: ctrl {}, shift {}, alt {}, code {}") \
+	X(STATUS_REPAINT, "ui: repainting") \
+	X(UI_QUIT, "ui: quitting") \
+	X(STARTUP_TIMELINE, "state: cold start, config {}ms, hooks {}ms, ui {}ms") \
+	X(STARTUP_OVER_BUDGET, "state: cold start took {}ms, over the budget of {}ms") \
+	X(JOURNAL_RESTORED, "state: restored mode {} from the journal in {}us") \
+	X(JOURNAL_STATS, "state: journal wrote {} of {} changes in {} syncs, {} bytes, {} compactions, durable after {}us on average") \
+	X(SCHEDULE_INVALID, "state: the schedule could not be read, so none is followed") \
+	X(SCHEDULE_CHANGED, "state: schedule changed from mode {} to {}, in mode {}") \
+	X(UI_INTENT, "ui: intent {} passed by another launch") \
+	X(INJECTED_EVENT, "injected key {}, tag {}, blocked {}") \
+	X(COMPOSITE_INVALID, "state: composite sequence of {} characters could not be read or added") \
+	X(UNLOCK_COMPOSITE, "state: unlock composite sequence")
+
+// Record a tracepoint, given by its name in INPUT_TRACEPOINT_LIST, with up to
+// INPUT_TRACEPOINT_ARGS numbers as its arguments. Tracepoints are compiled in
+// only if _WININPUT_TRACE is defined, and are otherwise removed along with
+// their arguments. When compiled in, they are recorded only while enabled by
+// enableTracepoints, and the arguments are not evaluated otherwise.
+#ifdef _WININPUT_TRACE
+#define INPUT_TRACEPOINT(name, ...) do { if (input::tracepointsEnabled()) \
+	input::writeTracepoint(input::Tracepoint::name, ##__VA_ARGS__); } while (0)
+#else
+#define INPUT_TRACEPOINT(name, ...) do {} while (0)
+#endif
+
+// Definitions provided by WinInput are contained within the 'input' scope
+namespace input {
+
+#define INPUT_TRACEPOINT_ID(name, format) name,
+	enum class Tracepoint : unsigned short { INPUT_TRACEPOINT_LIST(INPUT_TRACEPOINT_ID) COUNT };
+#undef INPUT_TRACEPOINT_ID
+
+	// A recorded tracepoint. The arguments are kept as raw numbers, and are
+	// only formatted when the records are read, such as by tools/tracefmt.cpp.
+	struct TracepointRecord {
+		unsigned long long time; // nanoseconds since tracepoints were first enabled
+		unsigned short id;       // a Tracepoint
+		unsigned char count;     // number of arguments
+		unsigned char thread;    // index of the thread that recorded it
+		unsigned int kinds;      // INPUT_TRACEPOINT_ kind of each argument, 2 bits each
+		unsigned long long args[INPUT_TRACEPOINT_ARGS];
+	};
+
+	static_assert(sizeof(TracepointRecord) == 64, "TracepointRecord should fill a cache line");
+
+	// Start or stop recording tracepoints. Has no effect unless _WININPUT_TRACE is defined.
+	void enableTracepoints(bool enable);
+
+	// Returns true if tracepoints are being recorded.
+	bool tracepointsEnabled();
+
+	// Write the records kept for each thread, ordered by time, to the file at
+	// the given path, to be formatted by tools/tracefmt.cpp. Records written
+	// while this runs may be torn, so it is best called once tracing is
+	// stopped, such as on exit.
+	// Returns true if successful, and false if otherwise.
+	bool dumpTracepoints(const std::string& path);
+
+	// Read the records written by dumpTracepoints from the file at the given path.
+	// Returns true if successful, and false if otherwise.
+	bool readTracepoints(const std::string& path, std::vector<TracepointRecord>& records);
+
+	// Returns the text of a record, with its arguments in its format.
+	std::string formatTracepoint(const TracepointRecord& record);
+
+	// Returns the slot of the next record of the calling thread, with the time
+	// and ID filled in, or nullptr if it cannot record tracepoints.
+	// Used by writeTracepoint.
+	TracepointRecord *beginTracepoint(Tracepoint id);
+
+	// Publish the record returned by the last call to beginTracepoint.
+	// Used by writeTracepoint.
+	void endTracepoint();
+
+	inline void setTracepointArgs(TracepointRecord&, int) {}
+
+	template <typename T, typename... Rest>
+	inline void setTracepointArgs(TracepointRecord& record, int index, T value, Rest... rest) {
+		static_assert(std::is_arithmetic<T>::value, "tracepoint arguments should be numbers");
+		unsigned long long raw = 0;
+		unsigned kind = INPUT_TRACEPOINT_UINT;
+		if (std::is_floating_point<T>::value) {
+			double real = (double)value;
+			std::memcpy(&raw, &real, sizeof(raw));
+			kind = INPUT_TRACEPOINT_FLOAT;
+		} else if (std::is_signed<T>::value) {
+			raw = (unsigned long long)(long long)value;
+			kind = INPUT_TRACEPOINT_INT;
+		} else {
+			raw = (unsigned long long)value;
+		}
+		record.args[index] = raw;
+		record.kinds |= kind << (index * 2);
+		setTracepointArgs(record, index + 1, rest...);
+	}
+
+	// Record a tracepoint with the given arguments, see INPUT_TRACEPOINT.
+	template <typename... Args>
+	inline void writeTracepoint(Tracepoint id, Args... args) {
+		static_assert(sizeof...(Args) <= INPUT_TRACEPOINT_ARGS, "too many tracepoint arguments");
+		TracepointRecord *record = beginTracepoint(id);
+		if (record == nullptr) return;
+		record->count = (unsigned char)sizeof...(Args);
+		record->kinds = 0;
+		setTracepointArgs(*record, 0, args...);
+		endTracepoint();
+	}
+}
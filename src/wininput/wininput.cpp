@@ -1,226 +1,806 @@
 
 #include "wininput.hpp"
+#include "audit.hpp"
+#include "composite.hpp"
+#include "devicetable.hpp"
+#include "gesture.hpp"
+#include "keybuffer.hpp"
+#include "keypattern.hpp"
+#include "pipeline.hpp"
+#include "pointindex.hpp"
+#include "secret.hpp"
+#include "sequence.hpp"
+#include "tracepoint.hpp"
 
-#include <iostream>
+#include <atomic>
+#include <cstring>
 #include <list>
 #include <mutex>
+#include <random>
+#include <vector>
 #include <windows.h>
 
-#ifdef _WININPUT_DEBUG
-#define _D(x) std::cout << x
-#else
-#define _D(x)
-#endif
+
+// Thread messages used to ask the wininput thread to remove or reinstall its hooks.
+#define WININPUT_MSG_SUSPEND (WM_APP + 1)
+#define WININPUT_MSG_RESUME (WM_APP + 2)
+// Thread message used to ask the wininput thread to discard or replay buffered keys.
+#define WININPUT_MSG_RELEASE (WM_APP + 3)
+// Thread message used by the wininput thread to replay the next batch of buffered keys.
+#define WININPUT_MSG_REPLAY (WM_APP + 4)
+// Thread message used to ask the wininput thread to install its hooks for the first time.
+#define WININPUT_MSG_START (WM_APP + 5)
+// Thread message used to ask the wininput thread to call a function, see postHookCall.
+#define WININPUT_MSG_CALL (WM_APP + 6)
+
+// Maximum time, in milliseconds, that start waits for the hooks to be installed.
+#define WININPUT_START_TIMEOUT 5000
+
+// Number of buffered key events passed to each SendInput call when replaying.
+#define WININPUT_REPLAY_BATCH 32
 
 namespace {
 
+	struct KeyHandler {
+		input::key_handler_fn fn;
+		bool repeats; // whether the handler sees auto-repeated key downs
+	};
+
+	// the verdict of the handlers without repeats on the last key down of a key
+	struct KeyVerdict {
+		unsigned long generation = 0; // 0 if there is no usable verdict
+		// index of the handler that halted processing, counting the pipeline stages first
+		int stopIndex = INPUT_PIPELINE_PASS;
+	};
+
 	struct KeySequence {
 		int id;
-		int pos = 0;
+		input::DeviceTable<int> pos; // the progress on each device
 		bool strict;
 		input::KeyData *evts;
 		input::event_handler_fn handler;
 	};
 
+	struct SecretKeySequence {
+		int id;
+		input::SecretMatcher matcher;
+		input::event_handler_fn handler;
+	};
+
+	// a KeyTiming in performance counter ticks
+	struct TimedKey {
+		DWORD vkCode;
+		LONGLONG down;
+		LONGLONG up;
+	};
+
+	struct KeyPatternSequence {
+		int id;
+		input::KeyPattern pattern;
+		input::DeviceTable<int> states; // the DFA state on each device
+		input::event_handler_fn handler;
+	};
+
 	struct MouseSequence {
 		int id;
 		int pos = 0;
 		unsigned tolerance;
 		input::MouseData *evts;
 		input::event_handler_fn handler;
+		unsigned long stamp = 0; // the last event that advanced this sequence
+	};
+
+	// the sequences of mouse events, and the index of their first events
+	struct MouseSequences {
+		std::list<MouseSequence> seqs;
+		input::PointIndex startIndex;
+		std::vector<MouseSequence*> seqsById;
+		std::vector<MouseSequence*> activeSeqs; // the sequences that are partially matched
+		unsigned long eventStamp = 0;
+
+		MouseSequences() {}
+
+		// the copy starts every sequence over, since its index is rebuilt
+		MouseSequences(const MouseSequences& other) : seqs(other.seqs), eventStamp(other.eventStamp) {
+			rebuild();
+		}
+
+		MouseSequences& operator=(const MouseSequences&) = delete;
+
+		// rebuild the index of the sequences, starting every sequence over
+		void rebuild() {
+			std::vector<input::PointIndex::Target> targets;
+			seqsById.clear();
+			for (auto& seq : seqs) {
+				seq.pos = 0;
+				if (seq.evts[0].code == 0) continue;
+				targets.push_back({ seq.evts[0].x, seq.evts[0].y, seq.tolerance, (int)seqsById.size() });
+				seqsById.push_back(&seq);
+			}
+			startIndex.build(targets);
+			activeSeqs.clear();
+			activeSeqs.reserve(seqsById.size());
+		}
+	};
+
+	// the secret sequences, which are checked first, and the others
+	struct KeySequences {
+		std::list<SecretKeySequence> secrets;
+		std::list<KeySequence> seqs;
 	};
 
 	HANDLE thread = NULL;
 	DWORD threadId = 0;
+
+	void retireHookLists(unsigned);
+
+	// handlers or sequences that are only stepped by the wininput thread,
+	// without locks. As for the composite matchers, changes are made to a
+	// copy, under the mutex, which then replaces it, and the copies replaced
+	// are freed on the wininput thread once it is between events, see
+	// retireHookLists
+	template<typename T>
+	class HookList {
+	public:
+		std::mutex mutex;
+
+		// returns the current set, or null if none has been published
+		T *get() {
+			return current.load(std::memory_order_acquire);
+		}
+
+		// returns a copy of the current set, to be changed and then published;
+		// must be called with the mutex held
+		T *copy() {
+			T *set = current.load();
+			return set ? new T(*set) : new T();
+		}
+
+		// replace the current set with the given one; must be called with the
+		// mutex held
+		void publish(T *next) {
+			T *prev = current.exchange(next);
+			if (prev == nullptr) return;
+
+			// without the wininput thread, no hook can be using it
+			if (thread == NULL) {
+				delete prev;
+			} else {
+				retired.push_back(prev);
+				PostThreadMessage(threadId, WININPUT_MSG_CALL, (WPARAM)retireHookLists, 0);
+			}
+		}
+
+		// free the sets that have been replaced
+		void retire() {
+			std::lock_guard<std::mutex> lock(mutex);
+			for (T *set : retired)
+				delete set;
+			retired.clear();
+		}
+
+	private:
+		std::atomic<T*> current{ nullptr };
+		std::vector<T*> retired;
+	};
+
 	bool failure = false;
 
-	std::list<input::key_handler_fn> keyHandlers;
-	std::list<input::mouse_handler_fn> mouseHandlers;
-	std::list<KeySequence> keyEventSeqs;
-	std::list<MouseSequence> mouseEventSeqs;
-	std::mutex keyHandlersMutex;
-	std::mutex mouseHandlersMutex;
-	std::mutex keyEventSeqsMutex;
-	std::mutex mouseEventSeqsMutex;
+	HHOOK keyboardHook = NULL;
+	HHOOK mouseHook = NULL;
+	std::atomic<bool> suspended(false);
+
+	// hooks are only installed once start is called, and startEvent is set
+	// once they are, or would have been if not for suspend
+	std::atomic<bool> started(false);
+	HANDLE startEvent = NULL;
+
+	// hook statistics
+	LARGE_INTEGER perfFreq;
+	DWORD startTime = 0;
+	DWORD suspendStart = 0;
+	std::atomic<unsigned long long> eventCount(0);
+	std::atomic<unsigned long long> hookTicks(0);
+	std::atomic<unsigned long long> suspendCount(0);
+	std::atomic<unsigned long long> suspendedMs(0);
+	std::atomic<unsigned long long> repeatCount(0);
+	std::atomic<unsigned long long> repeatsCached(0);
+
+	std::atomic<input::key_pipeline_fn> keyPipeline(nullptr);
+	std::atomic<input::injected_handler_fn> injectedHandler(nullptr);
+	std::atomic<int> keyPipelineStages(0);
+	std::atomic<input::mouse_pipeline_fn> mousePipeline(nullptr);
+	HookList<std::list<KeyHandler>> keyHandlers;
+	HookList<std::list<input::mouse_handler_fn>> mouseHandlers;
+	HookList<KeySequences> keyEventSeqs;
+	HookList<std::list<KeyPatternSequence>> keyPatterns;
+	HookList<MouseSequences> mouseEventSeqs;
 	int seqCounter = 0;
 
+	// the composite sequences, only stepped by the wininput thread; changes
+	// are made to a copy, under compositeSeqsMutex, which then replaces it,
+	// and the matchers replaced are freed on the wininput thread once it is
+	// between events, see retireComposites
+	std::atomic<input::CompositeMatcher*> compositeMatcher(nullptr);
+	std::vector<input::CompositeMatcher*> retiredMatchers;
+	std::mutex compositeSeqsMutex;
+
+	// blocked key events; only accessed by the wininput thread
+	std::atomic<bool> bufferKeys(false);
+	input::KeyBuffer keyBuffer;
+	input::BufferedKey replayKeys[INPUT_KEYBUFFER_SIZE];
+	// number of key downs seen by sequences; only written by the wininput thread
+	std::atomic<unsigned long> keyDownIndex(0);
+	INPUT replayBuffer[INPUT_KEYBUFFER_SIZE * 2];
+	int replayPos = 0;
+	int replayCount = 0;
+	// value of dwExtraInfo that marks the key events injected by the replay,
+	// chosen at random for each run by setupThread, and the number of them
+	// sent that have yet to reach the hook; other processes can pass their
+	// input as replayed neither by a known tag nor while no replay is going on
+	ULONG_PTR replayTag = 0;
+	std::atomic<long> replayInFlight(0);
+
+	// verdicts reused for auto-repeated key downs; only accessed by the wininput
+	// thread, and discarded by bumping the generation
+	KeyVerdict keyVerdicts[256];
+	std::atomic<unsigned long> verdictGeneration(1);
+
+	// ring of the most recent key downs; only accessed by the wininput thread
+	TimedKey keyTimings[INPUT_KEYTIMINGS];
+	unsigned long keyTimingCount = 0;
+
+	// bitmap of keys and mouse buttons currently held down; only accessed by the
+	// wininput thread, with VK_CONTROL, VK_SHIFT, VK_MENU set if either side is held
+	unsigned pressed[8] = { 0 };
+
+	// stroke tracking; the sampler is only accessed by the wininput thread, and the
+	// finished stroke is handed to the stroke thread through pendingStroke
+	std::atomic<input::stroke_handler_fn> strokeHandler(nullptr);
+	input::StrokeSampler strokeSampler;
+	bool strokeActive = false;
+	long cursorX = 0;
+	long cursorY = 0;
+	long penX = 0;
+	long penY = 0;
+	input::Stroke pendingStroke;
+	std::atomic<bool> strokePending(false);
+	std::atomic<bool> strokeThreadStop(false);
+	HANDLE strokeThread = NULL;
+	HANDLE strokeEvent = NULL;
+
 	bool trackMods = false;
 	bool ctrlActive = false;
 	bool shiftActive = false;
 	bool altActive = false;
 
+	// measures the time spent inside a hook callback
+	struct HookTimer {
+		LARGE_INTEGER start;
+
+		HookTimer() {
+			QueryPerformanceCounter(&start);
+		}
+
+		~HookTimer() {
+			LARGE_INTEGER end;
+			QueryPerformanceCounter(&end);
+			hookTicks.fetch_add(end.QuadPart - start.QuadPart, std::memory_order_relaxed);
+			eventCount.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+
 	bool checkKeyHandlers(input::KeyData data) {
-		if (keyHandlers.size() == 0) return false;
+		input::key_pipeline_fn pipeline = keyPipeline.load(std::memory_order_acquire);
+		std::list<KeyHandler> *handlers = keyHandlers.get();
+		if (pipeline == nullptr && (handlers == nullptr || handlers->empty())) return false;
+
+		bool repeat = data.type == INPUT_TYPE_KEYREPEAT;
+		unsigned long generation = verdictGeneration.load(std::memory_order_relaxed);
+		KeyVerdict& verdict = keyVerdicts[data.code & 0xFF];
+
+		// if cached, only handlers with repeats are called, and the others give
+		// the verdict they gave on the key down
+		bool cached = repeat && verdict.generation == generation;
+		if (cached) repeatsCached.fetch_add(1, std::memory_order_relaxed);
 
+		// handlers without repeats see a repeat without a usable verdict as a key down
+		input::KeyData down = data;
+		if (repeat) down.type = INPUT_TYPE_KEYDOWN;
+
+		// the compiled pipeline is run first, followed by the registered handlers
 		bool stop = false;
-		std::lock_guard<std::mutex> lock(keyHandlersMutex);
-		for (auto& handler : keyHandlers) {
-			stop = handler(data);
-			if (stop) break;
+		int stopIndex = INPUT_PIPELINE_PASS;
+		if (pipeline != nullptr) {
+			stopIndex = pipeline(data, down, cached, verdict.stopIndex);
+			stop = stopIndex != INPUT_PIPELINE_PASS;
+		}
+
+		if (!stop && handlers != nullptr) {
+			int index = keyPipelineStages.load(std::memory_order_relaxed);
+			for (auto& handler : *handlers) {
+				if (handler.repeats) {
+					stop = handler.fn(data);
+					if (stop) stopIndex = INPUT_PIPELINE_STOP;
+				} else if (!cached) {
+					stop = handler.fn(down);
+					if (stop) stopIndex = index;
+				} else if (index == verdict.stopIndex) {
+					stop = true;
+				}
+				if (stop) break;
+				++index;
+			}
+		}
+
+		if (!cached && data.type != INPUT_TYPE_KEYUP) {
+			// the verdict is unknown if a handler with repeats halted processing
+			verdict.generation = stopIndex == INPUT_PIPELINE_STOP ? 0 : generation;
+			verdict.stopIndex = stopIndex;
 		}
 		return stop;
 	}
 
+	// secret sequences are checked before the others
 	bool checkKeyEventHandlers(input::KeyData data) {
-		if (keyEventSeqs.size() == 0) return false;
+		KeySequences *seqs = keyEventSeqs.get();
+		if (seqs == nullptr) return false;
 
 		bool stop = false;
-		std::lock_guard<std::mutex> lock(keyEventSeqsMutex);
-		for (auto& seq : keyEventSeqs) {
-			bool matched = false;
-
-			input::KeyData* next = &seq.evts[seq.pos];
-			if (data.code == next->code && (!seq.strict ||
-				(data.ctrl == next->ctrl && data.shift == next->shift && data.alt == next->alt))) {
-				matched = true;
-
-			} else if (seq.pos != 0) {
-				seq.pos = 0;
-				next = &seq.evts[0];
-				if (data.code == next->code && (!seq.strict ||
-					(data.ctrl == next->ctrl && data.shift == next->shift && data.alt == next->alt))) {
-					matched = true;
-				}
+		for (auto& seq : seqs->secrets) {
+			if (seq.matcher.step(data)) {
+				INPUT_TRACEPOINT(KEY_SEQUENCE_MATCHED, seq.id, data.code);
+				stop = seq.handler();
+				if (stop) return stop;
 			}
+		}
+		for (auto& seq : seqs->seqs) {
+			if (input::stepKeySequence(seq.evts, seq.strict, seq.pos[data.device], data)) {
+				INPUT_TRACEPOINT(KEY_SEQUENCE_MATCHED, seq.id, data.code);
+				stop = seq.handler();
+				if (stop) break;
+			}
+		}
+		return stop;
+	}
 
-			if (matched) {
-				// increment pos on successful match
-				_D("Key Seq " << seq.id << " matched: " << data.code << std::endl);
-				++seq.pos;
+	bool checkKeyPatternHandlers(const input::KeyData& data) {
+		std::list<KeyPatternSequence> *patterns = keyPatterns.get();
+		if (patterns == nullptr) return false;
 
-				if (seq.evts[seq.pos].code == 0) {
-					// complete sequence matched
-					stop = seq.handler();
-					seq.pos = 0;
-					if (stop) break;
-				}
+		bool stop = false;
+		for (auto& seq : *patterns) {
+			if (seq.pattern.step(data, seq.states[data.device])) {
+				INPUT_TRACEPOINT(KEY_PATTERN_MATCHED, seq.id, data.code);
+				stop = seq.handler();
+				if (stop) break;
 			}
-
 		}
 		return stop;
 	}
 
 	bool checkMouseHandlers(input::MouseData data) {
-		if (mouseHandlers.size() == 0) return false;
+		input::mouse_pipeline_fn pipeline = mousePipeline.load(std::memory_order_acquire);
+		if (pipeline != nullptr && pipeline(data)) return true;
+		std::list<input::mouse_handler_fn> *handlers = mouseHandlers.get();
+		if (handlers == nullptr) return false;
 
 		bool stop = false;
-		std::lock_guard<std::mutex> lock(mouseHandlersMutex);
-		for (auto& handler : mouseHandlers) {
+		for (auto& handler : *handlers) {
 			stop = handler(data);
 			if (stop) break;
 		}
 		return stop;
 	}
 
+	inline bool matchMouseData(const input::MouseData& next, const input::MouseData& data, unsigned tolerance) {
+		int tol = (unsigned)tolerance;
+		return next.code == data.code && next.x >= data.x - tol && next.x <= data.x + tol &&
+			next.y >= data.y - tol && next.y <= data.y + tol;
+	}
+
+	// advance a sequence past a matched event, calling its handler if it is complete.
+	// Returns true if the sequence is still partially matched.
+	bool advanceMouseSequence(MouseSequence& seq, unsigned long stamp, const input::MouseData& data, bool& stop) {
+		// increment pos on successful match
+		INPUT_TRACEPOINT(MOUSE_SEQUENCE_MATCHED, seq.id, data.code, data.x, data.y);
+		seq.stamp = stamp;
+		++seq.pos;
+
+		if (seq.evts[seq.pos].code == 0) {
+			// complete sequence matched
+			stop = seq.handler();
+			seq.pos = 0;
+			return false;
+		}
+		return true;
+	}
+
+	// only the partially matched sequences, and the sequences whose first event
+	// is indexed in the same cell as the event, are tested
 	bool checkMouseEventHandlers(input::MouseData data) {
-		if (mouseEventSeqs.size() == 0) return false;
+		MouseSequences *seqs = mouseEventSeqs.get();
+		if (seqs == nullptr || seqs->seqs.empty()) return false;
 
 		bool stop = false;
-		std::lock_guard<std::mutex> lock(mouseEventSeqsMutex);
-		for (auto& seq : mouseEventSeqs) {
-			bool matched = false;
+		unsigned long stamp = ++seqs->eventStamp;
+		std::vector<MouseSequence*>& active = seqs->activeSeqs;
 
-			int tol = (unsigned)seq.tolerance;
-			input::MouseData* next = &seq.evts[seq.pos];
-			if (next->code == data.code && next->x >= data.x - tol && next->x <= data.x + tol &&
-				next->y >= data.y - tol && next->y <= data.y + tol) {
-				matched = true;
+		size_t kept = 0;
+		for (size_t i = 0; i < active.size(); i++) {
+			MouseSequence *seq = active[i];
+			if (stop) {
+				active[kept++] = seq;
+			} else if (matchMouseData(seq->evts[seq->pos], data, seq->tolerance)) {
+				if (advanceMouseSequence(*seq, stamp, data, stop))
+					active[kept++] = seq;
+			} else {
+				// start over; the first event is checked below
+				seq->pos = 0;
+			}
+		}
+		active.resize(kept);
+		if (stop) return stop;
 
-			} else if (seq.pos != 0) {
-				seq.pos = 0;
-				next = &seq.evts[0];
-				if (next->code == data.code && next->x >= data.x - tol && next->x <= data.x + tol &&
-					next->y >= data.y - tol && next->y <= data.y + tol) {
-					matched = true;
-				}
+		const std::vector<int> *candidates = seqs->startIndex.query(data.x, data.y);
+		if (candidates == nullptr) return false;
+
+		for (int id : *candidates) {
+			MouseSequence *seq = seqs->seqsById[id];
+			if (seq->pos != 0 || seq->stamp == stamp) continue;
+			if (!matchMouseData(seq->evts[0], data, seq->tolerance)) continue;
+
+			if (advanceMouseSequence(*seq, stamp, data, stop))
+				active.push_back(seq);
+			if (stop) break;
+		}
+		return stop;
+	}
+
+	inline bool isPressed(DWORD vk) {
+		return (pressed[(vk >> 5) & 7] >> (vk & 31)) & 1;
+	}
+
+	inline void setPressed(DWORD vk, bool down) {
+		if (down)
+			pressed[(vk >> 5) & 7] |= 1U << (vk & 31);
+		else
+			pressed[(vk >> 5) & 7] &= ~(1U << (vk & 31));
+	}
+
+	// update the pressed bitmap for the given key, including the generic modifier key
+	void updatePressedKey(DWORD vk, bool down) {
+		setPressed(vk, down);
+		if (vk == VK_LCONTROL || vk == VK_RCONTROL)
+			setPressed(VK_CONTROL, isPressed(VK_LCONTROL) || isPressed(VK_RCONTROL));
+		else if (vk == VK_LSHIFT || vk == VK_RSHIFT)
+			setPressed(VK_SHIFT, isPressed(VK_LSHIFT) || isPressed(VK_RSHIFT));
+		else if (vk == VK_LMENU || vk == VK_RMENU)
+			setPressed(VK_MENU, isPressed(VK_LMENU) || isPressed(VK_RMENU));
+	}
+
+	// update the pressed bitmap for the mouse button of the given mouse message
+	void updatePressedButton(WPARAM msg, DWORD mouseData) {
+		switch (msg) {
+		case WM_LBUTTONDOWN: setPressed(VK_LBUTTON, true); break;
+		case WM_LBUTTONUP: setPressed(VK_LBUTTON, false); break;
+		case WM_RBUTTONDOWN: setPressed(VK_RBUTTON, true); break;
+		case WM_RBUTTONUP: setPressed(VK_RBUTTON, false); break;
+		case WM_MBUTTONDOWN: setPressed(VK_MBUTTON, true); break;
+		case WM_MBUTTONUP: setPressed(VK_MBUTTON, false); break;
+		case WM_XBUTTONDOWN:
+		case WM_XBUTTONUP:
+			setPressed(HIWORD(mouseData) == XBUTTON1 ? VK_XBUTTON1 : VK_XBUTTON2,
+				msg == WM_XBUTTONDOWN);
+			break;
+		}
+	}
+
+	// check an event from the merged key and mouse stream against all composite
+	// sequences; timeouts are measured with the event timestamps
+	inline bool checkCompositeHandlers(short type, DWORD code, long x, long y, DWORD time) {
+		input::CompositeMatcher *matcher = compositeMatcher.load(std::memory_order_acquire);
+		if (matcher == nullptr) return false;
+		return matcher->step({ type, code, x, y, time, 0 }, pressed);
+	}
+
+	// free the handlers and sequences that have been replaced; called on the
+	// wininput thread, which only steps the current ones
+	void retireHookLists(unsigned) {
+		keyHandlers.retire();
+		mouseHandlers.retire();
+		keyEventSeqs.retire();
+		keyPatterns.retire();
+		mouseEventSeqs.retire();
+	}
+
+	// free the composite matchers that have been replaced; called on the
+	// wininput thread, which only steps the current one
+	void retireComposites(unsigned) {
+		std::lock_guard<std::mutex> lock(compositeSeqsMutex);
+		for (input::CompositeMatcher *matcher : retiredMatchers)
+			delete matcher;
+		retiredMatchers.clear();
+	}
+
+	// replace the composite matcher with the given one, or with none if it
+	// has no sequences; must be called with compositeSeqsMutex held
+	void publishComposites(input::CompositeMatcher *next) {
+		if (next->size() == 0) {
+			delete next;
+			next = nullptr;
+		}
+		input::CompositeMatcher *prev = compositeMatcher.exchange(next);
+		if (prev == nullptr) return;
+
+		// without the wininput thread, no hook can be using it
+		if (thread == NULL) {
+			delete prev;
+		} else {
+			retiredMatchers.push_back(prev);
+			PostThreadMessage(threadId, WININPUT_MSG_CALL, (WPARAM)retireComposites, 0);
+		}
+	}
+
+	// follow the stroke drawn with the left button held down. Blocked movements
+	// do not move the cursor, so the pen position accumulates the movement
+	// relative to where the cursor actually is.
+	void trackStroke(WPARAM msg, long x, long y, bool blocked) {
+		switch (msg) {
+		case WM_LBUTTONDOWN:
+			strokeActive = true;
+			penX = x;
+			penY = y;
+			strokeSampler.begin(penX, penY);
+			break;
+		case WM_MOUSEMOVE:
+			if (!strokeActive) break;
+			penX += x - cursorX;
+			penY += y - cursorY;
+			strokeSampler.add(penX, penY);
+			break;
+		case WM_LBUTTONUP:
+			if (!strokeActive) break;
+			strokeActive = false;
+			// drop the stroke if the previous one is still being handled
+			if (strokePending.load()) break;
+			if (strokeSampler.finish(pendingStroke)) {
+				strokePending.store(true);
+				SetEvent(strokeEvent);
 			}
+			break;
+		}
 
-			if (matched) {
-				// increment pos on successful match
-				_D("Mouse Seq " << seq.id << " matched: " << data.code \
-					<< ", " << data.x << ", " << data.y << std::endl);
-				++seq.pos;
-
-				if (seq.evts[seq.pos].code == 0) {
-					// complete sequence matched
-					stop = seq.handler();
-					seq.pos = 0;
-					if (stop) break;
-				}
+		if (!blocked) {
+			cursorX = x;
+			cursorY = y;
+		}
+	}
+
+	// the main function of the internal stroke thread
+	DWORD WINAPI _strokeMain(LPVOID lpParam) {
+		while (WaitForSingleObject(strokeEvent, INFINITE) == WAIT_OBJECT_0) {
+			if (strokeThreadStop.load()) break;
+			if (!strokePending.load()) continue;
+
+			input::stroke_handler_fn fn = strokeHandler.load();
+			if (fn) fn(pendingStroke);
+			strokePending.store(false);
+		}
+		return 0;
+	}
+
+	// add a blocked key event to the buffer, overwriting the oldest event if full
+	inline void bufferKey(const KBDLLHOOKSTRUCT *key) {
+		bool chord = isPressed(VK_CONTROL) || isPressed(VK_MENU) || isPressed(VK_LWIN) || isPressed(VK_RWIN);
+		keyBuffer.add({ key->vkCode, key->scanCode, (key->flags & LLKHF_UP) != 0,
+			(key->flags & LLKHF_EXTENDED) != 0, chord, key->time,
+			keyDownIndex.load(std::memory_order_relaxed) });
+	}
+
+	// send the next batch of replayed key events, and schedule the batch after it
+	void replayKeyBatch() {
+		int count = replayCount - replayPos;
+		if (count > WININPUT_REPLAY_BATCH) count = WININPUT_REPLAY_BATCH;
+		if (count <= 0) return;
+
+		// events that could not be injected never reach the hook
+		replayInFlight.fetch_add(count);
+		UINT sent = SendInput(count, &replayBuffer[replayPos], sizeof(INPUT));
+		if (sent < (UINT)count) replayInFlight.fetch_sub(count - (long)sent);
+		replayPos += count;
+		if (replayPos < replayCount)
+			PostThreadMessage(threadId, WININPUT_MSG_REPLAY, NULL, NULL);
+	}
+
+	// empty the key buffer, replaying the recent typing in it if requested (see
+	// KeyBuffer); key events that came after the key down numbered stripFrom
+	// are left out
+	void flushKeyBuffer(bool replay, unsigned long stripFrom) {
+		bool down[256] = { false };
+		int buffered = keyBuffer.size();
+		int count = 0;
+		replayPos = 0;
+		replayCount = 0;
+
+		if (replay)
+			count = keyBuffer.release(stripFrom, GetTickCount(), replayKeys, down);
+		else
+			keyBuffer.clear();
+
+		for (int n = 0; n < count; n++) {
+			const input::BufferedKey& key = replayKeys[n];
+
+			INPUT& in = replayBuffer[replayCount++];
+			in.type = INPUT_KEYBOARD;
+			in.ki.wVk = (WORD)(key.code & 0xFF);
+			in.ki.wScan = (WORD)key.scan;
+			in.ki.dwFlags = (key.up ? KEYEVENTF_KEYUP : 0) |
+				(key.extended ? KEYEVENTF_EXTENDEDKEY : 0);
+			in.ki.time = 0;
+			in.ki.dwExtraInfo = replayTag;
+		}
+
+		// release keys whose key up was not blocked, so none are left held down
+		for (int vk = 0; vk < 256; vk++) {
+			if (!down[vk] || (GetAsyncKeyState(vk) & 0x8000)) continue;
+
+			INPUT& in = replayBuffer[replayCount++];
+			in.type = INPUT_KEYBOARD;
+			in.ki.wVk = (WORD)vk;
+			in.ki.wScan = (WORD)MapVirtualKey(vk, MAPVK_VK_TO_VSC);
+			in.ki.dwFlags = KEYEVENTF_KEYUP;
+			in.ki.time = 0;
+			in.ki.dwExtraInfo = replayTag;
+		}
+
+		INPUT_TRACEPOINT(KEY_BUFFER_RELEASED, buffered, replayCount);
+		replayKeyBatch();
+	}
+
+	inline void recordKeyDown(DWORD vk, LONGLONG ticks) {
+		keyTimings[keyTimingCount % INPUT_KEYTIMINGS] = { vk, ticks, 0 };
+		++keyTimingCount;
+	}
+
+	// set the release time of the most recent press of the given key
+	inline void recordKeyUp(DWORD vk, LONGLONG ticks) {
+		unsigned long count = keyTimingCount < INPUT_KEYTIMINGS ? keyTimingCount : INPUT_KEYTIMINGS;
+		for (unsigned long i = 1; i <= count; i++) {
+			TimedKey& key = keyTimings[(keyTimingCount - i) % INPUT_KEYTIMINGS];
+			if (key.vkCode == vk) {
+				if (key.up == 0) key.up = ticks;
+				return;
 			}
 		}
-		return stop;
+	}
+
+	inline long long ticksToMicroseconds(LONGLONG ticks) {
+		// split to avoid overflowing when multiplying large tick counts
+		return ticks / perfFreq.QuadPart * 1000000LL
+			+ ticks % perfFreq.QuadPart * 1000000LL / perfFreq.QuadPart;
 	}
 
 	// callback function for keyboard hook
 	LRESULT CALLBACK lowLevelKeyboardProc(int code, WPARAM wParam, LPARAM lParam) {
+		input::AuditScope audit;
+		HookTimer timer;
 		bool stop = false;
 
 		if (code == HC_ACTION) {
 			LPKBDLLHOOKSTRUCT key = (LPKBDLLHOOKSTRUCT)lParam;
 
-			if ((key->flags >> LLKHF_INJECTED) & 1) {
-				// ignore injected events
+			if (key->flags & LLKHF_INJECTED) {
+				// injected events are only passed or blocked, by their tag, and
+				// the keys replayed from the buffer are always passed, while
+				// they are expected
+				input::injected_handler_fn fn = injectedHandler.load(std::memory_order_relaxed);
+				if (key->dwExtraInfo == replayTag && replayInFlight.load() > 0) {
+					replayInFlight.fetch_sub(1);
+				} else if (fn) {
+					stop = fn(key->dwExtraInfo, false);
+					INPUT_TRACEPOINT(INJECTED_EVENT, key->vkCode, key->dwExtraInfo, stop);
+					if (stop) return 1;
+				}
 			} else {
 				short type = INPUT_TYPE_KEYUP;
 				if (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN)
-					type = INPUT_TYPE_KEYDOWN;
+					type = isPressed(key->vkCode) ? INPUT_TYPE_KEYREPEAT : INPUT_TYPE_KEYDOWN;
+				bool down = type != INPUT_TYPE_KEYUP;
 
 				input::KeyData data;
 				if (trackMods) {
-					data = { key->vkCode, ctrlActive, shiftActive, altActive, type };
+					data = { key->vkCode, ctrlActive, shiftActive, altActive, type, key->time };
 
 					if (key->vkCode == VK_LCONTROL || key->vkCode == VK_RCONTROL)
-						ctrlActive = type == INPUT_TYPE_KEYDOWN;
+						ctrlActive = down;
 					else if (key->vkCode == VK_LSHIFT || key->vkCode == VK_RSHIFT)
-						shiftActive = type == INPUT_TYPE_KEYDOWN;
+						shiftActive = down;
 					else if (key->vkCode == VK_LMENU || key->vkCode == VK_RMENU)
-						altActive = type == INPUT_TYPE_KEYDOWN;
+						altActive = down;
 				} else {
 					SHORT ctrl = GetAsyncKeyState(VK_CONTROL) >> (sizeof(SHORT) - 1);
 					SHORT shift = GetAsyncKeyState(VK_SHIFT) >> (sizeof(SHORT) - 1);
 					SHORT alt = GetAsyncKeyState(VK_MENU) >> (sizeof(SHORT) - 1);
-					data = { key->vkCode, ctrl != 0, shift != 0, alt != 0, type };
+					data = { key->vkCode, ctrl != 0, shift != 0, alt != 0, type, key->time };
 				}
 
-				_D(data.code << ", " << data.ctrl << ", " << data.shift << ", " <<\
-					data.alt << ", " << data.type << std::endl);
+				updatePressedKey(key->vkCode, down);
+				if (type == INPUT_TYPE_KEYUP)
+					recordKeyUp(key->vkCode, timer.start.QuadPart);
+				else if (type == INPUT_TYPE_KEYREPEAT)
+					repeatCount.fetch_add(1, std::memory_order_relaxed);
+
+				INPUT_TRACEPOINT(KEY_EVENT, data.code, data.ctrl, data.shift, data.alt, data.type);
 
-				// sequences are only processed on key down
+				// sequences are only processed on key down, and not on repeats
 				// ctrl, shift, alt not processed by sequences
 				if (type == INPUT_TYPE_KEYDOWN &&
 					!(data.code >= VK_LSHIFT && data.code <= VK_RMENU)) {
+					keyDownIndex.store(keyDownIndex.load(std::memory_order_relaxed) + 1,
+						std::memory_order_relaxed);
+					recordKeyDown(key->vkCode, timer.start.QuadPart);
+
 					stop = checkKeyEventHandlers(data);
 					if (stop) return 1;
+
+					stop = checkKeyPatternHandlers(data);
+					if (stop) return 1;
+
+					stop = checkCompositeHandlers(INPUT_STEP_KEY, data.code, 0, 0, data.time);
+					if (stop) return 1;
 				}
 
 				stop = checkKeyHandlers(data);
-				if (stop) return 1;
+				if (stop) {
+					if (bufferKeys.load(std::memory_order_relaxed))
+						bufferKey(key);
+					return 1;
+				}
 			}
 		}
 
 		return CallNextHookEx(NULL, code, wParam, lParam);
 	}
 
+	bool handleMouseEvent(WPARAM wParam, const MSLLHOOKSTRUCT *inf) {
+		bool stop = false;
+		input::MouseData data = { wParam, inf->pt.x, inf->pt.y, inf->mouseData, inf->time };
+		updatePressedButton(wParam, inf->mouseData);
+
+		// skip mouse move events for sequences
+		if (wParam != WM_MOUSEMOVE) {
+			stop = checkMouseEventHandlers(data);
+			if (stop) return true;
+		}
+
+		// only button down and wheel events advance composite sequences
+		if (wParam == WM_LBUTTONDOWN || wParam == WM_RBUTTONDOWN ||
+			wParam == WM_MBUTTONDOWN || wParam == WM_XBUTTONDOWN ||
+			wParam == WM_MOUSEWHEEL || wParam == WM_MOUSEHWHEEL) {
+			stop = checkCompositeHandlers(INPUT_STEP_MOUSE, data.code, data.x, data.y, data.time);
+			if (stop) return true;
+		}
+
+		return checkMouseHandlers(data);
+	}
+
 	// callback function for mouse hook
 	LRESULT CALLBACK lowLevelMouseProc(int code, WPARAM wParam, LPARAM lParam) {
-		bool stop = false;
+		input::AuditScope audit;
+		HookTimer timer;
 
 		if (code == HC_ACTION) {
 			LPMSLLHOOKSTRUCT inf = (LPMSLLHOOKSTRUCT)lParam;
 
-			if ((inf->flags >> LLMHF_INJECTED) & 1) {
-				// ignore injected events
+			if (inf->flags & LLMHF_INJECTED) {
+				// injected events are only passed or blocked, by their tag
+				input::injected_handler_fn fn = injectedHandler.load(std::memory_order_relaxed);
+				if (fn && fn(inf->dwExtraInfo, true)) return 1;
 			} else {
-				input::MouseData data = { wParam, inf->pt.x, inf->pt.y, inf->mouseData };
-
-				// skip mouse move events for sequences
-				if (wParam != WM_MOUSEMOVE) {
-					stop = checkMouseEventHandlers(data);
-					if (stop) return 1;
-				}
-
-				stop = checkMouseHandlers(data);
+				bool stop = handleMouseEvent(wParam, inf);
+				if (strokeHandler.load(std::memory_order_relaxed))
+					trackStroke(wParam, inf->pt.x, inf->pt.y, stop);
 				if (stop) return 1;
 			}
 		}
@@ -228,27 +808,89 @@ namespace {
 		return CallNextHookEx(NULL, code, wParam, lParam);
 	}
 
+	void installHooks() {
+		if (keyboardHook != NULL) return;
+
+		HINSTANCE hInst = GetModuleHandle(NULL);
+		keyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, lowLevelKeyboardProc, hInst, 0);
+		mouseHook = SetWindowsHookEx(WH_MOUSE_LL, lowLevelMouseProc, hInst, 0);
+	}
+
+	void removeHooks() {
+		if (keyboardHook == NULL) return;
+
+		UnhookWindowsHookEx(keyboardHook);
+		UnhookWindowsHookEx(mouseHook);
+		keyboardHook = NULL;
+		mouseHook = NULL;
+	}
+
+	// resync the pressed keys and the tracked state of ctrl, shift, alt, as
+	// key events may have been missed while the hooks were removed
+	void resyncKeyState() {
+		for (DWORD vk = 1; vk < 256; vk++)
+			setPressed(vk, (GetAsyncKeyState(vk) & 0x8000) != 0);
+
+		if (!trackMods) return;
+		ctrlActive = isPressed(VK_CONTROL);
+		shiftActive = isPressed(VK_SHIFT);
+		altActive = isPressed(VK_MENU);
+	}
+
+	// install the hooks for the first time, once start is called
+	void startHooks() {
+		if (!suspended.load())
+			installHooks();
+		SetEvent(startEvent);
+	}
+
 	// the main function of the internal wininput thread
 	DWORD WINAPI _main(LPVOID lpParam) {
-		_D("WinInput thread started." << std::endl);
-		HINSTANCE hInst = GetModuleHandle(NULL);
-		HHOOK keyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, lowLevelKeyboardProc, hInst, 0);
-		HHOOK mouseHook = SetWindowsHookEx(WH_MOUSE_LL, lowLevelMouseProc, hInst, 0);
+		INPUT_TRACEPOINT(HOOK_THREAD_STARTED);
 
+		// create the message queue before checking whether start was called,
+		// so that its message is not lost if it is called in between
 		BOOL bRet;
 		MSG msg;
+		PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+		if (started.load())
+			startHooks();
+
 		while ((bRet = GetMessage(&msg, NULL, 0, 0)) != 0) {
-			if (bRet != -1) {
+			if (bRet == -1) continue;
+
+			// suspend and resume only set the flag at once, so the hooks follow
+			// its latest value, and a suspend that was undone before its message
+			// came up leaves them in place
+			if (msg.hwnd == NULL && msg.message == WININPUT_MSG_SUSPEND) {
+				if (suspended.load()) {
+					INPUT_TRACEPOINT(HOOKS_SUSPENDED);
+					removeHooks();
+					// the replayed events still to come are not seen by the hooks
+					replayInFlight.store(0);
+				}
+			} else if (msg.hwnd == NULL && msg.message == WININPUT_MSG_START) {
+				startHooks();
+			} else if (msg.hwnd == NULL && msg.message == WININPUT_MSG_RESUME) {
+				if (started.load() && !suspended.load() && keyboardHook == NULL) {
+					INPUT_TRACEPOINT(HOOKS_RESUMED);
+					installHooks();
+					resyncKeyState();
+				}
+			} else if (msg.hwnd == NULL && msg.message == WININPUT_MSG_RELEASE) {
+				flushKeyBuffer(msg.wParam != 0, (unsigned long)msg.lParam);
+			} else if (msg.hwnd == NULL && msg.message == WININPUT_MSG_REPLAY) {
+				replayKeyBatch();
+			} else if (msg.hwnd == NULL && msg.message == WININPUT_MSG_CALL) {
+				((input::hook_call_fn)msg.wParam)((unsigned)msg.lParam);
+			} else {
 				TranslateMessage(&msg);
 				DispatchMessage(&msg);
 			}
 		}
 
-		UnhookWindowsHookEx(keyboardHook);
-		UnhookWindowsHookEx(mouseHook);
-		keyboardHook = NULL;
-		mouseHook = NULL;
-		_D("WinInput thread stopped." << std::endl);
+		removeHooks();
+		INPUT_TRACEPOINT(HOOK_THREAD_STOPPED);
 
 		return 0;
 	}
@@ -258,7 +900,17 @@ namespace {
 		if (failure) return false;
 		if (thread != NULL) return true;
 
-		_D("Creating WinInput thread." << std::endl);
+		INPUT_TRACEPOINT(HOOK_THREAD_CREATED);
+		QueryPerformanceFrequency(&perfFreq);
+		startTime = GetTickCount();
+		std::random_device random;
+		while (replayTag == 0)
+			replayTag = (ULONG_PTR)(((unsigned long long)random() << 32) | random());
+		startEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (startEvent == NULL) {
+			failure = true;
+			return false;
+		}
 		thread = CreateThread(NULL, 0, _main, NULL, 0, &threadId);
 
 		if (thread == NULL) failure = true;
@@ -268,39 +920,65 @@ namespace {
 
 namespace input {
 
-	bool addKeyHandler(key_handler_fn fn) {
+	bool addKeyHandler(key_handler_fn fn, bool repeats) {
+		bool res = setupThread();
+		std::lock_guard<std::mutex> lock(keyHandlers.mutex);
+		std::list<KeyHandler> *next = keyHandlers.copy();
+		next->push_back({ fn, repeats });
+		keyHandlers.publish(next);
+		invalidateKeyVerdicts();
+		return res;
+	}
+
+	bool setKeyPipeline(key_pipeline_fn fn, int stages) {
+		bool res = setupThread();
+		keyPipelineStages.store(stages);
+		keyPipeline.store(fn, std::memory_order_release);
+		invalidateKeyVerdicts();
+		return res;
+	}
+
+	bool setMousePipeline(mouse_pipeline_fn fn) {
 		bool res = setupThread();
-		std::lock_guard<std::mutex> lock(keyHandlersMutex);
-		keyHandlers.push_back(fn);
+		mousePipeline.store(fn, std::memory_order_release);
 		return res;
 	}
 
 	bool addMouseHandler(mouse_handler_fn fn) {
 		bool res = setupThread();
-		std::lock_guard<std::mutex> lock(mouseHandlersMutex);
-		mouseHandlers.push_back(fn);
+		std::lock_guard<std::mutex> lock(mouseHandlers.mutex);
+		std::list<mouse_handler_fn> *next = mouseHandlers.copy();
+		next->push_back(fn);
+		mouseHandlers.publish(next);
 		return res;
 	}
 
 	bool removeKeyHandler(key_handler_fn fn) {
-		std::lock_guard<std::mutex> lock(keyHandlersMutex);
-		for (auto it = keyHandlers.begin(); it != keyHandlers.end(); ++it) {
-			if (*it == fn) {
-				keyHandlers.erase(it);
+		std::lock_guard<std::mutex> lock(keyHandlers.mutex);
+		std::list<KeyHandler> *next = keyHandlers.copy();
+		for (auto it = next->begin(); it != next->end(); ++it) {
+			if (it->fn == fn) {
+				next->erase(it);
+				keyHandlers.publish(next);
+				invalidateKeyVerdicts();
 				return true;
 			}
 		}
+		delete next;
 		return false;
 	}
 
 	bool removeMouseHandler(mouse_handler_fn fn) {
-		std::lock_guard<std::mutex> lock(mouseHandlersMutex);
-		for (auto it = mouseHandlers.begin(); it != mouseHandlers.end(); ++it) {
+		std::lock_guard<std::mutex> lock(mouseHandlers.mutex);
+		std::list<mouse_handler_fn> *next = mouseHandlers.copy();
+		for (auto it = next->begin(); it != next->end(); ++it) {
 			if (*it == fn) {
-				mouseHandlers.erase(it);
+				next->erase(it);
+				mouseHandlers.publish(next);
 				return true;
 			}
 		}
+		delete next;
 		return false;
 	}
 
@@ -308,10 +986,46 @@ namespace input {
 		bool res = setupThread();
 		int sid = ++seqCounter;
 		if (sequenceId) *sequenceId = sid;
-		KeySequence seq = { sid, 0, strict, data, fn };
+		KeySequence seq = { sid, input::DeviceTable<int>(0), strict, data, fn };
+
+		std::lock_guard<std::mutex> lock(keyEventSeqs.mutex);
+		KeySequences *next = keyEventSeqs.copy();
+		next->seqs.push_back(seq);
+		keyEventSeqs.publish(next);
+		return res;
+	}
+
+	bool addSecretSequence(const SecretKey& key, const SecretSequence& secret,
+		event_handler_fn fn, int *sequenceId) {
+		bool res = setupThread();
+		int sid = ++seqCounter;
+		if (sequenceId) *sequenceId = sid;
+
+		std::lock_guard<std::mutex> lock(keyEventSeqs.mutex);
+		KeySequences *next = keyEventSeqs.copy();
+		next->secrets.push_back({ sid, SecretMatcher(key, secret), fn });
+		keyEventSeqs.publish(next);
+		return res;
+	}
+
+	bool addKeyPattern(const char *pattern, event_handler_fn fn, int *sequenceId) {
+		KeyPatternSequence seq;
+		if (!seq.pattern.compile(pattern)) {
+			INPUT_TRACEPOINT(INVALID_KEY_PATTERN, std::strlen(pattern));
+			return false;
+		}
+
+		bool res = setupThread();
+		int sid = ++seqCounter;
+		if (sequenceId) *sequenceId = sid;
+		seq.id = sid;
+		seq.states.fill(seq.pattern.startState());
+		seq.handler = fn;
 
-		std::lock_guard<std::mutex> lock(keyEventSeqsMutex);
-		keyEventSeqs.push_back(seq);
+		std::lock_guard<std::mutex> lock(keyPatterns.mutex);
+		std::list<KeyPatternSequence> *next = keyPatterns.copy();
+		next->push_back(std::move(seq));
+		keyPatterns.publish(next);
 		return res;
 	}
 
@@ -321,33 +1035,121 @@ namespace input {
 		if (sequenceId) *sequenceId = sid;
 		MouseSequence seq = { sid, 0, tolerance, data, fn };
 
-		std::lock_guard<std::mutex> lock(mouseEventSeqsMutex);
-		mouseEventSeqs.push_back(seq);
+		std::lock_guard<std::mutex> lock(mouseEventSeqs.mutex);
+		MouseSequences *next = mouseEventSeqs.copy();
+		next->seqs.push_back(seq);
+		next->rebuild();
+		mouseEventSeqs.publish(next);
+		return res;
+	}
+
+	bool addCompositeSequence(const SequenceStep *steps, event_handler_fn fn, int *sequenceId) {
+		bool res = setupThread();
+		int sid = ++seqCounter;
+
+		std::lock_guard<std::mutex> lock(compositeSeqsMutex);
+		CompositeMatcher *current = compositeMatcher.load();
+		CompositeMatcher *next = current ? new CompositeMatcher(*current) : new CompositeMatcher();
+		if (!next->add(sid, steps, fn)) {
+			delete next;
+			return false;
+		}
+		if (sequenceId) *sequenceId = sid;
+		publishComposites(next);
 		return res;
 	}
 
 	bool removeKeySequence(int sequenceId) {
-		std::lock_guard<std::mutex> lock(keyEventSeqsMutex);
-		for (auto it = keyEventSeqs.begin(); it != keyEventSeqs.end(); ++it) {
+		std::lock_guard<std::mutex> lock(keyEventSeqs.mutex);
+		KeySequences *next = keyEventSeqs.copy();
+		for (auto it = next->seqs.begin(); it != next->seqs.end(); ++it) {
+			if (sequenceId == it->id) {
+				next->seqs.erase(it);
+				keyEventSeqs.publish(next);
+				return true;
+			}
+		}
+		delete next;
+		return false;
+	}
+
+	bool removeSecretSequence(int sequenceId) {
+		std::lock_guard<std::mutex> lock(keyEventSeqs.mutex);
+		KeySequences *next = keyEventSeqs.copy();
+		for (auto it = next->secrets.begin(); it != next->secrets.end(); ++it) {
+			if (sequenceId == it->id) {
+				next->secrets.erase(it);
+				keyEventSeqs.publish(next);
+				return true;
+			}
+		}
+		delete next;
+		return false;
+	}
+
+	bool removeKeyPattern(int sequenceId) {
+		std::lock_guard<std::mutex> lock(keyPatterns.mutex);
+		std::list<KeyPatternSequence> *next = keyPatterns.copy();
+		for (auto it = next->begin(); it != next->end(); ++it) {
 			if (sequenceId == it->id) {
-				keyEventSeqs.erase(it);
+				next->erase(it);
+				keyPatterns.publish(next);
 				return true;
 			}
 		}
+		delete next;
 		return false;
 	}
 
 	bool removeMouseSequence(int sequenceId) {
-		std::lock_guard<std::mutex> lock(mouseEventSeqsMutex);
-		for (auto it = mouseEventSeqs.begin(); it != mouseEventSeqs.end(); ++it) {
+		std::lock_guard<std::mutex> lock(mouseEventSeqs.mutex);
+		MouseSequences *next = mouseEventSeqs.copy();
+		for (auto it = next->seqs.begin(); it != next->seqs.end(); ++it) {
 			if (sequenceId == it->id) {
-				mouseEventSeqs.erase(it);
+				next->seqs.erase(it);
+				next->rebuild();
+				mouseEventSeqs.publish(next);
 				return true;
 			}
 		}
+		delete next;
 		return false;
 	}
 
+	bool removeCompositeSequence(int sequenceId) {
+		std::lock_guard<std::mutex> lock(compositeSeqsMutex);
+		CompositeMatcher *current = compositeMatcher.load();
+		if (current == nullptr) return false;
+
+		CompositeMatcher *next = new CompositeMatcher(*current);
+		if (!next->remove(sequenceId)) {
+			delete next;
+			return false;
+		}
+		publishComposites(next);
+		return true;
+	}
+
+	bool setStrokeHandler(stroke_handler_fn fn) {
+		bool res = setupThread();
+		if (fn && strokeThread == NULL) {
+			strokeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+			strokeThreadStop.store(false);
+			strokeThread = CreateThread(NULL, 0, _strokeMain, NULL, 0, NULL);
+			if (strokeThread == NULL) return false;
+		}
+		strokeHandler.store(fn);
+		return res;
+	}
+
+	void setInjectedHandler(injected_handler_fn fn) {
+		injectedHandler.store(fn);
+	}
+
+	void invalidateKeyVerdicts() {
+		verdictGeneration.fetch_add(1);
+	}
+
 	void trackModifierState(bool track) {
 		trackMods = track;
 		ctrlActive = false;
@@ -355,16 +1157,110 @@ namespace input {
 		altActive = false;
 	}
 
+	void setKeyBuffering(bool buffer) {
+		bufferKeys.store(buffer);
+	}
+
+	void releaseKeyBuffer(bool replay, int stripKeys) {
+		if (thread == NULL) return;
+		PostThreadMessage(threadId, WININPUT_MSG_RELEASE, (WPARAM)replay,
+			(LPARAM)(keyDownIndex.load() - stripKeys));
+	}
+
+	bool postHookCall(hook_call_fn fn, unsigned arg) {
+		if (thread == NULL) return false;
+		return PostThreadMessage(threadId, WININPUT_MSG_CALL, (WPARAM)fn, (LPARAM)arg) != 0;
+	}
+
+	int getKeyTimings(KeyTiming *timings, int count) {
+		if (perfFreq.QuadPart == 0) return 0;
+		if (count > INPUT_KEYTIMINGS) count = INPUT_KEYTIMINGS;
+		if ((unsigned long)count > keyTimingCount) count = (int)keyTimingCount;
+
+		for (int i = 0; i < count; i++) {
+			const TimedKey& key = keyTimings[(keyTimingCount - count + i) % INPUT_KEYTIMINGS];
+			timings[i].code = key.vkCode;
+			timings[i].down = ticksToMicroseconds(key.down);
+			timings[i].up = key.up != 0 ? ticksToMicroseconds(key.up) : 0LL;
+		}
+		return count;
+	}
+
+	bool start() {
+		if (!setupThread()) return false;
+		if (!started.exchange(true)) {
+			// fails if the thread has yet to create its queue, in which case
+			// it sees started once it does
+			PostThreadMessage(threadId, WININPUT_MSG_START, NULL, NULL);
+		}
+		return WaitForSingleObject(startEvent, WININPUT_START_TIMEOUT) == WAIT_OBJECT_0;
+	}
+
+	void suspend() {
+		if (suspended.exchange(true)) return;
+
+		suspendStart = GetTickCount();
+		++suspendCount;
+		if (thread != NULL)
+			PostThreadMessage(threadId, WININPUT_MSG_SUSPEND, NULL, NULL);
+	}
+
+	void resume() {
+		if (!suspended.exchange(false)) return;
+
+		suspendedMs += GetTickCount() - suspendStart;
+		if (thread != NULL)
+			PostThreadMessage(threadId, WININPUT_MSG_RESUME, NULL, NULL);
+	}
+
+	bool isSuspended() {
+		return suspended.load();
+	}
+
+	HookStats getHookStats() {
+		HookStats stats;
+		stats.events = eventCount.load();
+		if (perfFreq.QuadPart > 0)
+			stats.hookTime = hookTicks.load() * 1000000ULL / perfFreq.QuadPart;
+		stats.suspensions = suspendCount.load();
+		stats.repeats = repeatCount.load();
+		stats.repeatsCached = repeatsCached.load();
+		stats.suspendedTime = suspendedMs.load();
+		if (suspended.load())
+			stats.suspendedTime += GetTickCount() - suspendStart;
+
+		// extrapolate the event rate seen while hooked over the suspended time
+		unsigned long long totalTime = GetTickCount() - startTime;
+		if (thread != NULL && totalTime > stats.suspendedTime)
+			stats.wakeupsSaved = stats.events * stats.suspendedTime / (totalTime - stats.suspendedTime);
+		return stats;
+	}
+
 	void shutdown() {
 		if (thread != NULL) {
 			PostThreadMessage(threadId, WM_QUIT, NULL, NULL);
 			WaitForSingleObject(thread, INFINITE);
 			CloseHandle(thread);
+			CloseHandle(startEvent);
 			thread = NULL;
 			threadId = 0;
+			startEvent = NULL;
+			started.store(false);
+			retireComposites(0);
+			retireHookLists(0);
+		}
+
+		if (strokeThread != NULL) {
+			strokeThreadStop.store(true);
+			SetEvent(strokeEvent);
+			WaitForSingleObject(strokeThread, INFINITE);
+			CloseHandle(strokeThread);
+			CloseHandle(strokeEvent);
+			strokeThread = NULL;
+			strokeEvent = NULL;
 		}
 
 		failure = false;
-		_D("WinInput shutdown complete." << std::endl);
+		INPUT_TRACEPOINT(HOOK_SHUTDOWN);
 	}
 }
\ No newline at end of file
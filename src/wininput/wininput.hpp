@@ -1,11 +1,31 @@
 #pragma once
 
+#include <climits>
+
 // The value of KeyEvent.type that represents null.
 #define INPUT_TYPE_KEYNONE 0
 // The value of KeyEvent.type that represents a key-up input.
 #define INPUT_TYPE_KEYUP 2
 // The value of KeyEvent.type that represents a key-down input.
 #define INPUT_TYPE_KEYDOWN 3
+// The value of KeyEvent.type that represents a key-down input repeated while
+// the key is held down. It is only seen by key handlers that opt into repeats.
+#define INPUT_TYPE_KEYREPEAT 4
+
+// The number of recent key downs whose timings are kept, see getKeyTimings.
+#define INPUT_KEYTIMINGS 16
+
+// The number of input devices that can be told apart, see KeyData.device.
+#define INPUT_MAX_DEVICES 128
+
+// The value of SequenceStep.type that terminates a composite sequence.
+#define INPUT_STEP_NONE 0
+// The value of SequenceStep.type that represents a key-down input.
+#define INPUT_STEP_KEY 1
+// The value of SequenceStep.type that represents a mouse button or wheel input.
+#define INPUT_STEP_MOUSE 2
+// The maximum number of keys that can be held down as a chord in a SequenceStep.
+#define INPUT_STEP_MAXHELD 4
 
 // Definitions provided by WinInput are contained within the 'input' scope
 namespace input {
@@ -16,6 +36,10 @@ namespace input {
 		bool shift = false;
 		bool alt = false;
 		short type = INPUT_TYPE_KEYNONE;
+		unsigned long time = 0UL; // timestamp of the event, in milliseconds
+		// ID of the device, below INPUT_MAX_DEVICES, or 0 if the device is
+		// not known, as is always the case with the Windows hooks
+		unsigned device = 0;
 	};
 
 	struct MouseData {
@@ -23,6 +47,50 @@ namespace input {
 		long x = 0;
 		long y = 0;
 		unsigned long param = 0;
+		unsigned long time = 0UL; // timestamp of the event, in milliseconds
+		unsigned device = 0;      // see KeyData.device
+	};
+
+	// Describes one step of a composite sequence, which may mix keyboard and
+	// mouse inputs. For example, "hold Ctrl+Shift and click the top left corner
+	// twice within 500 ms" consists of two INPUT_STEP_MOUSE steps with code
+	// WM_LBUTTONDOWN, held { VK_CONTROL, VK_SHIFT }, a small region at (0, 0),
+	// and a maxDelay of 500 on the second step.
+	struct SequenceStep {
+		short type = INPUT_STEP_NONE;
+		// The virtual key code for key steps, or the mouse message for mouse steps.
+		unsigned long code = 0UL;
+		// Keys that must be held down when the step occurs, terminated by 0 if
+		// fewer than INPUT_STEP_MAXHELD. VK_CONTROL, VK_SHIFT, and VK_MENU match
+		// either the left or right key, and mouse buttons such as VK_LBUTTON
+		// can also be used.
+		unsigned long held[INPUT_STEP_MAXHELD] = { 0UL };
+		// The region, inclusive, that the cursor must be in for mouse steps.
+		long left = LONG_MIN;
+		long top = LONG_MIN;
+		long right = LONG_MAX;
+		long bottom = LONG_MAX;
+		// The maximum time allowed since the previous step, in milliseconds,
+		// where 0 = no limit.
+		unsigned long maxDelay = 0UL;
+	};
+
+	// The timing of a key press, in microseconds since an arbitrary point.
+	struct KeyTiming {
+		unsigned long code = 0UL;
+		long long down = 0LL;
+		long long up = 0LL; // 0 if the key has not been released yet
+	};
+
+	// Counters describing the work done by the keyboard and mouse hooks.
+	struct HookStats {
+		unsigned long long events = 0;        // number of events seen by the hooks
+		unsigned long long hookTime = 0;      // time spent inside the hooks, in microseconds
+		unsigned long long suspensions = 0;   // number of times the hooks were suspended
+		unsigned long long suspendedTime = 0; // time spent without hooks, in milliseconds
+		unsigned long long wakeupsSaved = 0;  // estimated hook calls avoided while suspended
+		unsigned long long repeats = 0;       // number of auto-repeated key downs
+		unsigned long long repeatsCached = 0; // repeats answered from the key down verdict
 	};
 
 	// Defines the type of function to be passed into addKeyHandler.
@@ -37,6 +105,29 @@ namespace input {
 	// should be halted, and false if otherwise.
 	typedef bool(*mouse_handler_fn)(MouseData& data);
 
+	struct Stroke;
+	struct SecretKey;
+	struct SecretSequence;
+
+	// Defines the type of function to be passed into setStrokeHandler.
+	// The function receives a stroke drawn with the left mouse button held down,
+	// after it has been resampled and normalized (see gesture.hpp). It is called
+	// on an internal worker thread, so that scoring the stroke does not delay
+	// the hooks.
+	typedef void(*stroke_handler_fn)(const Stroke& stroke);
+
+	// Defines the type of function to be passed into setInjectedHandler.
+	// The function receives the tag of an event injected by another process,
+	// such as with SendInput, which is the dwExtraInfo it was sent with. It is
+	// called within the hooks, so it should return quickly.
+	// The function should return true if the event should be blocked, and
+	// false if otherwise.
+	typedef bool(*injected_handler_fn)(unsigned long long tag, bool mouse);
+
+	// Defines the type of function to be passed into postHookCall.
+	// The function receives the argument it was posted with.
+	typedef void(*hook_call_fn)(unsigned arg);
+
 	// Defines the type of function to be passed into onKeyEvent and
 	// onMouseEvent.
 	// The function should return true if further processing of the input
@@ -45,8 +136,11 @@ namespace input {
 
 
 	// Register a key_handler_fn for handling keyboard events.
+	// Auto-repeated key downs are only passed to the function, as
+	// INPUT_TYPE_KEYREPEAT, if repeats is true. Otherwise, the verdict the
+	// function gave on the key down is reused for the repeats.
 	// Returns true if successful, and false if otherwise.
-	bool addKeyHandler(key_handler_fn fn);
+	bool addKeyHandler(key_handler_fn fn, bool repeats = false);
 
 	// Register a mouse_handler_fn for handling mouse events.
 	// Returns true if successful, and false if otherwise.
@@ -62,33 +156,153 @@ namespace input {
 
 	// Register an event_handler_fn that is called when the given sequence
 	// of key event(s) is observed. Set strict to true if ctrl, shift, alt
-	// should also be matched, or false if otherwise.
+	// should also be matched, or false if otherwise. Auto-repeated key downs
+	// are not seen by sequences, and the sequence has to be typed on a single
+	// device, see KeyData.device.
 	// The list of KeyData should be terminated by a 'null' KeyData with vkCode of 0.
 	// Returns true if successful, and false if otherwise.
 	// The ID of the sequence will be written to sequenceId.
 	bool addKeySequence(KeyData *data, bool strict, event_handler_fn fn, int *sequenceId);
 
+	// Register an event_handler_fn that is called when the key sequence kept
+	// as the given secret is observed (see secret.hpp), with ctrl, shift, alt
+	// matched the same as with strict set for addKeySequence. Secret sequences
+	// are checked before those added with addKeySequence.
+	// Returns true if successful, and false if otherwise.
+	// The ID of the sequence will be written to sequenceId.
+	bool addSecretSequence(const SecretKey& key, const SecretSequence& secret,
+		event_handler_fn fn, int *sequenceId);
+
+	// Register an event_handler_fn that is called when key-down events matching
+	// the given pattern are observed. See KeyPattern in keypattern.hpp for the
+	// pattern syntax. The pattern is compiled into a DFA when registered.
+	// Auto-repeated key downs are not seen by patterns, and the pattern has
+	// to be typed on a single device, the same as with addKeySequence.
+	// Returns true if successful, and false if otherwise, such as when the
+	// pattern is invalid.
+	// The ID of the sequence will be written to sequenceId.
+	bool addKeyPattern(const char *pattern, event_handler_fn fn, int *sequenceId);
+
 	// Register an event_handler_fn that is called when the given sequence
 	// of mouse event(s) is observed. Tolerance determines the allowed
 	// deviation of the x and y coordinate from the values specified in data.
 	// The list of MouseData should be terminated by a 'null' MouseData with code of 0.
+	// The first MouseData is indexed by position when the sequence is added, so
+	// it should not be modified afterwards.
 	// Returns true if successful, and false if otherwise.
 	// The ID of the sequence will be written to sequenceId.
 	bool addMouseSequence(MouseData *data, unsigned tolerance, event_handler_fn fn, int *sequenceId);
 
+	// Register an event_handler_fn that is called when the given composite
+	// sequence of key and mouse event(s) is observed. Only key-down, mouse button
+	// down, and mouse wheel events advance the sequence, and key-down events of
+	// ctrl, shift, and alt are ignored so that they can be held as chords.
+	// The list of SequenceStep should be terminated by a step of type INPUT_STEP_NONE.
+	// The steps are copied, so the list does not have to outlive this call.
+	// See CompositeMatcher in composite.hpp, which the hooks use without a
+	// lock, and parseCompositeSequence for reading the steps from text.
+	// Returns true if successful, and false if otherwise, such as when there
+	// are no steps or more than INPUT_COMPOSITE_MAX_STEPS.
+	// The ID of the sequence will be written to sequenceId.
+	bool addCompositeSequence(const SequenceStep *steps, event_handler_fn fn, int *sequenceId);
+
 	// Remove the previously registered sequence that matches the given sequenceId.
 	// Returns true if successful, and false if otherwise.
 	bool removeKeySequence(int sequenceId);
 
+	// Remove the previously registered secret sequence that matches the given sequenceId.
+	// Returns true if successful, and false if otherwise.
+	bool removeSecretSequence(int sequenceId);
+
+	// Remove the previously registered pattern that matches the given sequenceId.
+	// Returns true if successful, and false if otherwise.
+	bool removeKeyPattern(int sequenceId);
+
 	// Remove the previously registered sequence that matches the given sequenceId.
 	// Returns true if successful, and false if otherwise.
 	bool removeMouseSequence(int sequenceId);
 
+	// Remove the previously registered sequence that matches the given sequenceId.
+	// Returns true if successful, and false if otherwise.
+	bool removeCompositeSequence(int sequenceId);
+
+	// Register the stroke_handler_fn that receives strokes drawn with the left
+	// mouse button, replacing the previous one. Pass null to stop tracking strokes.
+	// Strokes are tracked whether or not the mouse events are blocked.
+	// Returns true if successful, and false if otherwise.
+	bool setStrokeHandler(stroke_handler_fn fn);
+
+	// Register the injected_handler_fn that decides whether input injected by
+	// other processes is blocked, replacing the previous one. Injected input
+	// is never seen by sequences or other handlers, and is passed if there is
+	// no handler. Keys replayed by releaseKeyBuffer are always passed, by a
+	// tag chosen at random for each run, and only while they are expected.
+	void setInjectedHandler(injected_handler_fn fn);
+
+	// Discard the verdicts reused for auto-repeated key downs. This should be
+	// called whenever a key handler may decide differently for a held key,
+	// such as after a change of mode. Until the key is pressed again, its
+	// repeats are then passed as key downs to handlers without repeats.
+	void invalidateKeyVerdicts();
+
 	// Sets whether the state of ctrl, shift, and alt should be internally tracked.
 	// This should be enabled if you are going to block those keys from reaching
 	// the OS inside your key handler function.
 	void trackModifierState(bool track);
 
+	// Sets whether key events blocked by a key handler should be buffered,
+	// instead of being dropped. The buffer holds a bounded number of events,
+	// with the oldest events being overwritten once it is full.
+	void setKeyBuffering(bool buffer);
+
+	// Empty the buffer of blocked key events. If replay is true, the keys typed
+	// in the few seconds before the unlock are injected again, in order,
+	// leaving out keys that do not type a character and those pressed along
+	// with ctrl, alt, or a Windows key (see KeyBuffer). Events belonging to
+	// the last stripKeys key downs seen by key sequences are left out as well,
+	// so that a sequence that was just matched is not replayed. Keys left held
+	// down by the replay are released. Can be called from any thread.
+	void releaseKeyBuffer(bool replay, int stripKeys);
+
+	// Call the given function on the internal thread, between input events,
+	// without waiting for it. Handlers run on that thread, so this is how other
+	// threads should change the state that handlers use without locks.
+	// Returns true if the call was queued, and false if there is no internal
+	// thread, in which case the function is not called.
+	bool postHookCall(hook_call_fn fn, unsigned arg);
+
+	// Copy the timings of the last count key downs into timings, oldest first.
+	// Key downs of ctrl, shift, alt, and auto-repeated key downs are left out,
+	// the same way they are for key sequences. The timings are only updated by
+	// the hooks, so this should be called from within a handler.
+	// Returns the number of timings copied, which is fewer than count if not
+	// enough key downs have been seen.
+	int getKeyTimings(KeyTiming *timings, int count);
+
+	// Install the keyboard and mouse hooks. Handlers, pipelines, and sequences
+	// can be registered before, which starts the internal thread, but no events
+	// are seen until this is called, so that the hooks go live with all of
+	// them in place. Waits until the hooks are installed, or would have been
+	// if not for suspend.
+	// Returns true if successful, and false if otherwise.
+	bool start();
+
+	// Temporarily remove the keyboard and mouse hooks. Registered handlers and
+	// sequences are kept, and no events are seen until resume is called.
+	// The hooks are removed by the internal thread once it gets to it, unless
+	// resume has been called by then, such as by a handler on that thread.
+	void suspend();
+
+	// Reinstall the keyboard and mouse hooks removed by suspend. The tracked
+	// state of ctrl, shift, and alt is resynced with the actual key state.
+	void resume();
+
+	// Returns true if the hooks are currently suspended.
+	bool isSuspended();
+
+	// Get the counters describing the work done by the hooks so far.
+	HookStats getHookStats();
+
 	// Remove the keyboard and mouse hooks, and stops the internal message handling thread.
 	void shutdown();
 
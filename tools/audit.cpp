@@ -0,0 +1,471 @@
+// Padlock hook path audit, for finding allocations, locks, and blocking
+// system calls on the thread that decides on input.
+//
+// Feeds a scripted run of input to the evdev backend through a fake device,
+// with the handlers of state.cpp (see src/handlers.hpp): the plug-ins, then
+// the sequences of each mode, stepped as the hook steps them, then the
+// handler of the mode, with mashing detection, and the limits of Throttled
+// mode. Changes of mode run the ModeSwitch of state.cpp, which records them
+// to a journal in a temporary file, and follows the session, with the calls
+// it makes to the hooks and the UI counted by a fake ModePlatform. The same file is built as a plug-in, which is loaded twice, once
+// called on the hook thread and once queued for the worker thread (see
+// src/wininput/plugins.hpp). The script
+// walks every mode through each of the sequences and through mashing, with
+// allowed and blocked keys, repeats, motion, clicks, and wheel input in
+// between, so that every path taken in each mode is exercised.
+//
+// Built with _WININPUT_AUDIT defined, the handlers run within an AuditScope
+// (see src/wininput/audit.hpp), and the first allocation, lock, or blocking
+// system call made by them aborts the run with a stack trace. The transitions
+// between modes seen are reported at the end, and the run fails if any of
+// those the policy allows is missing, or if a change of mode made none of
+// the calls to the platform or the journal expected of it. With --self-test, a handler allocates
+// once the script has started, to show that the audit catches it.
+// Autolock, gestures, and typing rhythm are not exercised, since they are
+// not part of the backend.
+//
+// Usage: audit [--self-test] PLUGIN
+// where PLUGIN is the path of the plug-in built from this file.
+//
+// Build from the root of the repository with:
+//   g++ -O1 -g -std=c++14 -pthread -rdynamic -D_WININPUT_AUDIT -Isrc
+//     tools/audit.cpp src/handlers.cpp src/policy.cpp src/session.cpp
+//     src/wininput/audit.cpp src/wininput/evdev.cpp src/wininput/journal.cpp
+//     src/wininput/keymap.cpp src/wininput/mashing.cpp src/wininput/plugins.cpp
+//     src/wininput/secret.cpp -ldl -o audit
+// and the plug-in with:
+//   g++ -O1 -g -std=c++14 -shared -fPIC -DAUDIT_LIBRARY -Isrc tools/audit.cpp -o audit-plugin.so
+
+#ifdef AUDIT_LIBRARY
+
+#include <atomic>
+#include "wininput/plugin.h"
+
+namespace {
+	std::atomic<int> loads(0);
+
+	int allowKey(const padlock_key_event *) {
+		return 0;
+	}
+
+	int allowMouse(const padlock_mouse_event *) {
+		return 0;
+	}
+}
+
+// the first load is called on the hook thread, and the second on the worker thread
+PADLOCK_PLUGIN_EXPORT const padlock_plugin *padlock_plugin_init(unsigned abi) {
+	static padlock_plugin descs[2];
+	int load = loads.fetch_add(1);
+	if (abi != PADLOCK_PLUGIN_ABI || load > 1) return nullptr;
+	padlock_plugin& desc = descs[load];
+	desc.abi = PADLOCK_PLUGIN_ABI;
+	desc.name = load == 0 ? "inline" : "async";
+	desc.flags = load == 0 ? 0 : PADLOCK_PLUGIN_ASYNC;
+	desc.on_key = allowKey;
+	desc.on_mouse = allowMouse;
+	return &desc;
+}
+
+#else
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include "handlers.hpp"
+#include "policy.hpp"
+#include "state.hpp"
+#include "wininput/audit.hpp"
+#include "wininput/evdev.hpp"
+#include "wininput/journal.hpp"
+#include "wininput/plugins.hpp"
+#include "wininput/sequence.hpp"
+
+// The number of modes, and of sequence types, see STATE_KEYSEQ_.
+#define AUDIT_MODES 4
+// The milliseconds between scripted events, and between those of mashing.
+#define AUDIT_EVENT_GAP 150
+#define AUDIT_MASH_GAP 5
+
+namespace {
+	using namespace state;
+
+	const char *modeNames[AUDIT_MODES] = { "Unlocked", "Restricted", "Locked", "Throttled" };
+
+	// the options of state::setup, with mashing detection on
+	Options opts;
+	input::SecretMatcher unlock;
+	const input::KeyData *seqs[AUDIT_MODES]; // apart from unlock
+
+	// the state of the sequences, only accessed by the evdev thread
+	std::atomic<InputState> mode(InputState::UNLOCKED);
+	int pos[AUDIT_MODES] = { 0 };
+	std::atomic<unsigned long long> transitions[AUDIT_MODES][AUDIT_MODES];
+	std::atomic<unsigned long long> handled(0);
+	std::atomic<bool> selfTest(false);
+
+	// the calls made on a change of mode; the hooks are never suspended,
+	// since the session is never away
+	struct PlatformCalls {
+		std::atomic<unsigned long long> trackMods{ 0 };
+		std::atomic<unsigned long long> verdicts{ 0 };
+		std::atomic<unsigned long long> buffering{ 0 };
+		std::atomic<unsigned long long> replays{ 0 };
+		std::atomic<unsigned long long> discards{ 0 };
+		std::atomic<unsigned long long> suspends{ 0 };
+		std::atomic<unsigned long long> resumes{ 0 };
+		std::atomic<unsigned long long> updates{ 0 };
+	};
+
+	// counts the calls to the hooks and the UI, and the transitions between
+	// modes, as the status shown by the UI follows them
+	class FakePlatform : public ModePlatform {
+	public:
+		PlatformCalls calls;
+
+		void trackModifierState(bool) override {
+			calls.trackMods.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void invalidateKeyVerdicts() override {
+			calls.verdicts.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void setKeyBuffering(bool) override {
+			calls.buffering.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void releaseKeyBuffer(bool replay, int) override {
+			(replay ? calls.replays : calls.discards).fetch_add(1, std::memory_order_relaxed);
+		}
+
+		bool isSuspended() override {
+			return false;
+		}
+
+		void resume() override {
+			calls.resumes.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void suspend() override {
+			calls.suspends.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void postStatusUpdate() override {
+			calls.updates.fetch_add(1, std::memory_order_relaxed);
+			InputState next = mode.load();
+			transitions[(int)shown][(int)next].fetch_add(1);
+			shown = next;
+		}
+
+	private:
+		InputState shown = InputState::UNLOCKED;
+	};
+
+	void changeMode(InputState next, bool trackMods, int stripKeys);
+
+	unsigned long long getTicks() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	ModeHandlers handlers(mode, opts, changeMode, getTicks);
+	SessionTracker session;
+	input::StateJournal journal;
+	FakePlatform platform;
+	ModeSwitch modeSwitch(mode, opts, handlers, session, journal, platform);
+
+	// as changeInputState
+	void changeMode(InputState next, bool trackMods, int stripKeys) {
+		modeSwitch.change(next, trackMods, stripKeys);
+	}
+
+	// the plug-ins, the sequences, then the handler of the mode, then the
+	// limits of Throttled mode, as the pipeline of state::setup
+	bool keyHandler(input::KeyData& data) {
+		handled.fetch_add(1, std::memory_order_relaxed);
+		if (selfTest.load()) {
+			std::vector<int> leak(16);
+			(void)leak;
+		}
+		if (input::runKeyPlugins(data)) return true;
+
+		if (data.type == INPUT_TYPE_KEYDOWN && !(data.code >= 0xA0 && data.code <= 0xA5)) {
+			for (int i = 0; i < AUDIT_MODES; i++) {
+				bool matched = i == 0 ? unlock.step(data) :
+					input::stepKeySequence(seqs[i], true, pos[i], data);
+				if (matched && handlers.sequence(STATE_KEYSEQ_UNLOCKED + i)) return true;
+			}
+		}
+		return handlers.key(data) || handlers.throttleKey(data);
+	}
+
+	bool mouseHandler(input::MouseData& data) {
+		handled.fetch_add(1, std::memory_order_relaxed);
+		return input::runMousePlugins(data) || handlers.mouse(data);
+	}
+
+	// writes the scripted input to the fake device
+	class Script {
+	public:
+		explicit Script(int fd) : fd(fd) {}
+
+		void key(unsigned short code, int value, unsigned gap = AUDIT_EVENT_GAP) {
+			event(EV_KEY, code, value, gap);
+			event(EV_SYN, SYN_REPORT, 0, 0);
+		}
+
+		void tap(unsigned short code, unsigned gap = AUDIT_EVENT_GAP) {
+			key(code, 1, gap);
+			key(code, 0, gap);
+		}
+
+		void chord(unsigned short mod, unsigned short code) {
+			key(mod, 1);
+			tap(code);
+			key(mod, 0);
+		}
+
+		void motion(int dx, int dy) {
+			event(EV_REL, REL_X, dx, AUDIT_EVENT_GAP);
+			event(EV_REL, REL_Y, dy, 0);
+			event(EV_SYN, SYN_REPORT, 0, 0);
+		}
+
+		void wheel(int value) {
+			event(EV_REL, REL_WHEEL, value, AUDIT_EVENT_GAP);
+			event(EV_SYN, SYN_REPORT, 0, 0);
+		}
+
+		// allowed and blocked keys in each mode, a held key, and the mouse
+		void traffic() {
+			tap(KEY_H);
+			tap(KEY_1);
+			tap(KEY_F5);
+			chord(KEY_LEFTCTRL, KEY_C);
+			chord(KEY_LEFTSHIFT, KEY_K);
+			key(KEY_J, 1);
+			for (int i = 0; i < 5; i++) key(KEY_J, 2, 30);
+			key(KEY_J, 0);
+			for (int i = 0; i < 6; i++) tap(KEY_E, 20);
+			motion(5, -3);
+			tap(BTN_LEFT);
+			tap(BTN_RIGHT);
+			wheel(1);
+		}
+
+		// the sequence of the given type, as set by state::setup
+		void sequence(int index) {
+			switch (index) {
+			case 0:
+				tap(KEY_A);
+				tap(KEY_S);
+				tap(KEY_D);
+				tap(KEY_F);
+				break;
+			case 1:
+				chord(KEY_LEFTALT, KEY_R);
+				break;
+			case 2:
+				chord(KEY_LEFTALT, KEY_L);
+				break;
+			default:
+				chord(KEY_LEFTALT, KEY_T);
+			}
+		}
+
+		// keys from far apart in quick succession
+		void mash() {
+			const unsigned short keys[] = { KEY_Q, KEY_P, KEY_Z, KEY_M, KEY_G, KEY_5, KEY_X, KEY_O };
+			for (unsigned short code : keys) key(code, 1, AUDIT_MASH_GAP);
+			for (unsigned short code : keys) key(code, 0, AUDIT_MASH_GAP);
+		}
+
+		// enter the given mode from any mode
+		void enter(int index) {
+			sequence(0);
+			if (index != 0) sequence(index);
+		}
+
+		unsigned long long written = 0;
+
+	private:
+		int fd;
+		// timestamps start far enough back that they never run ahead of the clock
+		long long time = 1000000;
+
+		void event(unsigned short type, unsigned short code, int value, unsigned gap) {
+			time += gap * 1000LL;
+			input_event evt;
+			std::memset(&evt, 0, sizeof(evt));
+			evt.input_event_sec = time / 1000000;
+			evt.input_event_usec = time % 1000000;
+			evt.type = type;
+			evt.code = code;
+			evt.value = value;
+			if (::write(fd, &evt, sizeof(evt)) == (ssize_t)sizeof(evt)) ++written;
+		}
+	};
+
+	// returns true if a sequence or mashing switches between the given modes
+	bool isReachable(int from, int to) {
+		if (to == (int)InputState::LOCKED) return true;
+		for (int i = 0; i < AUDIT_MODES; i++) {
+			if ((int)getSequenceTarget(STATE_KEYSEQ_UNLOCKED + i, (InputState)from) == to) return true;
+		}
+		return false;
+	}
+
+	void drainOutput(int fd) {
+		char buffer[4096];
+		while (read(fd, buffer, sizeof(buffer)) > 0) {}
+	}
+}
+
+int main(int argc, char **argv) {
+	bool runSelfTest = argc == 3 && std::strcmp(argv[1], "--self-test") == 0;
+	if (argc != 2 && !runSelfTest) {
+		fprintf(stderr, "usage: audit [--self-test] PLUGIN\n");
+		return 2;
+	}
+	const char *library = argv[argc - 1];
+	if (!input::loadPlugin(library) || !input::loadPlugin(library)) {
+		fprintf(stderr, "could not load %s twice\n", library);
+		return 2;
+	}
+#ifndef _WININPUT_AUDIT
+	fprintf(stderr, "warning: built without _WININPUT_AUDIT, nothing is audited\n");
+#endif
+
+	input::KeyData unlockSeq[] = {
+		{ 0x41, false, false, false, 3 }, // asdf
+		{ 0x53, false, false, false, 3 },
+		{ 0x44, false, false, false, 3 },
+		{ 0x46, false, false, false, 3 },
+		{ 0, false, false, false, 3 }
+	};
+	input::makeSecretKey(opts.secretKey);
+	input::makeSecret(opts.secretKey, unlockSeq, opts.unlockSecret);
+	unlock = input::SecretMatcher(opts.secretKey, opts.unlockSecret);
+	opts.limitSeq[0] = { 0x52, false, false, true, 3 }; // Alt+R
+	opts.lockSeq[0] = { 0x4C, false, false, true, 3 }; // Alt+L
+	opts.throttleSeq[0] = { 0x54, false, false, true, 3 }; // Alt+T
+	opts.throttleKeys = 4;
+	opts.throttleClicks = 2;
+	opts.mashLock = true;
+	opts.bufferKeys = true;
+	seqs[0] = nullptr;
+	seqs[1] = opts.limitSeq;
+	seqs[2] = opts.lockSeq;
+	seqs[3] = opts.throttleSeq;
+	handlers.setThrottleRates(opts.throttleKeys, opts.throttleClicks);
+
+	char journalPath[] = "/tmp/padlock-audit-XXXXXX";
+	int journalFd = mkstemp(journalPath);
+	unsigned char restored;
+	if (journalFd < 0) {
+		fprintf(stderr, "could not create a journal\n");
+		return 1;
+	}
+	close(journalFd);
+	journal.open(journalPath, restored);
+	journal.start();
+
+	int output[2];
+	int device[2];
+	if (pipe(output) != 0 || pipe(device) != 0) return 1;
+	fcntl(device[1], F_SETPIPE_SZ, 1 << 20);
+	input::evdev::setOutput(output[1]);
+	input::evdev::setKeyHandler(keyHandler, true);
+	input::evdev::setMouseHandler(mouseHandler);
+	if (!input::evdev::addFakeDevice(device[0], INPUT_DEVICE_KEYBOARD | INPUT_DEVICE_MOUSE)) {
+		fprintf(stderr, "could not add fake device\n");
+		return 1;
+	}
+	std::thread drain(drainOutput, output[0]);
+	input::evdev::start();
+
+	// every mode through every sequence, then through mashing
+	Script script(device[1]);
+	if (runSelfTest) selfTest.store(true);
+	for (int from = 0; from < AUDIT_MODES; from++) {
+		for (int seq = 0; seq < AUDIT_MODES; seq++) {
+			script.enter(from);
+			script.traffic();
+			script.sequence(seq);
+			script.traffic();
+		}
+		script.enter(from);
+		script.mash();
+		script.traffic();
+	}
+
+	input::evdev::Stats stats;
+	while ((stats = input::evdev::getStats()).events < script.written) usleep(1000);
+	input::evdev::shutdown();
+	std::vector<input::PluginInfo> plugins = input::getPlugins();
+	input::unloadPlugins();
+	journal.stop();
+	input::JournalStats journalStats = journal.getStats();
+	unlink(journalPath);
+	drain.join();
+	close(output[0]);
+	close(device[1]);
+
+	printf("%llu events, %llu handled, %llu blocked\n", stats.events, handled.load(), stats.blocked);
+	printf("transitions (from \\ to):\n%12s", "");
+	for (int to = 0; to < AUDIT_MODES; to++) printf("%12s", modeNames[to]);
+	printf("\n");
+
+	int missing = 0;
+	for (int from = 0; from < AUDIT_MODES; from++) {
+		printf("%12s", modeNames[from]);
+		for (int to = 0; to < AUDIT_MODES; to++) {
+			unsigned long long count = transitions[from][to].load();
+			if (from == to || !isReachable(from, to))
+				printf("%12s", "-");
+			else
+				printf("%12llu", count);
+			if (from != to && count == 0 && isReachable(from, to)) ++missing;
+		}
+		printf("\n");
+	}
+	const PlatformCalls& calls = platform.calls;
+	unsigned long long changes = calls.updates.load();
+	printf("%llu changes of mode: %llu verdict resets, %llu buffering changes, "
+		"%llu replays, %llu discards\n", changes, calls.verdicts.load(),
+		calls.buffering.load(), calls.replays.load(), calls.discards.load());
+	printf("journal: %llu recorded, %llu written\n", journalStats.recorded, journalStats.written);
+	if (changes == 0 || calls.trackMods.load() != changes || calls.verdicts.load() != changes
+		|| calls.replays.load() == 0 || calls.discards.load() == 0 || calls.buffering.load() == 0
+		|| journalStats.recorded == 0 || journalStats.written == 0) {
+		printf("  the changes of mode did not make the expected calls\n");
+		++missing;
+	}
+	for (auto& plugin : plugins) {
+		printf("plug-in %s: %llu calls, %llu dropped\n", plugin.name.c_str(), plugin.calls, plugin.dropped);
+		if (plugin.calls == 0) ++missing;
+	}
+
+#ifdef _WININPUT_AUDIT
+	unsigned long long reports = input::getAuditCount(INPUT_AUDIT_ALLOC)
+		+ input::getAuditCount(INPUT_AUDIT_LOCK) + input::getAuditCount(INPUT_AUDIT_SYSCALL);
+	printf("audit: %llu report(s)\n", reports);
+	if (reports != 0) return 1;
+#endif
+	if (missing != 0) {
+		printf("%d transition(s), plug-in(s), or call(s) not exercised\n", missing);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
+
+#endif
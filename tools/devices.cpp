@@ -0,0 +1,236 @@
+// Padlock device scaling test, for per-device policies with many input
+// devices feeding events at once.
+//
+// Feeds typing from 1, 8, and 64 fake devices at once, each written by its
+// own thread, to the evdev backend (see src/wininput/evdev.hpp). The policy
+// keeps its state per device in DeviceTables (see
+// src/wininput/devicetable.hpp): typing "lk" on a device locks that device,
+// and every key down on it is then blocked, while the other devices stay
+// live. The first device has null handlers, as an admin keyboard would, so it
+// is never locked even though it types "lk" as well. Some of the other
+// devices type "lk" partway through, and the rest type "l" and "k" but never
+// one after the other, so that a sequence matched across devices, as the
+// writers interleave, would lock them by mistake.
+//
+// The key downs let through on each device are checked against a model of
+// the policy run on the stream of that device alone, and the events emitted
+// against the key downs let through. The input_events handled per second are
+// reported for each number of devices.
+//
+// Usage: devices [EVENTS]
+// where EVENTS is the number of input_events fed in each run, 2000000 by default.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -pthread -Isrc/wininput tools/devices.cpp src/wininput/evdev.cpp
+//     src/wininput/keypattern.cpp -o devices
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include "devicetable.hpp"
+#include "evdev.hpp"
+#include "keypattern.hpp"
+
+// The default number of input_events fed in each run.
+#define DEVICES_EVENTS 2000000
+// The number of input_events written to a device at once.
+#define DEVICES_CHUNK 32
+
+namespace {
+	// the policy under test, run as the handlers of the evdev backend
+	input::KeyPattern lockPattern;
+	input::DeviceTable<int> patternStates;
+	input::DeviceTable<bool> locked(false);
+	input::DeviceTable<unsigned long long> passed(0);
+
+	bool policyKey(input::KeyData& data) {
+		bool& isLocked = locked[data.device];
+		if (data.type == INPUT_TYPE_KEYDOWN) {
+			if (lockPattern.step(data, patternStates[data.device])) isLocked = true;
+			if (!isLocked) ++passed[data.device];
+		}
+		return isLocked;
+	}
+
+	bool policyMouse(input::MouseData& data) {
+		return locked[data.device];
+	}
+
+	enum Role { ADMIN, LOCKING, LIVE };
+
+	// the events fed to a device, and the key downs the policy should let through
+	struct Feed {
+		Role role;
+		std::vector<input_event> events;
+		unsigned long long downs = 0;
+		unsigned long long passed = 0;
+	};
+
+	void add(Feed& feed, unsigned short type, unsigned short code, int value) {
+		input_event evt = {};
+		evt.type = type;
+		evt.code = code;
+		evt.value = value;
+		feed.events.push_back(evt);
+	}
+
+	// typing of a, s, d, l, and k; a locking device types "lk" halfway
+	// through, and the others only type "lk" if they are the admin
+	Feed makeFeed(Role role, size_t count, unsigned seed) {
+		const unsigned short keys[] = { KEY_A, KEY_S, KEY_D, KEY_L, KEY_K };
+		std::mt19937 generator(seed);
+		Feed feed;
+		feed.role = role;
+		feed.events.reserve(count + 4);
+		unsigned short last = 0;
+		bool isLocked = false;
+		while (feed.events.size() < count) {
+			unsigned short code = keys[generator() % 5];
+			bool halfway = feed.events.size() >= count / 2;
+			if (role == LOCKING && halfway && !isLocked && last == KEY_L) code = KEY_K;
+			else if (role == LIVE && last == KEY_L && code == KEY_K) code = KEY_A;
+			else if (role == ADMIN && generator() % 50 == 0) code = last == KEY_L ? KEY_K : KEY_L;
+
+			// the model of the policy, on this device alone
+			if (role != ADMIN && last == KEY_L && code == KEY_K) isLocked = true;
+			if (role == ADMIN || !isLocked) ++feed.passed;
+			++feed.downs;
+			last = code;
+
+			add(feed, EV_KEY, code, 1);
+			add(feed, EV_SYN, SYN_REPORT, 0);
+			add(feed, EV_KEY, code, 0);
+			add(feed, EV_SYN, SYN_REPORT, 0);
+		}
+		return feed;
+	}
+
+	void writeFeed(int fd, const Feed& feed) {
+		const char *bytes = (const char*)feed.events.data();
+		size_t size = feed.events.size() * sizeof(input_event);
+		for (size_t offset = 0; offset < size; ) {
+			ssize_t n = write(fd, bytes + offset, std::min(size - offset, DEVICES_CHUNK * sizeof(input_event)));
+			if (n <= 0) return;
+			offset += (size_t)n;
+		}
+	}
+
+	// count the EV_KEY events emitted, until the output is closed
+	void drainOutput(int fd, unsigned long long& keyCount) {
+		input_event buffer[256];
+		size_t partial = 0;
+		while (true) {
+			ssize_t n = read(fd, (char*)buffer + partial, sizeof(buffer) - partial);
+			if (n <= 0) return;
+			size_t size = partial + (size_t)n;
+			for (size_t i = 0; i < size / sizeof(input_event); i++)
+				if (buffer[i].type == EV_KEY) ++keyCount;
+			partial = size % sizeof(input_event);
+			memmove(buffer, (char*)buffer + size - partial, partial);
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: devices [EVENTS]\n");
+		return 2;
+	}
+	long total = argc > 1 ? atol(argv[1]) : DEVICES_EVENTS;
+	if (total <= 0) {
+		fprintf(stderr, "the number of events should be positive\n");
+		return 2;
+	}
+	lockPattern.compile("lk");
+
+	int failed = 0;
+	printf("%ld input_events per run:\n", total);
+	for (int count : { 1, 8, 64 }) {
+		std::vector<Feed> feeds;
+		unsigned long long fed = 0;
+		for (int i = 0; i < count; i++) {
+			Role role = i == 0 ? ADMIN : i % 2 == 0 ? LOCKING : LIVE;
+			feeds.push_back(makeFeed(role, total / count, 39 + i));
+			fed += feeds.back().events.size();
+		}
+
+		patternStates.fill(lockPattern.startState());
+		locked.fill(false);
+		passed.fill(0);
+		int output[2];
+		if (pipe(output) != 0) return 1;
+		fcntl(output[0], F_SETPIPE_SZ, 1 << 20);
+		input::evdev::setOutput(output[1]);
+		input::evdev::setKeyHandler(policyKey);
+		input::evdev::setMouseHandler(policyMouse);
+		std::vector<int> fds;
+		std::map<std::string, int> feedOfPath;
+		for (int i = 0; i < count; i++) {
+			int fd[2];
+			if (pipe(fd) != 0 || !input::evdev::addFakeDevice(fd[0], INPUT_DEVICE_KEYBOARD)) {
+				fprintf(stderr, "could not add fake device %d\n", i);
+				return 1;
+			}
+			feedOfPath["fd:" + std::to_string(fd[0])] = i;
+			fds.push_back(fd[1]);
+		}
+		std::vector<unsigned> ids(count, 0);
+		for (auto& device : input::evdev::getDevices())
+			ids[feedOfPath[device.path]] = device.id;
+		input::evdev::setDeviceHandlers(ids[0], nullptr, nullptr);
+
+		input::evdev::Stats base = input::evdev::getStats();
+		if (!input::evdev::start()) {
+			fprintf(stderr, "could not start the backend\n");
+			return 1;
+		}
+		unsigned long long keyCount = 0;
+		std::thread drain(drainOutput, output[0], std::ref(keyCount));
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> writers;
+		for (int i = 0; i < count; i++)
+			writers.emplace_back(writeFeed, fds[i], std::cref(feeds[i]));
+		for (auto& writer : writers) writer.join();
+		while (input::evdev::getStats().events - base.events < fed) usleep(100);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		input::evdev::shutdown();
+		drain.join();
+		close(output[0]);
+		for (int fd : fds) close(fd);
+
+		// the admin device is never seen by the policy, and is checked by
+		// the events emitted
+		int wrong = 0;
+		unsigned long long expectedKeys = 0, locking = 0;
+		for (int i = 0; i < count; i++) {
+			const Feed& feed = feeds[i];
+			expectedKeys += feed.passed * 2;
+			if (feed.role == LOCKING) ++locking;
+			unsigned long long seen = passed[ids[i]];
+			bool ok = feed.role == ADMIN ? seen == 0 && !locked[ids[i]] :
+				seen == feed.passed && locked[ids[i]] == (feed.role == LOCKING);
+			if (!ok) ++wrong;
+		}
+		bool ok = wrong == 0 && keyCount == expectedKeys;
+		printf("  %2d device(s), %llu locked: %5.2fM events/s, %d device(s) wrong, %llu of %llu key events emitted%s\n",
+			count, locking, fed / seconds / 1e6, wrong, keyCount, expectedKeys, ok ? "" : "  <- FAILED");
+		if (!ok) ++failed;
+	}
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
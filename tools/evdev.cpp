@@ -0,0 +1,240 @@
+// Padlock evdev throughput benchmark, for the rate at which the Linux backend
+// takes events from its devices, decides on them, and emits them again.
+//
+// Feeds frames of key downs and ups and mouse motion to the evdev backend
+// (see src/wininput/evdev.hpp) as fast as it takes them, through fake
+// devices, with handlers that block the keys with an odd virtual key code.
+// For 1, 4, and 16 devices at once, reports the input_events handled per
+// second of wall time, and per second of CPU time of the thread of the
+// backend, which is the rate one core sustains. The syscalls made per event
+// are reported from the statistics of the backend, and the events emitted are
+// checked against those the handlers let through.
+//
+// Usage: evdev [EVENTS]
+// where EVENTS is the number of input_events fed in each run, 4000000 by default.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -pthread -Isrc/wininput tools/evdev.cpp src/wininput/evdev.cpp -o evdev
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include "evdev.hpp"
+
+// The default number of input_events fed in each run.
+#define EVDEV_EVENTS 4000000
+// The number of input_events written to a device at once.
+#define EVDEV_CHUNK 64
+
+namespace {
+	// the keys pressed, a row of letters and digits
+	const unsigned short keys[] = {
+		KEY_Q, KEY_W, KEY_E, KEY_R, KEY_T, KEY_Y, KEY_U, KEY_I, KEY_O, KEY_P,
+		KEY_A, KEY_S, KEY_D, KEY_F, KEY_G, KEY_H, KEY_J, KEY_K, KEY_L,
+		KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7, KEY_8, KEY_9, KEY_0
+	};
+
+	bool blockOdd(input::KeyData& data) {
+		return (data.code & 1) != 0;
+	}
+
+	bool allowMouse(input::MouseData&) {
+		return false;
+	}
+
+	// the events fed to a device, and those the handlers should let through
+	struct Feed {
+		std::vector<input_event> events;
+		unsigned long long keys = 0;   // EV_KEY events expected on the output
+		unsigned long long motion = 0; // EV_REL events expected on the output
+		unsigned long long blocked = 0;
+	};
+
+	void add(Feed& feed, unsigned short type, unsigned short code, int value) {
+		input_event evt = {};
+		evt.type = type;
+		evt.code = code;
+		evt.value = value;
+		feed.events.push_back(evt);
+	}
+
+	// frames of a key down, a key up, or motion, with a zero timestamp, so
+	// that they are left out of the latency statistics
+	Feed makeFeed(size_t count, unsigned seed) {
+		std::mt19937 generator(seed);
+		Feed feed;
+		feed.events.reserve(count + 3);
+		while (feed.events.size() < count) {
+			if (generator() % 3 == 0) {
+				add(feed, EV_REL, REL_X, 1 + (int)(generator() % 5));
+				add(feed, EV_REL, REL_Y, -1 - (int)(generator() % 5));
+				feed.motion += 2;
+			} else {
+				unsigned short code = keys[generator() % (sizeof(keys) / sizeof(keys[0]))];
+				bool blocked = (input::evdev::toVirtualKey(code) & 1) != 0;
+				add(feed, EV_KEY, code, 1);
+				add(feed, EV_SYN, SYN_REPORT, 0);
+				add(feed, EV_KEY, code, 0);
+				if (blocked)
+					feed.blocked += 2;
+				else
+					feed.keys += 2;
+			}
+			add(feed, EV_SYN, SYN_REPORT, 0);
+		}
+		return feed;
+	}
+
+	void writeFeed(int fd, const Feed& feed) {
+		const char *bytes = (const char*)feed.events.data();
+		size_t size = feed.events.size() * sizeof(input_event);
+		for (size_t offset = 0; offset < size; ) {
+			ssize_t n = write(fd, bytes + offset, std::min(size - offset, EVDEV_CHUNK * sizeof(input_event)));
+			if (n <= 0) return;
+			offset += (size_t)n;
+		}
+	}
+
+	// count the EV_KEY and EV_REL events emitted, until the output is closed
+	void drainOutput(int fd, unsigned long long& keyCount, unsigned long long& motionCount) {
+		input_event buffer[256];
+		size_t partial = 0;
+		while (true) {
+			ssize_t n = read(fd, (char*)buffer + partial, sizeof(buffer) - partial);
+			if (n <= 0) return;
+			size_t size = partial + (size_t)n;
+			for (size_t i = 0; i < size / sizeof(input_event); i++) {
+				if (buffer[i].type == EV_KEY) ++keyCount;
+				else if (buffer[i].type == EV_REL) ++motionCount;
+			}
+			partial = size % sizeof(input_event);
+			memmove(buffer, (char*)buffer + size - partial, partial);
+		}
+	}
+
+	std::set<int> threadIds() {
+		std::set<int> ids;
+		DIR *dir = opendir("/proc/self/task");
+		if (dir == nullptr) return ids;
+		while (dirent *entry = readdir(dir))
+			if (entry->d_name[0] != '.') ids.insert(atoi(entry->d_name));
+		closedir(dir);
+		return ids;
+	}
+
+	// the time the thread has spent on a CPU, in seconds, or -1 if not known
+	double cpuTime(int tid) {
+		std::string path = "/proc/self/task/" + std::to_string(tid) + "/schedstat";
+		FILE *file = fopen(path.c_str(), "r");
+		if (file == nullptr) return -1.0;
+		unsigned long long ns = 0;
+		bool ok = fscanf(file, "%llu", &ns) == 1;
+		fclose(file);
+		return ok ? ns / 1e9 : -1.0;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: evdev [EVENTS]\n");
+		return 2;
+	}
+	long total = argc > 1 ? atol(argv[1]) : EVDEV_EVENTS;
+	if (total <= 0) {
+		fprintf(stderr, "the number of events should be positive\n");
+		return 2;
+	}
+
+	int failed = 0;
+	printf("%ld input_events per run:\n", total);
+	for (int devices : { 1, 4, 16 }) {
+		std::vector<Feed> feeds;
+		unsigned long long fed = 0;
+		for (int i = 0; i < devices; i++) {
+			feeds.push_back(makeFeed(total / devices, 38 + i));
+			fed += feeds.back().events.size();
+		}
+
+		int output[2];
+		if (pipe(output) != 0) return 1;
+		fcntl(output[0], F_SETPIPE_SZ, 1 << 20);
+		input::evdev::setOutput(output[1]);
+		input::evdev::setKeyHandler(blockOdd);
+		input::evdev::setMouseHandler(allowMouse);
+		std::vector<int> fds;
+		for (int i = 0; i < devices; i++) {
+			int fd[2];
+			if (pipe(fd) != 0 || !input::evdev::addFakeDevice(fd[0], INPUT_DEVICE_KEYBOARD | INPUT_DEVICE_MOUSE)) {
+				fprintf(stderr, "could not add fake device %d\n", i);
+				return 1;
+			}
+			fcntl(fd[1], F_SETPIPE_SZ, 1 << 20);
+			fds.push_back(fd[1]);
+		}
+
+		// the thread of the backend is the one started by start, and its
+		// statistics are kept from one run to the next
+		input::evdev::Stats base = input::evdev::getStats();
+		std::set<int> before = threadIds();
+		if (!input::evdev::start()) {
+			fprintf(stderr, "could not start the backend\n");
+			return 1;
+		}
+		int backend = 0;
+		for (int id : threadIds())
+			if (before.count(id) == 0) backend = id;
+		double cpuStart = cpuTime(backend);
+
+		unsigned long long keyCount = 0, motionCount = 0;
+		std::thread drain(drainOutput, output[0], std::ref(keyCount), std::ref(motionCount));
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> writers;
+		for (int i = 0; i < devices; i++)
+			writers.emplace_back(writeFeed, fds[i], std::cref(feeds[i]));
+		for (auto& writer : writers) writer.join();
+		while (input::evdev::getStats().events - base.events < fed) usleep(100);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double cpu = cpuTime(backend) - cpuStart;
+
+		input::evdev::Stats stats = input::evdev::getStats();
+		stats.reads -= base.reads;
+		stats.writes -= base.writes;
+		stats.blocked -= base.blocked;
+		input::evdev::shutdown();
+		drain.join();
+		close(output[0]);
+		for (int fd : fds) close(fd);
+
+		unsigned long long expectedKeys = 0, expectedMotion = 0, expectedBlocked = 0;
+		for (auto& feed : feeds) {
+			expectedKeys += feed.keys;
+			expectedMotion += feed.motion;
+			expectedBlocked += feed.blocked;
+		}
+		bool ok = keyCount == expectedKeys && motionCount == expectedMotion && stats.blocked == expectedBlocked;
+		printf("  %2d device(s): %5.2fM/s, %5.2fM/s per core (%.2fs CPU), %.1f events/read, %.1f events/write%s\n",
+			devices, fed / seconds / 1e6, cpu > 0 ? fed / cpu / 1e6 : 0.0, cpu,
+			(double)fed / stats.reads, stats.writes ? (double)fed / stats.writes : 0.0,
+			ok ? "" : "  <- FAILED: the events emitted differ");
+		if (!ok) ++failed;
+	}
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
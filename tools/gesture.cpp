@@ -0,0 +1,218 @@
+// Padlock gesture latency benchmark, for strokes recognized against 100
+// enrolled unlock gestures.
+//
+// Enrolls random shapes, drawn as polylines, as the templates of a
+// StrokeSampler and matchStroke (see src/wininput/gesture.hpp), then draws
+// each of them again with the shape bent, scaled, moved, and jittered, as
+// mouse movements with the button held down. When the button is released,
+// the stroke is finished on the drawing thread and handed to a worker thread
+// that scores it against the templates, as the hooks do, and the time from
+// the release to the verdict is measured. Random shapes that were not
+// enrolled are drawn as well, to see how often they would unlock.
+//
+// Fails if the 99th percentile of the latency is 1 ms or more, or if fewer
+// than 95% of the strokes of enrolled shapes are recognized.
+//
+// Usage: gesture [TEMPLATES [STROKES]]
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -pthread -Isrc/wininput tools/gesture.cpp src/wininput/gesture.cpp -o gesture
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "gesture.hpp"
+
+// The default number of templates, and of strokes drawn.
+#define GESTURE_TEMPLATES 100
+#define GESTURE_STROKES 20000
+// The tolerance of a match, in thousandths, as the default gtol in conf.ini.
+#define GESTURE_TOLERANCE 20
+// The latency, in microseconds, and the share of strokes recognized required.
+#define GESTURE_MAX_LATENCY 1000.0
+#define GESTURE_MIN_RECOGNIZED 0.95
+// The distance between mouse movements, in pixels.
+#define GESTURE_STEP 3.0
+
+namespace {
+	using input::Stroke;
+	using input::StrokeSampler;
+
+	struct Point {
+		double x;
+		double y;
+	};
+
+	typedef std::vector<Point> Shape;
+
+	std::mt19937 generator(31);
+
+	double uniform(double low, double high) {
+		return std::uniform_real_distribution<double>(low, high)(generator);
+	}
+
+	// a polyline of 3 to 6 segments in a 400 pixel box
+	Shape makeShape() {
+		Shape shape(4 + generator() % 4);
+		for (Point& p : shape)
+			p = { uniform(0, 400), uniform(0, 400) };
+		return shape;
+	}
+
+	// draw the shape as mouse movements, bent and placed as given, into the sampler
+	void draw(StrokeSampler& sampler, const Shape& shape, double bend, double scale,
+		double jitter) {
+		Shape bent = shape;
+		for (Point& p : bent)
+			p = { (p.x + uniform(-bend, bend)) * scale + 500, (p.y + uniform(-bend, bend)) * scale + 300 };
+
+		sampler.begin((long)bent[0].x, (long)bent[0].y);
+		for (size_t i = 1; i < bent.size(); i++) {
+			Point a = bent[i - 1], b = bent[i];
+			double length = std::hypot(b.x - a.x, b.y - a.y);
+			int steps = std::max(1, (int)(length / GESTURE_STEP));
+			for (int j = 1; j <= steps; j++) {
+				double t = (double)j / steps;
+				sampler.add((long)(a.x + (b.x - a.x) * t + uniform(-jitter, jitter)),
+					(long)(a.y + (b.y - a.y) * t + uniform(-jitter, jitter)));
+			}
+		}
+	}
+
+	// the worker that scores strokes, as the stroke thread of the hooks
+	class Recognizer {
+	public:
+		explicit Recognizer(const std::vector<Stroke>& templates) :
+			templates(templates), worker(&Recognizer::run, this) {}
+
+		~Recognizer() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			worker.join();
+		}
+
+		// finish the stroke, and wait for the index of the template it
+		// matches, or -1
+		int recognize(StrokeSampler& sampler) {
+			std::unique_lock<std::mutex> lock(mutex);
+			if (!sampler.finish(stroke)) return -1;
+			pending = true;
+			wake.notify_all();
+			done.wait(lock, [this] { return !pending; });
+			return verdict;
+		}
+
+	private:
+		const std::vector<Stroke>& templates;
+		Stroke stroke;
+		bool pending = false;
+		bool stopping = false;
+		int verdict = -1;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		std::thread worker;
+
+		void run() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				wake.wait(lock, [this] { return pending || stopping; });
+				if (stopping) return;
+				float distance;
+				int index = input::matchStroke(stroke, templates, &distance);
+				verdict = index >= 0 && distance * 1000.0f <= GESTURE_TOLERANCE ? index : -1;
+				pending = false;
+				done.notify_all();
+			}
+		}
+	};
+}
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		fprintf(stderr, "usage: gesture [TEMPLATES [STROKES]]\n");
+		return 2;
+	}
+	int count = argc > 1 ? atoi(argv[1]) : GESTURE_TEMPLATES;
+	int strokes = argc > 2 ? atoi(argv[2]) : GESTURE_STROKES;
+	if (count <= 0 || strokes <= 0) {
+		fprintf(stderr, "the numbers of templates and strokes should be positive\n");
+		return 2;
+	}
+
+	// enroll each shape as it is drawn once, as when recording a gesture
+	std::vector<Shape> shapes;
+	std::vector<Stroke> templates;
+	StrokeSampler sampler;
+	while ((int)templates.size() < count) {
+		Shape shape = makeShape();
+		Stroke stroke;
+		draw(sampler, shape, 0, 1, 1);
+		if (!sampler.finish(stroke)) continue;
+		shapes.push_back(shape);
+		templates.push_back(stroke);
+	}
+
+	Recognizer recognizer(templates);
+	std::vector<double> latencies;
+	latencies.reserve(strokes);
+	int recognized = 0, confused = 0, enrolled = 0, accepted = 0, others = 0;
+	for (int i = 0; i < strokes; i++) {
+		// one stroke in 4 is of a shape that was not enrolled
+		bool known = i % 4 != 0;
+		int shape = known ? (int)(generator() % count) : -1;
+		draw(sampler, known ? shapes[shape] : makeShape(), 12, uniform(0.5, 1.5), 1.5);
+
+		auto start = std::chrono::steady_clock::now();
+		int verdict = recognizer.recognize(sampler);
+		latencies.push_back(std::chrono::duration<double, std::micro>(
+			std::chrono::steady_clock::now() - start).count());
+
+		if (known) {
+			++enrolled;
+			if (verdict == shape) ++recognized;
+			else if (verdict >= 0) ++confused;
+		} else {
+			++others;
+			if (verdict >= 0) ++accepted;
+		}
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	double mean = 0;
+	for (double latency : latencies)
+		mean += latency / latencies.size();
+	double p99 = latencies[latencies.size() * 99 / 100];
+
+	printf("%d templates of %d points, %d strokes\n", count, GESTURE_POINTS, strokes);
+	printf("latency from release to verdict: mean %.1fus, p50 %.1fus, p99 %.1fus, max %.1fus\n",
+		mean, latencies[latencies.size() / 2], p99, latencies.back());
+	printf("enrolled shapes: %d of %d recognized, %d taken for another\n", recognized, enrolled, confused);
+	printf("other shapes: %d of %d accepted\n", accepted, others);
+
+	int failed = 0;
+	if (p99 >= GESTURE_MAX_LATENCY) {
+		printf("the 99th percentile of the latency is over %.0fus\n", GESTURE_MAX_LATENCY);
+		++failed;
+	}
+	if (recognized < enrolled * GESTURE_MIN_RECOGNIZED) {
+		printf("fewer than %.0f%% of the enrolled shapes were recognized\n", GESTURE_MIN_RECOGNIZED * 100);
+		++failed;
+	}
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
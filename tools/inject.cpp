@@ -0,0 +1,171 @@
+// Padlock injected input check, for the policy on input injected by other
+// processes, such as with SendInput.
+//
+// Builds InjectionPolicy tables (see src/policy.hpp) of random tags, up to
+// POLICY_INJECT_TAGS, and replays synthetic streams of injected events
+// through each mode: an on-screen keyboard and an accessibility tool with
+// tags of their own, a script without a tag, and a flood of random tags. The
+// verdicts are checked against a plain map of the same tags, and the time
+// taken by isBlocked is reported for each size of table, which should not
+// grow with the number of tags. The text of each policy is also read back
+// from toString.
+//
+// Usage: inject [POLICY]
+// where POLICY is as read by InjectionPolicy::parse, such as in conf.ini.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc tools/inject.cpp src/policy.cpp -o inject
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "policy.hpp"
+
+// The policy checked by default: an on-screen keyboard allowed in every
+// mode, and an accessibility tool in Unlocked and Restricted mode.
+#define INJECT_DEFAULT_POLICY "*:ut,0x4F534B31:urlt,0x41434331:ur"
+// The number of events of each stream, and of random policies built.
+#define INJECT_EVENTS 1000000
+#define INJECT_POLICIES 2000
+// The number of modes, see InputState.
+#define INJECT_MODES 4
+
+namespace {
+	using state::InjectionPolicy;
+	using state::InputState;
+
+	const char *modeNames[] = { "Unlocked", "Restricted", "Locked", "Throttled" };
+
+	// the policy as a plain map, to check the table against
+	struct Reference {
+		std::map<unsigned long long, unsigned> tags;
+		unsigned defaultModes = POLICY_DEFAULT_INJECT_MODES;
+
+		bool isBlocked(InputState state, unsigned long long tag) const {
+			auto it = tags.find(tag);
+			unsigned modes = it == tags.end() ? defaultModes : it->second;
+			return (modes & (1U << (int)state)) == 0;
+		}
+	};
+
+	// replay the tags through each mode, and return the number of verdicts
+	// that differ from the reference, along with the nanoseconds per event
+	int replay(const InjectionPolicy& policy, const Reference& reference,
+		const std::vector<unsigned long long>& stream, double& time, int *blocked) {
+		int mismatched = 0;
+		unsigned long long sum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int mode = 0; mode < INJECT_MODES; mode++) {
+			for (unsigned long long tag : stream) sum += policy.isBlocked((InputState)mode, tag);
+		}
+		time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+			/ (INJECT_MODES * stream.size());
+
+		for (int mode = 0; mode < INJECT_MODES; mode++) {
+			if (blocked) blocked[mode] = 0;
+			for (unsigned long long tag : stream) {
+				bool res = policy.isBlocked((InputState)mode, tag);
+				if (res != reference.isBlocked((InputState)mode, tag)) ++mismatched;
+				if (blocked && res) ++blocked[mode];
+			}
+		}
+		// keeps the timed loop from being optimized out
+		if (sum == (unsigned long long)-1) printf("\n");
+		return mismatched;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: inject [POLICY]\n");
+		return 2;
+	}
+	std::string text = argc == 2 ? argv[1] : INJECT_DEFAULT_POLICY;
+	InjectionPolicy policy;
+	if (!policy.parse(text)) {
+		fprintf(stderr, "invalid policy: %s\n", text.c_str());
+		return 2;
+	}
+	int failed = 0;
+	std::mt19937_64 random(11);
+
+	// the given policy, read back from its text, against streams from each source
+	InjectionPolicy reread;
+	if (!reread.parse(policy.toString()) || reread.toString() != policy.toString()) {
+		printf("policy not read back: %s\n", policy.toString().c_str());
+		++failed;
+	}
+	printf("policy: %s\n", policy.toString().c_str());
+
+	std::vector<std::pair<const char*, unsigned long long>> sources = {
+		{ "on-screen keyboard", 0x4F534B31 }, { "accessibility tool", 0x41434331 }, { "script", 0 } };
+	for (auto& source : sources) {
+		int blocked[INJECT_MODES];
+		for (int mode = 0; mode < INJECT_MODES; mode++) {
+			blocked[mode] = policy.isBlocked((InputState)mode, source.second);
+			if (blocked[mode] != reread.isBlocked((InputState)mode, source.second)) ++failed;
+		}
+		printf("  %-18s (tag 0x%llX):", source.first, source.second);
+		for (int mode = 0; mode < INJECT_MODES; mode++)
+			printf(" %s %s%s", modeNames[mode], blocked[mode] ? "blocked" : "allowed", mode < 3 ? "," : "\n");
+	}
+
+	// random policies of each size, with streams that mix their tags with others
+	printf("random policies:\n");
+	for (int size : { 0, 1, 8, POLICY_INJECT_TAGS / 2, POLICY_INJECT_TAGS }) {
+		int unbuilt = 0, mismatched = 0;
+		double time = 0.0;
+		for (int n = 0; n < INJECT_POLICIES; n++) {
+			InjectionPolicy table;
+			Reference reference;
+			unsigned defaultModes = (unsigned)(random() & 0xF);
+			table.setDefault(defaultModes);
+			reference.defaultModes = defaultModes;
+			std::vector<unsigned long long> listed;
+			for (int i = 0; i < size; i++) {
+				// small tags, as most tools use, as well as any others
+				unsigned long long tag = i % 2 ? random() : random() % 256;
+				unsigned modes = (unsigned)(random() & 0xF);
+				if (!table.allow(tag, modes)) {
+					++unbuilt;
+					break;
+				}
+				reference.tags[tag] = modes;
+				listed.push_back(tag);
+			}
+
+			// the streams of the first policy are long enough to time
+			size_t events = n == 0 ? INJECT_EVENTS : 1000;
+			std::vector<unsigned long long> stream;
+			for (size_t i = 0; i < events; i++) {
+				if (!listed.empty() && random() % 2) stream.push_back(listed[random() % listed.size()]);
+				else stream.push_back(random() % 4 == 0 ? 0 : random());
+			}
+			double taken;
+			mismatched += replay(table, reference, stream, taken, nullptr);
+			if (n == 0) time = taken;
+		}
+		printf("  %2d tags: %d not built, %d verdicts mismatched, %.1fns per event\n",
+			size, unbuilt, mismatched, time);
+		if (unbuilt != 0 || mismatched != 0) ++failed;
+	}
+
+	// a listed tag can be given new modes, and no more than POLICY_INJECT_TAGS are listed
+	InjectionPolicy full;
+	for (int i = 0; i < POLICY_INJECT_TAGS; i++)
+		if (!full.allow((unsigned long long)i, 0xF)) ++failed;
+	if (full.allow(POLICY_INJECT_TAGS, 0xF) || !full.allow(0, 0) || !full.isBlocked(InputState::UNLOCKED, 0)) ++failed;
+	for (const char *invalid : { "1", "x:u", "1:q", "-1:u", "*:" })
+		if (InjectionPolicy().parse(invalid)) ++failed;
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
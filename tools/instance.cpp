@@ -0,0 +1,154 @@
+// Padlock single-instance check, for the ownership of the hooks of a session
+// when Padlock is launched several times at once.
+//
+// Each round starts a number of processes, which all try to become the owner
+// of the hooks (see src/wininput/instance.hpp) at the same moment, and keep
+// whatever they got until every one of them has tried. Exactly one of them
+// should be the owner. The owner is then killed, as by a crash, and the
+// ownership should be free to take at once. Reports the rounds that did not
+// have exactly one owner, and the time taken to try.
+//
+// Usage: instance [PROCESSES [ROUNDS]]
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc/wininput tools/instance.cpp src/wininput/instance.cpp -o instance
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "instance.hpp"
+
+#define INSTANCE_DEFAULT_PROCESSES 16
+#define INSTANCE_DEFAULT_ROUNDS 50
+
+namespace {
+
+	// what each process reports once it has tried
+	struct Result {
+		pid_t pid;
+		bool owner;
+		unsigned long long time; // nanoseconds taken by acquire
+	};
+
+	unsigned long long nowNanos() {
+		return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// try to become the owner once the start pipe is closed, report it, and
+	// hold on until the hold pipe is closed
+	void launch(const std::string& name, int start, int results, int hold) {
+		char c;
+		if (read(start, &c, 1) < 0) _exit(2);
+		input::HookOwner owner;
+		unsigned long long begin = nowNanos();
+		Result result = { getpid(), owner.acquire(name), 0 };
+		result.time = nowNanos() - begin;
+		if (write(results, &result, sizeof(result)) != sizeof(result)) _exit(2);
+		if (read(hold, &c, 1) < 0) _exit(2);
+		_exit(0);
+	}
+
+	// run a round of the given number of processes, and return the number of
+	// owners among them, or -1 if the ownership could not be taken over once
+	// the owner was killed
+	int round(const std::string& name, int processes, std::vector<unsigned long long>& times) {
+		int start[2], results[2], hold[2];
+		if (pipe(start) != 0 || pipe(results) != 0 || pipe(hold) != 0) return -1;
+
+		std::vector<pid_t> pids;
+		for (int i = 0; i < processes; i++) {
+			pid_t pid = fork();
+			if (pid == 0) {
+				close(start[1]);
+				close(results[0]);
+				close(hold[1]);
+				launch(name, start[0], results[1], hold[0]);
+			}
+			if (pid > 0) pids.push_back(pid);
+		}
+		close(start[0]);
+		close(results[1]);
+		close(hold[0]);
+
+		// every process is released at once
+		close(start[1]);
+		int owners = 0;
+		pid_t ownerPid = -1;
+		Result result;
+		for (size_t i = 0; i < pids.size(); i++) {
+			if (read(results[0], &result, sizeof(result)) != sizeof(result)) break;
+			times.push_back(result.time);
+			if (result.owner) {
+				++owners;
+				ownerPid = result.pid;
+			}
+		}
+		close(results[0]);
+
+		// the ownership ends with the owner, however it exits
+		bool takenOver = true;
+		if (ownerPid > 0) {
+			kill(ownerPid, SIGKILL);
+			waitpid(ownerPid, nullptr, 0);
+			input::HookOwner owner;
+			takenOver = owner.acquire(name);
+		}
+		close(hold[1]);
+		for (pid_t pid : pids)
+			if (pid != ownerPid) waitpid(pid, nullptr, 0);
+		return takenOver ? owners : -1;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		fprintf(stderr, "usage: instance [PROCESSES [ROUNDS]]\n");
+		return 2;
+	}
+	int processes = argc > 1 ? std::atoi(argv[1]) : INSTANCE_DEFAULT_PROCESSES;
+	int rounds = argc > 2 ? std::atoi(argv[2]) : INSTANCE_DEFAULT_ROUNDS;
+	if (processes <= 0 || rounds <= 0) {
+		fprintf(stderr, "invalid processes or rounds\n");
+		return 2;
+	}
+	// in a folder of its own, so that Padlock can be running meanwhile
+	char folder[] = "/tmp/padlock-instance.XXXXXX";
+	if (mkdtemp(folder) == nullptr) {
+		perror("mkdtemp");
+		return 2;
+	}
+	setenv("XDG_RUNTIME_DIR", folder, 1);
+	std::string name = "Padlock.Hooks";
+
+	std::vector<unsigned long long> times;
+	int failed = 0, notTakenOver = 0;
+	for (int i = 0; i < rounds; i++) {
+		int owners = round(name, processes, times);
+		if (owners == -1) {
+			++notTakenOver;
+		} else if (owners != 1) {
+			if (failed++ < 10) printf("round %d: %d owners\n", i, owners);
+		}
+	}
+
+	std::remove((std::string(folder) + "/" + name + ".lock").c_str());
+	rmdir(folder);
+
+	std::sort(times.begin(), times.end());
+	printf("%d rounds of %d processes: %d without exactly one owner, %d not taken over after a crash\n",
+		rounds, processes, failed, notTakenOver);
+	if (!times.empty()) {
+		printf("acquire: p50 %lluus, p99 %lluus, max %lluus\n", times[times.size() / 2] / 1000,
+			times[std::min(times.size() - 1, times.size() * 99 / 100)] / 1000, times.back() / 1000);
+	}
+	if (failed != 0 || notTakenOver != 0) return 1;
+	printf("OK\n");
+	return 0;
+}
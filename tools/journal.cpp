@@ -0,0 +1,148 @@
+// Padlock state journal benchmark, for the cost of keeping the mode across
+// crashes and restarts.
+//
+// Records changes of mode to a StateJournal (see src/wininput/journal.hpp)
+// in a folder, first spaced out as a person would switch modes, then in a
+// burst, and reports for each:
+// - the time taken by record, which is what each change of mode adds on the
+//   thread that makes it;
+// - the time until each change is durable;
+// - the write amplification, as the bytes written to the file over those of
+//   the records of the changes, and as whole pages synced over those bytes,
+//   which is closer to what the disk sees.
+// It then checks recovery: the last state is recovered from a journal of
+// every length up to a compaction, and after many compactions, with the
+// time taken, and so is the state before it when the last record is torn.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -pthread -Isrc/wininput tools/journal.cpp
+//     src/wininput/journal.cpp -o journal
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "journal.hpp"
+
+// The number of changes of mode recorded by each run.
+#define JOURNAL_CHANGES 2000
+// The milliseconds between spaced out changes of mode.
+#define JOURNAL_SPACING 2
+// The size of the pages synced by the disk.
+#define JOURNAL_PAGE 4096
+// The number of modes, which the recorded states cycle through.
+#define JOURNAL_MODES 4
+
+namespace {
+
+	unsigned long long nowNanos() {
+		return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	unsigned long long percentile(std::vector<unsigned long long> values, double p) {
+		std::sort(values.begin(), values.end());
+		return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+	}
+
+	// record the changes, spaced by the given milliseconds, and report them
+	void run(const std::string& path, const char *name, unsigned spacing) {
+		std::remove(path.c_str());
+		input::StateJournal journal;
+		unsigned char state;
+		journal.open(path, state);
+		journal.start();
+
+		std::vector<unsigned long long> times;
+		for (int i = 0; i < JOURNAL_CHANGES; i++) {
+			unsigned long long start = nowNanos();
+			journal.record((unsigned char)(i % JOURNAL_MODES));
+			times.push_back(nowNanos() - start);
+			if (spacing) std::this_thread::sleep_for(std::chrono::milliseconds(spacing));
+		}
+		journal.stop();
+
+		input::JournalStats stats = journal.getStats();
+		double logical = (double)stats.written * sizeof(input::JournalRecord);
+		printf("%s: %llu changes, %llu written, %llu replaced in the queue, %llu syncs, %llu compactions\n",
+			name, stats.recorded, stats.written, stats.replaced, stats.syncs, stats.compactions);
+		printf("  record: p50 %lluns, p99 %lluns, max %lluns\n", percentile(times, 0.5),
+			percentile(times, 0.99), percentile(times, 1.0));
+		printf("  durable after: mean %.0fus, max %lluus\n",
+			stats.written ? (double)stats.durableTime / stats.written : 0.0, stats.maxDurableTime);
+		printf("  write amplification: %.2fx in bytes, %.0fx in pages\n",
+			logical ? stats.bytes / logical : 0.0,
+			logical ? (double)stats.syncs * JOURNAL_PAGE / logical : 0.0);
+	}
+
+	// write the given number of changes, then time recovering from them
+	bool recover(const std::string& path, int changes, bool tear, unsigned long long& time) {
+		std::remove(path.c_str());
+		unsigned char state = 0;
+		{
+			input::StateJournal journal;
+			journal.open(path, state);
+			journal.start();
+			for (int i = 0; i < changes; i++) {
+				journal.record((unsigned char)(i % JOURNAL_MODES));
+				// one at a time, so that every change gets a record
+				while (journal.getStats().written + journal.getStats().replaced < (unsigned long long)i + 1)
+					std::this_thread::yield();
+			}
+			journal.stop();
+		}
+
+		// tearing the last record leaves the change before it
+		int expected = changes - 1;
+		if (tear) {
+			FILE *file = std::fopen(path.c_str(), "r+b");
+			std::fseek(file, -4, SEEK_END);
+			std::fputc(0xFF, file);
+			std::fclose(file);
+			--expected;
+		}
+
+		input::StateJournal journal;
+		unsigned long long start = nowNanos();
+		bool recovered = journal.open(path, state);
+		time = nowNanos() - start;
+		return recovered && state == expected % JOURNAL_MODES;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: journal [FOLDER]\n");
+		return 2;
+	}
+	std::string path = std::string(argc == 2 ? argv[1] : ".") + "/padlock.journal";
+
+	run(path, "spaced", JOURNAL_SPACING);
+	run(path, "burst", 0);
+
+	int failed = 0;
+	const int lengths[] = { 1, 2, INPUT_JOURNAL_RECORDS / 2, INPUT_JOURNAL_RECORDS,
+		INPUT_JOURNAL_RECORDS + 1, 10 * INPUT_JOURNAL_RECORDS + 7 };
+	printf("recovery:\n");
+	for (int changes : lengths) {
+		for (int tear = 0; tear < 2; tear++) {
+			if (tear && changes < 2) continue;
+			unsigned long long time;
+			bool ok = recover(path, changes, tear != 0, time);
+			printf("  %6d changes%-6s: %s in %lluus\n", changes, tear ? ", torn" : "",
+				ok ? "recovered" : "FAILED", time / 1000);
+			if (!ok) ++failed;
+		}
+	}
+	std::remove(path.c_str());
+
+	if (failed != 0) {
+		printf("%d recovery check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,342 @@
+// Padlock key buffer check, for the keys replayed once Restricted mode is
+// unlocked.
+//
+// Types scripted and random streams of key events into a KeyBuffer (see
+// src/wininput/keybuffer.hpp) the way the keyboard hook buffers the keys it
+// blocks, with the unlock sequence typed last, and checks what would be
+// replayed: the text typed within the window before the unlock, in order,
+// without the unlock sequence, shortcuts such as Ctrl+W and Alt+F4, or keys
+// that do not type a character, with no key up replayed without its key down
+// and no key left held down unknowingly. Each event is numbered in its scan
+// code, so that the order can be checked after any overwrite of the ring.
+//
+// The time taken to buffer a key event, which the hook pays for every key it
+// blocks, and to release a full buffer, are reported as well.
+//
+// Usage: keybuffer [TEXT]
+// where TEXT is typed, as letters, digits, and spaces, just before the unlock
+// sequence, and the text that would be replayed is printed.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc/wininput tools/keybuffer.cpp src/wininput/keybuffer.cpp -o keybuffer
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "keybuffer.hpp"
+
+// The number of random streams, and of key events in each.
+#define KEYBUFFER_STREAMS 5000
+#define KEYBUFFER_EVENTS 600
+// The number of key events buffered to time KeyBuffer::add.
+#define KEYBUFFER_TIMED_EVENTS 50000000
+// The unlock sequence typed at the end of each stream.
+#define KEYBUFFER_UNLOCK "ASDF"
+
+// Virtual key codes used by the streams.
+#define VK_RETURN 0x0D
+#define VK_ESCAPE 0x1B
+#define VK_SPACE 0x20
+#define VK_LEFT 0x25
+#define VK_F4 0x73
+#define VK_LSHIFT 0xA0
+#define VK_LCONTROL 0xA2
+#define VK_LMENU 0xA4
+#define VK_LWIN 0x5B
+
+namespace {
+	using input::BufferedKey;
+	using input::KeyBuffer;
+
+	// types key events into a buffer the way the keyboard hook does, all of
+	// them being blocked as in Restricted mode
+	class Typist {
+	public:
+		KeyBuffer buffer;
+		std::vector<BufferedKey> typed; // every event, in order
+		unsigned long time = 100000;
+		unsigned long index = 0; // key downs seen by sequences
+
+		void press(unsigned long code, unsigned long gap = 80) {
+			time += gap;
+			// as in the hook, key downs of ctrl, shift, and alt are not counted
+			if (!(code >= VK_LSHIFT && code <= VK_LMENU + 1)) ++index;
+			held[code] = true;
+			add(code, false);
+		}
+
+		void release(unsigned long code, unsigned long gap = 40) {
+			time += gap;
+			held[code] = false;
+			add(code, true);
+		}
+
+		void tap(unsigned long code, unsigned long gap = 80) {
+			press(code, gap);
+			release(code);
+		}
+
+		// type letters, digits, and spaces, with shift for capitals
+		void type(const std::string& text) {
+			for (char c : text) {
+				bool upper = isupper((unsigned char)c) != 0;
+				if (upper) press(VK_LSHIFT);
+				tap(c == ' ' ? VK_SPACE : (unsigned long)toupper((unsigned char)c));
+				if (upper) release(VK_LSHIFT);
+			}
+		}
+
+		// a shortcut, such as Ctrl+W
+		void chord(unsigned long modifier, unsigned long code) {
+			press(modifier);
+			tap(code);
+			release(modifier);
+		}
+
+		// the stripFrom passed when the unlock sequence has just been typed
+		unsigned long unlock() {
+			type(KEYBUFFER_UNLOCK);
+			return index - (sizeof(KEYBUFFER_UNLOCK) - 1);
+		}
+
+	private:
+		bool held[256] = { false };
+
+		void add(unsigned long code, bool up) {
+			bool chord = held[VK_LCONTROL] || held[VK_LMENU] || held[VK_LWIN];
+			BufferedKey key = { code, (unsigned long)typed.size(), up, false, chord, time, index };
+			typed.push_back(key);
+			buffer.add(key);
+		}
+	};
+
+	// the text typed by the replayed events
+	std::string toText(const BufferedKey *keys, int count) {
+		std::string text;
+		bool shift = false;
+		for (int i = 0; i < count; i++) {
+			if (keys[i].code == VK_LSHIFT) {
+				shift = !keys[i].up;
+			} else if (!keys[i].up) {
+				char c = keys[i].code == VK_SPACE ? ' ' : (char)keys[i].code;
+				text += shift || !isalpha((unsigned char)c) ? c : (char)tolower((unsigned char)c);
+			}
+		}
+		return text;
+	}
+
+	int failed = 0;
+
+	void expect(Typist& typist, unsigned long stripFrom, const std::string& expected, const char *what) {
+		BufferedKey out[INPUT_KEYBUFFER_SIZE];
+		bool held[256];
+		int count = typist.buffer.release(stripFrom, typist.time, out, held);
+		std::string text = toText(out, count);
+		bool ok = text == expected && typist.buffer.size() == 0;
+		printf("  %-44s \"%s\"%s\n", what, text.c_str(), ok ? "" : "  <- FAILED");
+		if (!ok) ++failed;
+	}
+
+	void runScript() {
+		printf("scripted:\n");
+		{
+			Typist typist;
+			typist.type("Hello world");
+			expect(typist, typist.unlock(), "Hello world", "text, then the unlock sequence");
+		}
+		{
+			Typist typist;
+			typist.type("draft ");
+			typist.chord(VK_LCONTROL, 'W');
+			typist.chord(VK_LMENU, VK_F4);
+			typist.chord(VK_LWIN, 'L');
+			typist.tap(VK_RETURN);
+			typist.tap(VK_ESCAPE);
+			typist.tap(VK_LEFT);
+			typist.type("kept");
+			expect(typist, typist.unlock(), "draft kept", "shortcuts and keys that type nothing");
+		}
+		{
+			Typist typist;
+			typist.type("old ");
+			typist.time += INPUT_KEYBUFFER_WINDOW;
+			typist.type("new");
+			expect(typist, typist.unlock(), "new", "text typed before the window");
+		}
+		{
+			// only the digits still in the ring after the 22 events of the rest
+			Typist typist;
+			std::string digits;
+			for (int i = 0; i < INPUT_KEYBUFFER_SIZE; i++) {
+				typist.press('0' + i % 10, 1);
+				typist.release('0' + i % 10, 1);
+				if (i >= 11 + INPUT_KEYBUFFER_SIZE / 2) digits += (char)('0' + i % 10);
+			}
+			typist.type("end");
+			expect(typist, typist.unlock(), digits + "end", "overflowed, oldest events first");
+		}
+		{
+			Typist typist;
+			typist.type("discarded");
+			typist.unlock();
+			typist.buffer.clear();
+			expect(typist, typist.index, "", "discarded");
+		}
+	}
+
+	// check what would be replayed from a random stream against the events
+	// typed, returning the number of problems found
+	int checkRelease(const Typist& typist, unsigned long stripFrom, const BufferedKey *out,
+		int count, const bool *held, int& replayed) {
+		int problems = 0;
+		bool down[256] = { false };
+		size_t first = typist.typed.size() > INPUT_KEYBUFFER_SIZE ?
+			typist.typed.size() - INPUT_KEYBUFFER_SIZE : 0;
+
+		// the window ends at the first key down of the unlock sequence
+		unsigned long end = typist.time;
+		for (size_t i = first; i < typist.typed.size(); i++) {
+			if (!typist.typed[i].up && typist.typed[i].index > stripFrom) {
+				end = typist.typed[i].time;
+				break;
+			}
+		}
+
+		// every event replayed was typed, in order, since the buffer was last full
+		int next = 0;
+		for (size_t i = first; i < typist.typed.size(); i++) {
+			const BufferedKey& key = typist.typed[i];
+			bool recent = end - key.time <= INPUT_KEYBUFFER_WINDOW;
+			bool eligible = key.up ? down[key.code] : (!key.chord && key.index <= stripFrom
+				&& recent && input::isTypingKey(key.code));
+
+			bool taken = next < count && out[next].scan == key.scan;
+			if (taken != eligible) ++problems;
+			if (taken) ++next;
+			if (eligible) down[key.code] = !key.up;
+		}
+		if (next != count) ++problems;
+
+		for (int vk = 0; vk < 256; vk++)
+			if (held[vk] != down[vk]) ++problems;
+		replayed += count;
+		return problems;
+	}
+
+	void runRandom() {
+		std::mt19937 random(27);
+		const unsigned long letters[] = { 'A', 'E', 'K', 'Q', 'Z', '3', VK_SPACE };
+		const unsigned long others[] = { VK_RETURN, VK_ESCAPE, VK_LEFT, VK_F4 };
+		const unsigned long modifiers[] = { VK_LCONTROL, VK_LMENU, VK_LWIN, VK_LSHIFT };
+		int problems = 0, replayed = 0, typed = 0;
+
+		for (int n = 0; n < KEYBUFFER_STREAMS; n++) {
+			Typist typist;
+			unsigned long held = 0; // a modifier held down, if any
+			while (typist.typed.size() < KEYBUFFER_EVENTS) {
+				unsigned long gap = random() % 8 == 0 ? random() % 5000 : random() % 200;
+				switch (random() % 10) {
+				case 0:
+					typist.tap(others[random() % 4], gap);
+					break;
+				case 1:
+					if (held) {
+						typist.release(held, gap);
+						held = 0;
+					} else {
+						held = modifiers[random() % 4];
+						typist.press(held, gap);
+					}
+					break;
+				case 2:
+					// a key held down through the unlock sequence, or released in it
+					typist.press(letters[random() % 7], gap);
+					break;
+				default:
+					typist.tap(letters[random() % 7], gap);
+				}
+			}
+			if (held) typist.release(held);
+			unsigned long stripFrom = typist.unlock();
+
+			BufferedKey out[INPUT_KEYBUFFER_SIZE];
+			bool down[256];
+			int count = typist.buffer.release(stripFrom, typist.time, out, down);
+			problems += checkRelease(typist, stripFrom, out, count, down, replayed);
+			typed += (int)typist.typed.size();
+		}
+		printf("random: %d streams, %d key events, %d replayed, %d problem(s)\n",
+			KEYBUFFER_STREAMS, typed, replayed, problems);
+		if (problems != 0) ++failed;
+	}
+
+	void runTimed() {
+		KeyBuffer buffer;
+		BufferedKey key = { 'A', 0, false, false, false, 0, 0 };
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned long i = 0; i < KEYBUFFER_TIMED_EVENTS; i++) {
+			key.scan = i;
+			key.up = (i & 1) != 0;
+			buffer.add(key);
+		}
+		double addTime = std::chrono::duration<double, std::nano>(
+			std::chrono::steady_clock::now() - start).count() / KEYBUFFER_TIMED_EVENTS;
+
+		BufferedKey out[INPUT_KEYBUFFER_SIZE];
+		bool held[256];
+		int releases = 10000, count = 0;
+		start = std::chrono::steady_clock::now();
+		for (int n = 0; n < releases; n++) {
+			for (int i = 0; i < INPUT_KEYBUFFER_SIZE; i++) {
+				key.up = (i & 1) != 0;
+				buffer.add(key);
+			}
+			count += buffer.release(~0UL, 0, out, held);
+		}
+		double releaseTime = std::chrono::duration<double, std::micro>(
+			std::chrono::steady_clock::now() - start).count() / releases;
+
+		printf("timed: %.2fns per key event buffered, %.2fus per release of %d events\n",
+			addTime, releaseTime, INPUT_KEYBUFFER_SIZE);
+		if (count != releases * INPUT_KEYBUFFER_SIZE) ++failed;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: keybuffer [TEXT]\n");
+		return 2;
+	}
+
+	if (argc == 2) {
+		std::string text = argv[1];
+		for (char c : text) {
+			if (!isalnum((unsigned char)c) && c != ' ') {
+				fprintf(stderr, "only letters, digits, and spaces can be typed: %s\n", argv[1]);
+				return 2;
+			}
+		}
+		Typist typist;
+		typist.type(text);
+		unsigned long stripFrom = typist.unlock();
+		BufferedKey out[INPUT_KEYBUFFER_SIZE];
+		bool held[256];
+		int count = typist.buffer.release(stripFrom, typist.time, out, held);
+		printf("replayed: \"%s\", %d of %d key events\n", toText(out, count).c_str(),
+			count, (int)typist.typed.size());
+	}
+
+	runScript();
+	runRandom();
+	runTimed();
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
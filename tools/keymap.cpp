@@ -0,0 +1,183 @@
+// Padlock key naming test, for naming keys by the keyboard layout in use.
+//
+// Names keys with keyToString (see src/wininput/keymap.hpp) on layouts made
+// of FixedKeyLayout tables, standing in for the layouts of the system, and
+// checks that:
+// - the default layout names every key and modifier as the US tables do
+// - digit and punctuation keys are named by the text they type on another
+//   layout, and keep their US names where it types nothing
+// - the names of a layout are built once, from a call to translate for each
+//   typed key with and without shift, and then only read
+// - notifyLayoutChange switches to the names of its layout, built again
+//   from the layout when next used
+// The time taken to name a key is reported, once the names are built.
+//
+// Usage: keymap
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc/wininput tools/keymap.cpp src/wininput/keymap.cpp -o keymap
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include "keymap.hpp"
+
+// The number of keys named for the timing.
+#define KEYMAP_NAMES 2000000
+// The number of typed keys, see typedKeys in keymap.cpp, each translated
+// with and without shift when the names of a layout are built.
+#define KEYMAP_TYPED_KEYS 23
+// The IDs of the German and French layouts.
+#define KEYMAP_LAYOUT_DE 0x04070407ULL
+#define KEYMAP_LAYOUT_FR 0x040C040CULL
+
+namespace {
+	int failed = 0;
+
+	void check(bool ok, const char *what) {
+		printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+		if (!ok) ++failed;
+	}
+
+	input::KeyData key(unsigned long code, bool ctrl = false, bool shift = false, bool alt = false) {
+		input::KeyData data;
+		data.code = code;
+		data.ctrl = ctrl;
+		data.shift = shift;
+		data.alt = alt;
+		data.type = INPUT_TYPE_KEYDOWN;
+		return data;
+	}
+
+	struct Case {
+		input::KeyData key;
+		const char *name;
+	};
+
+	// returns the number of cases named otherwise, printing the first few
+	int countWrong(const Case *cases, size_t count) {
+		int wrong = 0;
+		for (size_t i = 0; i < count; i++) {
+			std::string name = input::keyToString(cases[i].key);
+			if (name == cases[i].name) continue;
+			if (++wrong <= 3)
+				printf("    0x%02lX is named %s, not %s\n", cases[i].key.code, name.c_str(), cases[i].name);
+		}
+		return wrong;
+	}
+
+	// the layouts of a system, counting the calls made to them
+	class Layouts : public input::KeyLayout {
+	public:
+		unsigned long long layout = INPUT_LAYOUT_US;
+		unsigned long calls = 0;
+		std::map<unsigned long long, input::FixedKeyLayout> tables;
+
+		unsigned long long current() override {
+			return layout;
+		}
+
+		bool translate(unsigned long long id, unsigned code, bool shift, std::string& text) override {
+			++calls;
+			auto it = tables.find(id);
+			return it != tables.end() && it->second.translate(id, code, shift, text);
+		}
+	};
+
+	// the keys that differ from the US layout on a German one, with ü and ö
+	// as in the Windows-1252 code page of the edit controls
+	void makeGerman(input::FixedKeyLayout& layout) {
+		layout.set(0x32, "2", "\"");
+		layout.set(0x33, "3", "\xA7");
+		layout.set(0x36, "6", "&");
+		layout.set(0x37, "7", "/");
+		layout.set(0x38, "8", "(");
+		layout.set(0x39, "9", ")");
+		layout.set(0x30, "0", "=");
+		layout.set(0xBA, "\xFC", "\xDC");
+		layout.set(0xBB, "+", "*");
+		layout.set(0xBF, "#", "'");
+		layout.set(0xC0, "\xF6", "\xD6");
+		layout.set(0xDC, "^", nullptr);
+		layout.set(0xDE, nullptr, nullptr);
+		layout.set(0xE2, "<", ">");
+	}
+}
+
+int main(int argc, char **) {
+	if (argc != 1) {
+		fprintf(stderr, "usage: keymap\n");
+		return 2;
+	}
+	input::setupCodemap();
+
+	printf("the default layout:\n");
+	const Case us[] = {
+		{ key(0x41), "a" }, { key(0x41, false, true), "A" }, { key(0x41, true), "[Ctrl+A]" },
+		{ key(0x41, true, true, true), "[Ctrl+Shift+Alt+A]" },
+		{ key(0x31), "1" }, { key(0x31, false, true), "!" }, { key(0x31, true), "[Ctrl+1]" },
+		{ key(0x30, false, false, true), "[Alt+0]" }, { key(0x30, true, true), "[Ctrl+Shift+0]" },
+		{ key(0xBA), ";" }, { key(0xBA, false, true), ":" }, { key(0xBA, true), "[Ctrl+;]" },
+		{ key(0xDB), "[LB]" }, { key(0xDB, false, true), "{" }, { key(0xDD, false, false, true), "[Alt+RB]" },
+		{ key(0xDE, false, true), "\"" }, { key(0xE2), "[OEM102]" }, { key(0xDF), "[OEM8]" },
+		{ key(0x70), "[F1]" }, { key(0x0D, false, true), "[Shift+Enter]" }, { key(0x60), "[00]" },
+		{ key(0x6B), "+" }, { key(0xA4), "[Alt]" }, { key(0xFF), "[Unk]" }, { key(0x12345), "[Unk]" },
+	};
+	check(countWrong(us, sizeof(us) / sizeof(us[0])) == 0, "keys are named as on the US tables");
+
+	printf("a German layout:\n");
+	Layouts layouts;
+	layouts.tables.emplace(INPUT_LAYOUT_US, input::FixedKeyLayout());
+	for (unsigned long long id : { KEYMAP_LAYOUT_DE, KEYMAP_LAYOUT_FR, 1ULL, 2ULL, 3ULL }) {
+		input::FixedKeyLayout layout(id);
+		makeGerman(layout);
+		layouts.tables.emplace(id, layout);
+	}
+	layouts.layout = KEYMAP_LAYOUT_DE;
+	input::setKeyLayout(&layouts);
+	const Case de[] = {
+		{ key(0xBA), "\xFC" }, { key(0xBA, false, true), "\xDC" }, { key(0xBA, true), "[Ctrl+\xFC]" },
+		{ key(0xC0, false, true), "\xD6" }, { key(0x32, false, true), "\"" }, { key(0x30, false, true), "=" },
+		{ key(0x32, true, true), "[Ctrl+Shift+2]" }, { key(0xBF), "#" }, { key(0xE2, false, true), ">" },
+		{ key(0xDC), "^" }, { key(0xDC, false, true), "[Shift+^]" }, { key(0xDE), "'" },
+		{ key(0xDE, false, true), "[Shift+']" }, { key(0x5A), "z" }, { key(0x70, true), "[Ctrl+F1]" },
+	};
+	check(countWrong(de, sizeof(de) / sizeof(de[0])) == 0, "typed keys are named by their text");
+	check(layouts.calls == 2 * KEYMAP_TYPED_KEYS, "the names are built with one call per key and shift");
+
+	// the names are only read once built
+	auto start = std::chrono::steady_clock::now();
+	size_t length = 0;
+	for (int i = 0; i < KEYMAP_NAMES; i++)
+		length += input::keyToString(de[i % (sizeof(de) / sizeof(de[0]))].key).size();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("  %.1f ns per key named (%zu characters)\n", seconds * 1e9 / KEYMAP_NAMES, length);
+	check(layouts.calls == 2 * KEYMAP_TYPED_KEYS, "naming keys does not call the layout");
+
+	printf("switching layouts:\n");
+	unsigned long calls = layouts.calls;
+	for (unsigned long long id : { KEYMAP_LAYOUT_FR, 1ULL, 2ULL, 3ULL }) {
+		input::notifyLayoutChange(id);
+		for (const Case& c : de) input::keyToString(c.key);
+	}
+	check(layouts.calls - calls == 4 * 2 * KEYMAP_TYPED_KEYS, "the names of each layout are built once");
+	calls = layouts.calls;
+	layouts.tables.find(KEYMAP_LAYOUT_DE)->second.set(0xBA, "~", nullptr);
+	input::notifyLayoutChange(KEYMAP_LAYOUT_DE);
+	check(input::keyToString(key(0xBA)) == "~" && layouts.calls - calls == 2 * KEYMAP_TYPED_KEYS,
+		"a change to the same layout builds its names again");
+	input::notifyLayoutChange(0x12345678ULL);
+	check(input::keyToString(key(0xBA, false, true)) == "[Shift+;]" && input::keyToString(key(0x31)) == "1",
+		"a layout that types nothing keeps the US names");
+
+	input::setKeyLayout(nullptr);
+	check(countWrong(us, sizeof(us) / sizeof(us[0])) == 0, "the default layout is used again");
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
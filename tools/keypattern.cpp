@@ -0,0 +1,147 @@
+// Padlock key pattern benchmark, for patterns that compile into hundreds of
+// DFA states.
+//
+// Compiles a set of key patterns (see src/wininput/keypattern.hpp), from a
+// few states to a few thousand, and reports the number of states and symbol
+// classes of each, and the time taken to compile it. Each pattern is then
+// stepped through a random stream of key downs, the way the keyboard hook
+// steps the patterns set in conf.ini, and the time per key down is reported.
+// The matches are checked against a direct search of the stream, which looks
+// for the fixed-length pattern ending at each key down, after the last match.
+//
+// Usage: keypattern [PATTERN]
+// where PATTERN is compiled and timed along with the others, without a check
+// of its matches.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc/wininput tools/keypattern.cpp src/wininput/keypattern.cpp -o keypattern
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "keypattern.hpp"
+
+// The number of times each pattern is compiled, and of key downs it steps through.
+#define KEYPATTERN_COMPILES 20
+#define KEYPATTERN_EVENTS 20000000
+
+namespace {
+	using input::KeyData;
+	using input::KeyPattern;
+
+	// A pattern, and the keys at each of its positions for the direct search,
+	// or none if it is not checked.
+	struct Case {
+		std::string pattern;
+		std::vector<std::string> positions;
+	};
+
+	// a[ab]{n}, whose DFA has to remember the last n + 1 keys, so 2^(n+1) states
+	Case lastKeys(int n) {
+		Case c = { "a(a|b){" + std::to_string(n) + "}", { "A" } };
+		c.positions.resize(n + 1, "AB");
+		return c;
+	}
+
+	// the stream of key downs: mostly A and B, with C and digits breaking
+	// the longer patterns, and ctrl held down now and then
+	std::vector<KeyData> makeStream() {
+		std::mt19937 random(29);
+		const char keys[] = "AAABBBC0123";
+		std::vector<KeyData> stream(KEYPATTERN_EVENTS);
+		for (KeyData& data : stream) {
+			data.code = (unsigned long)keys[random() % (sizeof(keys) - 1)];
+			data.ctrl = random() % 64 == 0;
+		}
+		return stream;
+	}
+
+	// count the matches of a case found by a direct search of the stream
+	long search(const Case& c, const std::vector<KeyData>& stream) {
+		size_t length = c.positions.size();
+		long matches = 0;
+		size_t next = 0; // the first key down after the last match
+		for (size_t end = length - 1; end < stream.size(); end++) {
+			size_t start = end + 1 - length;
+			if (start < next) continue;
+			bool found = true;
+			for (size_t i = 0; i < length && found; i++) {
+				const KeyData& data = stream[start + i];
+				found = !data.ctrl && c.positions[i].find((char)data.code) != std::string::npos;
+			}
+			if (found) {
+				++matches;
+				next = end + 1;
+			}
+		}
+		return matches;
+	}
+
+	int failed = 0;
+
+	void run(const Case& c, const std::vector<KeyData>& stream) {
+		KeyPattern pattern;
+		std::string error;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < KEYPATTERN_COMPILES; i++) {
+			if (!pattern.compile(c.pattern.c_str(), &error)) {
+				printf("  %-24s %s  <- FAILED\n", c.pattern.c_str(), error.c_str());
+				++failed;
+				return;
+			}
+		}
+		double compileTime = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count() / KEYPATTERN_COMPILES;
+
+		long matches = 0;
+		int state = pattern.startState();
+		start = std::chrono::steady_clock::now();
+		for (const KeyData& data : stream) {
+			if (pattern.step(data, state)) ++matches;
+		}
+		double stepTime = std::chrono::duration<double, std::nano>(
+			std::chrono::steady_clock::now() - start).count() / stream.size();
+
+		bool ok = true;
+		if (!c.positions.empty()) ok = search(c, stream) == matches;
+		printf("  %-24s %5d states %4d classes %9.3fms compile %6.2fns/key %8ld matches%s\n",
+			c.pattern.c_str(), pattern.stateCount(), pattern.classCount(), compileTime,
+			stepTime, matches, ok ? "" : "  <- FAILED");
+		if (!ok) ++failed;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: keypattern [PATTERN]\n");
+		return 2;
+	}
+
+	std::vector<Case> cases = {
+		{ "\\d{4}<Enter>", {} },
+		{ "+?a+?s+?d+?f", {} },
+		{ "abc", { "A", "B", "C" } },
+		{ "(a|b)c\\d", { "AB", "C", "0123456789" } },
+		{ "(a|b|c)*a(b|0)*c", {} },
+		lastKeys(5),
+		lastKeys(7),
+		lastKeys(8),
+		lastKeys(9),
+		lastKeys(10),
+	};
+	if (argc == 2) cases.push_back({ argv[1], {} });
+
+	std::vector<KeyData> stream = makeStream();
+	printf("%d key downs:\n", KEYPATTERN_EVENTS);
+	for (const Case& c : cases)
+		run(c, stream);
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,675 @@
+// Padlock input load generator, for stress testing the input path on Linux.
+//
+// Generates a mix of key downs and ups, repeats, motion, clicks, and wheel
+// events at a target rate, along with adversarial input such as near misses
+// of the unlock sequence and storms of modifier keys.
+//
+// With --target pipe, the events are fed to the evdev backend through fake
+// devices, with a lock policy as the handlers: each device starts locked, is
+// unlocked by typing the unlock sequence on it, and is locked again by Alt+L.
+// The events emitted by the backend are then checked against a reference
+// model of that policy, and the latency of each report is taken from the
+// backend's statistics.
+// With --target uinput, the events are written to a virtual device, to be
+// picked up by a separate process running the backend. Only the achieved
+// rate is reported then.
+// With --trace, the events seen by the backend are also recorded as a trace,
+// such as to try tools/simulate.cpp on.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -pthread -Isrc/wininput tools/loadgen.cpp
+//     src/wininput/evdev.cpp src/wininput/keypattern.cpp -o loadgen
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include "devicetable.hpp"
+#include "evdev.hpp"
+#include "keypattern.hpp"
+
+// The name of the virtual device created with --target uinput.
+#define LOADGEN_DEVICE_NAME "Padlock load generator"
+// The kinds of events mixed by the generator, see Mix.
+#define LOADGEN_ACTIONS 9
+
+namespace {
+
+	const char *actionNames[LOADGEN_ACTIONS] = {
+		"keys", "repeats", "motion", "clicks", "wheel", "nearmiss", "modstorm", "unlock", "lock"
+	};
+
+	enum Action { KEYS, REPEATS, MOTION, CLICKS, WHEEL, NEARMISS, MODSTORM, UNLOCK, LOCK };
+
+	struct Config {
+		std::string target = "pipe";
+		unsigned rate = 20000;   // events per second per device, where 0 = no limit
+		double seconds = 5.0;
+		int devices = 1;
+		std::string unlock = "asdf";
+		unsigned seed = 1;
+		std::string trace;       // file the backend records a trace to, with --target pipe
+		unsigned mix[LOADGEN_ACTIONS] = { 50, 10, 15, 5, 5, 5, 4, 3, 3 };
+	};
+
+	const unsigned short typingKeys[] = {
+		KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7, KEY_8, KEY_9, KEY_0,
+		KEY_Q, KEY_W, KEY_E, KEY_R, KEY_T, KEY_Y, KEY_U, KEY_I, KEY_O, KEY_P,
+		KEY_A, KEY_S, KEY_D, KEY_F, KEY_G, KEY_H, KEY_J, KEY_K, KEY_L,
+		KEY_Z, KEY_X, KEY_C, KEY_V, KEY_B, KEY_N, KEY_M, KEY_SPACE, KEY_ENTER
+	};
+
+	const unsigned short modifierKeys[] = {
+		KEY_LEFTCTRL, KEY_RIGHTCTRL, KEY_LEFTSHIFT, KEY_RIGHTSHIFT, KEY_LEFTALT, KEY_RIGHTALT
+	};
+
+	const unsigned short buttons[] = { BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, BTN_SIDE, BTN_EXTRA };
+
+	inline long long monotonicMicroseconds() {
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+	}
+
+	inline bool isModifier(unsigned short code) {
+		for (unsigned short mod : modifierKeys)
+			if (code == mod) return true;
+		return false;
+	}
+
+	inline unsigned short letterKey(char c) {
+		static const unsigned short letters[26] = {
+			KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J, KEY_K, KEY_L, KEY_M,
+			KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R, KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z
+		};
+		return letters[c - 'a'];
+	}
+
+	// the emitted events, counted by type, code, and value
+	typedef std::map<unsigned long long, unsigned long long> EventCounts;
+
+	inline unsigned long long eventKey(unsigned short type, unsigned short code, int value) {
+		return ((unsigned long long)type << 48) | ((unsigned long long)code << 32) | (unsigned)value;
+	}
+
+	// The policy under test, run as the handlers of the evdev backend.
+	input::KeyPattern unlockPattern;
+	input::DeviceTable<int> patternStates;
+	input::DeviceTable<bool> locked(true);
+
+	bool policyKey(input::KeyData& data) {
+		bool modifier = data.code >= 0xA0 && data.code <= 0xA5;
+		bool& isLocked = locked[data.device];
+
+		if (data.type == INPUT_TYPE_KEYDOWN && !modifier) {
+			if (unlockPattern.step(data, patternStates[data.device]) && isLocked) {
+				isLocked = false;
+				return true;
+			}
+			if (data.code == 'L' && data.alt && !data.ctrl && !data.shift && !isLocked) {
+				isLocked = true;
+				return true;
+			}
+		}
+		return isLocked;
+	}
+
+	bool policyMouse(input::MouseData& data) {
+		return locked[data.device];
+	}
+
+	// A reference model of the policy and of the rules of the backend, kept
+	// deliberately simple: the unlock sequence is found by comparing the last
+	// key downs, instead of with a DFA.
+	class ReferenceModel {
+	public:
+		explicit ReferenceModel(const std::string& unlock) : unlock(unlock) {}
+
+		void process(const input_event& evt) {
+			switch (evt.type) {
+			case EV_KEY:
+				processKey(evt);
+				break;
+			case EV_REL:
+				if (evt.code == REL_X) {
+					dx += evt.value;
+				} else if (evt.code == REL_Y) {
+					dy += evt.value;
+				} else if (isLocked) {
+					++blocked;
+				} else {
+					emit(EV_REL, evt.code, evt.value);
+				}
+				break;
+			case EV_SYN:
+				if (dx != 0 || dy != 0) {
+					if (isLocked) {
+						++blocked;
+					} else {
+						if (dx) emit(EV_REL, REL_X, dx);
+						if (dy) emit(EV_REL, REL_Y, dy);
+					}
+				}
+				dx = 0;
+				dy = 0;
+				break;
+			}
+		}
+
+		EventCounts emitted;
+		unsigned long long blocked = 0;
+		bool isLocked = true;
+
+	private:
+		struct TypedKey {
+			unsigned long vk;
+			bool ctrl, shift, alt;
+		};
+
+		void emit(unsigned short type, unsigned short code, int value) {
+			++emitted[eventKey(type, code, value)];
+		}
+
+		void processKey(const input_event& evt) {
+			bool wasDown = down[evt.code];
+			bool button = evt.code >= BTN_MOUSE && evt.code <= BTN_EXTRA;
+			bool stop = isLocked;
+
+			if (evt.value == 2) {
+				stop = !wasDown;
+			} else if (!button) {
+				TypedKey key = { input::evdev::toVirtualKey(evt.code), ctrl(), shift(), alt() };
+				held[evt.code] = evt.value != 0;
+				if (evt.value == 1 && !isModifier(evt.code)) stop = typed(key);
+			}
+
+			// a key up is emitted if and only if its key down was
+			if (evt.value == 0 ? !wasDown : stop) {
+				++blocked;
+				return;
+			}
+			emit(EV_KEY, evt.code, evt.value);
+			down[evt.code] = evt.value != 0;
+		}
+
+		// update the state for a key down, and return whether it is blocked
+		bool typed(const TypedKey& key) {
+			history.push_back(key);
+			if (history.size() > unlock.size())
+				history.erase(history.begin());
+
+			bool matched = history.size() == unlock.size();
+			for (size_t i = 0; matched && i < unlock.size(); i++) {
+				const TypedKey& k = history[i];
+				matched = k.vk == (unsigned long)(unlock[i] - 'a' + 'A') && !k.ctrl && !k.shift && !k.alt;
+			}
+			if (matched) history.clear();
+
+			if (matched && isLocked) {
+				isLocked = false;
+				return true;
+			}
+			if (key.vk == 'L' && key.alt && !key.ctrl && !key.shift && !isLocked) {
+				isLocked = true;
+				return true;
+			}
+			return isLocked;
+		}
+
+		bool ctrl() const { return held[KEY_LEFTCTRL] || held[KEY_RIGHTCTRL]; }
+		bool shift() const { return held[KEY_LEFTSHIFT] || held[KEY_RIGHTSHIFT]; }
+		bool alt() const { return held[KEY_LEFTALT] || held[KEY_RIGHTALT]; }
+
+		std::string unlock;
+		std::vector<TypedKey> history;
+		bool held[KEY_CNT] = { false };
+		bool down[KEY_CNT] = { false };
+		int dx = 0;
+		int dy = 0;
+	};
+
+	// Generates the events of one device, and passes them to its reference model.
+	class Generator {
+	public:
+		Generator(const Config& config, int index)
+			: model(config.unlock), config(config), random(config.seed * 7919 + index) {
+			for (int i = 0; i < LOADGEN_ACTIONS; i++) total += config.mix[i];
+		}
+
+		// append the events of one randomly chosen action, and return the
+		// number of events other than SYN_REPORT
+		int next(std::vector<input_event>& out) {
+			buffer = &out;
+			count = 0;
+			unsigned pick = std::uniform_int_distribution<unsigned>(0, total - 1)(random);
+			int action = 0;
+			while (pick >= config.mix[action]) pick -= config.mix[action++];
+
+			switch ((Action)action) {
+			case KEYS:
+				press(typingKeys[uniform(sizeof(typingKeys) / sizeof(typingKeys[0]))]);
+				break;
+			case REPEATS: {
+				unsigned short key = typingKeys[uniform(sizeof(typingKeys) / sizeof(typingKeys[0]))];
+				key1(key, 1);
+				for (int n = 2 + (int)uniform(20); n > 0; n--) key1(key, 2);
+				key1(key, 0);
+				break;
+			}
+			case MOTION:
+				add(EV_REL, REL_X, (int)uniform(21) - 10);
+				add(EV_REL, REL_Y, (int)uniform(21) - 10);
+				syn();
+				break;
+			case CLICKS: {
+				unsigned short button = buttons[uniform(sizeof(buttons) / sizeof(buttons[0]))];
+				key1(button, 1);
+				key1(button, 0);
+				break;
+			}
+			case WHEEL:
+				add(EV_REL, uniform(4) == 0 ? REL_HWHEEL : REL_WHEEL, uniform(2) ? 1 : -1);
+				syn();
+				break;
+			case NEARMISS:
+				nearMiss();
+				break;
+			case MODSTORM:
+				modifierStorm();
+				break;
+			case UNLOCK:
+				for (char c : config.unlock) press(letterKey(c));
+				break;
+			case LOCK:
+				key1(KEY_LEFTALT, 1);
+				press(KEY_L);
+				key1(KEY_LEFTALT, 0);
+				break;
+			}
+			return count;
+		}
+
+		ReferenceModel model;
+
+	private:
+		unsigned uniform(unsigned n) {
+			return std::uniform_int_distribution<unsigned>(0, n - 1)(random);
+		}
+
+		void add(unsigned short type, unsigned short code, int value) {
+			input_event evt;
+			memset(&evt, 0, sizeof(evt));
+			evt.type = type;
+			evt.code = code;
+			evt.value = value;
+			buffer->push_back(evt);
+			model.process(evt);
+			if (type != EV_SYN) ++count;
+		}
+
+		void syn() {
+			add(EV_SYN, SYN_REPORT, 0);
+		}
+
+		void key1(unsigned short code, int value) {
+			add(EV_KEY, code, value);
+			syn();
+		}
+
+		void press(unsigned short code) {
+			key1(code, 1);
+			key1(code, 0);
+		}
+
+		// a prefix of the unlock sequence followed by a wrong key, or the whole
+		// sequence typed with shift held
+		void nearMiss() {
+			size_t length = config.unlock.size();
+			if (length > 1 && uniform(2)) {
+				size_t prefix = 1 + uniform((unsigned)length - 1);
+				for (size_t i = 0; i < prefix; i++) press(letterKey(config.unlock[i]));
+				unsigned short wrong;
+				do {
+					wrong = letterKey((char)('a' + uniform(26)));
+				} while (wrong == letterKey(config.unlock[prefix]));
+				press(wrong);
+			} else {
+				key1(KEY_LEFTSHIFT, 1);
+				for (char c : config.unlock) press(letterKey(c));
+				key1(KEY_LEFTSHIFT, 0);
+			}
+		}
+
+		// overlapping presses and releases of the modifier keys, mixed with a
+		// few typed keys, leaving none held down
+		void modifierStorm() {
+			bool held[6] = { false };
+			for (int n = 10 + (int)uniform(20); n > 0; n--) {
+				int mod = (int)uniform(7);
+				if (mod == 6) {
+					press(typingKeys[uniform(sizeof(typingKeys) / sizeof(typingKeys[0]))]);
+					continue;
+				}
+				held[mod] = !held[mod];
+				key1(modifierKeys[mod], held[mod] ? 1 : 0);
+			}
+			for (int mod = 0; mod < 6; mod++)
+				if (held[mod]) key1(modifierKeys[mod], 0);
+		}
+
+		const Config& config;
+		std::mt19937 random;
+		unsigned total = 0;
+		std::vector<input_event> *buffer = nullptr;
+		int count = 0;
+	};
+
+	struct DeviceResult {
+		unsigned long long events = 0;    // events other than SYN_REPORT
+		unsigned long long written = 0;   // all events
+		double seconds = 0.0;
+	};
+
+	// generate events for the given time, and write them to fd at the configured rate
+	void runDevice(const Config& config, Generator& generator, int fd, DeviceResult& result) {
+		std::vector<input_event> chunk;
+		long long start = monotonicMicroseconds();
+		long long end = start + (long long)(config.seconds * 1000000.0);
+		long long now = start;
+		timespec tick;
+		clock_gettime(CLOCK_MONOTONIC, &tick);
+
+		while (now < end) {
+			unsigned long long due = config.rate ?
+				(unsigned long long)((now - start) * (double)config.rate / 1000000.0) : result.events + 256;
+			while (result.events < due)
+				result.events += generator.next(chunk);
+
+			// all events of a chunk are stamped with the time it is written
+			for (auto& evt : chunk) {
+				evt.input_event_sec = now / 1000000;
+				evt.input_event_usec = now % 1000000;
+			}
+			size_t offset = 0;
+			while (offset < chunk.size()) {
+				ssize_t n = write(fd, chunk.data() + offset, (chunk.size() - offset) * sizeof(input_event));
+				if (n <= 0) break;
+				offset += n / sizeof(input_event);
+			}
+			result.written += chunk.size();
+			chunk.clear();
+
+			if (config.rate) {
+				// wake up every millisecond to write the events that are due
+				tick.tv_nsec += 1000000;
+				if (tick.tv_nsec >= 1000000000) {
+					tick.tv_nsec -= 1000000000;
+					++tick.tv_sec;
+				}
+				clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tick, nullptr);
+			}
+			now = monotonicMicroseconds();
+		}
+		result.seconds = (now - start) / 1000000.0;
+	}
+
+	int openUinput() {
+		int fd = open("/dev/uinput", O_WRONLY | O_CLOEXEC);
+		if (fd < 0) return -1;
+
+		ioctl(fd, UI_SET_EVBIT, EV_SYN);
+		ioctl(fd, UI_SET_EVBIT, EV_KEY);
+		ioctl(fd, UI_SET_EVBIT, EV_REL);
+		for (int code = 1; code < BTN_MISC; code++) ioctl(fd, UI_SET_KEYBIT, code);
+		for (unsigned short button : buttons) ioctl(fd, UI_SET_KEYBIT, button);
+		ioctl(fd, UI_SET_RELBIT, REL_X);
+		ioctl(fd, UI_SET_RELBIT, REL_Y);
+		ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
+		ioctl(fd, UI_SET_RELBIT, REL_HWHEEL);
+
+		uinput_user_dev dev;
+		memset(&dev, 0, sizeof(dev));
+		strncpy(dev.name, LOADGEN_DEVICE_NAME, UINPUT_MAX_NAME_SIZE - 1);
+		dev.id.bustype = BUS_VIRTUAL;
+		dev.id.vendor = 0x1;
+		dev.id.product = 0x2;
+		dev.id.version = 1;
+		if (write(fd, &dev, sizeof(dev)) != (ssize_t)sizeof(dev) || ioctl(fd, UI_DEV_CREATE) != 0) {
+			close(fd);
+			return -1;
+		}
+		// give the backend time to find and grab the device
+		sleep(1);
+		return fd;
+	}
+
+	// read the events emitted by the backend until the output is closed
+	void drainOutput(int fd, EventCounts& counts) {
+		input_event events[256];
+		size_t partial = 0;
+		while (true) {
+			ssize_t n = read(fd, (char*)events + partial, sizeof(events) - partial);
+			if (n <= 0) break;
+
+			size_t total = partial + (size_t)n;
+			size_t count = total / sizeof(input_event);
+			for (size_t i = 0; i < count; i++) {
+				if (events[i].type != EV_SYN)
+					++counts[eventKey(events[i].type, events[i].code, events[i].value)];
+			}
+			partial = total % sizeof(input_event);
+			memmove(events, (char*)events + count * sizeof(input_event), partial);
+		}
+	}
+
+	// the upper bound, in microseconds, of the latency bucket holding the given fraction of reports
+	unsigned long long latencyPercentile(const input::evdev::Stats& stats, double fraction) {
+		unsigned long long total = 0;
+		for (int i = 0; i < INPUT_LATENCY_BUCKETS; i++) total += stats.latency[i];
+		if (total == 0) return 0;
+
+		unsigned long long seen = 0;
+		for (int i = 0; i < INPUT_LATENCY_BUCKETS; i++) {
+			seen += stats.latency[i];
+			if (seen >= fraction * total) return 1ULL << i;
+		}
+		return 1ULL << (INPUT_LATENCY_BUCKETS - 1);
+	}
+
+	bool parseMix(const char *arg, Config& config) {
+		std::string mix = arg;
+		size_t pos = 0;
+		while (pos < mix.size()) {
+			size_t end = mix.find(',', pos);
+			if (end == std::string::npos) end = mix.size();
+			std::string item = mix.substr(pos, end - pos);
+			size_t eq = item.find('=');
+			if (eq == std::string::npos) return false;
+
+			int action = 0;
+			while (action < LOADGEN_ACTIONS && item.compare(0, eq, actionNames[action]) != 0) ++action;
+			if (action == LOADGEN_ACTIONS) return false;
+			config.mix[action] = (unsigned)atoi(item.c_str() + eq + 1);
+			pos = end + 1;
+		}
+
+		unsigned total = 0;
+		for (int i = 0; i < LOADGEN_ACTIONS; i++) total += config.mix[i];
+		return total > 0;
+	}
+
+	void usage() {
+		fprintf(stderr,
+			"usage: loadgen [options]\n"
+			"  --target pipe|uinput  feed the backend in this process, or a virtual device (pipe)\n"
+			"  --rate N              events per second per device, 0 = no limit (20000)\n"
+			"  --seconds N           duration of the run (5)\n"
+			"  --devices N           number of devices generating events (1)\n"
+			"  --unlock SEQ          unlock sequence, letters only (asdf)\n"
+			"  --mix NAME=W,...      weights of keys, repeats, motion, clicks, wheel,\n"
+			"                        nearmiss, modstorm, unlock, lock\n"
+			"  --seed N              seed of the random generator (1)\n"
+			"  --trace FILE          record the events seen by the backend (pipe only)\n");
+	}
+
+	bool parseArgs(int argc, char **argv, Config& config) {
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (i + 1 >= argc) return false;
+			const char *value = argv[++i];
+
+			if (arg == "--target") config.target = value;
+			else if (arg == "--rate") config.rate = (unsigned)atoi(value);
+			else if (arg == "--seconds") config.seconds = atof(value);
+			else if (arg == "--devices") config.devices = atoi(value);
+			else if (arg == "--unlock") config.unlock = value;
+			else if (arg == "--seed") config.seed = (unsigned)atoi(value);
+			else if (arg == "--trace") config.trace = value;
+			else if (arg == "--mix") {
+				if (!parseMix(value, config)) return false;
+			} else return false;
+		}
+
+		if (config.target != "pipe" && config.target != "uinput") return false;
+		if (!config.trace.empty() && config.target != "pipe") return false;
+		if (config.devices < 1 || config.devices >= INPUT_MAX_DEVICES) return false;
+		if (config.unlock.empty()) return false;
+		for (char c : config.unlock)
+			if (c < 'a' || c > 'z') return false;
+		return true;
+	}
+}
+
+int main(int argc, char **argv) {
+	Config config;
+	if (!parseArgs(argc, argv, config)) {
+		usage();
+		return 2;
+	}
+
+	bool pipeTarget = config.target == "pipe";
+	std::vector<Generator*> generators;
+	std::vector<DeviceResult> results(config.devices);
+	std::vector<int> fds;
+	int output[2] = { -1, -1 };
+	EventCounts emitted;
+	std::thread drain;
+
+	if (pipeTarget) {
+		std::string error;
+		if (!unlockPattern.compile(config.unlock.c_str(), &error)) {
+			fprintf(stderr, "invalid unlock sequence: %s\n", error.c_str());
+			return 1;
+		}
+		patternStates.fill(unlockPattern.startState());
+
+		if (pipe(output) != 0) return 1;
+		input::evdev::setOutput(output[1]);
+		if (!config.trace.empty()) {
+			int fd = open(config.trace.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0) {
+				fprintf(stderr, "could not create trace %s\n", config.trace.c_str());
+				return 1;
+			}
+			input::evdev::setTraceOutput(fd);
+		}
+		input::evdev::setKeyHandler(policyKey);
+		input::evdev::setMouseHandler(policyMouse);
+		for (int i = 0; i < config.devices; i++) {
+			int fds2[2];
+			if (pipe(fds2) != 0 || !input::evdev::addFakeDevice(fds2[0],
+				INPUT_DEVICE_KEYBOARD | INPUT_DEVICE_MOUSE)) {
+				fprintf(stderr, "could not add fake device %d\n", i);
+				return 1;
+			}
+			fcntl(fds2[1], F_SETPIPE_SZ, 1 << 20);
+			fds.push_back(fds2[1]);
+		}
+		drain = std::thread(drainOutput, output[0], std::ref(emitted));
+		input::evdev::start();
+	} else {
+		for (int i = 0; i < config.devices; i++) {
+			int fd = openUinput();
+			if (fd < 0) {
+				fprintf(stderr, "could not create uinput device %d\n", i);
+				return 1;
+			}
+			fds.push_back(fd);
+		}
+	}
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < config.devices; i++) {
+		generators.push_back(new Generator(config, i));
+		threads.emplace_back(runDevice, std::cref(config), std::ref(*generators[i]), fds[i], std::ref(results[i]));
+	}
+	for (auto& thread : threads) thread.join();
+
+	unsigned long long events = 0;
+	unsigned long long written = 0;
+	double seconds = 0.0;
+	for (auto& result : results) {
+		events += result.events;
+		written += result.written;
+		if (result.seconds > seconds) seconds = result.seconds;
+	}
+	printf("target %s, %d device(s), %.2f s\n", config.target.c_str(), config.devices, seconds);
+	printf("rate: %llu events (%llu with SYN_REPORT), %.0f/s per device achieved, %u/s target\n",
+		events, written, events / seconds / config.devices, config.rate);
+
+	int status = 0;
+	if (pipeTarget) {
+		// wait for the backend to catch up, then close the output to end the drain
+		while (input::evdev::getStats().events < written) usleep(1000);
+		input::evdev::Stats stats = input::evdev::getStats();
+		input::evdev::shutdown();
+		drain.join();
+		close(output[0]);
+
+		EventCounts expected;
+		unsigned long long expectedBlocked = 0;
+		for (auto *generator : generators) {
+			for (auto& entry : generator->model.emitted) expected[entry.first] += entry.second;
+			expectedBlocked += generator->model.blocked;
+		}
+		unsigned long long emittedTotal = 0;
+		unsigned long long mismatches = 0;
+		for (auto& entry : emitted) emittedTotal += entry.second;
+		for (auto& entry : expected) {
+			auto it = emitted.find(entry.first);
+			if (it == emitted.end() || it->second != entry.second) ++mismatches;
+		}
+		for (auto& entry : emitted)
+			if (expected.find(entry.first) == expected.end()) ++mismatches;
+		bool correct = mismatches == 0 && stats.blocked == expectedBlocked;
+
+		printf("verdicts: %llu emitted, %llu blocked; reference model: %llu blocked, %llu mismatched kinds -> %s\n",
+			emittedTotal, stats.blocked, expectedBlocked, mismatches, correct ? "OK" : "FAILED");
+		printf("backend: %.1f events/read, %.1f events/write, %llu repeats\n",
+			(double)stats.events / stats.reads, stats.writes ? (double)stats.events / stats.writes : 0.0,
+			stats.repeats);
+		printf("latency per report: p50 < %lluus, p90 < %lluus, p99 < %lluus, p99.9 < %lluus, max < %lluus\n",
+			latencyPercentile(stats, 0.5), latencyPercentile(stats, 0.9), latencyPercentile(stats, 0.99),
+			latencyPercentile(stats, 0.999), latencyPercentile(stats, 1.0));
+		if (!correct) status = 1;
+	} else {
+		for (int fd : fds) {
+			ioctl(fd, UI_DEV_DESTROY);
+			close(fd);
+		}
+	}
+
+	for (auto *generator : generators) delete generator;
+	return status;
+}
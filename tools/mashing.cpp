@@ -0,0 +1,302 @@
+// Padlock mashing evaluation, for the limits of the detector that switches
+// to Locked mode when the keyboard is mashed.
+//
+// Replays typing sessions through a MashDetector (see
+// src/wininput/mashing.hpp) the way keyHandler feeds it, resetting it after
+// each detection as the change of mode does, and reports the false
+// positives: every detection in a session is one, as the sessions are of
+// people typing. The sessions are the traces in FOLDER (see
+// src/wininput/trace.hpp), such as those recorded by the evdev backend, or
+// if none is given, an hour of generated typing for each of several speeds
+// from 40 to 160 words per minute.
+//
+// Mashing is then spliced into the sessions at random points: random keys at
+// 20 and 40 keys per second, and a paw landing on clusters of neighbouring
+// keys. The detection latency, from the first key of the mashing to the
+// detection, is reported for each, with the mashing missed if it is not
+// detected within 3 seconds.
+//
+// Fails if generated typing is taken for mashing, or if mashing at 40 keys
+// per second is missed.
+//
+// Usage: mashing [--limits WINDOW,KEYS,PRESSED,SPREADKEYS,SPREAD] [FOLDER]
+// where the limits are those of MashLimits, set as mwin, mkeys, mpress,
+// mskeys, and mspread in conf.ini, and default to the defaults there.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc/wininput tools/mashing.cpp src/wininput/mashing.cpp -o mashing
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "mashing.hpp"
+#include "trace.hpp"
+
+// The length of each generated session, in milliseconds, and the speeds typed.
+#define MASHING_SESSION_LENGTH 3600000UL
+#define MASHING_SPEEDS { 40, 70, 100, 130, 160 }
+// The number of times each kind of mashing is spliced into the sessions,
+// and the time it lasts, in milliseconds.
+#define MASHING_RUNS 1000
+#define MASHING_LENGTH 3000UL
+// The number of events of a session replayed before the mashing starts.
+#define MASHING_WARMUP 200
+
+namespace {
+	using input::KeyData;
+	using input::MashDetector;
+	using input::MashLimits;
+
+	typedef std::vector<KeyData> Session;
+
+	struct Named {
+		std::string name;
+		Session events;
+	};
+
+	std::mt19937 generator(33);
+
+	double uniform(double low, double high) {
+		return std::uniform_real_distribution<double>(low, high)(generator);
+	}
+
+	// the rows of letters and digits of a US keyboard, from the left
+	const char *rows[] = { "1234567890", "QWERTYUIOP", "ASDFGHJKL", "ZXCVBNM" };
+
+	KeyData keyEvent(unsigned long code, short type, unsigned long time) {
+		KeyData data;
+		data.code = code;
+		data.type = type;
+		data.time = time;
+		return data;
+	}
+
+	// put the key downs and ups of a session in order, keeping a key up
+	// after its key down when they share a time
+	void sortSession(Session& session) {
+		std::stable_sort(session.begin(), session.end(), [](const KeyData& a, const KeyData& b) {
+			return a.time < b.time;
+		});
+	}
+
+	// an hour of typing at the given speed, in words of 5 characters per
+	// minute, with keys rolled over, pauses between sentences, and shift for
+	// capitals
+	Session generateTyping(int wpm) {
+		const char letters[] = "etaoinshrdlcumwfgypbvkjxqz";
+		Session session;
+		double interval = 60000.0 / (wpm * 5.0);
+		double time = 1000;
+		int words = 0;
+		while (time < MASHING_SESSION_LENGTH) {
+			int length = 1 + (int)(generator() % 9);
+			bool capital = words % 12 == 0;
+			for (int i = 0; i <= length; i++) {
+				// a word, then a space, typed with a gap that varies by half
+				unsigned long code = i == length ? ' ' :
+					(unsigned long)toupper(letters[std::min(25, (int)std::abs(std::normal_distribution<double>(0, 7)(generator)))]);
+				time += interval * uniform(0.5, 1.5);
+				double dwell = uniform(60, 140);
+				if (capital && i == 0) {
+					session.push_back(keyEvent(0xA0, INPUT_TYPE_KEYDOWN, (unsigned long)(time - 40)));
+					session.push_back(keyEvent(0xA0, INPUT_TYPE_KEYUP, (unsigned long)(time + dwell + 10)));
+				}
+				session.push_back(keyEvent(code, INPUT_TYPE_KEYDOWN, (unsigned long)time));
+				session.push_back(keyEvent(code, INPUT_TYPE_KEYUP, (unsigned long)(time + dwell)));
+			}
+			if (++words % 12 == 0) time += uniform(1000, 10000);
+		}
+		sortSession(session);
+		return session;
+	}
+
+	// mashing from the given time, as random keys at the given rate, or as a
+	// paw landing on clusters of 3 to 6 neighbouring keys if rate is 0
+	Session generateMashing(unsigned long start, int rate) {
+		Session mash;
+		double time = start;
+		while (time < start + MASHING_LENGTH) {
+			int row = (int)(generator() % 4);
+			int column = (int)(generator() % strlen(rows[row]));
+			if (rate > 0) {
+				unsigned long code = (unsigned long)rows[row][column];
+				double dwell = uniform(50, 250);
+				mash.push_back(keyEvent(code, INPUT_TYPE_KEYDOWN, (unsigned long)time));
+				mash.push_back(keyEvent(code, INPUT_TYPE_KEYUP, (unsigned long)(time + dwell)));
+				time += 1000.0 / rate * uniform(0.5, 1.5);
+				continue;
+			}
+
+			int keys = 3 + (int)(generator() % 4);
+			double dwell = uniform(100, 400);
+			for (int i = 0; i < keys; i++) {
+				int r = std::min(3, std::max(0, row + (int)(generator() % 3) - 1));
+				int c = std::min((int)strlen(rows[r]) - 1, std::max(0, column + (int)(generator() % 3) - 1));
+				double at = time + uniform(0, 30);
+				mash.push_back(keyEvent((unsigned long)rows[r][c], INPUT_TYPE_KEYDOWN, (unsigned long)at));
+				mash.push_back(keyEvent((unsigned long)rows[r][c], INPUT_TYPE_KEYUP, (unsigned long)(at + dwell)));
+			}
+			time += uniform(300, 800);
+		}
+		sortSession(mash);
+		return mash;
+	}
+
+	bool readTraces(const std::string& folder, std::vector<Named>& sessions) {
+		DIR *dir = opendir(folder.c_str());
+		if (dir == nullptr) return false;
+		while (dirent *entry = readdir(dir)) {
+			std::string path = folder + "/" + entry->d_name;
+			struct stat st;
+			if (entry->d_name[0] == '.' || stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+			FILE *file = fopen(path.c_str(), "rb");
+			if (file == nullptr) continue;
+			Named session = { entry->d_name, {} };
+			input::TraceRecord rec;
+			while (fread(&rec, sizeof(rec), 1, file) == 1) {
+				if (rec.kind == INPUT_TRACE_KEY) session.events.push_back(input::toKeyData(rec));
+			}
+			fclose(file);
+			if (!session.events.empty()) sessions.push_back(std::move(session));
+		}
+		closedir(dir);
+		std::sort(sessions.begin(), sessions.end(), [](const Named& a, const Named& b) {
+			return a.name < b.name;
+		});
+		return true;
+	}
+
+	// replay a session, returning the number of detections
+	int countDetections(const Session& session, const MashLimits& limits) {
+		MashDetector detector;
+		detector.setLimits(limits);
+		int detections = 0;
+		for (const KeyData& data : session) {
+			if (detector.update(data)) {
+				++detections;
+				detector.reset();
+			}
+		}
+		return detections;
+	}
+
+	// splice mashing into a session at a random point, returning the
+	// latency of its detection, or -1 if it was missed
+	long measureLatency(const Session& session, const MashLimits& limits, int rate) {
+		size_t end = generator() % session.size();
+		size_t begin = end > MASHING_WARMUP ? end - MASHING_WARMUP : 0;
+		MashDetector detector;
+		detector.setLimits(limits);
+		for (size_t i = begin; i < end; i++) {
+			if (detector.update(session[i])) detector.reset();
+		}
+
+		// keys held down in the session are still held as the mashing starts
+		unsigned long start = session[end].time;
+		for (const KeyData& data : generateMashing(start, rate)) {
+			if (detector.update(data)) return (long)(data.time - start);
+		}
+		return -1;
+	}
+
+	bool parseLimits(const char *text, MashLimits& limits) {
+		char *end;
+		const char *p = text;
+		limits.window = strtoul(p, &end, 10);
+		if (*end != ',') return false;
+		limits.keys = (int)strtol(end + 1, &end, 10);
+		if (*end != ',') return false;
+		limits.pressed = (int)strtol(end + 1, &end, 10);
+		if (*end != ',') return false;
+		limits.spreadKeys = (int)strtol(end + 1, &end, 10);
+		if (*end != ',') return false;
+		limits.spread = strtof(end + 1, &end);
+		return *end == '\0' && limits.window > 0;
+	}
+}
+
+int main(int argc, char **argv) {
+	MashLimits limits;
+	std::string folder;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--limits") == 0 && i + 1 < argc) {
+			if (!parseLimits(argv[++i], limits)) {
+				fprintf(stderr, "limits should be WINDOW,KEYS,PRESSED,SPREADKEYS,SPREAD: %s\n", argv[i]);
+				return 2;
+			}
+		} else if (folder.empty() && argv[i][0] != '-') {
+			folder = argv[i];
+		} else {
+			fprintf(stderr, "usage: mashing [--limits WINDOW,KEYS,PRESSED,SPREADKEYS,SPREAD] [FOLDER]\n");
+			return 2;
+		}
+	}
+
+	std::vector<Named> sessions;
+	bool generated = folder.empty();
+	if (generated) {
+		for (int wpm : MASHING_SPEEDS)
+			sessions.push_back({ std::to_string(wpm) + " wpm", generateTyping(wpm) });
+	} else if (!readTraces(folder, sessions) || sessions.empty()) {
+		fprintf(stderr, "no traces with key events in %s\n", folder.c_str());
+		return 2;
+	}
+
+	printf("limits: %lums window, %d keys, %d pressed, spread %.2f over %d keys\n",
+		limits.window, limits.keys, limits.pressed, limits.spread, limits.spreadKeys);
+	printf("typing (%s):\n", generated ? "generated" : folder.c_str());
+	int falsePositives = 0;
+	double totalHours = 0;
+	for (const Named& session : sessions) {
+		int detections = countDetections(session.events, limits);
+		double hours = (session.events.back().time - session.events.front().time) / 3600000.0;
+		printf("  %-24s %8zu key events %6.2fh %4d false positive(s)\n", session.name.c_str(),
+			session.events.size(), hours, detections);
+		falsePositives += detections;
+		totalHours += hours;
+	}
+	printf("  %d false positive(s) in %.2fh, %.2f per hour\n", falsePositives, totalHours,
+		totalHours > 0 ? falsePositives / totalHours : 0.0);
+
+	printf("mashing, %d runs each:\n", MASHING_RUNS);
+	int failed = 0;
+	const int rates[] = { 20, 40, 0 };
+	for (int rate : rates) {
+		std::vector<long> latencies;
+		for (int run = 0; run < MASHING_RUNS; run++) {
+			long latency = measureLatency(sessions[run % sessions.size()].events, limits, rate);
+			if (latency >= 0) latencies.push_back(latency);
+		}
+		std::sort(latencies.begin(), latencies.end());
+		double mean = 0;
+		for (long latency : latencies)
+			mean += (double)latency / latencies.size();
+
+		std::string name = rate > 0 ? std::to_string(rate) + " keys/s" : "paw clusters";
+		bool ok = rate != 40 || latencies.size() == MASHING_RUNS;
+		if (latencies.empty()) {
+			printf("  %-14s none caught%s\n", name.c_str(), ok ? "" : "  <- FAILED");
+		} else {
+			printf("  %-14s %4zu caught, latency mean %.0fms, p50 %ldms, p95 %ldms, max %ldms%s\n",
+				name.c_str(), latencies.size(), mean, latencies[latencies.size() / 2],
+				latencies[latencies.size() * 95 / 100], latencies.back(), ok ? "" : "  <- FAILED");
+		}
+		if (!ok) ++failed;
+	}
+
+	if (generated && falsePositives != 0) ++failed;
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
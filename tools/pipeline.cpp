@@ -0,0 +1,210 @@
+// Padlock pipeline benchmark, for the handlers that decide on each key event.
+//
+// Runs a stream of typing through the keyboard decision path of each mode
+// twice: through a list of registered key_handler_fn, locked and called
+// indirectly one after the other, as addKeyHandler registers them, and
+// through a pipeline compiled from the same handlers (see
+// src/wininput/pipeline.hpp), as state::setup installs them. The handlers
+// are those of state.cpp, built from the same parts: the plug-ins, with none
+// loaded, then the handler of the mode, with mashing detection and autolock
+// (see src/wininput/mashing.hpp and src/policy.hpp), and then the limits of
+// Throttled mode. The time taken per key event is reported for each, and
+// the verdicts of both are checked to be the same.
+//
+// Usage: pipeline [EVENTS]
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -pthread -Isrc tools/pipeline.cpp src/policy.cpp
+//     src/wininput/mashing.cpp -o pipeline
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <random>
+#include <vector>
+#include "policy.hpp"
+#include "wininput/mashing.hpp"
+#include "wininput/pipeline.hpp"
+
+// The default number of key events of the stream.
+#define PIPELINE_EVENTS 4000000
+// The autolock period, and the limits of Throttled mode, as in conf.ini.
+#define PIPELINE_AUTOLOCK 60000UL
+#define PIPELINE_THROTTLE_KEYS 5
+
+namespace {
+	using namespace state;
+
+	const char *modeNames[] = { "Unlocked", "Restricted", "Locked", "Throttled" };
+
+	// the state the handlers decide by, as kept by state.cpp
+	std::atomic<InputState> inputState(InputState::UNLOCKED);
+	KeySet limitKeys;
+	input::MashDetector mashDetector;
+	Throttle throttle;
+	unsigned long lastActive = 0;
+
+	// the plug-ins loaded, of which there are none
+	std::atomic<std::vector<input::key_handler_fn>*> plugins(nullptr);
+
+	bool runKeyPlugins(input::KeyData& data) {
+		std::vector<input::key_handler_fn> *loaded = plugins.load(std::memory_order_acquire);
+		if (loaded == nullptr) return false;
+		for (input::key_handler_fn fn : *loaded)
+			if (fn(data)) return true;
+		return false;
+	}
+
+	// as state::keyHandler, with the event time as the tick count
+	bool keyHandler(input::KeyData& data) {
+		if (mashDetector.update(data) && inputState.load() != InputState::LOCKED) {
+			inputState.store(InputState::LOCKED);
+			return true;
+		}
+
+		InputState state = inputState.load();
+		if (state == InputState::UNLOCKED) {
+			if (data.time - lastActive > PIPELINE_AUTOLOCK)
+				inputState.store(InputState::LOCKED);
+			lastActive = data.time;
+			return false;
+		}
+		return isKeyBlocked(state, data, limitKeys);
+	}
+
+	// as state::throttleKeyHandler
+	bool throttleKeyHandler(input::KeyData& data) {
+		if (inputState.load() != InputState::THROTTLED) return false;
+		return throttle.isKeyBlocked(data);
+	}
+
+	// the registered handlers, as kept by wininput.cpp
+	struct KeyHandler {
+		input::key_handler_fn fn;
+		bool repeats;
+	};
+
+	std::list<KeyHandler> keyHandlers;
+	std::mutex keyHandlersMutex;
+
+	bool runList(input::KeyData& data) {
+		std::lock_guard<std::mutex> lock(keyHandlersMutex);
+		for (auto& handler : keyHandlers) {
+			if (handler.fn(data)) return true;
+		}
+		return false;
+	}
+
+	typedef input::KeyPipeline<0, input::KeyStage<runKeyPlugins>, input::KeyStage<keyHandler>,
+		input::RepeatKeyStage<throttleKeyHandler>> Pipeline;
+
+	bool runPipeline(input::KeyData& data) {
+		input::KeyData down = data;
+		return Pipeline::run(data, down, false, INPUT_PIPELINE_PASS) != INPUT_PIPELINE_PASS;
+	}
+
+	// typing, with words of letters and spaces, and shift now and then
+	std::vector<input::KeyData> makeStream(int count) {
+		std::mt19937 generator(36);
+		std::vector<input::KeyData> stream;
+		stream.reserve(count);
+		unsigned long time = 1000;
+		while ((int)stream.size() < count) {
+			unsigned long code = generator() % 6 == 0 ? 0x20 : 'A' + generator() % 26;
+			bool shift = generator() % 20 == 0;
+			time += 40 + generator() % 300;
+			input::KeyData data;
+			data.code = shift ? 0xA0 : code;
+			data.time = time;
+			data.type = INPUT_TYPE_KEYDOWN;
+			if (shift) {
+				stream.push_back(data);
+				data.code = code;
+				data.shift = true;
+				stream.push_back(data);
+			} else {
+				stream.push_back(data);
+			}
+			data.type = INPUT_TYPE_KEYUP;
+			data.time = time += 60 + generator() % 80;
+			stream.push_back(data);
+			if (shift) {
+				data.code = 0xA0;
+				data.shift = false;
+				stream.push_back(data);
+			}
+		}
+		stream.resize(count);
+		return stream;
+	}
+
+	// run the stream in the given mode, returning the time per event in
+	// nanoseconds and the verdicts
+	double run(const std::vector<input::KeyData>& stream, InputState mode, bool (*path)(input::KeyData&),
+		std::vector<bool>& verdicts) {
+		inputState.store(mode);
+		mashDetector.reset();
+		throttle.reset();
+		lastActive = stream.front().time;
+		verdicts.assign(stream.size(), false);
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < stream.size(); i++) {
+			input::KeyData data = stream[i];
+			verdicts[i] = path(data);
+		}
+		return std::chrono::duration<double, std::nano>(
+			std::chrono::steady_clock::now() - start).count() / stream.size();
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: pipeline [EVENTS]\n");
+		return 2;
+	}
+	int count = argc > 1 ? atoi(argv[1]) : PIPELINE_EVENTS;
+	if (count <= 0) {
+		fprintf(stderr, "the number of events should be positive\n");
+		return 2;
+	}
+
+	limitKeys.parse(POLICY_DEFAULT_LIMIT_KEYS);
+	throttle.setRates(PIPELINE_THROTTLE_KEYS, 0);
+	keyHandlers.push_back({ runKeyPlugins, false });
+	keyHandlers.push_back({ keyHandler, false });
+	keyHandlers.push_back({ throttleKeyHandler, true });
+	std::vector<input::KeyData> stream = makeStream(count);
+
+	int failed = 0;
+	printf("%d key events:\n", count);
+	for (int m = 0; m < 4; m++) {
+		std::vector<bool> listVerdicts, pipelineVerdicts;
+		double listTime = 0, pipelineTime = 0;
+		// each way is run twice, alternating, and the faster run is kept
+		for (int i = 0; i < 2; i++) {
+			double t = run(stream, (InputState)m, runList, listVerdicts);
+			if (i == 0 || t < listTime) listTime = t;
+			t = run(stream, (InputState)m, runPipeline, pipelineVerdicts);
+			if (i == 0 || t < pipelineTime) pipelineTime = t;
+		}
+		long blocked = 0;
+		for (bool verdict : pipelineVerdicts)
+			if (verdict) ++blocked;
+		bool ok = listVerdicts == pipelineVerdicts;
+		printf("  %-10s list %6.2fns, pipeline %6.2fns per event, %.0f%% less time, %ld blocked%s\n",
+			modeNames[m], listTime, pipelineTime, 100.0 * (1.0 - pipelineTime / listTime), blocked,
+			ok ? "" : "  <- FAILED: the verdicts differ");
+		if (!ok) ++failed;
+	}
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,289 @@
+// Padlock plug-in host test, for loading plug-ins and calling them on the
+// hook path (see src/wininput/plugins.hpp).
+//
+// The same file is built as a plug-in, which takes a behaviour from the name
+// it is loaded under: "block" blocks the Windows key and right clicks,
+// "slow" sleeps on F12 and F11, "async" asks to be called on the worker
+// thread and would block every key, while "stale" and "none" fail to
+// initialise. The test copies it into a folder under each name, along with a
+// file that is not a plug-in, and checks that:
+// - only block, slow, and async are loaded by loadPlugins
+// - only the events blocked by block are blocked, as async is not asked
+// - async sees the events that reach it on the worker thread
+// - slow is moved to the worker thread when it overruns its budget, and is
+//   disabled when it keeps overrunning there
+// - plug-ins loaded while the hook path runs are seen by it, without the
+//   verdicts of the others changing
+// - unloadPlugins shuts down every plug-in, with events still queued for the
+//   worker thread, after which no event is blocked
+//
+// Usage: plugins LIBRARY
+// where LIBRARY is the path of the plug-in built from this file.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -pthread -Isrc/wininput tools/plugins.cpp src/wininput/plugins.cpp -ldl -o plugins
+// and the plug-in with:
+//   g++ -O2 -std=c++14 -shared -fPIC -DPLUGINS_LIBRARY -Isrc/wininput tools/plugins.cpp -o plugin.so
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "plugin.h"
+
+// The virtual key codes and mouse messages the plug-ins act on.
+#define PLUGINS_KEY_WIN 0x5B
+#define PLUGINS_KEY_F11 0x7A
+#define PLUGINS_KEY_F12 0x7B
+#define PLUGINS_KEY_A 0x41
+#define PLUGINS_MOUSE_MOVE 0x0200
+#define PLUGINS_MOUSE_RDOWN 0x0204
+// The time slow sleeps on F12, over the default budget on the hook thread,
+// and on F11, over the budget on the worker thread, in milliseconds.
+#define PLUGINS_SLOW_F12 1
+#define PLUGINS_SLOW_F11 30
+
+#ifdef PLUGINS_LIBRARY
+
+#include <dlfcn.h>
+
+namespace {
+	std::string path;
+
+	int blockKey(const padlock_key_event *event) {
+		return event->code == PLUGINS_KEY_WIN;
+	}
+
+	int blockMouse(const padlock_mouse_event *event) {
+		return event->code == PLUGINS_MOUSE_RDOWN;
+	}
+
+	int slowKey(const padlock_key_event *event) {
+		if (event->type != PADLOCK_KEYDOWN) return 0;
+		if (event->code == PLUGINS_KEY_F12)
+			std::this_thread::sleep_for(std::chrono::milliseconds(PLUGINS_SLOW_F12));
+		else if (event->code == PLUGINS_KEY_F11)
+			std::this_thread::sleep_for(std::chrono::milliseconds(PLUGINS_SLOW_F11));
+		return 0;
+	}
+
+	int blockAll(const padlock_key_event *) {
+		return 1;
+	}
+
+	// leave a file next to the library, for the test to find
+	void shutdown() {
+		FILE *file = fopen((path + ".down").c_str(), "w");
+		if (file != nullptr) fclose(file);
+	}
+}
+
+PADLOCK_PLUGIN_EXPORT const padlock_plugin *padlock_plugin_init(unsigned abi) {
+	static padlock_plugin desc;
+	Dl_info info;
+	if (abi != PADLOCK_PLUGIN_ABI || dladdr((void*)&padlock_plugin_init, &info) == 0) return nullptr;
+	path = info.dli_fname;
+	std::string name = path.substr(path.rfind('/') + 1);
+
+	desc.abi = PADLOCK_PLUGIN_ABI;
+	desc.name = "test";
+	desc.shutdown = shutdown;
+	if (name.compare(0, 5, "block") == 0) {
+		desc.on_key = blockKey;
+		desc.on_mouse = blockMouse;
+	} else if (name.compare(0, 4, "slow") == 0) {
+		desc.on_key = slowKey;
+	} else if (name.compare(0, 5, "async") == 0) {
+		desc.flags = PADLOCK_PLUGIN_ASYNC;
+		desc.on_key = blockAll;
+	} else if (name.compare(0, 5, "stale") == 0) {
+		desc.abi = PADLOCK_PLUGIN_ABI + 1;
+	} else {
+		return nullptr;
+	}
+	return &desc;
+}
+
+#else
+
+#include <atomic>
+#include <vector>
+#include <unistd.h>
+#include "plugins.hpp"
+
+// The number of plug-ins loaded while the hook path runs.
+#define PLUGINS_LATE_LOADS 20
+
+namespace {
+	int failed = 0;
+
+	void check(bool ok, const char *what) {
+		printf("  %-56s %s\n", what, ok ? "ok" : "FAILED");
+		if (!ok) ++failed;
+	}
+
+	bool copyFile(const std::string& from, const std::string& to) {
+		FILE *in = fopen(from.c_str(), "rb");
+		if (in == nullptr) return false;
+		FILE *out = fopen(to.c_str(), "wb");
+		if (out == nullptr) {
+			fclose(in);
+			return false;
+		}
+		char buffer[4096];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), in)) > 0)
+			fwrite(buffer, 1, read, out);
+		fclose(in);
+		return fclose(out) == 0;
+	}
+
+	bool exists(const std::string& path) {
+		return access(path.c_str(), F_OK) == 0;
+	}
+
+	bool key(unsigned long code, short type = INPUT_TYPE_KEYDOWN) {
+		input::KeyData data;
+		data.code = code;
+		data.type = type;
+		return input::runKeyPlugins(data);
+	}
+
+	bool mouse(unsigned code) {
+		input::MouseData data;
+		data.code = code;
+		return input::runMousePlugins(data);
+	}
+
+	// find a plug-in by the name of its file
+	input::PluginInfo find(const std::string& name) {
+		for (auto& info : input::getPlugins())
+			if (info.path.compare(info.path.rfind('/') + 1, std::string::npos, name) == 0) return info;
+		return input::PluginInfo();
+	}
+
+	// wait for the worker thread to bring the plug-in to the given mode and
+	// number of calls, up to 2 seconds
+	bool waitFor(const std::string& name, int mode, unsigned long long calls) {
+		for (int i = 0; i < 200; i++) {
+			input::PluginInfo info = find(name);
+			if (info.mode == mode && info.calls >= calls) return true;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return false;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: plugins LIBRARY\n");
+		return 2;
+	}
+	std::string library = argv[1];
+	char folderName[] = "/tmp/plugins.XXXXXX";
+	if (!exists(library) || mkdtemp(folderName) == nullptr) {
+		fprintf(stderr, "cannot read %s or create a folder for the plug-ins\n", argv[1]);
+		return 2;
+	}
+	std::string folder = folderName;
+	std::vector<std::string> files;
+	for (const char *name : { "block.so", "slow.so", "async.so", "stale.so", "none.so" }) {
+		files.push_back(folder + "/" + name);
+		copyFile(library, files.back());
+	}
+	FILE *notes = fopen((folder + "/notes.txt").c_str(), "w");
+	if (notes != nullptr) fclose(notes);
+
+	printf("loading %s:\n", folder.c_str());
+	check(input::loadPlugins(std::string()) == 0, "nothing is loaded from an empty folder name");
+	check(input::loadPlugins(folder) == 3, "block, slow, and async are loaded");
+	std::vector<input::PluginInfo> infos = input::getPlugins();
+	check(infos.size() == 3 && find("block.so").mode == INPUT_PLUGIN_INLINE
+		&& find("slow.so").mode == INPUT_PLUGIN_INLINE && find("async.so").mode == INPUT_PLUGIN_ASYNC,
+		"only async is called on the worker thread");
+
+	// plug-ins are called in the order they were loaded, and async does not
+	// see the events that block blocks before it
+	bool asyncFirst = false;
+	for (auto& info : infos) {
+		if (info.path == folder + "/async.so") asyncFirst = true;
+		if (info.path == folder + "/block.so") break;
+	}
+
+	printf("calling them:\n");
+	unsigned long long asyncCalls = 0;
+	bool ok = true;
+	for (int i = 0; i < 100; i++) {
+		bool win = i % 10 == 0;
+		ok = ok && key(win ? PLUGINS_KEY_WIN : PLUGINS_KEY_A) == win;
+		ok = ok && key(win ? PLUGINS_KEY_WIN : PLUGINS_KEY_A, INPUT_TYPE_KEYUP) == win;
+		asyncCalls += win && !asyncFirst ? 0 : 2;
+	}
+	check(ok, "only the Windows key is blocked");
+	check(mouse(PLUGINS_MOUSE_RDOWN) && !mouse(PLUGINS_MOUSE_MOVE), "only right clicks are blocked");
+	check(waitFor("async.so", INPUT_PLUGIN_ASYNC, asyncCalls), "async sees the events that reach it");
+
+	printf("overrunning the budget:\n");
+	for (int i = 0; i < 3; i++)
+		key(PLUGINS_KEY_F12);
+	check(find("slow.so").mode == INPUT_PLUGIN_ASYNC, "slow is moved to the worker thread");
+	for (int i = 0; i < 3; i++)
+		key(PLUGINS_KEY_F11);
+	check(waitFor("slow.so", INPUT_PLUGIN_DISABLED, 0), "slow is disabled when it keeps overrunning");
+	check(find("slow.so").overruns == 6, "every overrun is counted");
+
+	printf("loading %d more while the hook path runs:\n", PLUGINS_LATE_LOADS);
+	std::atomic<bool> stop(false);
+	std::atomic<long> events(0), wrong(0);
+	double slowest = 0;
+	std::thread hook([&] {
+		while (!stop.load()) {
+			auto start = std::chrono::steady_clock::now();
+			bool win = events.load() % 2 == 0;
+			if (key(win ? PLUGINS_KEY_WIN : PLUGINS_KEY_A) != win) wrong.fetch_add(1);
+			double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+			if (elapsed > slowest) slowest = elapsed;
+			events.fetch_add(1);
+		}
+	});
+	int loaded = 0;
+	for (int i = 0; i < PLUGINS_LATE_LOADS; i++) {
+		files.push_back(folder + "/block" + std::to_string(i) + ".so");
+		if (copyFile(library, files.back()) && input::loadPlugin(files.back())) ++loaded;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	stop.store(true);
+	hook.join();
+	printf("  %ld events, slowest %.1fus\n", events.load(), slowest);
+	check(loaded == PLUGINS_LATE_LOADS && input::getPlugins().size() == 3 + PLUGINS_LATE_LOADS,
+		"every plug-in is loaded");
+	check(wrong.load() == 0, "no verdict changes");
+
+	printf("unloading them:\n");
+	for (int i = 0; i < 1000; i++)
+		key(PLUGINS_KEY_A);
+	input::unloadPlugins();
+	int down = 0;
+	for (auto& file : files)
+		if (exists(file + ".down")) ++down;
+	check(down == 3 + PLUGINS_LATE_LOADS, "every plug-in is shut down");
+	check(input::getPlugins().empty() && !key(PLUGINS_KEY_WIN) && !mouse(PLUGINS_MOUSE_RDOWN),
+		"no event is blocked afterwards");
+
+	for (auto& file : files) {
+		unlink(file.c_str());
+		unlink((file + ".down").c_str());
+	}
+	unlink((folder + "/notes.txt").c_str());
+	rmdir(folder.c_str());
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
+
+#endif
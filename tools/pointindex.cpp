@@ -0,0 +1,165 @@
+// Padlock mouse target benchmark, for the grid that indexes the first events
+// of mouse sequences.
+//
+// Registers 10,000 targets, such as hot corners and click targets, spread
+// over a desktop of several monitors that extends to negative coordinates,
+// in a PointIndex (see src/wininput/pointindex.hpp), the way the hooks index
+// the first event of each mouse sequence. Random clicks, half of them aimed
+// at a target, are then looked up in the grid and tested against the
+// candidates of their cell, and every click is also tested against every
+// target, as the hooks did before the index, to check that no hit is missed
+// and to compare the time taken per click.
+//
+// Usage: pointindex [TARGETS [TOLERANCE]]
+// where TOLERANCE is the largest tolerance of a target, in pixels.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc/wininput tools/pointindex.cpp src/wininput/pointindex.cpp -o pointindex
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "pointindex.hpp"
+
+// The default number of targets, and largest tolerance.
+#define POINTINDEX_TARGETS 10000
+#define POINTINDEX_TOLERANCE 24
+// The number of clicks tested, and of those timed against every target.
+#define POINTINDEX_CLICKS 2000000
+#define POINTINDEX_SCANNED_CLICKS 20000
+// The desktop: 4 by 2 monitors of 1920x1080, from the one above and to the
+// left of the primary monitor.
+#define POINTINDEX_LEFT -1920
+#define POINTINDEX_TOP -1080
+#define POINTINDEX_RIGHT 5760
+#define POINTINDEX_BOTTOM 1080
+
+namespace {
+	using input::PointIndex;
+
+	struct Click {
+		long x;
+		long y;
+	};
+
+	// the test of the hooks, as in matchMouseData
+	inline bool hits(const PointIndex::Target& t, const Click& c) {
+		long tol = (long)t.tolerance;
+		return t.x >= c.x - tol && t.x <= c.x + tol && t.y >= c.y - tol && t.y <= c.y + tol;
+	}
+
+	double since(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		fprintf(stderr, "usage: pointindex [TARGETS [TOLERANCE]]\n");
+		return 2;
+	}
+	int count = argc > 1 ? atoi(argv[1]) : POINTINDEX_TARGETS;
+	int maxTolerance = argc > 2 ? atoi(argv[2]) : POINTINDEX_TOLERANCE;
+	if (count <= 0 || maxTolerance < 0) {
+		fprintf(stderr, "the number of targets should be positive, and the tolerance not negative\n");
+		return 2;
+	}
+
+	std::mt19937 random(30);
+	auto coord = [&](long low, long high) { return low + (long)(random() % (unsigned long)(high - low)); };
+
+	// a quarter of the targets are in the corners of a monitor, the others anywhere
+	std::vector<PointIndex::Target> targets(count);
+	for (int i = 0; i < count; i++) {
+		PointIndex::Target& t = targets[i];
+		t.id = i;
+		t.tolerance = (unsigned)(random() % (maxTolerance + 1));
+		if (i % 4 == 0) {
+			t.x = coord(POINTINDEX_LEFT / 1920, POINTINDEX_RIGHT / 1920) * 1920 + (random() % 2 ? 1919 : 0);
+			t.y = coord(POINTINDEX_TOP / 1080, POINTINDEX_BOTTOM / 1080) * 1080 + (random() % 2 ? 1079 : 0);
+		} else {
+			t.x = coord(POINTINDEX_LEFT, POINTINDEX_RIGHT);
+			t.y = coord(POINTINDEX_TOP, POINTINDEX_BOTTOM);
+		}
+	}
+
+	std::vector<Click> clicks(POINTINDEX_CLICKS);
+	for (Click& c : clicks) {
+		if (random() % 2) {
+			const PointIndex::Target& t = targets[random() % count];
+			long spread = 2L * maxTolerance + 1;
+			c.x = t.x - maxTolerance + (long)(random() % spread);
+			c.y = t.y - maxTolerance + (long)(random() % spread);
+		} else {
+			c.x = coord(POINTINDEX_LEFT, POINTINDEX_RIGHT);
+			c.y = coord(POINTINDEX_TOP, POINTINDEX_BOTTOM);
+		}
+	}
+
+	PointIndex index;
+	auto start = std::chrono::steady_clock::now();
+	index.build(targets);
+	double buildTime = since(start) / 1e6;
+
+	// indexed: only the candidates of the cell of each click are tested
+	long indexedHits = 0, candidates = 0;
+	start = std::chrono::steady_clock::now();
+	for (const Click& c : clicks) {
+		const std::vector<int> *ids = index.query(c.x, c.y);
+		if (ids == nullptr) continue;
+		candidates += (long)ids->size();
+		for (int id : *ids)
+			if (hits(targets[id], c)) ++indexedHits;
+	}
+	double indexedTime = since(start) / POINTINDEX_CLICKS;
+
+	// every target is tested, for a sample of the clicks
+	long scannedHits = 0;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < POINTINDEX_SCANNED_CLICKS; i++) {
+		for (const PointIndex::Target& t : targets)
+			if (hits(t, clicks[i])) ++scannedHits;
+	}
+	double scanTime = since(start) / POINTINDEX_SCANNED_CLICKS;
+
+	// every hit of every click is among the candidates of its cell, and no
+	// candidate is listed twice
+	int problems = 0;
+	long checkedHits = 0;
+	std::vector<int> seen(count, -1);
+	for (int i = 0; i < POINTINDEX_CLICKS; i++) {
+		const Click& c = clicks[i];
+		const std::vector<int> *ids = index.query(c.x, c.y);
+		if (ids != nullptr) {
+			for (int id : *ids) {
+				if (seen[id] == i) ++problems;
+				seen[id] = i;
+			}
+		}
+		if (i % (POINTINDEX_CLICKS / POINTINDEX_SCANNED_CLICKS) != 0) continue;
+		for (const PointIndex::Target& t : targets) {
+			if (!hits(t, c)) continue;
+			++checkedHits;
+			if (seen[t.id] != i) ++problems;
+		}
+	}
+
+	printf("%d targets, tolerance up to %d, desktop %d,%d to %d,%d\n", count, maxTolerance,
+		POINTINDEX_LEFT, POINTINDEX_TOP, POINTINDEX_RIGHT, POINTINDEX_BOTTOM);
+	printf("build: %.2fms\n", buildTime);
+	printf("indexed: %.1fns per click, %.2f candidates per click, %ld hits in %d clicks\n",
+		indexedTime, (double)candidates / POINTINDEX_CLICKS, indexedHits, POINTINDEX_CLICKS);
+	printf("scanned: %.1fns per click, %ld hits in %d clicks\n",
+		scanTime, scannedHits, POINTINDEX_SCANNED_CLICKS);
+	printf("checked: %ld hits of %d clicks, %d missed or repeated\n",
+		checkedHits, POINTINDEX_SCANNED_CLICKS, problems);
+
+	if (problems != 0) {
+		printf("1 check(s) failed\n");
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
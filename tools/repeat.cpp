@@ -0,0 +1,241 @@
+// Padlock repeat measurement, for the work the keyboard hook does while a
+// key is held down.
+//
+// Holds a key down in each mode and feeds its auto-repeats to a model of the
+// keyboard hook, built from the same parts as the hook: the unlock and mode
+// sequences of state::setup (see src/wininput/secret.hpp and sequence.hpp),
+// and a compiled pipeline (see src/wininput/pipeline.hpp) of the plug-ins,
+// the handler of the mode, and the limits of Throttled mode. Each repeat is
+// run twice: collapsed, as the hook does, where repeats skip the sequences
+// and reuse the cached verdict of their key down, and uncollapsed, as the
+// hook did before, where every repeat is a key down that steps and resets
+// every sequence and runs every handler.
+//
+// The time taken per repeat, and the sequences stepped and handlers called
+// per repeat, are reported for each mode and way, and the verdicts of both
+// are checked to be the same. The key is also released and pressed again,
+// and the mode changed while it is held, as the verdicts are cached per key
+// down and per mode.
+//
+// Usage: repeat [KEY]
+// where KEY is the virtual key code held down, 0x41 (A) by default.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc tools/repeat.cpp src/policy.cpp
+//     src/wininput/secret.cpp -o repeat
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "policy.hpp"
+#include "state.hpp"
+#include "wininput/pipeline.hpp"
+#include "wininput/secret.hpp"
+#include "wininput/sequence.hpp"
+
+// The number of repeats of each key down, and of key downs in each mode.
+#define REPEAT_REPEATS 64
+#define REPEAT_PRESSES 20000
+// The default key held down, and the limits of Throttled mode.
+#define REPEAT_KEY 0x41
+#define REPEAT_THROTTLE_KEYS 5
+
+namespace {
+	using namespace state;
+
+	const char *modeNames[] = { "Unlocked", "Restricted", "Locked", "Throttled" };
+
+	// the state the handlers decide by, as kept by state.cpp
+	InputState mode = InputState::UNLOCKED;
+	KeySet limitKeys;
+	Throttle throttle;
+	long handlerCalls = 0;
+
+	// no plug-ins are loaded
+	bool pluginStage(input::KeyData&) {
+		++handlerCalls;
+		return false;
+	}
+
+	bool modeStage(input::KeyData& data) {
+		++handlerCalls;
+		return isKeyBlocked(mode, data, limitKeys);
+	}
+
+	bool throttleStage(input::KeyData& data) {
+		++handlerCalls;
+		return mode == InputState::THROTTLED && throttle.isKeyBlocked(data);
+	}
+
+	typedef input::KeyPipeline<0, input::KeyStage<pluginStage>, input::KeyStage<modeStage>,
+		input::RepeatKeyStage<throttleStage>> Pipeline;
+
+	// the verdict of the last key down of a key, as kept by the hook
+	struct Verdict {
+		unsigned long generation = 0;
+		int stopIndex = INPUT_PIPELINE_PASS;
+	};
+
+	// a model of the keyboard hook, with the sequences of state::setup
+	class Hook {
+	public:
+		long sequenceSteps = 0;
+
+		Hook() {
+			input::KeyData unlockSeq[Options::MAX_SEQ_LEN] = {
+				{ 0x41, false, false, false, 3 }, // asdf
+				{ 0x53, false, false, false, 3 },
+				{ 0x44, false, false, false, 3 },
+				{ 0x46, false, false, false, 3 }
+			};
+			input::SecretKey key;
+			input::SecretSequence secret;
+			input::makeSecretKey(key);
+			input::makeSecret(key, unlockSeq, secret);
+			unlock = input::SecretMatcher(key, secret);
+			seqs[0][0] = { 0x52, false, false, true, 3 }; // Alt+R
+			seqs[1][0] = { 0x4C, false, false, true, 3 }; // Alt+L
+			seqs[2][0] = { 0x54, false, false, true, 3 }; // Alt+T
+		}
+
+		// forget the cached verdicts, as on a change of mode
+		void invalidate() {
+			++generation;
+		}
+
+		// returns true if the key event is blocked; if collapse is false,
+		// repeats are handled as key downs, as before they were told apart
+		bool key(input::KeyData data, bool collapse) {
+			if (!collapse && data.type == INPUT_TYPE_KEYREPEAT) data.type = INPUT_TYPE_KEYDOWN;
+
+			// sequences are only processed on key down, and not on repeats
+			if (data.type == INPUT_TYPE_KEYDOWN) {
+				sequenceSteps += 4;
+				unlock.step(data);
+				for (int i = 0; i < 3; i++)
+					input::stepKeySequence(seqs[i], true, pos[i], data);
+			}
+
+			// as checkKeyHandlers
+			bool repeat = data.type == INPUT_TYPE_KEYREPEAT;
+			Verdict& verdict = verdicts[data.code & 0xFF];
+			bool cached = repeat && verdict.generation == generation;
+			input::KeyData down = data;
+			if (repeat) down.type = INPUT_TYPE_KEYDOWN;
+
+			int stopIndex = Pipeline::run(data, down, cached, verdict.stopIndex);
+			if (!cached && data.type != INPUT_TYPE_KEYUP) {
+				verdict.generation = stopIndex == INPUT_PIPELINE_STOP ? 0 : generation;
+				verdict.stopIndex = stopIndex;
+			}
+			return stopIndex != INPUT_PIPELINE_PASS;
+		}
+
+	private:
+		input::SecretMatcher unlock;
+		input::KeyData seqs[3][Options::MAX_SEQ_LEN];
+		int pos[3] = { 0 };
+		Verdict verdicts[256];
+		unsigned long generation = 1;
+	};
+
+	struct Result {
+		double time = 0;      // nanoseconds per repeat
+		double steps = 0;     // sequences stepped per repeat
+		double calls = 0;     // handlers called per repeat
+		long blocked = 0;     // repeats blocked
+	};
+
+	// hold the key down in the given mode, with the key pressed REPEAT_PRESSES
+	// times and repeated REPEAT_REPEATS times each, and the mode left and
+	// entered again halfway through, returning the verdicts of the repeats
+	Result hold(unsigned long code, InputState held, bool collapse, std::vector<bool>& verdicts) {
+		Hook hook;
+		mode = held;
+		throttle.reset();
+		handlerCalls = 0;
+		verdicts.clear();
+		verdicts.reserve((size_t)REPEAT_PRESSES * REPEAT_REPEATS);
+
+		// the repeats of a key held down come 33ms apart
+		input::KeyData data;
+		data.code = code;
+		unsigned long time = 1000;
+		Result result;
+		double elapsed = 0;
+		for (int press = 0; press < REPEAT_PRESSES; press++) {
+			data.type = INPUT_TYPE_KEYDOWN;
+			data.time = time;
+			hook.key(data, collapse);
+
+			long steps = hook.sequenceSteps, calls = handlerCalls;
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < REPEAT_REPEATS; i++) {
+				if (press == REPEAT_PRESSES / 2 && i == REPEAT_REPEATS / 2) {
+					// a change of mode while the key is held, such as by the schedule
+					hook.invalidate();
+					throttle.reset();
+				}
+				data.type = INPUT_TYPE_KEYREPEAT;
+				data.time = time += 33;
+				bool blocked = hook.key(data, collapse);
+				verdicts.push_back(blocked);
+				if (blocked) ++result.blocked;
+			}
+			elapsed += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			result.steps += hook.sequenceSteps - steps;
+			result.calls += handlerCalls - calls;
+
+			data.type = INPUT_TYPE_KEYUP;
+			data.time = time += 80;
+			hook.key(data, collapse);
+			time += 200;
+		}
+
+		double repeats = (double)REPEAT_PRESSES * REPEAT_REPEATS;
+		result.time = elapsed / repeats;
+		result.steps /= repeats;
+		result.calls /= repeats;
+		return result;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: repeat [KEY]\n");
+		return 2;
+	}
+	unsigned long code = argc > 1 ? strtoul(argv[1], nullptr, 0) : REPEAT_KEY;
+	if (code == 0 || code > 0xFE) {
+		fprintf(stderr, "the key should be a virtual key code from 0x01 to 0xFE\n");
+		return 2;
+	}
+
+	limitKeys.parse(POLICY_DEFAULT_LIMIT_KEYS);
+	throttle.setRates(REPEAT_THROTTLE_KEYS, 0);
+
+	int failed = 0;
+	printf("key 0x%02lX held down %d times, %d repeats each:\n", code, REPEAT_PRESSES, REPEAT_REPEATS);
+	for (int m = 0; m < 4; m++) {
+		std::vector<bool> collapsedVerdicts, uncollapsedVerdicts;
+		Result collapsed = hold(code, (InputState)m, true, collapsedVerdicts);
+		Result uncollapsed = hold(code, (InputState)m, false, uncollapsedVerdicts);
+		bool ok = collapsedVerdicts == uncollapsedVerdicts;
+
+		printf("  %-10s collapsed %6.2fns, %.2f steps, %.2f calls; uncollapsed %6.2fns, %.2f steps, %.2f calls;"
+			" %.0f%% less time, %ld blocked%s\n", modeNames[m],
+			collapsed.time, collapsed.steps, collapsed.calls,
+			uncollapsed.time, uncollapsed.steps, uncollapsed.calls,
+			100.0 * (1.0 - collapsed.time / uncollapsed.time), collapsed.blocked,
+			ok ? "" : "  <- FAILED: the verdicts differ");
+		if (!ok) ++failed;
+	}
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,148 @@
+// Padlock rhythm latency benchmark, for the check of the typing rhythm of
+// the unlock sequence.
+//
+// Simulates typists, each with their own habits for every key of the unlock
+// sequence, and enrolls a profile from 5 samples of their typing, as "Learn
+// unlock rhythm" does (see src/wininput/rhythm.hpp). Each unlock is then
+// checked the way the unlock handler does on the hook thread: the features
+// are extracted from the key timings, and scored against the profile. The
+// time taken by each check is measured, for sequences of 4 to 16 keys, along
+// with how often the typist and an impostor who knows the sequence would be
+// let in at the default tolerance.
+//
+// Fails if the 99th percentile of the time taken by a check is 10 us or more,
+// well within the time a hook may take to return.
+//
+// Usage: rhythm [TOLERANCE]
+// where TOLERANCE is the maximum score, in hundredths, as rtol in conf.ini.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc/wininput tools/rhythm.cpp src/wininput/rhythm.cpp -o rhythm
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "rhythm.hpp"
+
+// The number of typists, and of unlocks by each of them and by an impostor.
+#define RHYTHM_TYPISTS 200
+#define RHYTHM_UNLOCKS 200
+// The number of enrollment samples, as in state.cpp.
+#define RHYTHM_SAMPLES 5
+// The default tolerance, and the time a check may take, in microseconds.
+#define RHYTHM_TOLERANCE 250
+#define RHYTHM_MAX_LATENCY 10.0
+
+namespace {
+	using input::KeyTiming;
+	using input::RhythmProfile;
+
+	std::mt19937 generator(32);
+
+	double normal(double mean, double deviation) {
+		return std::normal_distribution<double>(mean, deviation)(generator);
+	}
+
+	// the mean flight and dwell times of a typist for each key, in milliseconds
+	struct Typist {
+		double flight[INPUT_KEYTIMINGS];
+		double dwell[INPUT_KEYTIMINGS];
+
+		Typist() {
+			double speed = std::uniform_real_distribution<double>(0.6, 1.6)(generator);
+			for (int i = 0; i < INPUT_KEYTIMINGS; i++) {
+				flight[i] = std::max(40.0, normal(170, 60)) * speed;
+				dwell[i] = std::max(30.0, normal(95, 25));
+			}
+		}
+
+		// type the sequence, with the timings in microseconds as the hooks
+		// keep them, the last key being still held down
+		void type(int keys, KeyTiming *timings) const {
+			long long time = 1000000;
+			for (int i = 0; i < keys; i++) {
+				if (i > 0) time += (long long)(std::max(15.0, normal(flight[i], flight[i] * 0.12)) * 1000);
+				timings[i].code = 'A' + i;
+				timings[i].down = time;
+				timings[i].up = i + 1 < keys ?
+					time + (long long)(std::max(10.0, normal(dwell[i], dwell[i] * 0.12)) * 1000) : 0;
+			}
+		}
+	};
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: rhythm [TOLERANCE]\n");
+		return 2;
+	}
+	int tolerance = argc > 1 ? atoi(argv[1]) : RHYTHM_TOLERANCE;
+	if (tolerance <= 0) {
+		fprintf(stderr, "the tolerance should be positive\n");
+		return 2;
+	}
+
+	int failed = 0;
+	printf("%d typists, %d unlocks each, tolerance %d\n", RHYTHM_TYPISTS, RHYTHM_UNLOCKS, tolerance);
+	for (int keys = 4; keys <= INPUT_KEYTIMINGS; keys += 4) {
+		std::vector<double> latencies;
+		latencies.reserve(RHYTHM_TYPISTS * RHYTHM_UNLOCKS * 2);
+		long genuine = 0, impostors = 0, attempts = 0;
+
+		for (int t = 0; t < RHYTHM_TYPISTS; t++) {
+			Typist typist, impostor;
+			KeyTiming timings[INPUT_KEYTIMINGS];
+			float samples[RHYTHM_SAMPLES][RHYTHM_MAX_FEATURES];
+			int features = 0;
+			for (int s = 0; s < RHYTHM_SAMPLES; s++) {
+				typist.type(keys, timings);
+				features = input::extractRhythm(timings, keys, samples[s]);
+			}
+			RhythmProfile profile;
+			if (!input::buildRhythmProfile(samples, RHYTHM_SAMPLES, features, profile)) {
+				printf("  %2d keys: the profile could not be built  <- FAILED\n", keys);
+				++failed;
+				break;
+			}
+
+			for (int u = 0; u < RHYTHM_UNLOCKS * 2; u++) {
+				bool own = u % 2 == 0;
+				(own ? typist : impostor).type(keys, timings);
+
+				// as checkRhythm, once the key timings are taken from the hooks
+				auto start = std::chrono::steady_clock::now();
+				float extracted[RHYTHM_MAX_FEATURES];
+				int count = input::extractRhythm(timings, keys, extracted);
+				float score = input::scoreRhythm(profile, extracted, count);
+				bool accepted = score * 100.0f <= tolerance;
+				latencies.push_back(std::chrono::duration<double, std::micro>(
+					std::chrono::steady_clock::now() - start).count());
+
+				if (accepted) ++(own ? genuine : impostors);
+				if (own) ++attempts;
+			}
+		}
+		if (latencies.empty()) continue;
+
+		std::sort(latencies.begin(), latencies.end());
+		double mean = 0;
+		for (double latency : latencies)
+			mean += latency / latencies.size();
+		double p99 = latencies[latencies.size() * 99 / 100];
+		bool ok = p99 < RHYTHM_MAX_LATENCY;
+		printf("  %2d keys: mean %.3fus, p99 %.3fus, max %.3fus; typist let in %.1f%%, impostor %.1f%%%s\n",
+			keys, mean, p99, latencies.back(), 100.0 * genuine / attempts,
+			100.0 * impostors / attempts, ok ? "" : "  <- FAILED");
+		if (!ok) ++failed;
+	}
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,180 @@
+// Padlock schedule simulator, for checking a schedule of modes, and the
+// engine that follows it, on a simulated clock.
+//
+// Follows a schedule (see src/schedule.hpp) for a number of days from a
+// date, in local time, the way Padlock does: the clock jumps straight to the
+// time given by Scheduler::wait, as the one timer of the UI would fire, and
+// the scheduled mode is updated then. Each change of mode is printed, and
+// every minute of the period is then checked against the rules evaluated
+// directly, so that a missed or early change fails the run. The clock is
+// also set back and forward to check that the engine catches up.
+//
+// Before that, the TimerWheel is checked against a sorted list, with timers
+// spread from minutes to years ahead, added while it advances.
+//
+// Usage: schedule [RULES [YYYY-MM-DD [DAYS]]]
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc tools/schedule.cpp src/schedule.cpp -o schedule
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "schedule.hpp"
+
+// The schedule followed by default: evenings restricted on weekdays, two exam
+// blocks locked, throttled Saturdays, and Sunday nights locked past midnight.
+#define SCHEDULE_DEFAULT_RULES "restrict weekdays 22:00-06:00; lock 2026-11-10 09:00-12:00; " \
+	"lock 2026-11-17 13:30-15:00; throttle sat 10:00-18:00; lock sun 23:00-01:00"
+#define SCHEDULE_DEFAULT_START "2026-11-01"
+#define SCHEDULE_DEFAULT_DAYS 30
+// The number of timers of the check of the wheel.
+#define SCHEDULE_WHEEL_TIMERS 20000
+
+namespace {
+	using state::InputState;
+
+	const char *modeNames[] = { "Unlocked", "Restricted", "Locked", "Throttled" };
+
+	class SimulatedClock : public state::ScheduleClock {
+	public:
+		long long time = 0;
+
+		long long now() override {
+			return time;
+		}
+	};
+
+	std::string formatTime(long long time) {
+		std::time_t t = (std::time_t)time;
+		char text[32];
+		std::strftime(text, sizeof(text), "%a %Y-%m-%d %H:%M", std::localtime(&t));
+		return text;
+	}
+
+	// timers due at random minutes, fired by the wheel in the same order as
+	// by a sorted list
+	bool checkWheel() {
+		std::mt19937 random(7);
+		std::uniform_int_distribution<int> spread(0, 5);
+		state::TimerWheel wheel;
+		std::multimap<long long, int> expected;
+		long long now = 29000000;
+		wheel.reset(now);
+
+		int fired = 0, mismatched = 0;
+		for (int i = 0; i < SCHEDULE_WHEEL_TIMERS; i++) {
+			// from a minute to a few years ahead, and some already due
+			long long ahead = (long long)(random() % (1ULL << (4 * spread(random))));
+			if (i % 97 == 0) ahead = -(long long)(random() % 100);
+			wheel.add(now + ahead, i);
+			expected.insert({ now + ahead, i });
+
+			if (i % 10 == 9) {
+				now += random() % 5000;
+				wheel.advance(now, [&](int id) {
+					auto it = expected.begin();
+					if (it == expected.end() || it->first > now) {
+						++mismatched;
+						return;
+					}
+					// timers due at the same minute may come in any order
+					auto match = it;
+					while (match != expected.end() && match->first == it->first && match->second != id) ++match;
+					if (match == expected.end() || match->first != it->first) ++mismatched;
+					else expected.erase(match);
+					++fired;
+				});
+				if (!expected.empty() && expected.begin()->first <= now) ++mismatched;
+				long long next = wheel.next();
+				if (expected.empty() ? next != -1 : next != std::max(expected.begin()->first, now)) ++mismatched;
+			}
+		}
+		printf("wheel: %d timers fired, %d left, %d mismatched\n", fired, wheel.size(), mismatched);
+		return mismatched == 0 && wheel.size() == (int)expected.size();
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 4) {
+		fprintf(stderr, "usage: schedule [RULES [YYYY-MM-DD [DAYS]]]\n");
+		return 2;
+	}
+	std::string text = argc > 1 ? argv[1] : SCHEDULE_DEFAULT_RULES;
+	const char *date = argc > 2 ? argv[2] : SCHEDULE_DEFAULT_START;
+	int days = argc > 3 ? std::atoi(argv[3]) : SCHEDULE_DEFAULT_DAYS;
+
+	std::vector<state::ScheduleRule> rules;
+	int year, month, day;
+	if (!state::parseSchedule(text, rules) || rules.empty()) {
+		fprintf(stderr, "invalid schedule: %s\n", text.c_str());
+		return 2;
+	}
+	if (std::sscanf(date, "%d-%d-%d", &year, &month, &day) != 3 || days <= 0) {
+		fprintf(stderr, "invalid date or days\n");
+		return 2;
+	}
+	bool wheelOk = checkWheel();
+
+	std::tm local;
+	std::memset(&local, 0, sizeof(local));
+	local.tm_year = year - 1900;
+	local.tm_mon = month - 1;
+	local.tm_mday = day;
+	local.tm_isdst = -1;
+	long long start = (long long)std::mktime(&local);
+	long long end = start + days * 86400LL;
+
+	// follow the schedule from timer to timer
+	SimulatedClock clock;
+	clock.time = start;
+	state::Scheduler scheduler(clock);
+	scheduler.load(text);
+	std::vector<std::pair<long long, InputState>> changes;
+	changes.push_back({ start, scheduler.update() });
+	int timers = 0;
+	auto began = std::chrono::steady_clock::now();
+	while (true) {
+		long long wait = scheduler.wait();
+		if (wait < 0 || clock.time + wait / 1000 >= end) break;
+		clock.time += wait / 1000;
+		++timers;
+		InputState mode = scheduler.update();
+		if (mode != changes.back().second) changes.push_back({ clock.time, mode });
+	}
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+
+	for (auto& change : changes)
+		printf("%s  %s\n", formatTime(change.first).c_str(), modeNames[(int)change.second]);
+	printf("%d rules, %d days: %zu changes from %d timers in %.2fms\n", (int)rules.size(), days,
+		changes.size() - 1, timers, elapsed);
+
+	// every minute against the rules
+	int missed = 0;
+	size_t next = 0;
+	for (long long time = start; time < end; time += 60) {
+		while (next + 1 < changes.size() && changes[next + 1].first <= time) ++next;
+		if (state::getScheduledMode(rules, time) != changes[next].second) {
+			if (missed++ < 10)
+				printf("mismatch at %s\n", formatTime(time).c_str());
+		}
+	}
+
+	// the clock set back a day, then forward a week
+	int jumps = 0;
+	for (long long offset : { -86400LL, 7 * 86400LL, -3600LL }) {
+		clock.time += offset;
+		if (scheduler.update() != state::getScheduledMode(rules, clock.time)) ++jumps;
+	}
+
+	printf("%d minute(s) mismatched, %d jump(s) mismatched\n", missed, jumps);
+	if (!wheelOk || missed != 0 || jumps != 0) return 1;
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,336 @@
+// Padlock session check, for removing the hooks while the user is away.
+//
+// Passes session events, read by feedSessionEvents (see src/session.hpp) as
+// they are simulated on Linux, to a model of the wininput thread: a queue of
+// posted calls and of the messages that remove and reinstall the hooks, with
+// input events arriving in between, which may change the mode, such as the
+// lock sequence, and requests for a mode from other threads, such as from
+// another launch of Padlock. The decisions are those of SessionTracker, and
+// are wired up the same way as in src/state.cpp and src/wininput/wininput.cpp.
+//
+// A scripted run goes through the cases that matter first: the hooks are
+// removed while the user is away in Unlocked mode, kept in the other modes,
+// and reinstalled as soon as the user returns or the mode changes, even if
+// the change comes while the hooks are about to be removed. Random feeds of
+// events are then run with the queue processed at random points, and the
+// hooks are checked never to be removed outside Unlocked mode, and to match
+// the session and the mode once the queue is drained. The share of input
+// events that did not wake the hooks is reported as well.
+//
+// Usage: session [FILE]
+// where FILE holds session events, one per line, as read by feedSessionEvents
+// (lock, unlock, display-off, display-on), which are also run in Unlocked mode
+// with the hooks shown after each.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc tools/session.cpp src/session.cpp -o session
+
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include "session.hpp"
+
+// The number of random feeds, and of steps of each.
+#define SESSION_FEEDS 2000
+#define SESSION_STEPS 400
+
+namespace {
+	using namespace state;
+
+	const char *modeNames[] = { "Unlocked", "Restricted", "Locked", "Throttled" };
+
+	// the messages and calls queued for the wininput thread
+	enum class Message { SUSPEND, RESUME, UPDATE, REQUEST };
+
+	struct Queued {
+		Message message;
+		InputState mode; // for REQUEST
+	};
+
+	// the wininput thread, and the parts of state.cpp that run on it
+	class Model {
+	public:
+		SessionTracker session;
+		InputState mode = InputState::UNLOCKED;
+		bool hooked = true;
+		unsigned long long removedOutsideUnlocked = 0;
+		unsigned long long events = 0;
+		unsigned long long eventsAway = 0; // events that came while the hooks were removed
+		unsigned long long unfiltered = 0; // of those, events outside Unlocked mode
+
+		// state::notifySessionEvent
+		void notify(SessionEvent evt) {
+			session.update(evt);
+			post({ Message::UPDATE, InputState::UNLOCKED });
+		}
+
+		// state::requestMode, posted from the UI thread
+		void request(InputState next) {
+			post({ Message::REQUEST, next });
+		}
+
+		// an input event seen by the hooks, which may change the mode
+		void input(InputState next) {
+			++events;
+			if (!hooked) {
+				++eventsAway;
+				if (mode != InputState::UNLOCKED) ++unfiltered;
+				return;
+			}
+			if (next != mode) changeMode(next);
+		}
+
+		// process the next message, returning false if there are none
+		bool step() {
+			if (queue.empty()) return false;
+			Queued next = queue.front();
+			queue.pop_front();
+
+			switch (next.message) {
+			case Message::SUSPEND:
+				if (suspended) {
+					if (mode != InputState::UNLOCKED) ++removedOutsideUnlocked;
+					hooked = false;
+				}
+				break;
+			case Message::RESUME:
+				if (!suspended) hooked = true;
+				break;
+			case Message::UPDATE:
+				updateSuspension();
+				break;
+			case Message::REQUEST:
+				changeMode(next.mode);
+				break;
+			}
+			return true;
+		}
+
+		void drain() {
+			while (step()) {}
+		}
+
+		bool isPending() const {
+			return !queue.empty();
+		}
+
+		// returns true if the hooks are where they should be once the queue is drained
+		bool isSettled() const {
+			bool away = session.isAway() && mode == InputState::UNLOCKED;
+			return hooked == !away && suspended == away;
+		}
+
+	private:
+		bool suspended = false; // the flag of input::suspend and input::resume
+		std::deque<Queued> queue;
+
+		void post(Queued queued) {
+			queue.push_back(queued);
+		}
+
+		void suspend() {
+			if (suspended) return;
+			suspended = true;
+			post({ Message::SUSPEND, InputState::UNLOCKED });
+		}
+
+		void resume() {
+			if (!suspended) return;
+			suspended = false;
+			post({ Message::RESUME, InputState::UNLOCKED });
+		}
+
+		// changeInputState
+		void changeMode(InputState next) {
+			mode = next;
+			switch (session.getAction(mode, suspended)) {
+			case HookAction::RESUME:
+				resume();
+				break;
+			case HookAction::SUSPEND:
+				post({ Message::UPDATE, InputState::UNLOCKED });
+				break;
+			case HookAction::NONE:
+				break;
+			}
+		}
+
+		// updateSuspension
+		void updateSuspension() {
+			switch (session.getAction(mode, suspended)) {
+			case HookAction::SUSPEND:
+				suspend();
+				break;
+			case HookAction::RESUME:
+				resume();
+				changeMode(mode);
+				break;
+			case HookAction::NONE:
+				break;
+			}
+		}
+	};
+
+	Model *model = nullptr;
+
+	void passEvent(SessionEvent evt) {
+		model->notify(evt);
+	}
+
+	// feed the given lines of events to the model, draining the queue after each
+	int feed(Model& target, const char *text) {
+		model = &target;
+		std::istringstream in(text);
+		int count = feedSessionEvents(in, passEvent);
+		target.drain();
+		return count;
+	}
+
+	int failed = 0;
+
+	void expect(const Model& m, bool hooked, const char *what) {
+		bool ok = m.hooked == hooked && m.isSettled() && m.removedOutsideUnlocked == 0;
+		printf("  %-58s %s, %s%s\n", what, modeNames[(int)m.mode], m.hooked ? "hooked" : "unhooked",
+			ok ? "" : "  <- FAILED");
+		if (!ok) ++failed;
+	}
+
+	void runScript() {
+		printf("scripted:\n");
+		{
+			Model m;
+			feed(m, "lock\n");
+			expect(m, false, "session locked in Unlocked mode");
+			feed(m, "unlock\n");
+			expect(m, true, "session unlocked");
+			feed(m, "lock\ndisplay-off\nunlock\n");
+			expect(m, false, "session unlocked while the display is off");
+			feed(m, "display-on\n");
+			expect(m, true, "display on");
+		}
+		for (InputState mode : { InputState::LIMITED, InputState::LOCKED, InputState::THROTTLED }) {
+			Model m;
+			m.request(mode);
+			m.drain();
+			feed(m, "# the keys that wake the display stay filtered\ndisplay-off\nlock\n");
+			m.input(mode);
+			expect(m, true, "display off and session locked outside Unlocked mode");
+		}
+		{
+			Model m;
+			feed(m, "display-off\n");
+			m.request(InputState::LOCKED);
+			m.drain();
+			expect(m, true, "locked by another launch while the display is off");
+			m.request(InputState::UNLOCKED);
+			m.drain();
+			expect(m, false, "unlocked again while the display is off");
+			feed(m, "display-on\n");
+			expect(m, true, "display on");
+		}
+		{
+			// the lock sequence comes in before the suspension is decided
+			Model m;
+			m.notify(SessionEvent::DISPLAY_OFF);
+			m.input(InputState::LOCKED);
+			m.drain();
+			expect(m, true, "locked before the display off is handled");
+		}
+		{
+			// or after it is decided, before the hooks are removed
+			Model m;
+			m.notify(SessionEvent::DISPLAY_OFF);
+			m.step();
+			m.input(InputState::LOCKED);
+			m.drain();
+			expect(m, true, "locked while the hooks are about to be removed");
+		}
+	}
+
+	void runRandom() {
+		std::mt19937 random(7);
+		unsigned long long unsettled = 0, removed = 0, events = 0, eventsAway = 0, unfiltered = 0;
+		for (int n = 0; n < SESSION_FEEDS; n++) {
+			Model m;
+			for (int i = 0; i < SESSION_STEPS; i++) {
+				switch (random() % 6) {
+				case 0:
+					m.notify((SessionEvent)(random() % 4));
+					break;
+				case 1:
+					m.request((InputState)(random() % 4));
+					break;
+				case 2:
+				case 3:
+					// mostly typing that leaves the mode as is
+					m.input(random() % 8 == 0 ? (InputState)(random() % 4) : m.mode);
+					break;
+				default:
+					m.step();
+				}
+				if (!m.isPending() && !m.isSettled()) ++unsettled;
+			}
+			m.drain();
+			if (!m.isSettled()) ++unsettled;
+			removed += m.removedOutsideUnlocked;
+			events += m.events;
+			eventsAway += m.eventsAway;
+			unfiltered += m.unfiltered;
+		}
+		printf("random: %d feeds, %llu input events, %.1f%% without the hooks, "
+			"%llu of them outside Unlocked mode before a pending resume\n",
+			SESSION_FEEDS, events, events ? 100.0 * eventsAway / events : 0.0, unfiltered);
+		printf("  %llu unsettled, %llu removal(s) outside Unlocked mode\n", unsettled, removed);
+		if (unsettled != 0 || removed != 0) ++failed;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "usage: session [FILE]\n");
+		return 2;
+	}
+
+	if (argc == 2) {
+		std::ifstream in(argv[1]);
+		if (!in.good()) {
+			fprintf(stderr, "could not open %s\n", argv[1]);
+			return 2;
+		}
+		std::stringstream text;
+		text << in.rdbuf();
+
+		// each event is run separately, to show the hooks after it
+		Model m;
+		model = &m;
+		printf("%s:\n", argv[1]);
+		std::string line;
+		while (std::getline(text, line)) {
+			std::istringstream one(line);
+			int count = feedSessionEvents(one, passEvent);
+			if (count < 0) {
+				fprintf(stderr, "not a session event: %s\n", line.c_str());
+				return 2;
+			}
+			if (count == 0) continue;
+			m.drain();
+			printf("  %-12s %s\n", line.c_str(), m.hooked ? "hooked" : "unhooked");
+		}
+	}
+
+	runScript();
+	runRandom();
+
+	SessionEvent evt;
+	for (const char *invalid : { "", "locked", "display", "Lock" })
+		if (parseSessionEvent(invalid, evt)) ++failed;
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,652 @@
+// Padlock policy simulator, for trying a change of policy on recorded input.
+//
+// Replays a folder of traces (see src/wininput/trace.hpp), such as those
+// recorded by the evdev backend, through the decisions of each mode twice:
+// once with the current configuration, and once with a candidate one. The
+// events whose verdicts differ are then reported by key and by mode, so that
+// a new Restricted allowlist or set of sequences can be checked against real
+// usage before it is rolled out.
+//
+// Configurations are conf.ini files as saved by Padlock. The keys that affect
+// the verdicts are read: the sequences (useq, rseq, lseq, tseq), the keys
+// allowed in Restricted mode (rallow), the limits of Throttled mode (tkeys,
+// tclicks), and mashing detection (mash, mwin, mkeys, mpress, mskeys,
+// mspread). Missing keys keep their defaults. Newer versions only store a
+// hash of the unlock sequence (useqh), so it is then taken from --unlock, and
+// only read from the plaintext useq of older versions; a configuration with
+// neither keeps the default of asdf.
+//
+// Each trace is replayed from the start in its own session, in the same order
+// as the hooks process events: sequences on key downs, then the handler of
+// the mode, then the limits of Throttled mode, with repeats reusing the
+// verdict of their key down. Autolock, gestures, typing rhythm, and plug-ins
+// are not simulated, so the unlock sequence always unlocks.
+//
+// The traces are shared between worker threads, each with its own queue, and
+// a worker that runs out of traces steals from the others. Traces are mapped
+// into memory and read in place.
+//
+// Usage: simulate [options] --candidate CONF FOLDER
+// where the options are listed by running it without arguments. Sequences
+// given on the command line are keys separated by spaces, each a letter, a
+// digit, or a key name as in src/wininput/keypattern.hpp, such as F5 or
+// 0xBA, with any of Ctrl+, Shift+, and Alt+ before it, e.g. "Ctrl+Alt+U n l k".
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -pthread -Isrc tools/simulate.cpp src/policy.cpp
+//     src/wininput/keymap.cpp src/wininput/keypattern.cpp src/wininput/mashing.cpp
+//     src/wininput/secret.cpp -o simulate
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "policy.hpp"
+#include "state.hpp"
+#include "wininput/devicetable.hpp"
+#include "wininput/keymap.hpp"
+#include "wininput/keypattern.hpp"
+#include "wininput/sequence.hpp"
+#include "wininput/trace.hpp"
+
+// The number of modes, and of sequence types, see STATE_KEYSEQ_.
+#define SIMULATE_MODES 4
+// The index of the mode handler in the key pipeline, after the plug-ins.
+#define SIMULATE_MODE_STAGE 1
+// The values of Verdict.stopIndex, as in pipeline.hpp.
+#define SIMULATE_PASS -1
+#define SIMULATE_STOP -2
+
+namespace {
+	using namespace state;
+
+	const char *modeNames[SIMULATE_MODES] = { "Unlocked", "Restricted", "Locked", "Throttled" };
+
+	struct Config {
+		std::string folder;
+		std::string current;    // conf.ini of the current policy, or empty for the defaults
+		std::string candidate;  // conf.ini of the candidate policy
+		std::string unlock;     // unlock sequence of both, if hashed in conf.ini
+		int threads = 0;        // 0 = one per core
+		InputState mode = InputState::UNLOCKED;
+		int top = 20;           // number of keys listed
+	};
+
+	// intentionally naive conversion, returns 0 if no conversion can be made
+	int nstoi(const char *p) {
+		int x = 0;
+		while (*p >= '0' && *p <= '9') {
+			x = (x * 10) + (*p - '0');
+			++p;
+		}
+		return x;
+	}
+
+	// read a sequence in the format saved by settings.cpp
+	void loadSeq(const std::string& value, input::KeyData *seq) {
+		std::stringstream in(value);
+		for (int i = 0; i < Options::MAX_SEQ_LEN; i++) {
+			if (!in.good()) {
+				seq[i].code = 0;
+				continue;
+			}
+			seq[i].ctrl = in.get() == '1';
+			seq[i].shift = in.get() == '1';
+			seq[i].alt = in.get() == '1';
+			in >> seq[i].code;
+			in.ignore(1);
+		}
+		seq[Options::MAX_SEQ_LEN - 1].code = 0;
+	}
+
+	bool equalsIgnoreCase(const std::string& a, const char *b) {
+		if (a.size() != strlen(b)) return false;
+		for (size_t i = 0; i < a.size(); i++)
+			if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+		return true;
+	}
+
+	// read a sequence given on the command line, such as "Ctrl+Alt+U n l k"
+	bool parseSeq(const std::string& value, input::KeyData *seq) {
+		std::stringstream in(value);
+		std::string token;
+		int length = 0;
+		while (in >> token) {
+			if (length >= Options::MAX_SEQ_LEN - 1) return false;
+			input::KeyData& key = seq[length++];
+			key = input::KeyData();
+			key.type = INPUT_TYPE_KEYDOWN;
+			size_t plus;
+			while ((plus = token.find('+')) != std::string::npos && plus + 1 < token.size()) {
+				std::string modifier = token.substr(0, plus);
+				if (equalsIgnoreCase(modifier, "ctrl")) key.ctrl = true;
+				else if (equalsIgnoreCase(modifier, "shift")) key.shift = true;
+				else if (equalsIgnoreCase(modifier, "alt")) key.alt = true;
+				else return false;
+				token.erase(0, plus + 1);
+			}
+			if (token.size() == 1 && isalnum((unsigned char)token[0]))
+				key.code = toupper((unsigned char)token[0]);
+			else
+				key.code = input::parseKeyName(token);
+			if (key.code == 0) return false;
+		}
+		for (int i = length; i < Options::MAX_SEQ_LEN; i++) seq[i].code = 0;
+		return length > 0;
+	}
+
+	// load the options that affect the verdicts from a conf.ini, on top of the
+	// defaults of state::setup; the unlock sequence is taken from unlock if
+	// given, as newer versions only store its hash
+	bool loadOptions(const std::string& path, const std::string& unlock, Options& opts) {
+		input::KeyData unlockSeq[Options::MAX_SEQ_LEN] = {
+			{ 0x41, false, false, false, 3 }, // asdf
+			{ 0x53, false, false, false, 3 },
+			{ 0x44, false, false, false, 3 },
+			{ 0x46, false, false, false, 3 }
+		};
+		if (!unlock.empty()) parseSeq(unlock, unlockSeq);
+		input::makeSecretKey(opts.secretKey);
+		input::makeSecret(opts.secretKey, unlockSeq, opts.unlockSecret);
+		opts.limitSeq[0] = { 0x52, false, false, true, 3 }; // Alt+R
+		opts.lockSeq[0] = { 0x4C, false, false, true, 3 }; // Alt+L
+		opts.throttleSeq[0] = { 0x54, false, false, true, 3 }; // Alt+T
+		if (path.empty()) return true;
+
+		std::ifstream in(path);
+		if (!in.good()) return false;
+		std::map<std::string, std::string> ini;
+		std::string key, value;
+		while (std::getline(in, key, '=') && std::getline(in, value)) {
+			if (!value.empty() && value.back() == '\r') value.pop_back();
+			if (!key.empty() && !value.empty()) ini[key] = value;
+		}
+
+		// the unlock sequence of newer versions is only stored hashed, under a
+		// key protected for the user on Windows, so it cannot be read back
+		if (unlock.empty() && ini.count("useq")) {
+			loadSeq(ini["useq"], unlockSeq);
+			input::makeSecret(opts.secretKey, unlockSeq, opts.unlockSecret);
+		} else if (unlock.empty() && ini.count("useqh")) {
+			fprintf(stderr, "%s: the unlock sequence is hashed, give it with --unlock\n", path.c_str());
+			return false;
+		}
+		if (ini.count("rseq")) loadSeq(ini["rseq"], opts.limitSeq);
+		if (ini.count("lseq")) loadSeq(ini["lseq"], opts.lockSeq);
+		if (ini.count("tseq")) loadSeq(ini["tseq"], opts.throttleSeq);
+		if (ini.count("rallow") && !opts.limitKeys.parse(ini["rallow"])) {
+			fprintf(stderr, "%s: invalid rallow, using the default keys\n", path.c_str());
+		}
+		if (ini.count("tkeys")) opts.throttleKeys = nstoi(ini["tkeys"].c_str());
+		if (ini.count("tclicks")) opts.throttleClicks = nstoi(ini["tclicks"].c_str());
+		opts.mashLock = nstoi(ini["mash"].c_str()) != 0;
+		if (ini.count("mwin")) opts.mashLimits.window = nstoi(ini["mwin"].c_str());
+		if (ini.count("mkeys")) opts.mashLimits.keys = nstoi(ini["mkeys"].c_str());
+		if (ini.count("mpress")) opts.mashLimits.pressed = nstoi(ini["mpress"].c_str());
+		if (ini.count("mskeys")) opts.mashLimits.spreadKeys = nstoi(ini["mskeys"].c_str());
+		if (ini.count("mspread")) opts.mashLimits.spread = nstoi(ini["mspread"].c_str()) / 10.0f;
+		return true;
+	}
+
+	// the verdict of the last key down of a key, reused by its repeats
+	struct Verdict {
+		unsigned long generation = 0;
+		int stopIndex = SIMULATE_PASS;
+	};
+
+	// a session of Padlock with the given options, deciding which events are blocked
+	class Session {
+	public:
+		Session(const Options& opts, InputState mode) : opts(opts), mode(mode) {
+			unlock = input::SecretMatcher(opts.secretKey, opts.unlockSecret);
+			seqs[0] = nullptr;
+			seqs[1] = opts.limitSeq;
+			seqs[2] = opts.lockSeq;
+			seqs[3] = opts.throttleSeq;
+			for (int i = 0; i < SIMULATE_MODES; i++) pos[i].fill(0);
+			throttle.setRates(opts.throttleKeys, opts.throttleClicks);
+			changeMode(mode);
+		}
+
+		InputState getMode() const {
+			return mode;
+		}
+
+		// returns true if the key event is blocked
+		bool key(const input::KeyData& data) {
+			// sequences are only processed on key down, and not on repeats,
+			// in the order they are added by state::setup
+			if (data.type == INPUT_TYPE_KEYDOWN && !(data.code >= 0xA0 && data.code <= 0xA5)) {
+				for (int i = 0; i < SIMULATE_MODES; i++) {
+					bool matched = i == 0 ? unlock.step(data) :
+						input::stepKeySequence(seqs[i], true, pos[i][data.device], data);
+					if (!matched) continue;
+					InputState target = getSequenceTarget(STATE_KEYSEQ_UNLOCKED + i, mode);
+					if (target != mode) {
+						changeMode(target);
+						return true;
+					}
+				}
+			}
+
+			// a change of mode by the handler only applies to the next key down
+			unsigned long current = generation;
+			bool repeat = data.type == INPUT_TYPE_KEYREPEAT;
+			Verdict& verdict = verdicts[data.code & 0xFF];
+			bool cached = repeat && verdict.generation == current;
+			input::KeyData down = data;
+			if (repeat) down.type = INPUT_TYPE_KEYDOWN;
+
+			int stopIndex = SIMULATE_PASS;
+			if (cached) {
+				if (verdict.stopIndex == SIMULATE_MODE_STAGE) stopIndex = SIMULATE_MODE_STAGE;
+			} else if (modeHandler(down)) {
+				stopIndex = SIMULATE_MODE_STAGE;
+			}
+			if (stopIndex == SIMULATE_PASS && mode == InputState::THROTTLED
+				&& throttle.isKeyBlocked(data)) stopIndex = SIMULATE_STOP;
+
+			if (!cached && data.type != INPUT_TYPE_KEYUP) {
+				verdict.generation = stopIndex == SIMULATE_STOP ? 0 : current;
+				verdict.stopIndex = stopIndex;
+			}
+			return stopIndex != SIMULATE_PASS;
+		}
+
+		// returns true if the mouse event is blocked
+		bool mouse(const input::MouseData& data) {
+			if (mode == InputState::THROTTLED) return throttle.isMouseBlocked(data);
+			return isMouseBlocked(mode);
+		}
+
+	private:
+		const Options& opts;
+		input::SecretMatcher unlock;
+		const input::KeyData *seqs[SIMULATE_MODES]; // apart from unlock
+		input::DeviceTable<int> pos[SIMULATE_MODES];
+		InputState mode;
+		Throttle throttle;
+		input::MashDetector mashDetector;
+		Verdict verdicts[256];
+		unsigned long generation = 1;
+
+		void changeMode(InputState next) {
+			mode = next;
+			++generation;
+			mashDetector.setLimits(opts.mashLimits);
+			mashDetector.reset();
+			if (next == InputState::THROTTLED) throttle.reset();
+		}
+
+		// the key handler of state.cpp
+		bool modeHandler(const input::KeyData& data) {
+			if (opts.mashLock && mashDetector.update(data) && mode != InputState::LOCKED) {
+				changeMode(InputState::LOCKED);
+				return true;
+			}
+			return isKeyBlocked(mode, data, opts.limitKeys);
+		}
+	};
+
+	// the verdicts of a key or mouse message under both policies
+	struct Counts {
+		unsigned long long events = 0;
+		unsigned long long blockedBefore = 0; // blocked by the current policy
+		unsigned long long blockedAfter = 0;  // blocked by the candidate policy
+		unsigned long long newlyBlocked = 0;
+		unsigned long long newlyAllowed = 0;
+
+		void add(bool before, bool after) {
+			++events;
+			if (before) ++blockedBefore;
+			if (after) ++blockedAfter;
+			if (after && !before) ++newlyBlocked;
+			if (before && !after) ++newlyAllowed;
+		}
+
+		void merge(const Counts& other) {
+			events += other.events;
+			blockedBefore += other.blockedBefore;
+			blockedAfter += other.blockedAfter;
+			newlyBlocked += other.newlyBlocked;
+			newlyAllowed += other.newlyAllowed;
+		}
+	};
+
+	// the results of a worker, merged once all traces are done
+	struct Results {
+		unsigned long long files = 0;
+		unsigned long long bytes = 0;
+		unsigned long long skipped = 0;      // traces that could not be read
+		Counts keys[256];                    // by key code
+		std::map<unsigned, Counts> mouse;    // by mouse message
+		Counts modes[SIMULATE_MODES][SIMULATE_MODES]; // by mode under the current and candidate policies
+
+		void merge(const Results& other) {
+			files += other.files;
+			bytes += other.bytes;
+			skipped += other.skipped;
+			for (int i = 0; i < 256; i++) keys[i].merge(other.keys[i]);
+			for (auto& entry : other.mouse) mouse[entry.first].merge(entry.second);
+			for (int i = 0; i < SIMULATE_MODES; i++)
+				for (int j = 0; j < SIMULATE_MODES; j++) modes[i][j].merge(other.modes[i][j]);
+		}
+	};
+
+	struct Trace {
+		std::string path;
+		unsigned long long size;
+	};
+
+	// the traces queued for a worker, taken from the back by the worker
+	// itself, and stolen from the front by the others
+	class WorkQueue {
+	public:
+		void push(size_t item) {
+			std::lock_guard<std::mutex> lock(mutex);
+			items.push_back(item);
+		}
+
+		bool pop(size_t& item) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (items.empty()) return false;
+			item = items.back();
+			items.pop_back();
+			return true;
+		}
+
+		bool steal(size_t& item) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (items.empty()) return false;
+			item = items.front();
+			items.pop_front();
+			return true;
+		}
+
+	private:
+		std::deque<size_t> items;
+		std::mutex mutex;
+	};
+
+	const Options *currentOpts;
+	const Options *candidateOpts;
+	InputState initialMode;
+	std::vector<Trace> traces;
+	std::vector<WorkQueue> queues;
+
+	void replay(const Trace& trace, Results& results) {
+		int fd = open(trace.path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			++results.skipped;
+			return;
+		}
+		size_t count = trace.size / sizeof(input::TraceRecord);
+		if (count == 0) {
+			close(fd);
+			return;
+		}
+		void *map = mmap(nullptr, count * sizeof(input::TraceRecord), PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED) {
+			++results.skipped;
+			return;
+		}
+		madvise(map, count * sizeof(input::TraceRecord), MADV_SEQUENTIAL);
+
+		Session before(*currentOpts, initialMode);
+		Session after(*candidateOpts, initialMode);
+		const input::TraceRecord *records = (const input::TraceRecord*)map;
+		for (size_t i = 0; i < count; i++) {
+			const input::TraceRecord& rec = records[i];
+			int modeBefore = (int)before.getMode();
+			int modeAfter = (int)after.getMode();
+			bool blockedBefore, blockedAfter;
+			if (rec.kind == INPUT_TRACE_KEY) {
+				input::KeyData data = input::toKeyData(rec);
+				blockedBefore = before.key(data);
+				blockedAfter = after.key(data);
+				results.keys[data.code & 0xFF].add(blockedBefore, blockedAfter);
+			} else if (rec.kind == INPUT_TRACE_MOUSE) {
+				input::MouseData data = input::toMouseData(rec);
+				blockedBefore = before.mouse(data);
+				blockedAfter = after.mouse(data);
+				results.mouse[data.code].add(blockedBefore, blockedAfter);
+			} else {
+				continue;
+			}
+			results.modes[modeBefore][modeAfter].add(blockedBefore, blockedAfter);
+		}
+
+		munmap(map, count * sizeof(input::TraceRecord));
+		++results.files;
+		results.bytes += trace.size;
+	}
+
+	void runWorker(int index, Results& results) {
+		int workers = (int)queues.size();
+		size_t item;
+		while (true) {
+			bool found = queues[index].pop(item);
+			for (int i = 1; !found && i < workers; i++)
+				found = queues[(index + i) % workers].steal(item);
+			// no traces are added once the workers start, so all are done
+			if (!found) return;
+			replay(traces[item], results);
+		}
+	}
+
+	bool findTraces(const std::string& folder) {
+		DIR *dir = opendir(folder.c_str());
+		if (dir == nullptr) return false;
+		while (dirent *entry = readdir(dir)) {
+			std::string path = folder + "/" + entry->d_name;
+			struct stat st;
+			if (entry->d_name[0] == '.' || stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+			if (st.st_size % sizeof(input::TraceRecord) != 0)
+				fprintf(stderr, "%s: ends with a partial record, which is ignored\n", path.c_str());
+			traces.push_back({ path, (unsigned long long)st.st_size });
+		}
+		closedir(dir);
+		return true;
+	}
+
+	const char *mouseName(unsigned code) {
+		switch (code) {
+		case 0x0200: return "mouse move";
+		case 0x0201: return "left down";
+		case 0x0202: return "left up";
+		case 0x0204: return "right down";
+		case 0x0205: return "right up";
+		case 0x0207: return "middle down";
+		case 0x0208: return "middle up";
+		case 0x020A: return "wheel";
+		case 0x020B: return "X down";
+		case 0x020C: return "X up";
+		case 0x020E: return "horizontal wheel";
+		}
+		return "mouse";
+	}
+
+	void printCounts(const char *name, const Counts& counts) {
+		printf("  %-22s %12llu %12llu %12llu %12llu %12llu\n", name, counts.events,
+			counts.blockedBefore, counts.blockedAfter, counts.newlyBlocked, counts.newlyAllowed);
+	}
+
+	void printHeader(const char *name) {
+		printf("  %-22s %12s %12s %12s %12s %12s\n", name, "events", "blocked", "candidate",
+			"new blocks", "new allows");
+	}
+
+	void printResults(const Results& results, const Config& config) {
+		printf("\nverdicts by mode (current -> candidate):\n");
+		printHeader("mode");
+		for (int i = 0; i < SIMULATE_MODES; i++) {
+			for (int j = 0; j < SIMULATE_MODES; j++) {
+				if (results.modes[i][j].events == 0) continue;
+				std::string name = std::string(modeNames[i]) + " -> " + modeNames[j];
+				printCounts(name.c_str(), results.modes[i][j]);
+			}
+		}
+
+		// keys and mouse messages whose verdicts changed, most changes first
+		struct Row {
+			std::string name;
+			const Counts *counts;
+		};
+		std::vector<Row> rows;
+		for (unsigned code = 0; code < 256; code++) {
+			const Counts& counts = results.keys[code];
+			if (counts.newlyBlocked + counts.newlyAllowed == 0) continue;
+			input::KeyData key;
+			key.code = code;
+			std::string name = input::keyToString(key);
+			if (name.empty()) name = "key " + std::to_string(code);
+			rows.push_back({ name, &counts });
+		}
+		for (auto& entry : results.mouse) {
+			if (entry.second.newlyBlocked + entry.second.newlyAllowed == 0) continue;
+			rows.push_back({ mouseName(entry.first), &entry.second });
+		}
+		std::stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+			return a.counts->newlyBlocked + a.counts->newlyAllowed
+				> b.counts->newlyBlocked + b.counts->newlyAllowed;
+		});
+
+		printf("\nkeys and mouse input with changed verdicts (%d of %d):\n",
+			(int)std::min(rows.size(), (size_t)config.top), (int)rows.size());
+		if (rows.empty()) return;
+		printHeader("input");
+		for (size_t i = 0; i < rows.size() && (int)i < config.top; i++)
+			printCounts(rows[i].name.c_str(), *rows[i].counts);
+	}
+
+	bool parseMode(const std::string& name, InputState& mode) {
+		if (name == "unlocked") mode = InputState::UNLOCKED;
+		else if (name == "restricted") mode = InputState::LIMITED;
+		else if (name == "locked") mode = InputState::LOCKED;
+		else if (name == "throttled") mode = InputState::THROTTLED;
+		else return false;
+		return true;
+	}
+
+	void usage() {
+		fprintf(stderr,
+			"usage: simulate [options] --candidate CONF FOLDER\n"
+			"  --candidate CONF  conf.ini of the candidate policy\n"
+			"  --current CONF    conf.ini of the current policy (defaults)\n"
+			"  --unlock SEQ      unlock sequence of both policies, such as \"a s d f\",\n"
+			"                    instead of the one in conf.ini, which is needed if it\n"
+			"                    is only stored hashed there\n"
+			"  --threads N       number of worker threads, 0 = one per core (0)\n"
+			"  --mode MODE       mode at the start of each trace: unlocked, restricted,\n"
+			"                    locked, throttled (unlocked)\n"
+			"  --top N           number of keys listed (20)\n");
+	}
+
+	bool parseArgs(int argc, char **argv, Config& config) {
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (arg.compare(0, 2, "--") != 0) {
+				if (!config.folder.empty()) return false;
+				config.folder = arg;
+				continue;
+			}
+			if (i + 1 >= argc) return false;
+			const char *value = argv[++i];
+
+			if (arg == "--candidate") config.candidate = value;
+			else if (arg == "--current") config.current = value;
+			else if (arg == "--unlock") {
+				input::KeyData seq[Options::MAX_SEQ_LEN];
+				if (!parseSeq(value, seq)) return false;
+				config.unlock = value;
+			}
+			else if (arg == "--threads") config.threads = atoi(value);
+			else if (arg == "--top") config.top = atoi(value);
+			else if (arg == "--mode") {
+				if (!parseMode(value, config.mode)) return false;
+			} else return false;
+		}
+		return !config.folder.empty() && !config.candidate.empty() && config.threads >= 0;
+	}
+}
+
+int main(int argc, char **argv) {
+	Config config;
+	if (!parseArgs(argc, argv, config)) {
+		usage();
+		return 2;
+	}
+
+	static Options current, candidate;
+	if (!loadOptions(config.current, config.unlock, current)) {
+		fprintf(stderr, "could not read %s\n", config.current.c_str());
+		return 1;
+	}
+	if (!loadOptions(config.candidate, config.unlock, candidate)) {
+		fprintf(stderr, "could not read %s\n", config.candidate.c_str());
+		return 1;
+	}
+	currentOpts = &current;
+	candidateOpts = &candidate;
+	initialMode = config.mode;
+	input::setupCodemap();
+
+	if (!findTraces(config.folder)) {
+		fprintf(stderr, "could not read %s\n", config.folder.c_str());
+		return 1;
+	}
+
+	// each worker starts with its largest traces, leaving the smallest to be
+	// stolen by workers that run out, so that they finish together
+	int workers = config.threads > 0 ? config.threads : (int)std::thread::hardware_concurrency();
+	if (workers < 1) workers = 1;
+	std::sort(traces.begin(), traces.end(), [](const Trace& a, const Trace& b) {
+		return a.size > b.size;
+	});
+	queues = std::vector<WorkQueue>(workers);
+	for (size_t i = 0; i < traces.size(); i++)
+		queues[i % workers].push(traces.size() - 1 - i);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Results*> results;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < workers; i++) {
+		results.push_back(new Results());
+		threads.emplace_back(runWorker, i, std::ref(*results[i]));
+	}
+	for (auto& thread : threads) thread.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Results total;
+	for (auto *result : results) {
+		total.merge(*result);
+		delete result;
+	}
+
+	unsigned long long events = 0;
+	for (int i = 0; i < SIMULATE_MODES; i++)
+		for (int j = 0; j < SIMULATE_MODES; j++) events += total.modes[i][j].events;
+	printf("%llu traces, %llu skipped, %.1f MB, %llu events in %.3f s with %d thread(s)\n",
+		total.files, total.skipped, total.bytes / 1e6, events, seconds, workers);
+	printf("throughput: %.2f GB/min, %.1fM events/s\n",
+		seconds > 0 ? total.bytes / 1e9 / seconds * 60 : 0.0, seconds > 0 ? events / 1e6 / seconds : 0.0);
+	printResults(total, config);
+	return 0;
+}
@@ -0,0 +1,292 @@
+// Padlock throttle check, for the limits of Throttled mode under a sustained
+// stream of input.
+//
+// Replays a synthetic stream of 5,000 events per second, for a minute of
+// event time, through a Throttle (see src/policy.hpp) as the hooks do in
+// Throttled mode: key downs, auto-repeats, and key ups of letters and
+// modifiers, clicks of every button, and mouse movement and wheel input.
+// The verdicts are checked against the limits: no more key downs and clicks
+// are passed over any period than a second's burst plus the rate allows,
+// no fewer than the rate allows while the stream keeps asking, every key
+// and button up is blocked exactly when neither its down nor a repeat of it
+// was passed, and modifiers, movement, and the wheel always pass. A stream under the limits is then
+// checked to pass in full.
+//
+// The time taken per event is reported, which the hook thread pays on top
+// of the other handlers, along with the rate of events that it could keep up
+// with on a single core.
+//
+// Usage: throttle [KEYS [CLICKS]]
+// where KEYS and CLICKS are the key downs and clicks allowed per second, as
+// tkeys and tclicks in conf.ini.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc tools/throttle.cpp src/policy.cpp -o throttle
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "policy.hpp"
+
+// The rate of the stream, in events per second, and its length, in milliseconds.
+#define THROTTLE_RATE 5000
+#define THROTTLE_LENGTH 60000UL
+// The default limits, as in conf.ini.
+#define THROTTLE_KEYS 5
+#define THROTTLE_CLICKS 2
+// The number of times the stream is replayed to time the throttle, and the
+// time an event may take, in nanoseconds.
+#define THROTTLE_TIMED_RUNS 50
+#define THROTTLE_MAX_COST 1000.0
+
+// Virtual key codes and mouse messages used by the stream.
+#define VK_LSHIFT 0xA0
+#define VK_LCONTROL 0xA2
+#define WM_MOUSEMOVE 0x0200
+#define WM_LBUTTONDOWN 0x0201
+#define WM_LBUTTONUP 0x0202
+#define WM_RBUTTONDOWN 0x0204
+#define WM_RBUTTONUP 0x0205
+#define WM_MBUTTONDOWN 0x0207
+#define WM_MBUTTONUP 0x0208
+#define WM_MOUSEWHEEL 0x020A
+
+namespace {
+	using state::Throttle;
+
+	// an event of the stream; down is true for a key down, a repeat, or a click
+	struct Event {
+		bool key;
+		input::KeyData keyData;
+		input::MouseData mouseData;
+		bool down;
+		bool limited; // whether the event is subject to the limits
+		int pair;     // for an up, the index of its down, or -1
+	};
+
+	std::mt19937 generator(34);
+
+	Event keyEvent(unsigned long code, short type, unsigned long time) {
+		Event evt = { true, {}, {}, type != INPUT_TYPE_KEYUP,
+			code != VK_LSHIFT && code != VK_LCONTROL, -1 };
+		evt.keyData.code = code;
+		evt.keyData.type = type;
+		evt.keyData.time = time;
+		return evt;
+	}
+
+	Event mouseEvent(unsigned code, unsigned long time, bool down, bool limited) {
+		Event evt = { false, {}, {}, down, limited, -1 };
+		evt.mouseData.code = code;
+		evt.mouseData.time = time;
+		return evt;
+	}
+
+	// a stream at the given rate, in which a key or button goes down every
+	// interval milliseconds on average and is held for a while, with
+	// movement, the wheel, and auto-repeats if requested filling the rest
+	std::vector<Event> makeStream(int rate, double keyInterval, double clickInterval, bool repeats) {
+		const unsigned buttonDowns[] = { WM_LBUTTONDOWN, WM_RBUTTONDOWN, WM_MBUTTONDOWN };
+		const unsigned buttonUps[] = { WM_LBUTTONUP, WM_RBUTTONUP, WM_MBUTTONUP };
+		std::vector<Event> stream;
+		int heldKey[256], heldButton[3] = { -1, -1, -1 };
+		unsigned long keyUpAt[256] = { 0 }, buttonUpAt[3] = { 0 };
+		for (int i = 0; i < 256; i++) heldKey[i] = -1;
+		double nextKey = 0, nextClick = 0;
+
+		long count = (long)rate * (long)THROTTLE_LENGTH / 1000;
+		for (long n = 0; n < count; n++) {
+			unsigned long time = (unsigned long)(n * 1000 / rate);
+
+			// release what is due first
+			bool released = false;
+			for (int vk = 0; vk < 256 && !released; vk++) {
+				if (heldKey[vk] < 0 || keyUpAt[vk] > time) continue;
+				stream.push_back(keyEvent(vk, INPUT_TYPE_KEYUP, time));
+				stream.back().pair = heldKey[vk];
+				heldKey[vk] = -1;
+				released = true;
+			}
+			for (int b = 0; b < 3 && !released; b++) {
+				if (heldButton[b] < 0 || buttonUpAt[b] > time) continue;
+				stream.push_back(mouseEvent(buttonUps[b], time, false, true));
+				stream.back().pair = heldButton[b];
+				heldButton[b] = -1;
+				released = true;
+			}
+			if (released) continue;
+
+			if (time >= nextKey) {
+				// a letter, or now and then a modifier, that is not already held
+				unsigned long vk = generator() % 8 == 0 ? (generator() % 2 ? VK_LSHIFT : VK_LCONTROL)
+					: 'A' + generator() % 26;
+				nextKey += keyInterval * std::uniform_real_distribution<double>(0.5, 1.5)(generator);
+				if (heldKey[vk] < 0) {
+					heldKey[vk] = (int)stream.size();
+					keyUpAt[vk] = time + 30 + generator() % 600;
+					stream.push_back(keyEvent(vk, INPUT_TYPE_KEYDOWN, time));
+					continue;
+				}
+			}
+			if (time >= nextClick) {
+				int b = (int)(generator() % 3);
+				nextClick += clickInterval * std::uniform_real_distribution<double>(0.5, 1.5)(generator);
+				if (heldButton[b] < 0) {
+					heldButton[b] = (int)stream.size();
+					buttonUpAt[b] = time + 50 + generator() % 200;
+					stream.push_back(mouseEvent(buttonDowns[b], time, true, true));
+					continue;
+				}
+			}
+
+			// a repeat of a key held for over 500ms, or else movement and the wheel
+			int repeat = -1;
+			for (int vk = 'A'; vk <= 'Z' && repeat < 0 && repeats; vk++) {
+				if (heldKey[vk] >= 0 && time - stream[heldKey[vk]].keyData.time > 500 && generator() % 4 == 0)
+					repeat = vk;
+			}
+			if (repeat >= 0)
+				stream.push_back(keyEvent(repeat, INPUT_TYPE_KEYREPEAT, time));
+			else
+				stream.push_back(mouseEvent(generator() % 8 == 0 ? WM_MOUSEWHEEL : WM_MOUSEMOVE, time, false, false));
+		}
+		return stream;
+	}
+
+	bool isBlocked(Throttle& throttle, const Event& evt) {
+		return evt.key ? throttle.isKeyBlocked(evt.keyData) : throttle.isMouseBlocked(evt.mouseData);
+	}
+
+	// check that the passed downs of one kind keep to the rate over every
+	// period, and use every token if the stream asked for at least twice as
+	// many
+	int checkRate(const std::vector<unsigned long>& passed, long asked, unsigned rate, const char *name) {
+		if (rate == 0) {
+			printf("  %-6s %6zu passed of %ld, no limit\n", name, passed.size(), asked);
+			return passed.size() == (size_t)asked ? 0 : 1;
+		}
+		int problems = 0;
+		for (size_t i = 0; i < passed.size(); i++) {
+			for (size_t j = i; j < passed.size(); j++) {
+				// a full burst at the start of the period, then the rate
+				double allowed = rate + (double)rate * (passed[j] - passed[i]) / 1000.0;
+				if (j - i + 1 > allowed + 1e-9) {
+					++problems;
+					break;
+				}
+			}
+		}
+		double expected = rate + (double)rate * THROTTLE_LENGTH / 1000.0;
+		if (asked >= expected * 2 && passed.size() + 2 < expected) ++problems;
+		printf("  %-6s %6zu passed of %ld, %.0f allowed%s\n", name, passed.size(), asked, expected,
+			problems != 0 ? "  <- FAILED" : "");
+		return problems;
+	}
+
+	int failed = 0;
+
+	void runSaturated(unsigned keys, unsigned clicks) {
+		// a key down every 25ms and a click every 100ms on average, well over
+		// the default limits, at the rate of the stream
+		std::vector<Event> stream = makeStream(THROTTLE_RATE, 25, 100, true);
+		Throttle throttle;
+		throttle.setRates(keys, clicks);
+		throttle.reset();
+
+		// whether the down of each key held, or one of its repeats, was passed
+		bool keyPassed[256] = { false };
+		std::vector<bool> blocked(stream.size());
+		std::vector<unsigned long> passedKeys, passedClicks;
+		long askedKeys = 0, askedClicks = 0;
+		int problems = 0, passedFree = 0, free = 0;
+		for (size_t i = 0; i < stream.size(); i++) {
+			const Event& evt = stream[i];
+			blocked[i] = isBlocked(throttle, evt);
+			if (evt.key && evt.keyData.type == INPUT_TYPE_KEYDOWN)
+				keyPassed[evt.keyData.code] = false;
+			if (evt.key && evt.down && !blocked[i])
+				keyPassed[evt.keyData.code] = true;
+
+			if (evt.pair >= 0) {
+				bool passed = evt.key ? keyPassed[evt.keyData.code] : !blocked[evt.pair];
+				if (blocked[i] == passed) ++problems;
+			} else if (!evt.limited) {
+				++free;
+				if (blocked[i]) ++problems;
+				else ++passedFree;
+			} else if (evt.down) {
+				++(evt.key ? askedKeys : askedClicks);
+				if (!blocked[i]) {
+					(evt.key ? passedKeys : passedClicks).push_back(
+						evt.key ? evt.keyData.time : evt.mouseData.time);
+				}
+			}
+		}
+
+		printf("saturated: %zu events over %lus at %d/s, %d keys/s and %d clicks/s allowed\n",
+			stream.size(), THROTTLE_LENGTH / 1000, THROTTLE_RATE, keys, clicks);
+		problems += checkRate(passedKeys, askedKeys, keys, "keys");
+		problems += checkRate(passedClicks, askedClicks, clicks, "clicks");
+		printf("  %d of %d modifiers, movements, and wheel events passed, %d problem(s)\n",
+			passedFree, free, problems);
+		if (problems != 0) ++failed;
+
+		// time the stream through the throttle as a whole
+		auto start = std::chrono::steady_clock::now();
+		long blockedCount = 0;
+		for (int run = 0; run < THROTTLE_TIMED_RUNS; run++) {
+			throttle.reset();
+			for (const Event& evt : stream)
+				if (isBlocked(throttle, evt)) ++blockedCount;
+		}
+		double cost = std::chrono::duration<double, std::nano>(
+			std::chrono::steady_clock::now() - start).count() / (stream.size() * (double)THROTTLE_TIMED_RUNS);
+		bool ok = cost < THROTTLE_MAX_COST;
+		printf("  %.2fns per event, %.1fM events/s on one core, %.4f%% of a core at %d/s, %ld blocked per run%s\n",
+			cost, 1e3 / cost, cost * THROTTLE_RATE / 1e7, THROTTLE_RATE,
+			blockedCount / THROTTLE_TIMED_RUNS, ok ? "" : "  <- FAILED");
+		if (!ok) ++failed;
+	}
+
+	void runUnderLimit(unsigned keys, unsigned clicks) {
+		// key downs and clicks spaced at least a little over the time it
+		// takes to refill a token pass in full, when no key is held long
+		// enough to repeat, since repeats take tokens as well
+		if (keys == 0 || clicks == 0) return;
+		std::vector<Event> stream = makeStream(THROTTLE_RATE, 2200.0 / keys, 2200.0 / clicks, false);
+		Throttle throttle;
+		throttle.setRates(keys, clicks);
+		throttle.reset();
+		int blocked = 0;
+		for (const Event& evt : stream)
+			if (isBlocked(throttle, evt)) ++blocked;
+		printf("under the limits: %zu events, %d blocked%s\n", stream.size(), blocked,
+			blocked != 0 ? "  <- FAILED" : "");
+		if (blocked != 0) ++failed;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		fprintf(stderr, "usage: throttle [KEYS [CLICKS]]\n");
+		return 2;
+	}
+	int keys = argc > 1 ? atoi(argv[1]) : THROTTLE_KEYS;
+	int clicks = argc > 2 ? atoi(argv[2]) : THROTTLE_CLICKS;
+	if (keys < 0 || clicks < 0) {
+		fprintf(stderr, "the limits should not be negative\n");
+		return 2;
+	}
+
+	runSaturated((unsigned)keys, (unsigned)clicks);
+	runUnderLimit((unsigned)keys, (unsigned)clicks);
+
+	if (failed != 0) {
+		printf("%d check(s) failed\n", failed);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,37 @@
+// Padlock tracepoint formatter.
+//
+// Prints the tracepoints recorded by a build with _WININPUT_TRACE defined,
+// such as the Debug configurations started with /trace, which writes them to
+// padlock.trace in the Padlock folder of the local application data on exit.
+// The records only hold the ID of each tracepoint and its raw arguments, and
+// are formatted here with the formats of wininput/tracepoint.hpp, so this
+// should be built from the same revision as the traced build.
+//
+// Build from the root of the repository with:
+//   g++ -O2 -std=c++14 -Isrc/wininput tools/tracefmt.cpp
+//     src/wininput/tracepoint.cpp -o tracefmt
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "tracepoint.hpp"
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: tracefmt FILE\n");
+		return 2;
+	}
+
+	std::vector<input::TracepointRecord> records;
+	if (!input::readTracepoints(argv[1], records)) {
+		fprintf(stderr, "%s is not a tracepoint file\n", argv[1]);
+		return 1;
+	}
+
+	// times are printed in milliseconds, along with the thread of each record
+	for (auto& record : records) {
+		printf("%14.6f  %2u  %s\n", record.time / 1e6, (unsigned)record.thread,
+			input::formatTracepoint(record).c_str());
+	}
+	return 0;
+}